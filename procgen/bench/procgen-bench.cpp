@@ -0,0 +1,505 @@
+/*
+
+Throughput benchmark for the env library, prints the results as JSON
+
+For every game and every combination of --envs and --threads this creates a VecGame through the libenv api,
+steps it with random actions and reports the steps per second along with the per phase timings from the
+collect_stats option. Each game also gets one run with render_human to time the hi-res frame, and one with
+step_kernels cleared, whose step_kernel_speedup is how much faster the game_step phase of the first run was with the
+step kernels that BasicAbstractGame::specialize() compiles for the game. bytes_per_env is the heap the VecGame holds
+after the warmup steps divided by the number of envs, without the observation buffers, which belong to the caller.
+It includes the share of each env in the process wide asset cache filled during the run, so it's only comparable
+between runs of the same game and number of envs, and it's 0 where the allocator can't report its usage.
+
+Each game also gets allocation checks, runs whose steady_allocs_per_step counts the heap allocations of the steps that
+didn't reset any env. The containers that stepping fills are given room for a level when it's generated, so the
+steps in between don't allocate. Two runs with symbolic observations, so that nothing is drawn, one of a single env
+and one of the last --envs value (at least 2) on the last --threads value, fail the benchmark when a game makes more
+than --max-steady-allocs allocations per step, 0 by default. A third run of the same envs with rgb observations is
+only reported, since QPainter allocates its state on every frame drawn with Qt. The resets themselves allocate, level
+generation builds its rooms, paths and choices in containers of its own, and aren't counted. The count needs the
+library to use the operator new of the executable, which a windows dll doesn't, there it's always 0.
+
+    procgen_bench --resource-root procgen/data/assets/ --games fruitbot,coinrun --envs 1,16,64 --threads 0,4
+
+*/
+
+#include "libenv.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <vector>
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+extern "C" {
+LIBENV_API int get_game_names(char *data, int length);
+LIBENV_API int libenv_get_stats(libenv_env *handle, uint64_t *data, int length);
+}
+
+// every allocation of the process goes through here, the library's included, since a replacement operator new in the
+// executable takes precedence over the default one
+static std::atomic<uint64_t> num_allocations{0};
+
+// not inlined, gcc would otherwise see the malloc and free inside the standard containers and warn about the mismatch
+#if defined(__GNUC__)
+#define BENCH_NOINLINE __attribute__((noinline))
+#else
+#define BENCH_NOINLINE
+#endif
+
+BENCH_NOINLINE void *operator new(size_t size) {
+    num_allocations.fetch_add(1, std::memory_order_relaxed);
+    void *p = malloc(size > 0 ? size : 1);
+    if (p == nullptr) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+BENCH_NOINLINE void operator delete(void *p) noexcept {
+    free(p);
+}
+
+BENCH_NOINLINE void operator delete(void *p, size_t) noexcept {
+    free(p);
+}
+
+// in the order of StatsPhase in phase-stats.h
+static const char *STATS_PHASES[] = {"game_step", "erase", "reset", "render", "render_hires", "convert", "encode", "wait"};
+const int NUM_PHASES = sizeof(STATS_PHASES) / sizeof(STATS_PHASES[0]);
+const int NUM_BUCKETS = 32;
+const int VALUES_PER_PHASE = 3 + NUM_BUCKETS;
+const int NUM_ACTIONS = 15;
+
+struct BenchConfig {
+    std::string game;
+    int num_envs = 1;
+    int num_threads = 0;
+    bool render_human = false;
+    bool step_kernels = true;
+    // symbolic observations, for counting the allocations of stepping without those of drawing
+    bool symbolic_obs = false;
+    // the mean game_step time of the same config with step_kernels, to report the speedup against
+    double kernel_game_step_ns = 0.0;
+};
+
+struct BenchArgs {
+    std::vector<std::string> games;
+    std::vector<int> envs = {1, 16, 64};
+    std::vector<int> threads = {0, 1, 4};
+    int steps = 1000;
+    int warmup = 100;
+    int render_res = 512;
+    // pcg32 has a much smaller state, see randgen.h, but draws different levels
+    std::string rand_gen = "mt19937";
+    // fail if a symbolic allocation check run makes more allocations per step than this, negative to not check
+    double max_steady_allocs = 0.0;
+    std::string resource_root;
+};
+
+struct BenchResult {
+    double mean_game_step_ns = 0.0;
+    double steady_allocs_per_step = 0.0;
+};
+
+static std::vector<std::string> split(const std::string &s, char delimiter) {
+    std::vector<std::string> parts;
+    size_t start = 0;
+    while (start <= s.size()) {
+        size_t end = s.find(delimiter, start);
+        if (end == std::string::npos) {
+            end = s.size();
+        }
+        if (end > start) {
+            parts.push_back(s.substr(start, end - start));
+        }
+        start = end + 1;
+    }
+    return parts;
+}
+
+static std::vector<int> split_ints(const std::string &s) {
+    std::vector<int> values;
+    for (const auto &part : split(s, ',')) {
+        values.push_back(atoi(part.c_str()));
+    }
+    return values;
+}
+
+// libenv options point at their values, so the values are kept alongside them
+class Options {
+  public:
+    void add_int(const char *name, int32_t value) {
+        ints.push_back(value);
+        add(name, LIBENV_DTYPE_INT32, 1, 'i');
+    }
+
+    void add_bool(const char *name, bool value) {
+        bools.push_back(value ? 1 : 0);
+        add(name, LIBENV_DTYPE_UINT8, 1, 'b');
+    }
+
+    void add_string(const char *name, const std::string &value) {
+        strings.push_back(value);
+        add(name, LIBENV_DTYPE_UINT8, (int)(value.size()), 's');
+    }
+
+    // the pointers are only filled in here, once the value vectors are done growing
+    libenv_options get() {
+        size_t i = 0, b = 0, s = 0;
+        for (size_t k = 0; k < items.size(); k++) {
+            if (kinds[k] == 'i') {
+                items[k].data = &ints[i++];
+            } else if (kinds[k] == 'b') {
+                items[k].data = &bools[b++];
+            } else {
+                items[k].data = (void *)(strings[s++].data());
+            }
+        }
+        libenv_options options;
+        options.items = items.data();
+        options.count = (int)(items.size());
+        return options;
+    }
+
+  private:
+    std::vector<libenv_option> items;
+    std::vector<char> kinds;
+    std::vector<int32_t> ints;
+    std::vector<uint8_t> bools;
+    std::vector<std::string> strings;
+
+    void add(const char *name, libenv_dtype dtype, int count, char kind) {
+        libenv_option opt;
+        memset(&opt, 0, sizeof(opt));
+        strncpy(opt.name, name, LIBENV_MAX_NAME_LEN - 1);
+        opt.dtype = dtype;
+        opt.count = count;
+        items.push_back(opt);
+        kinds.push_back(kind);
+    }
+};
+
+static size_t tensortype_num_bytes(const libenv_tensortype &t) {
+    size_t n = t.dtype == LIBENV_DTYPE_UINT8 ? 1 : 4;
+    for (int d = 0; d < t.ndim; d++) {
+        n *= t.shape[d];
+    }
+    return n;
+}
+
+static std::vector<libenv_tensortype> get_tensortypes(libenv_env *env, libenv_space_name space) {
+    std::vector<libenv_tensortype> types(libenv_get_tensortypes(env, space, nullptr));
+    libenv_get_tensortypes(env, space, types.data());
+    return types;
+}
+
+static std::vector<uint64_t> get_stats(libenv_env *env, int num_envs) {
+    std::vector<uint64_t> stats((num_envs + 1) * NUM_PHASES * VALUES_PER_PHASE);
+    libenv_get_stats(env, stats.data(), (int)(stats.size()));
+    return stats;
+}
+
+// the bytes allocated on the heap, including the large blocks that malloc maps separately
+static uint64_t heap_bytes_in_use() {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+    struct mallinfo2 info = mallinfo2();
+    return info.uordblks + info.hblkhd;
+#else
+    return 0;
+#endif
+}
+
+// print the phases combined over all envs, counting only what happened between the two snapshots
+static void print_phases(const std::vector<uint64_t> &before, const std::vector<uint64_t> &after, int num_envs) {
+    printf("\"phases\": {");
+    bool first_phase = true;
+    for (int p = 0; p < NUM_PHASES; p++) {
+        uint64_t count = 0;
+        uint64_t total_ns = 0;
+        std::vector<uint64_t> buckets(NUM_BUCKETS, 0);
+        for (int e = 0; e <= num_envs; e++) {
+            size_t offset = (size_t)(e * NUM_PHASES + p) * VALUES_PER_PHASE;
+            count += after[offset] - before[offset];
+            total_ns += after[offset + 1] - before[offset + 1];
+            for (int b = 0; b < NUM_BUCKETS; b++) {
+                buckets[b] += after[offset + 3 + b] - before[offset + 3 + b];
+            }
+        }
+        if (count == 0) {
+            continue;
+        }
+
+        // upper bounds of the histogram buckets
+        auto percentile_us = [&](double pct) {
+            uint64_t seen = 0;
+            int b = 0;
+            for (; b < NUM_BUCKETS - 1; b++) {
+                seen += buckets[b];
+                if (seen >= count * pct / 100) {
+                    break;
+                }
+            }
+            return (double)(uint64_t(1) << (b + 1)) / 1e3;
+        };
+
+        printf("%s\"%s\": {\"count\": %llu, \"mean_us\": %.3f, \"p50_us\": %.3f, \"p99_us\": %.3f}", first_phase ? "" : ", ",
+               STATS_PHASES[p], (unsigned long long)count, (double)total_ns / count / 1e3, percentile_us(50), percentile_us(99));
+        first_phase = false;
+    }
+    printf("}");
+}
+
+static BenchResult run_bench(const BenchConfig &config, const BenchArgs &args, bool first_result) {
+    Options opts;
+    opts.add_string("env_name", config.game);
+    opts.add_int("num_levels", 0);
+    opts.add_int("start_level", 0);
+    opts.add_int("num_actions", NUM_ACTIONS);
+    opts.add_int("rand_seed", 0);
+    opts.add_int("num_threads", config.num_threads);
+    opts.add_string("resource_root", args.resource_root);
+    opts.add_bool("render_human", config.render_human);
+    opts.add_int("render_res", args.render_res);
+    opts.add_bool("collect_stats", true);
+    opts.add_bool("step_kernels", config.step_kernels);
+    opts.add_string("rand_gen", args.rand_gen);
+    if (config.symbolic_obs) {
+        opts.add_bool("rgb_obs", false);
+        opts.add_bool("symbolic_obs", true);
+    }
+
+    uint64_t heap_before = heap_bytes_in_use();
+    libenv_env *env = libenv_make(config.num_envs, opts.get());
+
+    auto ob_types = get_tensortypes(env, LIBENV_SPACE_OBSERVATION);
+    auto info_types = get_tensortypes(env, LIBENV_SPACE_INFO);
+    auto ac_types = get_tensortypes(env, LIBENV_SPACE_ACTION);
+
+    // the buffer of env e for tensor t is at t * num_envs + e, see convert_bufs() in vecgame.cpp
+    std::vector<std::vector<uint8_t>> storage;
+    auto make_bufs = [&](const std::vector<libenv_tensortype> &types, std::vector<void *> &ptrs) {
+        for (const auto &t : types) {
+            for (int e = 0; e < config.num_envs; e++) {
+                storage.emplace_back(tensortype_num_bytes(t));
+                ptrs.push_back(storage.back().data());
+            }
+        }
+    };
+    storage.reserve(config.num_envs * (ob_types.size() + info_types.size() + ac_types.size()));
+    std::vector<void *> ob_ptrs, info_ptrs, ac_ptrs;
+    make_bufs(ob_types, ob_ptrs);
+    make_bufs(info_types, info_ptrs);
+    make_bufs(ac_types, ac_ptrs);
+    std::vector<float> rew(config.num_envs);
+    std::vector<uint8_t> first(config.num_envs);
+
+    libenv_buffers bufs;
+    bufs.ob = ob_ptrs.data();
+    bufs.rew = rew.data();
+    bufs.first = first.data();
+    bufs.info = info_ptrs.data();
+    bufs.ac = ac_ptrs.data();
+    libenv_set_buffers(env, &bufs);
+
+    uint32_t rand_state = 12345;
+    // the steps that didn't reset any env and the allocations made during them
+    int steady_steps = 0;
+    uint64_t steady_allocs = 0;
+    auto step = [&]() {
+        for (int e = 0; e < config.num_envs; e++) {
+            rand_state = rand_state * 1103515245 + 12345;
+            *(int32_t *)(ac_ptrs[e]) = (rand_state >> 16) % NUM_ACTIONS;
+        }
+        uint64_t allocs_before = num_allocations.load(std::memory_order_relaxed);
+        libenv_act(env);
+        libenv_observe(env);
+        uint64_t allocs = num_allocations.load(std::memory_order_relaxed) - allocs_before;
+        for (int e = 0; e < config.num_envs; e++) {
+            if (first[e]) {
+                return;
+            }
+        }
+        steady_steps++;
+        steady_allocs += allocs;
+    };
+
+    libenv_observe(env);
+    for (int s = 0; s < args.warmup; s++) {
+        step();
+    }
+
+    uint64_t obs_bytes = 0;
+    for (const auto &buf : storage) {
+        obs_bytes += buf.size();
+    }
+    uint64_t heap_after = heap_bytes_in_use();
+    // the option list and the tensor types are a few kilobytes at most
+    double bytes_per_env = heap_after > heap_before + obs_bytes ? (double)(heap_after - heap_before - obs_bytes) / config.num_envs : 0.0;
+
+    auto stats_before = get_stats(env, config.num_envs);
+    steady_steps = 0;
+    steady_allocs = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int s = 0; s < args.steps; s++) {
+        step();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    auto stats_after = get_stats(env, config.num_envs);
+
+    libenv_close(env);
+
+    uint64_t game_steps = 0;
+    uint64_t game_step_ns = 0;
+    for (int e = 0; e < config.num_envs; e++) {
+        size_t offset = (size_t)(e * NUM_PHASES) * VALUES_PER_PHASE;
+        game_steps += stats_after[offset] - stats_before[offset];
+        game_step_ns += stats_after[offset + 1] - stats_before[offset + 1];
+    }
+    double mean_game_step_ns = game_steps > 0 ? (double)game_step_ns / game_steps : 0.0;
+
+    size_t reset_offset = 2 * VALUES_PER_PHASE;
+    uint64_t resets = 0;
+    uint64_t reset_ns = 0;
+    for (int e = 0; e < config.num_envs; e++) {
+        size_t offset = (size_t)(e * NUM_PHASES) * VALUES_PER_PHASE + reset_offset;
+        resets += stats_after[offset] - stats_before[offset];
+        reset_ns += stats_after[offset + 1] - stats_before[offset + 1];
+    }
+
+    BenchResult result;
+    result.mean_game_step_ns = mean_game_step_ns;
+    result.steady_allocs_per_step = steady_steps > 0 ? (double)steady_allocs / steady_steps : 0.0;
+
+    printf("%s\n    {\"game\": \"%s\", \"num_envs\": %d, \"num_threads\": %d, \"render_human\": %s, \"step_kernels\": %s, ",
+           first_result ? "" : ",", config.game.c_str(), config.num_envs, config.num_threads, config.render_human ? "true" : "false",
+           config.step_kernels ? "true" : "false");
+    printf("\"symbolic_obs\": %s, ", config.symbolic_obs ? "true" : "false");
+    printf("\"steps\": %d, \"seconds\": %.6f, \"steps_per_sec\": %.1f, \"env_steps_per_sec\": %.1f, ", args.steps, seconds,
+           args.steps / seconds, (double)args.steps * config.num_envs / seconds);
+    // resets per second of a single thread, the resets in the run depend on how long the episodes were
+    printf("\"resets\": %llu, \"resets_per_sec\": %.1f, ", (unsigned long long)resets, reset_ns > 0 ? resets * 1e9 / reset_ns : 0.0);
+    printf("\"bytes_per_env\": %.0f, ", bytes_per_env);
+    printf("\"steady_steps\": %d, \"steady_allocs_per_step\": %.3f, ", steady_steps, result.steady_allocs_per_step);
+    if (config.kernel_game_step_ns > 0) {
+        printf("\"step_kernel_speedup\": %.3f, ", mean_game_step_ns / config.kernel_game_step_ns);
+    }
+    print_phases(stats_before, stats_after, config.num_envs);
+    printf("}");
+    fflush(stdout);
+    return result;
+}
+
+static void usage() {
+    fprintf(stderr, "usage: procgen_bench --resource-root DIR [--games a,b] [--envs 1,16,64] [--threads 0,1,4] [--steps N] [--warmup N] [--render-res N] [--rand-gen NAME] [--max-steady-allocs N]\n");
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv) {
+    BenchArgs args;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            usage();
+        }
+        std::string value = argv[++i];
+        if (arg == "--games") {
+            args.games = split(value, ',');
+        } else if (arg == "--envs") {
+            args.envs = split_ints(value);
+        } else if (arg == "--threads") {
+            args.threads = split_ints(value);
+        } else if (arg == "--steps") {
+            args.steps = atoi(value.c_str());
+        } else if (arg == "--warmup") {
+            args.warmup = atoi(value.c_str());
+        } else if (arg == "--render-res") {
+            args.render_res = atoi(value.c_str());
+        } else if (arg == "--rand-gen") {
+            args.rand_gen = value;
+        } else if (arg == "--max-steady-allocs") {
+            args.max_steady_allocs = atof(value.c_str());
+        } else if (arg == "--resource-root") {
+            args.resource_root = value;
+        } else {
+            usage();
+        }
+    }
+    if (args.resource_root.empty() || args.envs.empty() || args.threads.empty() || args.steps <= 0) {
+        usage();
+    }
+
+    if (args.games.empty()) {
+        std::vector<char> names(4096);
+        int length = get_game_names(names.data(), (int)(names.size()));
+        args.games = split(std::string(names.data(), length), ',');
+    }
+
+    printf("{\"version\": 1, \"steps\": %d, \"warmup\": %d, \"render_res\": %d, \"rand_gen\": \"%s\", \"results\": [", args.steps,
+           args.warmup, args.render_res, args.rand_gen.c_str());
+    bool first_result = true;
+    std::vector<std::string> failed_games;
+    for (const auto &game : args.games) {
+        double kernel_game_step_ns = 0.0;
+        for (int num_envs : args.envs) {
+            for (int num_threads : args.threads) {
+                BenchConfig config;
+                config.game = game;
+                config.num_envs = num_envs;
+                config.num_threads = num_threads;
+                double game_step_ns = run_bench(config, args, first_result).mean_game_step_ns;
+                if (kernel_game_step_ns == 0.0) {
+                    kernel_game_step_ns = game_step_ns;
+                }
+                first_result = false;
+            }
+        }
+
+        BenchConfig generic_config;
+        generic_config.game = game;
+        generic_config.num_envs = args.envs[0];
+        generic_config.num_threads = args.threads[0];
+        generic_config.step_kernels = false;
+        generic_config.kernel_game_step_ns = kernel_game_step_ns;
+        run_bench(generic_config, args, first_result);
+
+        BenchConfig config;
+        config.game = game;
+        config.num_envs = args.envs[0];
+        config.num_threads = args.threads[0];
+        config.render_human = true;
+        run_bench(config, args, first_result);
+
+        BenchConfig alloc_config;
+        alloc_config.game = game;
+        alloc_config.symbolic_obs = true;
+        double steady_allocs = run_bench(alloc_config, args, first_result).steady_allocs_per_step;
+
+        alloc_config.num_envs = std::max(args.envs.back(), 2);
+        alloc_config.num_threads = args.threads.back();
+        steady_allocs = std::max(steady_allocs, run_bench(alloc_config, args, first_result).steady_allocs_per_step);
+
+        if (args.max_steady_allocs >= 0 && steady_allocs > args.max_steady_allocs) {
+            failed_games.push_back(game);
+        }
+
+        // reported only, see the top of the file
+        alloc_config.symbolic_obs = false;
+        run_bench(alloc_config, args, first_result);
+    }
+    printf("\n]}\n");
+
+    for (const auto &game : failed_games) {
+        fprintf(stderr, "%s allocates while stepping\n", game.c_str());
+    }
+
+    return failed_games.empty() ? 0 : EXIT_FAILURE;
+}
@@ -11,6 +11,73 @@ SCRIPT_DIR = os.path.dirname(os.path.abspath(__file__))
 
 MAX_STATE_SIZE = 2 ** 20
 
+# the phases timed with collect_stats=True, in the order of StatsPhase in phase-stats.h
+STATS_PHASES = ["game_step", "erase", "reset", "render", "render_hires", "convert", "encode", "wait"]
+STATS_NUM_BUCKETS = 32
+
+# the layout of LevelSummary in level-summary.h, returned by generate_levels()
+LEVEL_SUMMARY_DTYPE = np.dtype(
+    [
+        ("level_seed", np.int32),
+        ("width", np.int32),
+        ("height", np.int32),
+        ("num_entities", np.int32),
+        ("walls", np.int32),
+        ("doors", np.int32),
+        ("good_objects", np.int32),
+        ("bad_objects", np.int32),
+        ("path_length", np.int32),
+    ]
+)
+
+# the layout of DrawCommand in draw-list.h, returned by record_draw_lists()
+DRAW_COMMAND_DTYPE = np.dtype(
+    [
+        ("kind", np.int32),
+        ("asset", np.int32),
+        ("theme", np.int32),
+        ("is_reflected", np.int32),
+        ("color", np.uint32),
+        ("x", np.float32),
+        ("y", np.float32),
+        ("w", np.float32),
+        ("h", np.float32),
+        ("rotation", np.float32),
+        ("alpha", np.float32),
+    ]
+)
+# the values of DrawKind in draw-list.h
+DRAW_FILL, DRAW_IMAGE, DRAW_BACKGROUND = 0, 1, 2
+
+# the layout of EpisodeStats in episode-stats.h, returned by drain_episode_stats()
+EPISODE_STATS_DTYPE = np.dtype(
+    [
+        ("env", np.int32),
+        ("level_seed", np.int32),
+        ("return", np.float32),
+        ("length", np.int32),
+        ("level_complete", np.int32),
+        ("good_objects", np.int32),
+        ("bad_objects", np.int32),
+        ("wall_hits", np.int32),
+    ]
+)
+
+def parse_tile_stream(data):
+    """
+    Split a frame of the encode_tiles stream, info["tiles"][:info["tiles_size"]], into
+    (keyframe, tile_size, tiles, jpeg). tiles is an (n, 2) array of the x, y of each tile in units of tiles,
+    tile i is at rows i * tile_size to (i + 1) * tile_size of the decoded jpeg, see tile-stream.h.
+    """
+    data = memoryview(bytes(data))
+    flags, tile_size, num_tiles = np.frombuffer(data[:12], dtype="<i4")
+    tiles = np.frombuffer(data[12 : 12 + 4 * num_tiles], dtype="<u2").reshape(num_tiles, 2)
+    offset = 12 + 4 * num_tiles
+    (jpeg_size,) = np.frombuffer(data[offset : offset + 4], dtype="<i4")
+    jpeg = bytes(data[offset + 4 : offset + 4 + jpeg_size])
+    return bool(flags & 1), int(tile_size), tiles, jpeg
+
+
 ENV_NAMES = [
     "bigfish",
     "bossfight",
@@ -50,6 +117,15 @@ DISTRIBUTION_MODE_DICT = {
     "exploration": 20,
 }
 
+# sent to the library as an int of 100 times the value, see Game::parse_level_options()
+FRUITBOT_REWARD_OPTIONS = [
+    "fruitbot_reward_completion",
+    "fruitbot_reward_positive",
+    "fruitbot_reward_negative",
+    "fruitbot_reward_wall_hit",
+    "fruitbot_reward_step",
+]
+
 
 def create_random_seed():
     rand_seed = random.SystemRandom().randint(0, 2 ** 31 - 1)
@@ -80,9 +156,55 @@ class BaseProcgenEnv(CEnv):
         use_sequential_levels=False,
         debug_mode=0,
         resource_root=None,
+        resource_bundle=None,
+        # "auto" starts a thread per cpu and then keeps the number of them that steps the envs the fastest, timed
+        # over the first few hundred steps, the other threads stay parked
         num_threads=4,
+        work_stealing=False,
+        async_step=False,
+        cache_levels=False,
+        pregenerate_levels=False,
+        rgb_obs=True,
+        symbolic_obs=False,
+        symbolic_obs_entities=32,
+        symbolic_obs_grid_dim=16,
+        encode_jpeg=False,
+        jpeg_quality=85,
+        # info["tiles"] holds only the tiles of the render_res frame that changed since the last frame, with every
+        # tile again each keyframe_interval frames (0 for only on request_keyframe()), see parse_tile_stream()
+        encode_tiles=False,
+        tile_size=32,
+        keyframe_interval=60,
+        tick_hz=0,
+        collect_stats=False,
+        # keep a summary of each completed episode for drain_episode_stats()
+        episode_stats=False,
+        # log the actions of each level for drain_level_logs(), to replay them later with replay_level()
+        record_actions=False,
+        # threads for generate_levels(), each with its own copy of each game, 0 doesn't make them
+        level_generators=0,
+        trace_events=0,
+        trace_path="",
+        # a cpu list like "0-15,32-47" to pin the stepping threads to, numa_local_envs also makes each env on the
+        # cpu of the worker that steps it, which needs work_stealing for a fixed assignment of envs to workers
+        cpu_affinity="",
+        numa_local_envs=False,
+        # required alignment in bytes of the buffers given to set_observation_buffer()
+        obs_alignment=1,
         render_mode=None,
+        render_res=512,
+        # format of the rgb observation: "hwc" or "chw", 3 channels or 1 for grayscale, rendered at
+        # obs_res x obs_res with obs_res up to 64
+        obs_layout="hwc",
+        obs_channels=3,
+        obs_res=64,
+        # stack the last frame_stack frames of the rgb observation along a leading dimension, oldest first, the frames
+        # before the start of an episode are zero. With frame_stack_ring each new frame replaces the oldest one in
+        # place instead and info["frame_stack_head"] is the index of the newest frame
+        frame_stack=1,
+        frame_stack_ring=False,
     ):
+        default_resource_root = resource_root is None
         if resource_root is None:
             resource_root = os.path.join(SCRIPT_DIR, "data", "assets") + os.sep
             assert os.path.exists(resource_root)
@@ -100,6 +222,13 @@ class BaseProcgenEnv(CEnv):
             # Only build if prebuilt binaries are not found
             lib_dir = build(debug=debug)
         
+        if resource_bundle is None:
+            # a build with -DPROCGEN_RESOURCE_BUNDLE=ON writes the decoded images of the default resource_root next to
+            # the library, an empty resource_bundle decodes them from the image files instead
+            resource_bundle = os.path.join(lib_dir, "resources.bundle")
+            if not default_resource_root or not os.path.exists(resource_bundle):
+                resource_bundle = ""
+
         self.combos = self.get_combos()
 
         if render_mode is None:
@@ -121,10 +250,40 @@ class BaseProcgenEnv(CEnv):
                 "use_sequential_levels": bool(use_sequential_levels),
                 "debug_mode": debug_mode,
                 "rand_seed": rand_seed,
-                "num_threads": num_threads,
+                "num_threads": -1 if num_threads == "auto" else num_threads,
+                "work_stealing": bool(work_stealing),
+                "async_step": bool(async_step),
+                "cache_levels": bool(cache_levels),
+                "pregenerate_levels": bool(pregenerate_levels),
+                "rgb_obs": bool(rgb_obs),
+                "symbolic_obs": bool(symbolic_obs),
+                "symbolic_obs_entities": symbolic_obs_entities,
+                "symbolic_obs_grid_dim": symbolic_obs_grid_dim,
+                "encode_jpeg": bool(encode_jpeg),
+                "jpeg_quality": jpeg_quality,
+                "encode_tiles": bool(encode_tiles),
+                "tile_size": tile_size,
+                "keyframe_interval": keyframe_interval,
+                "tick_hz": tick_hz,
+                "collect_stats": bool(collect_stats),
+                "episode_stats": bool(episode_stats),
+                "record_actions": bool(record_actions),
+                "level_generators": level_generators,
+                "trace_events": trace_events,
+                "trace_path": trace_path,
+                "cpu_affinity": cpu_affinity,
+                "numa_local_envs": bool(numa_local_envs),
+                "obs_alignment": obs_alignment,
                 "render_human": render_human,
+                "render_res": render_res,
+                "obs_layout": obs_layout,
+                "obs_channels": obs_channels,
+                "obs_res": obs_res,
+                "frame_stack": frame_stack,
+                "frame_stack_ring": bool(frame_stack_ring),
                 # these will only be used the first time an environment is created in a process
                 "resource_root": resource_root,
+                "resource_bundle": resource_bundle,
             }
         )
 
@@ -137,25 +296,379 @@ class BaseProcgenEnv(CEnv):
             c_func_defs=[
                 "int get_state(libenv_env *, int, char *, int);",
                 "void set_state(libenv_env *, int, char *, int);",
+                "void get_states(libenv_env *, char *, int, int *);",
+                "void set_states(libenv_env *, char *, int, int *);",
+                "void libenv_clone_env(libenv_env *, int, int);",
+                "void set_obs_buffer(libenv_env *, const char *, char *);",
+                "void set_step_mask(libenv_env *, uint8_t *);",
+                "void libenv_reset_env(libenv_env *, int, int);",
+                "void libenv_reconfigure(libenv_env *, int, struct libenv_options);",
+                "int libenv_get_stats(libenv_env *, uint64_t *, int);",
+                "int libenv_drain_episode_stats(libenv_env *, void *, int);",
+                "void libenv_generate_levels(libenv_env *, int, int, int, void *);",
+                "int libenv_num_active_threads(libenv_env *);",
+                "int libenv_rand_gen_draws(libenv_env *, const char *, int, int, int, int32_t *, int);",
+                "int libenv_record_draw_lists(libenv_env *, int32_t *);",
+                "int libenv_copy_draw_lists(libenv_env *, void *, int);",
+                "int libenv_draw_list_image(libenv_env *, int, int, int, int, int32_t *, uint32_t *, int);",
+                "void libenv_request_keyframe(libenv_env *, int);",
+                "int libenv_level_logs_size(libenv_env *);",
+                "int libenv_drain_level_logs(libenv_env *, char *, int);",
+                "void libenv_replay_level(libenv_env *, int, int, const uint8_t *, int, int);",
+                "int libenv_replay_seek(libenv_env *, int, int);",
+                "void libenv_dump_trace(libenv_env *, const char *);",
+                "int get_state_delta(libenv_env *, int, char *, int, char *, int);",
+                "void set_state_delta(libenv_env *, int, char *, int, char *, int);",
             ],
         )
         # don't use the dict space for actions
         self.ac_space = self.ac_space["action"]
+        # scratch space for get_state and set_state, MAX_STATE_SIZE bytes per env, allocated on first use
+        self._state_buf = None
+        self._state_lengths = None
+        # arrays given to set_observation_buffer(), kept alive while the envs write to them
+        self._obs_targets = {}
+
+    def _get_state_bufs(self):
+        if self._state_buf is None:
+            # skip zeroing the buffer, only the part of it that holds each state is ever read
+            alloc = self._ffi.new_allocator(should_clear_after_alloc=False)
+            self._state_buf = alloc(f"char[{MAX_STATE_SIZE * self.num}]")
+            self._state_lengths = self._ffi.new(f"int[{self.num}]")
+        return self._state_buf, self._state_lengths
 
     def get_state(self):
-        length = MAX_STATE_SIZE
-        buf = self._ffi.new(f"char[{length}]")
+        buf, lengths = self._get_state_bufs()
+        self.call_c_func("get_states", buf, MAX_STATE_SIZE, lengths)
+        return [
+            bytes(self._ffi.buffer(buf + env_idx * MAX_STATE_SIZE, lengths[env_idx]))
+            for env_idx in range(self.num)
+        ]
+
+    def set_state(self, states):
+        assert len(states) == self.num
+        buf, lengths = self._get_state_bufs()
+        for env_idx in range(self.num):
+            state = states[env_idx]
+            assert len(state) <= MAX_STATE_SIZE
+            self._ffi.memmove(buf + env_idx * MAX_STATE_SIZE, state, len(state))
+            lengths[env_idx] = len(state)
+        self.call_c_func("set_states", buf, MAX_STATE_SIZE, lengths)
+
+    def get_state_delta(self, base_states):
+        """
+        Same as get_state() but each state is encoded relative to the corresponding entry of base_states, usually
+        an earlier get_state(). This is typically an order of magnitude smaller than the state itself.
+        """
+        assert len(base_states) == self.num
+        buf, _ = self._get_state_bufs()
         result = []
         for env_idx in range(self.num):
-            n = self.call_c_func("get_state", env_idx, buf, length)
+            base = base_states[env_idx]
+            n = self.call_c_func(
+                "get_state_delta", env_idx, base, len(base), buf, MAX_STATE_SIZE
+            )
             result.append(bytes(self._ffi.buffer(buf, n)))
         return result
 
-    def set_state(self, states):
-        assert len(states) == self.num
+    def set_state_delta(self, base_states, deltas):
+        """
+        Restore the states returned by get_state_delta(), base_states must be the same as for get_state_delta()
+        """
+        assert len(base_states) == self.num
+        assert len(deltas) == self.num
         for env_idx in range(self.num):
-            state = states[env_idx]
-            self.call_c_func("set_state", env_idx, state, len(state))
+            base = base_states[env_idx]
+            delta = deltas[env_idx]
+            self.call_c_func(
+                "set_state_delta", env_idx, base, len(base), delta, len(delta)
+            )
+
+    def set_observation_buffer(self, name, array):
+        """
+        Have the envs write observation name straight into array from now on, a C-contiguous array with one entry
+        per env, for instance a numpy view of page-locked memory that the gpu copies from. The current observations
+        are copied into it. observe() keeps returning the arrays allocated by the env, which are no longer updated
+        for this observation. None goes back to writing into those arrays.
+        """
+        if array is None:
+            self.call_c_func("set_obs_buffer", name.encode(), self._ffi.NULL)
+            self._obs_targets.pop(name, None)
+            return
+        space = self.ob_space[name]
+        assert array.flags.c_contiguous and array.flags.writeable
+        assert array.shape == (self.num,) + tuple(space.shape)
+        assert array.dtype == np.dtype(space.eltype.dtype_name)
+        self.call_c_func("set_obs_buffer", name.encode(), self._ffi.from_buffer("char *", array))
+        self._obs_targets[name] = array
+
+    def observation_dlpack(self, name="rgb"):
+        """
+        DLPack capsule for the array given to set_observation_buffer(), e.g. for torch.from_dlpack(), this needs
+        numpy >= 1.22. Like the array, it's only complete after observe().
+        """
+        return self._obs_targets[name].__dlpack__()
+
+    def clone_env(self, src_idx, dst_idx):
+        """
+        Make env dst_idx a copy of env src_idx, this is equivalent to copying its entry of get_state()
+        into set_state() but doesn't serialize anything
+        """
+        assert 0 <= src_idx < self.num and 0 <= dst_idx < self.num
+        self.call_c_func("libenv_clone_env", src_idx, dst_idx)
+
+    def set_step_mask(self, mask):
+        """
+        Only step the envs where mask is true from now on, None steps all envs again. The other envs
+        ignore their action, keep their last observation and report no reward.
+        """
+        if mask is None:
+            self.call_c_func("set_step_mask", self._ffi.NULL)
+            return
+        mask = np.ascontiguousarray(mask, dtype=np.uint8)
+        assert mask.shape == (self.num,)
+        self.call_c_func("set_step_mask", self._ffi.from_buffer("uint8_t *", mask))
+
+    def act_masked(self, ac, mask):
+        """
+        Step only the envs where mask is true, useful when the envs are shared between users
+        that don't all act at the same time. With tick_hz, use set_step_mask() instead.
+        """
+        assert not self.options["tick_hz"], "act_masked doesn't apply to tick mode, use set_step_mask"
+        self.set_step_mask(mask)
+        try:
+            self.act(ac)
+        finally:
+            self.set_step_mask(None)
+
+    def reset_env(self, env_idx, level_seed_gen_seed=-1):
+        """
+        End the episode of env env_idx and start a new one, first is set on the next observe().
+        A level_seed_gen_seed >= 0 reseeds the sequence of levels the env plays from then on.
+        """
+        assert 0 <= env_idx < self.num
+        self.call_c_func("libenv_reset_env", env_idx, level_seed_gen_seed)
+
+    def get_stats(self, percentiles=(50, 90, 99)):
+        """
+        Timing of each phase of stepping since the env was created, requires collect_stats=True.
+        Returns {game_name: {phase: stats}} with the envs of each game combined, plus the time spent
+        waiting for the stepping threads under "vecgame". Each stats dict has count, mean_us and max_us,
+        and p<N>_us for each percentile, these are upper bounds from a histogram with power of 2 buckets.
+        """
+        assert self.options["collect_stats"], "get_stats requires collect_stats=True"
+        values_per_phase = 3 + STATS_NUM_BUCKETS
+        values_per_env = len(STATS_PHASES) * values_per_phase
+        buf = np.zeros((self.num + 1) * values_per_env, dtype=np.uint64)
+        self.call_c_func("libenv_get_stats", self._ffi.from_buffer("uint64_t *", buf), len(buf))
+        buf = buf.reshape(self.num + 1, len(STATS_PHASES), values_per_phase)
+
+        env_names = self.options["env_name"].split(",")
+        groups = {}
+        for env_idx in range(self.num):
+            groups.setdefault(env_names[env_idx % len(env_names)], []).append(env_idx)
+        groups["vecgame"] = [self.num]
+
+        result = {}
+        for name, rows in groups.items():
+            phases = {}
+            for phase_idx, phase in enumerate(STATS_PHASES):
+                v = buf[rows, phase_idx]
+                count = int(v[:, 0].sum())
+                if count == 0:
+                    continue
+                buckets = v[:, 3:].sum(axis=0)
+                cumulative = np.cumsum(buckets)
+                stats = {
+                    "count": count,
+                    "mean_us": float(v[:, 1].sum()) / count / 1e3,
+                    "max_us": float(v[:, 2].max()) / 1e3,
+                }
+                for p in percentiles:
+                    b = int(np.searchsorted(cumulative, count * p / 100))
+                    stats[f"p{p}_us"] = 2.0 ** (b + 1) / 1e3
+                phases[phase] = stats
+            result[name] = phases
+        return result
+
+    def drain_episode_stats(self):
+        """
+        The episodes completed since the last call, requires episode_stats=True. Returns a structured array with
+        EPISODE_STATS_DTYPE, one row per episode with the env, level seed, return, length and level_complete of the
+        episode, plus counts of game specific events that are 0 for the games that don't have them. With
+        use_sequential_levels each level is a row. Episodes ended by reset_env() are not included.
+        """
+        assert self.options["episode_stats"], "drain_episode_stats requires episode_stats=True"
+        chunks = []
+        while True:
+            buf = np.zeros(max(self.num, 64), dtype=EPISODE_STATS_DTYPE)
+            n = self.call_c_func("libenv_drain_episode_stats", self._ffi.from_buffer("void *", buf), len(buf))
+            chunks.append(buf[:n])
+            if n < len(buf):
+                return np.concatenate(chunks)
+
+    def generate_levels(self, seed_start, count, game_idx=0):
+        """
+        Generate the levels of seeds seed_start to seed_start + count - 1 without rendering or stepping them, with the
+        options of the envs, on level_generators threads. Returns a structured array with LEVEL_SUMMARY_DTYPE, one row
+        per seed with the size and the number of entities of the level, plus game specific measures that are 0 for the
+        games that don't have them. game_idx picks the game of a comma separated env_name. The envs aren't touched
+        and may be stepped from another thread meanwhile.
+        """
+        assert self.options["level_generators"] > 0, "generate_levels requires level_generators > 0"
+        out = np.zeros(count, dtype=LEVEL_SUMMARY_DTYPE)
+        self.call_c_func("libenv_generate_levels", game_idx, seed_start, count, self._ffi.from_buffer("void *", out))
+        return out
+
+    def num_active_threads(self):
+        """
+        The number of threads stepping the envs, with num_threads="auto" this is the number found to be the fastest
+        once the tuning is done and the number being timed before that.
+        """
+        return self.call_c_func("libenv_num_active_threads")
+
+    def rand_gen_draws(self, method, seed, a, b):
+        """
+        The result of the RandGen method with a new generator of the kind of rand_gen seeded with seed, for testing
+        them. method is "partition" or "partition_spacings" with x=a and n=b, "choose_n" or "choose_n_fast" choosing
+        b of range(a), or "simple_choose" or "simple_choose_fast" with n=a and k=b.
+        """
+        out = np.zeros(max(a, b), dtype=np.int32)
+        n = self.call_c_func(
+            "libenv_rand_gen_draws",
+            method.encode(),
+            seed,
+            a,
+            b,
+            self._ffi.from_buffer("int32_t *", out),
+            out.size,
+        )
+        return out[:n].tolist()
+
+    def record_draw_lists(self):
+        """
+        The observation of each env as a list of draw commands instead of pixels, for drawing the observations of all
+        the envs in one pass outside of procgen, for example on a GPU with rgb_obs=False. Returns (counts, commands)
+        where commands is an array with DRAW_COMMAND_DTYPE of the commands of all the envs in order of env, and
+        counts[e] is the number of commands of env e, or -1 if its game doesn't support software_render. Each frame
+        is drawn by blending its commands in order over a black frame of obs_res pixels, with the images from
+        draw_list_image().
+        """
+        counts = np.zeros(self.num, dtype=np.int32)
+        total = self.call_c_func("libenv_record_draw_lists", self._ffi.from_buffer("int32_t *", counts))
+        commands = np.zeros(total, dtype=DRAW_COMMAND_DTYPE)
+        n = self.call_c_func("libenv_copy_draw_lists", self._ffi.from_buffer("void *", commands), total)
+        assert n == total
+        return counts, commands
+
+    def draw_list_image(self, kind, asset, theme=0, env_idx=0):
+        """
+        The image of the DRAW_IMAGE or DRAW_BACKGROUND commands of record_draw_lists() with this kind, asset and theme,
+        as a (height, width) uint32 array of premultiplied 0xAARRGGBB pixels, without the reflection, or None if
+        there's no such image. The images are the same for the envs of a game with the same options, so they only need
+        to be fetched once for an atlas of them.
+        """
+        size = np.zeros(2, dtype=np.int32)
+        size_ptr = self._ffi.from_buffer("int32_t *", size)
+        if not self.call_c_func("libenv_draw_list_image", env_idx, kind, asset, theme, size_ptr, self._ffi.NULL, 0):
+            return None
+        pixels = np.zeros((size[1], size[0]), dtype=np.uint32)
+        self.call_c_func(
+            "libenv_draw_list_image",
+            env_idx,
+            kind,
+            asset,
+            theme,
+            size_ptr,
+            self._ffi.from_buffer("uint32_t *", pixels),
+            pixels.size,
+        )
+        return pixels
+
+    def drain_level_logs(self):
+        """
+        The levels completed since the last call, requires record_actions=True. Returns a list of
+        (env, level_seed, actions) in order of env and then of completion, where actions is a uint8 array with the
+        action of each frame of the level, so a step is several frames with frame_skip. A level logs an action of -1
+        as 255. Levels that get_state() and friends loaded a state into are not included.
+        """
+        assert self.options["record_actions"], "drain_level_logs requires record_actions=True"
+        size = self.call_c_func("libenv_level_logs_size")
+        buf = np.zeros(size, dtype=np.uint8)
+        n = self.call_c_func("libenv_drain_level_logs", self._ffi.from_buffer("char *", buf), len(buf))
+        logs = []
+        offset = 0
+        while offset < n:
+            env_idx, level_seed, num_frames = buf[offset : offset + 12].view(np.int32)
+            offset += 12
+            logs.append((int(env_idx), int(level_seed), buf[offset : offset + num_frames].copy()))
+            offset += num_frames
+        return logs
+
+    def replay_level(self, env_idx, level_seed, actions, checkpoint_interval=64):
+        """
+        Start replaying a level from drain_level_logs() in env env_idx, which must have the same options as the env
+        that recorded it, and observe its first frame. Use replay_seek() to go to a frame of the level, a checkpoint of
+        the state is kept every checkpoint_interval frames so seeking only steps from the checkpoint before the frame.
+        Not supported with async_step or tick_hz.
+        """
+        assert not self.options["record_actions"], "an env that records actions can't replay them"
+        assert 0 <= env_idx < self.num
+        actions = np.ascontiguousarray(actions, dtype=np.uint8)
+        self.call_c_func(
+            "libenv_replay_level",
+            env_idx,
+            level_seed,
+            self._ffi.from_buffer("uint8_t *", actions),
+            len(actions),
+            checkpoint_interval,
+        )
+
+    def replay_seek(self, env_idx, frame):
+        """
+        Go to the state after frame frames of the level being replayed in env env_idx and observe it, without
+        rendering the frames in between. Returns the frame reached, which is the last one if frame is past it. With
+        frame_skip_max_pool the observation is of the frame alone rather than pooled.
+        """
+        assert 0 <= env_idx < self.num
+        return self.call_c_func("libenv_replay_seek", env_idx, frame)
+
+    def request_keyframe(self, env_idx):
+        """
+        Make the next frame of the encode_tiles stream of env env_idx a keyframe, for a viewer that joins the stream.
+        """
+        assert self.options["encode_tiles"], "request_keyframe requires encode_tiles=True"
+        assert 0 <= env_idx < self.num
+        self.call_c_func("libenv_request_keyframe", env_idx)
+
+    def dump_trace(self, path):
+        """
+        Write a Chrome trace of what each stepping thread did to path, requires trace_events > 0.
+        Each thread keeps its last trace_events events, the file can be opened in Perfetto or chrome://tracing.
+        With trace_path set, the trace is also written there when the env is closed.
+        """
+        assert self.options["trace_events"] > 0, "dump_trace requires trace_events > 0"
+        self.call_c_func("libenv_dump_trace", path.encode("utf8"))
+
+    def act_async(self, ac):
+        """
+        Start stepping with the given actions and return immediately, requires async_step=True.
+        The observation buffers keep the previous batch until wait() is called.
+
+        With tick_hz > 0 (which also needs async_step=True), the envs are instead stepped tick_hz times
+        per second on a background thread: act() only sets the actions the following ticks use and
+        observe() waits for the next tick, with the rewards summed and first kept over any ticks that
+        weren't observed.
+        """
+        assert self.options["async_step"], "act_async requires async_step=True"
+        self.act(ac)
+
+    def wait(self):
+        """
+        Wait for the batch started by act_async() and publish it to the observation buffers,
+        libenv_observe does the same as libenv_wait when async_step is enabled
+        """
+        return self.observe()
 
     def get_combos(self):
         return [
@@ -215,11 +728,30 @@ class ProcgenGym3Env(BaseProcgenEnv):
         env_name,
         center_agent=True,
         use_backgrounds=True,
+        cache_background=False,
+        cache_sprites=False,
+        # the number of scaled sprites cache_sprites keeps before it starts over
+        sprite_cache_entries=4096,
+        software_render=False,
+        # step the objects with physics compiled for the class of the game, setting it to False gives the same
+        # results through virtual calls
+        step_kernels=True,
+        # draw the grid by runs of equal cells, setting it to False draws it cell by cell with the same frames
+        draw_grid_runs=True,
+        # repaint only what changed in the render_mode="rgb_array" frame, for the games that support it (bigfish
+        # and fruitbot), the camera moves by whole pixels so the frame can be up to half a pixel off
+        incremental_render=False,
+        # move the camera by whole pixels as incremental_render does, with and without it the frames are the same
+        snap_camera=False,
+        frame_skip=1,
+        frame_skip_max_pool=False,
         use_monochrome_assets=False,
         restrict_themes=False,
         use_generated_assets=False,
         paint_vel_info=False,
         distribution_mode="hard",
+        # "pcg32" has a much smaller state than "mt19937", about 10KB less per env, but generates different levels
+        rand_gen="mt19937",
         # FruitBot custom rewards
         fruitbot_reward_completion=10.0,
         fruitbot_reward_positive=1.0,
@@ -241,6 +773,8 @@ class ProcgenGym3Env(BaseProcgenEnv):
         fruitbot_bad_line_x_pct=85,
         fruitbot_line_padding_pct=10,
         fruitbot_force_no_walls=False,
+        # same results as the default step with less work per step
+        fruitbot_fast_step=False,
         **kwargs,
     ):
         assert (
@@ -266,8 +800,19 @@ class ProcgenGym3Env(BaseProcgenEnv):
                 "use_monochrome_assets": bool(use_monochrome_assets),
                 "restrict_themes": bool(restrict_themes),
                 "use_backgrounds": bool(use_backgrounds),
+                "cache_background": bool(cache_background),
+                "cache_sprites": bool(cache_sprites),
+                "sprite_cache_entries": sprite_cache_entries,
+                "software_render": bool(software_render),
+                "step_kernels": bool(step_kernels),
+                "draw_grid_runs": bool(draw_grid_runs),
+                "incremental_render": bool(incremental_render),
+                "snap_camera": bool(snap_camera),
+                "frame_skip": frame_skip,
+                "frame_skip_max_pool": bool(frame_skip_max_pool),
                 "paint_vel_info": bool(paint_vel_info),
                 "distribution_mode": distribution_mode,
+                "rand_gen": rand_gen,
             }
         
         # Add FruitBot custom rewards (multiply by 100 for int transmission)
@@ -292,10 +837,36 @@ class ProcgenGym3Env(BaseProcgenEnv):
             options["fruitbot_bad_line_x_pct"] = fruitbot_bad_line_x_pct
             options["fruitbot_line_padding_pct"] = fruitbot_line_padding_pct
             options["fruitbot_force_no_walls"] = bool(fruitbot_force_no_walls)
+            options["fruitbot_fast_step"] = bool(fruitbot_fast_step)
         
         super().__init__(num, env_name, options, **kwargs)
-        
-        
+
+    def reconfigure(self, env_idx, level_seed_gen_seed=-1, **kwargs):
+        """
+        Change the levels env env_idx plays and start a new episode in it, first is set on the next observe(). This
+        reuses the threads and loaded assets of the env, so it's much faster than making a new env for a new user.
+        Takes distribution_mode, use_sequential_levels, num_levels with start_level, and for fruitbot the reward and
+        layout parameters of the constructor, the ones that aren't given keep their values. A start_level without
+        num_levels keeps the number of levels, which must not be unlimited. A level_seed_gen_seed >= 0
+        reseeds the sequence of levels like reset_env(). Not supported with cache_levels or pregenerate_levels.
+        """
+        assert 0 <= env_idx < self.num
+        assert not (
+            self.options["cache_levels"] or self.options["pregenerate_levels"]
+        ), "reconfigure doesn't support cache_levels or pregenerate_levels"
+        options = {"level_seed_gen_seed": level_seed_gen_seed}
+        for name, value in kwargs.items():
+            if name == "distribution_mode":
+                assert value != "exploration", "reconfigure doesn't support exploration mode"
+                value = DISTRIBUTION_MODE_DICT[value]
+            elif name in FRUITBOT_REWARD_OPTIONS:
+                name = name + "_x100"
+                value = int(value * 100)
+            options[name] = value
+        c_options, keepalives = self._convert_options(self._ffi, self._c_lib, options)
+        self.call_c_func("libenv_reconfigure", env_idx, c_options[0])
+
+
 class ToBaselinesVecEnv(gym3.ToBaselinesVecEnv):
     metadata = {
         'render.modes': ['human', 'rgb_array'],
@@ -307,8 +878,10 @@ class ToBaselinesVecEnv(gym3.ToBaselinesVecEnv):
         if mode == "rgb_array":
             if "rgb" in info:
                 return info["rgb"]
+            elif "rgb" in ob:
+                return ob['rgb'][0]
             else:
-                return ob['rgb'][0]        
+                raise Exception("render needs an rgb frame, use render_mode=\"rgb_array\" with rgb_obs=False")
 
 
 def ProcgenEnv(num_envs, env_name, **kwargs):
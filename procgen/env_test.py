@@ -1,9 +1,39 @@
+import io
+import json
+import math
+import os
+import time
 import numpy as np
 import pytest
-from .env import ENV_NAMES
+from .env import DRAW_FILL, ENV_NAMES, parse_tile_stream
 from procgen import ProcgenGym3Env
 
 
+def collect_rollout(num_steps, act=None, **kwargs):
+    """
+    Make a ProcgenGym3Env with kwargs and step it num_steps times, with random actions from a fixed seed or with
+    act(step). Returns the env and a dict of arrays with one entry per observe(), the first from before any step: one
+    for each observation, "rew", "first", and "info_rgb" with render_mode="rgb_array"
+    """
+    rng = np.random.RandomState(0)
+    env = ProcgenGym3Env(**kwargs)
+    rollout = {}
+    for step in range(num_steps + 1):
+        if step > 0:
+            if act is None:
+                env.act(rng.randint(low=0, high=env.ac_space.eltype.n, size=(env.num,), dtype=np.int32))
+            else:
+                env.act(act(step - 1))
+        rew, obs, first = env.observe()
+        values = dict(obs, rew=rew, first=first)
+        info = env.get_info()
+        if "rgb" in info[0]:
+            values["info_rgb"] = np.array([env_info["rgb"] for env_info in info])
+        for key, value in values.items():
+            rollout.setdefault(key, []).append(value)
+    return env, {key: np.array(values) for key, values in rollout.items()}
+
+
 @pytest.mark.parametrize("env_name", ["coinrun", "starpilot"])
 def test_seeding(env_name):
     num_envs = 1
@@ -52,6 +82,604 @@ def test_determinism(env_name):
     assert np.array_equal(obs1, obs2)
 
 
+@pytest.mark.parametrize("env_name", ["fruitbot", "starpilot"])
+def test_work_stealing_matches_default(env_name):
+    _, expected = collect_rollout(64, num=16, env_name=env_name, rand_seed=23, num_threads=3)
+    _, actual = collect_rollout(64, num=16, env_name=env_name, rand_seed=23, num_threads=3, work_stealing=True)
+    assert np.array_equal(expected["rgb"], actual["rgb"])
+
+
+def test_auto_threads():
+    # long enough for the tuning to finish on a machine with up to 16 cpus
+    _, expected = collect_rollout(200, num=16, env_name="fruitbot", rand_seed=23, num_threads=3)
+    env, actual = collect_rollout(200, num=16, env_name="fruitbot", rand_seed=23, num_threads="auto")
+    assert np.array_equal(expected["rgb"], actual["rgb"])
+    assert 1 <= env.num_active_threads() <= min(16, os.cpu_count())
+
+
+@pytest.mark.parametrize("env_name", ENV_NAMES)
+def test_cache_background_matches_default(env_name):
+    # the cached background is blitted at whole pixels, so is the rest of the frame with snap_camera, and the cache
+    # has to be dropped on every reset to a new level
+    options = dict(num=3, env_name=env_name, rand_seed=23, render_mode="rgb_array", snap_camera=True)
+    _, expected = collect_rollout(300, **options)
+    _, actual = collect_rollout(300, cache_background=True, **options)
+    assert actual["first"][1:].any()
+    assert np.array_equal(expected["rgb"], actual["rgb"])
+    assert np.array_equal(expected["info_rgb"], actual["info_rgb"])
+
+
+@pytest.mark.parametrize("env_name", ENV_NAMES)
+def test_cache_sprites_matches_default(env_name):
+    # the cached sprites are blitted at whole pixels, the other rotations and the tiled images aren't cached
+    options = dict(num=2, env_name=env_name, rand_seed=23, render_mode="rgb_array")
+    _, expected = collect_rollout(200, **options)
+    _, actual = collect_rollout(200, cache_sprites=True, **options)
+    for key in ["rgb", "info_rgb"]:
+        diff = np.abs(expected[key].astype(np.int32) - actual[key])
+        assert diff.mean(axis=(2, 3, 4)).max() < 10
+    # starting the cache over only costs the scaling again
+    _, small_cache = collect_rollout(200, cache_sprites=True, sprite_cache_entries=4, **options)
+    assert np.array_equal(actual["rgb"], small_cache["rgb"])
+    assert np.array_equal(actual["info_rgb"], small_cache["info_rgb"])
+
+
+def test_fruitbot_fast_step_matches_default():
+    options = dict(num=16, env_name="fruitbot", rand_seed=23, fruitbot_door_prob_pct=50)
+    _, expected = collect_rollout(64, **options)
+    _, actual = collect_rollout(64, fruitbot_fast_step=True, **options)
+    assert np.array_equal(expected["rgb"], actual["rgb"])
+    assert np.array_equal(expected["rew"], actual["rew"])
+
+
+@pytest.mark.parametrize("env_name", ENV_NAMES)
+def test_step_kernels_match_virtual_calls(env_name):
+    _, expected = collect_rollout(200, num=4, env_name=env_name, rand_seed=23)
+    _, actual = collect_rollout(200, num=4, env_name=env_name, rand_seed=23, step_kernels=False)
+    for key in ["rgb", "rew", "first"]:
+        assert np.array_equal(expected[key], actual[key])
+
+
+@pytest.mark.parametrize("env_name", ENV_NAMES)
+def test_grid_runs_match_cell_by_cell(env_name):
+    # the software renderer fills the runs of solid color cells with one rect
+    for kwargs in [{}, {"software_render": True, "use_monochrome_assets": True}]:
+        options = dict(num=2, env_name=env_name, rand_seed=23, render_mode="rgb_array", **kwargs)
+        _, expected = collect_rollout(100, **options)
+        _, actual = collect_rollout(100, draw_grid_runs=False, **options)
+        assert np.array_equal(expected["rgb"], actual["rgb"])
+        assert np.array_equal(expected["info_rgb"], actual["info_rgb"])
+
+
+@pytest.mark.parametrize("env_name", ["fruitbot", "heist"])
+def test_prebuilt_levels_match_default(env_name):
+    options = dict(num=4, env_name=env_name, rand_seed=23, num_levels=2)
+    _, expected = collect_rollout(300, **options)
+    for kwargs in [{"cache_levels": True}, {"pregenerate_levels": True}]:
+        _, actual = collect_rollout(300, **options, **kwargs)
+        assert np.array_equal(expected["rgb"], actual["rgb"])
+
+
+@pytest.mark.parametrize("env_name", ENV_NAMES)
+def test_clone_env_matches_set_state(env_name):
+    # clone_env() goes through the copy_state() of the game, set_state() through a serialize() and deserialize()
+    # round trip, the copies must stay the same from then on
+    env = ProcgenGym3Env(num=2, env_name=env_name, rand_seed=23)
+    round_trip_env = ProcgenGym3Env(num=1, env_name=env_name, rand_seed=5)
+    rng = np.random.RandomState(0)
+    for _ in range(50):
+        env.act(rng.randint(0, env.ac_space.eltype.n, size=(env.num,), dtype=np.int32))
+    state = env.get_state()
+    env.clone_env(0, 1)
+    round_trip_env.set_state([state[0]])
+    assert env.get_state() == [state[0], state[0]]
+
+    for _ in range(100):
+        act = rng.randint(0, env.ac_space.eltype.n, dtype=np.int32)
+        env.act(np.full(env.num, act, dtype=np.int32))
+        round_trip_env.act(np.array([act], dtype=np.int32))
+        rew, obs, first = env.observe()
+        round_trip_rew, round_trip_obs, round_trip_first = round_trip_env.observe()
+        assert rew[1] == round_trip_rew[0] and first[1] == round_trip_first[0]
+        assert np.array_equal(obs["rgb"][1], round_trip_obs["rgb"][0])
+    assert env.get_state()[1] == round_trip_env.get_state()[0]
+
+
+def test_state_delta_roundtrip():
+    env = ProcgenGym3Env(num=2, env_name="fruitbot", rand_seed=23)
+    base = env.get_state()
+    for _ in range(5):
+        env.act(np.zeros(env.num, dtype=np.int32))
+    state = env.get_state()
+    deltas = env.get_state_delta(base)
+    assert all(len(d) < len(s) for d, s in zip(deltas, state))
+    env.set_state(base)
+    env.set_state_delta(base, deltas)
+    assert env.get_state() == state
+
+    # a delta buffer from the C api only has to fit the delta, not the full state
+    for env_idx in range(env.num):
+        out = env._ffi.new("char[]", len(deltas[env_idx]))
+        n = env.call_c_func("get_state_delta", env_idx, base[env_idx], len(base[env_idx]), out, len(out))
+        assert bytes(env._ffi.buffer(out, n)) == deltas[env_idx]
+
+
+def test_pcg32_rand_gen_state():
+    env = ProcgenGym3Env(num=2, env_name="fruitbot", rand_seed=23, rand_gen="pcg32")
+    mt_env = ProcgenGym3Env(num=2, env_name="fruitbot", rand_seed=23)
+    for _ in range(5):
+        env.act(np.zeros(env.num, dtype=np.int32))
+    state = env.get_state()
+    assert len(state[0]) + 4000 < len(mt_env.get_state()[0])
+    for _ in range(5):
+        env.act(np.zeros(env.num, dtype=np.int32))
+    _, obs, _ = env.observe()
+    expected = obs["rgb"].copy()
+    env.set_state(state)
+    for _ in range(5):
+        env.act(np.zeros(env.num, dtype=np.int32))
+    _, obs, _ = env.observe()
+    assert np.array_equal(expected, obs["rgb"])
+
+
+def test_rand_gen_helpers_keep_their_draws():
+    # the levels of the existing distribution modes depend on these, the draws are from before the fast versions
+    env = ProcgenGym3Env(num=1, env_name="coinrun")
+    expected = {
+        7: ([2, 5, 6, 6, 1], [5, 4, 1, 2], [5, 2, 1, 6]),
+        42: ([6, 4, 4, 2, 4], [2, 6, 5, 8], [2, 7, 6, 4]),
+    }
+    for seed, (partition, choose_n, simple_choose) in expected.items():
+        assert env.rand_gen_draws("partition", seed, 20, 5) == partition
+        assert env.rand_gen_draws("choose_n", seed, 10, 4) == choose_n
+        assert env.rand_gen_draws("simple_choose", seed, 10, 4) == simple_choose
+
+
+@pytest.mark.parametrize("rand_gen", ["mt19937", "pcg32"])
+def test_fast_rand_gen_helpers(rand_gen):
+    env = ProcgenGym3Env(num=1, env_name="coinrun", rand_gen=rand_gen)
+    for seed in range(50):
+        x = seed % 37
+        n = 1 + seed % 9
+        parts = env.rand_gen_draws("partition_spacings", seed, x, n)
+        assert len(parts) == n and sum(parts) == x and min(parts) >= 0
+
+        k = seed % 11
+        for method in ["choose_n_fast", "simple_choose_fast"]:
+            picks = env.rand_gen_draws(method, seed, 10, k)
+            assert len(picks) == min(k, 10)
+            assert len(set(picks)) == len(picks)
+            assert all(0 <= p < 10 for p in picks)
+
+
+@pytest.mark.parametrize("async_step", [False, True])
+def test_set_observation_buffer(async_step):
+    env = ProcgenGym3Env(num=4, env_name="starpilot", rand_seed=23, async_step=async_step, obs_alignment=64)
+    ref_env = ProcgenGym3Env(num=4, env_name="starpilot", rand_seed=23, async_step=async_step)
+    storage = np.zeros(env.num * 64 * 64 * 3 + 64, dtype=np.uint8)
+    offset = -storage.ctypes.data % 64
+    target = storage[offset : offset + env.num * 64 * 64 * 3].reshape(env.num, 64, 64, 3)
+    _, obs, _ = env.observe()
+    env.set_observation_buffer("rgb", target)
+    assert np.array_equal(target, obs["rgb"])
+    for _ in range(5):
+        ac = np.random.randint(0, env.ac_space.eltype.n, size=(env.num,), dtype=np.int32)
+        env.act(ac)
+        ref_env.act(ac)
+        env.observe()
+        _, ref_obs, _ = ref_env.observe()
+        assert np.array_equal(target, ref_obs["rgb"])
+    env.set_observation_buffer("rgb", None)
+
+
+def test_obs_alignment_only_checks_registered_buffers():
+    # the buffers gym3 allocates for set_buffers() aren't aligned to more than 16 bytes
+    env = ProcgenGym3Env(num=2, env_name="starpilot", obs_alignment=4096)
+    env.act(np.zeros(env.num, dtype=np.int32))
+    env.observe()
+
+
+def test_obs_layout_and_channels():
+    def first_observation(**kwargs):
+        return collect_rollout(0, num=2, env_name="coinrun", rand_seed=23, **kwargs)[1]["rgb"][0]
+
+    hwc = first_observation()
+    assert np.array_equal(first_observation(obs_layout="chw"), hwc.transpose(0, 3, 1, 2))
+    gray = first_observation(obs_channels=1)
+    assert gray.shape == (2, 64, 64, 1)
+    luma = hwc.astype(np.float64) @ np.array([0.299, 0.587, 0.114])
+    assert np.abs(gray[..., 0] - luma).max() <= 1
+    assert first_observation(obs_res=32, obs_layout="chw").shape == (2, 3, 32, 32)
+
+
+def test_frame_stack():
+    def make_env(**kwargs):
+        return ProcgenGym3Env(num=2, env_name="coinrun", rand_seed=23, **kwargs)
+
+    env = make_env()
+    stack_env = make_env(frame_stack=4)
+    ring_env = make_env(frame_stack=4, frame_stack_ring=True)
+    _, obs, _ = stack_env.observe()
+    assert obs["rgb"].shape == (2, 4, 64, 64, 3)
+    assert not obs["rgb"][:, :3].any()
+    prev = obs["rgb"][:, -1].copy()
+    for step in range(20):
+        act = np.full(env.num, step % 4, dtype=np.int32)
+        for e in (env, stack_env, ring_env):
+            e.act(act)
+        _, obs, first = env.observe()
+        _, stack_obs, _ = stack_env.observe()
+        _, ring_obs, _ = ring_env.observe()
+        assert np.array_equal(stack_obs["rgb"][:, -1], obs["rgb"])
+        # a new episode starts a new stack
+        prev[first] = 0
+        assert np.array_equal(stack_obs["rgb"][:, -2], prev)
+        prev = obs["rgb"].copy()
+        head = ring_env.get_info()[0]["frame_stack_head"]
+        order = (head + 1 + np.arange(4)) % 4
+        assert np.array_equal(ring_obs["rgb"][0, order], stack_obs["rgb"][0])
+
+
+@pytest.mark.parametrize("env_name", ["bigfish", "fruitbot"])
+def test_incremental_render_matches_full_repaint(env_name):
+    # the fruitbot camera scrolls every step, snap_camera makes the full repaint use the same whole pixel camera
+    options = dict(num=2, env_name=env_name, rand_seed=23, render_mode="rgb_array", snap_camera=True)
+    act = lambda step: np.full(2, step % 9, dtype=np.int32)
+    _, expected = collect_rollout(100, act=act, **options)
+    _, actual = collect_rollout(100, act=act, incremental_render=True, **options)
+    for step in range(len(expected["info_rgb"])):
+        assert np.array_equal(expected["info_rgb"][step, 0], actual["info_rgb"][step, 0]), f"frame {step} differs"
+
+
+def test_encode_jpeg():
+    Image = pytest.importorskip("PIL.Image")
+    # without the textured backgrounds, which lose the most to the chroma subsampling
+    env = ProcgenGym3Env(
+        num=2,
+        env_name="bigfish",
+        rand_seed=3,
+        use_backgrounds=False,
+        render_mode="rgb_array",
+        render_res=256,
+        encode_jpeg=True,
+    )
+    for _ in range(20):
+        env.act(np.random.randint(0, env.ac_space.eltype.n, size=(env.num,), dtype=np.int32))
+        for info in env.get_info():
+            assert 0 < info["jpeg_size"] <= info["jpeg"].size
+            image = Image.open(io.BytesIO(bytes(info["jpeg"][: info["jpeg_size"]])))
+            assert image.format == "JPEG" and image.size == (256, 256)
+            # the jpeg is the same frame as the rgb info, within what the compression loses
+            decoded = np.asarray(image.convert("RGB"))
+            assert np.abs(decoded.astype(np.int32) - info["rgb"]).mean() < 8
+
+
+def test_tile_stream_round_trip():
+    Image = pytest.importorskip("PIL.Image")
+    env = ProcgenGym3Env(
+        num=1,
+        env_name="bigfish",
+        rand_seed=3,
+        render_mode="rgb_array",
+        render_res=256,
+        encode_tiles=True,
+        keyframe_interval=0,
+        jpeg_quality=95,
+    )
+    frame = None
+    last_rgb = None
+    keyframes = []
+    for step in range(60):
+        if step == 30:
+            # the frame of the reset is never read, so the next one has to be a keyframe
+            env.reset_env(0, level_seed_gen_seed=5)
+        else:
+            info = env.get_info()[0]
+            keyframe, tile_size, tiles, jpeg = parse_tile_stream(info["tiles"][: info["tiles_size"]])
+            keyframes.append(keyframe)
+            sent = np.zeros((256 // tile_size, 256 // tile_size), dtype=bool)
+            sent[tiles[:, 1], tiles[:, 0]] = True
+            if keyframe:
+                assert sent.all()
+                frame = np.zeros_like(info["rgb"])
+            else:
+                # the tiles that weren't sent are exactly those of the last frame that was read
+                unchanged = np.repeat(np.repeat(~sent, tile_size, axis=0), tile_size, axis=1)
+                assert np.array_equal(info["rgb"][unchanged], last_rgb[unchanged])
+            if len(tiles) > 0:
+                strip = np.asarray(Image.open(io.BytesIO(jpeg)).convert("RGB"))
+                for i, (tx, ty) in enumerate(tiles):
+                    frame[ty * tile_size : (ty + 1) * tile_size, tx * tile_size : (tx + 1) * tile_size] = strip[
+                        i * tile_size : (i + 1) * tile_size
+                    ]
+            assert np.abs(frame.astype(np.int32) - info["rgb"]).mean() < 8
+            last_rgb = info["rgb"].copy()
+        env.act(np.random.randint(0, env.ac_space.eltype.n, size=(env.num,), dtype=np.int32))
+    assert keyframes[0] and keyframes[30] and not any(keyframes[1:30])
+
+
+def test_symbolic_obs_without_rgb():
+    act = lambda step: np.zeros(2, dtype=np.int32)
+    _, expected = collect_rollout(100, act=act, num=2, env_name="fruitbot", rand_seed=23)
+    _, actual = collect_rollout(
+        100, act=act, num=2, env_name="fruitbot", rand_seed=23, symbolic_obs=True, rgb_obs=False
+    )
+    assert np.array_equal(expected["rew"], actual["rew"])
+    assert "rgb" not in actual
+    assert actual["entities"].shape[1:] == (2, 32, 5)
+    assert actual["grid"].shape[1:] == (2, 16, 16)
+
+
+def test_render_without_rgb_obs():
+    from procgen import ProcgenEnv
+
+    env = ProcgenEnv(num_envs=1, env_name="fruitbot", symbolic_obs=True, rgb_obs=False, render_mode="rgb_array")
+    env.reset()
+    assert env.render(mode="rgb_array").shape == (512, 512, 3)
+
+    env = ProcgenEnv(num_envs=1, env_name="fruitbot", symbolic_obs=True, rgb_obs=False)
+    env.reset()
+    with pytest.raises(Exception, match="render_mode"):
+        env.render(mode="rgb_array")
+
+
+def test_frame_skip_matches_repeated_actions():
+    skip_env = ProcgenGym3Env(num=1, env_name="starpilot", rand_seed=23, frame_skip=4)
+    env = ProcgenGym3Env(num=1, env_name="starpilot", rand_seed=23)
+    act = np.array([1], dtype=np.int32)
+    for _ in range(10):
+        skip_env.act(act)
+        skip_rew, skip_obs, skip_first = skip_env.observe()
+        total_rew = 0
+        for _ in range(4):
+            env.act(act)
+            rew, obs, first = env.observe()
+            total_rew += rew
+        if first[0] or skip_first[0]:
+            break
+        assert np.array_equal(skip_rew, total_rew)
+        assert np.array_equal(skip_obs["rgb"], obs["rgb"])
+
+
+def test_act_masked_and_reset_env():
+    env = ProcgenGym3Env(num=2, env_name="fruitbot", rand_seed=23)
+    ref_env = ProcgenGym3Env(num=2, env_name="fruitbot", rand_seed=23)
+    act = np.zeros(env.num, dtype=np.int32)
+    for _ in range(20):
+        _, prev_obs, _ = env.observe()
+        prev_obs = prev_obs["rgb"].copy()
+        env.act_masked(act, np.array([True, False]))
+        ref_env.act(act)
+        rew, obs, first = env.observe()
+        _, ref_obs, _ = ref_env.observe()
+        assert np.array_equal(obs["rgb"][0], ref_obs["rgb"][0])
+        assert np.array_equal(obs["rgb"][1], prev_obs[1])
+        assert rew[1] == 0 and not first[1]
+
+    env.reset_env(1, level_seed_gen_seed=5)
+    _, _, first = env.observe()
+    assert first[1] and not first[0]
+
+
+def test_reconfigure_matches_new_env():
+    layout = dict(distribution_mode="easy", fruitbot_num_walls=0, fruitbot_num_good_min=3, fruitbot_reward_positive=7.0)
+    env = ProcgenGym3Env(num=2, env_name="fruitbot", rand_seed=23)
+    ref_env = ProcgenGym3Env(num=2, env_name="fruitbot", rand_seed=23, **layout)
+    env.reconfigure(1, level_seed_gen_seed=5, **layout)
+    ref_env.reset_env(1, level_seed_gen_seed=5)
+    for step in range(200):
+        rew, obs, first = env.observe()
+        ref_rew, ref_obs, ref_first = ref_env.observe()
+        assert np.array_equal(obs["rgb"][1], ref_obs["rgb"][1])
+        assert rew[1] == ref_rew[1] and first[1] == ref_first[1]
+        act = np.full(env.num, step % 9, dtype=np.int32)
+        env.act(act)
+        ref_env.act(act)
+
+
+def test_reconfigure_start_level():
+    env = ProcgenGym3Env(num=2, env_name="coinrun", rand_seed=23, num_levels=1, start_level=0)
+    ref_env = ProcgenGym3Env(num=2, env_name="coinrun", rand_seed=23, num_levels=1, start_level=7)
+    # the start_level on its own keeps the single level
+    env.reconfigure(1, start_level=7)
+    ref_env.reset_env(1)
+    _, obs, _ = env.observe()
+    _, ref_obs, _ = ref_env.observe()
+    assert np.array_equal(obs["rgb"][1], ref_obs["rgb"][1])
+    assert not np.array_equal(obs["rgb"][0], obs["rgb"][1])
+
+
+def test_generate_levels():
+    summaries = []
+    for level_generators in [1, 4]:
+        env = ProcgenGym3Env(num=1, env_name="fruitbot", level_generators=level_generators, fruitbot_num_walls=3)
+        summaries.append(env.generate_levels(100, 300))
+    assert np.array_equal(summaries[0], summaries[1])
+    assert list(summaries[0]["level_seed"]) == list(range(100, 400))
+    assert (summaries[0]["walls"] == 3).all()
+
+    env = ProcgenGym3Env(num=1, env_name="maze", level_generators=2)
+    assert (env.generate_levels(0, 50)["path_length"] >= 0).all()
+
+
+def replay_draw_list(env, commands, env_idx, res):
+    """
+    Draw the commands of one env the way a batch renderer would, sampling the images at the nearest pixel, as a
+    (res, res, 3) float array
+    """
+    frame = np.zeros((res, res, 3))
+    for cmd in commands:
+        if cmd["kind"] == DRAW_FILL:
+            color = int(cmd["color"])
+            alpha = (color >> 24) / 255
+            rgb = np.array([(color >> 16) & 255, (color >> 8) & 255, color & 255]) * alpha
+            x0, y0 = max(math.floor(cmd["x"]), 0), max(math.floor(cmd["y"]), 0)
+            x1, y1 = min(math.ceil(cmd["x"] + cmd["w"]), res), min(math.ceil(cmd["y"] + cmd["h"]), res)
+            if x0 < x1 and y0 < y1:
+                frame[y0:y1, x0:x1] = rgb + frame[y0:y1, x0:x1] * (1 - alpha)
+            continue
+
+        image = env.draw_list_image(cmd["kind"], cmd["asset"], cmd["theme"], env_idx)
+        image_h, image_w = image.shape
+        # the rect is turned by whole quarter turns clockwise around its center
+        quarter_turns = round(float(cmd["rotation"]) / (math.pi / 2)) % 4
+        cx, cy = cmd["x"] + cmd["w"] / 2, cmd["y"] + cmd["h"] / 2
+        box_w, box_h = (cmd["h"], cmd["w"]) if quarter_turns % 2 else (cmd["w"], cmd["h"])
+        x0, y0 = math.floor(cx - box_w / 2 + 0.5), math.floor(cy - box_h / 2 + 0.5)
+        x1, y1 = math.floor(cx + box_w / 2 + 0.5), math.floor(cy + box_h / 2 + 0.5)
+        xs, ys = np.arange(max(x0, 0), min(x1, res)), np.arange(max(y0, 0), min(y1, res))
+        if len(xs) == 0 or len(ys) == 0:
+            continue
+        u, v = np.meshgrid((xs - x0 + 0.5) / (x1 - x0), (ys - y0 + 0.5) / (y1 - y0))
+        su, sv = [(u, v), (v, 1 - u), (1 - u, 1 - v), (1 - v, u)][quarter_turns]
+        if cmd["is_reflected"]:
+            su = 1 - su
+        ix = np.minimum((su * image_w).astype(np.int64), image_w - 1)
+        iy = np.minimum((sv * image_h).astype(np.int64), image_h - 1)
+        pixels = image[iy, ix].astype(np.int64)
+        alpha = ((pixels >> 24) & 255) / 255 * cmd["alpha"]
+        rgb = np.stack([(pixels >> 16) & 255, (pixels >> 8) & 255, pixels & 255], axis=-1) * cmd["alpha"]
+        region = frame[ys[0] : ys[-1] + 1, xs[0] : xs[-1] + 1]
+        frame[ys[0] : ys[-1] + 1, xs[0] : xs[-1] + 1] = rgb + region * (1 - alpha[..., None])
+    return frame
+
+
+@pytest.mark.parametrize("env_name", ["bigfish", "fruitbot", "starpilot"])
+def test_draw_lists_match_observations(env_name):
+    env = ProcgenGym3Env(num=3, env_name=env_name, rand_seed=7, software_render=True)
+    rng = np.random.RandomState(0)
+    for step in range(101):
+        if step % 20 == 0:
+            _, obs, _ = env.observe()
+            counts, commands = env.record_draw_lists()
+            starts = np.concatenate([[0], np.cumsum(counts)])
+            for env_idx in range(env.num):
+                frame = replay_draw_list(
+                    env, commands[starts[env_idx] : starts[env_idx + 1]], env_idx, obs["rgb"].shape[1]
+                )
+                # the software renderer scales the images smoothly, the replay takes the nearest pixel
+                assert np.abs(frame - obs["rgb"][env_idx]).mean() < 8
+        env.act(rng.randint(0, env.ac_space.eltype.n, size=(env.num,), dtype=np.int32))
+
+
+def test_draw_lists():
+    for env_name in ["bigfish", "fruitbot", "starpilot"]:
+        env = ProcgenGym3Env(num=3, env_name=env_name, rand_seed=5)
+        for _ in range(20):
+            env.act(np.random.randint(0, env.ac_space.eltype.n, size=(env.num,), dtype=np.int32))
+        counts, commands = env.record_draw_lists()
+        assert (counts > 0).all() and counts.sum() == len(commands)
+        # every frame starts by clearing it to black
+        starts = np.concatenate([[0], np.cumsum(counts)[:-1]])
+        assert (commands["kind"][starts] == DRAW_FILL).all()
+        assert (commands["color"][starts] == 0xFF000000).all()
+        for cmd in commands[commands["kind"] != DRAW_FILL]:
+            image = env.draw_list_image(cmd["kind"], cmd["asset"], cmd["theme"])
+            assert image is not None and image.size > 0
+
+    env = ProcgenGym3Env(num=2, env_name="coinrun")
+    counts, commands = env.record_draw_lists()
+    assert list(counts) == [-1, -1] and len(commands) == 0
+
+
+def test_tick_mode_paces_observations():
+    env = ProcgenGym3Env(num=2, env_name="fruitbot", rand_seed=23, async_step=True, tick_hz=20)
+    env.observe()
+    start = time.time()
+    for _ in range(5):
+        env.act(np.zeros(env.num, dtype=np.int32))
+        env.observe()
+    # every observe() waits for a new tick
+    assert time.time() - start >= 0.2
+
+
+def test_get_stats():
+    env = ProcgenGym3Env(num=2, env_name="fruitbot", collect_stats=True)
+    for _ in range(10):
+        env.act(np.zeros(env.num, dtype=np.int32))
+        env.observe()
+    stats = env.get_stats()
+    assert stats["fruitbot"]["game_step"]["count"] == 2 * 10
+    assert stats["fruitbot"]["render"]["p50_us"] <= stats["fruitbot"]["render"]["p99_us"]
+    assert "wait" in stats["vecgame"]
+
+
+def test_drain_episode_stats():
+    env = ProcgenGym3Env(num=4, env_name="fruitbot", rand_seed=23, episode_stats=True)
+    returns = np.zeros(env.num)
+    lengths = np.zeros(env.num, dtype=np.int32)
+    expected = []
+    for step in range(1000):
+        env.act(np.full(env.num, step % 9, dtype=np.int32))
+        rew, _, first = env.observe()
+        returns += rew
+        lengths += 1
+        for env_idx in np.nonzero(first)[0]:
+            expected.append((env_idx, returns[env_idx], lengths[env_idx]))
+            returns[env_idx] = 0
+            lengths[env_idx] = 0
+    episodes = env.drain_episode_stats()
+    assert len(episodes) == len(expected) > 0
+    expected.sort(key=lambda e: e[0])
+    assert np.array_equal(episodes["env"], [e[0] for e in expected])
+    assert np.allclose(episodes["return"], [e[1] for e in expected])
+    assert np.array_equal(episodes["length"], [e[2] for e in expected])
+    assert episodes["good_objects"].sum() > 0
+    assert len(env.drain_episode_stats()) == 0
+
+
+def test_replay_level():
+    env = ProcgenGym3Env(num=2, env_name="fruitbot", rand_seed=23, record_actions=True)
+    observations = [env.observe()[1]["rgb"][0].copy()]
+    for step in range(300):
+        env.act(np.full(env.num, step % 9, dtype=np.int32))
+        _, obs, first = env.observe()
+        if first[0]:
+            break
+        observations.append(obs["rgb"][0].copy())
+    else:
+        assert False, "the level didn't end"
+    logs = [log for log in env.drain_level_logs() if log[0] == 0]
+    env_idx, level_seed, actions = logs[0]
+    assert len(actions) == len(observations)
+
+    replay_env = ProcgenGym3Env(num=1, env_name="fruitbot", rand_seed=23)
+    replay_env.replay_level(0, level_seed, actions, checkpoint_interval=16)
+    # out of order, so that some seeks go back to a checkpoint
+    for frame in [len(actions) - 1, 5, 40, 17, 0, len(actions) // 2]:
+        assert replay_env.replay_seek(0, frame) == frame
+        assert np.array_equal(replay_env.observe()[1]["rgb"][0], observations[frame])
+
+
+def test_dump_trace(tmp_path):
+    env = ProcgenGym3Env(num=2, env_name="fruitbot", trace_events=1000)
+    for _ in range(10):
+        env.act(np.zeros(env.num, dtype=np.int32))
+        env.observe()
+    path = str(tmp_path / "trace.json")
+    env.dump_trace(path)
+    with open(path) as f:
+        events = json.load(f)["traceEvents"]
+    steps = [e for e in events if e["ph"] == "X" and e["name"] == "step"]
+    assert sorted(set(e["args"]["env"] for e in steps)) == [0, 1]
+    assert any(e["name"] == "game_step" for e in events)
+
+
+def test_async_step_matches_sync():
+    env = ProcgenGym3Env(num=4, env_name="fruitbot", rand_seed=23, async_step=True)
+    _, obs, _ = env.observe()
+    prev = obs["rgb"].copy()
+    env.act_async(np.zeros(env.num, dtype=np.int32))
+    _, obs, _ = env.wait()
+    stepped = obs["rgb"].copy()
+
+    sync_env = ProcgenGym3Env(num=4, env_name="fruitbot", rand_seed=23)
+    sync_env.act(np.zeros(sync_env.num, dtype=np.int32))
+    _, sync_obs, _ = sync_env.observe()
+    assert np.array_equal(stepped, sync_obs["rgb"])
+    assert not np.array_equal(prev, stepped)
+
+
 @pytest.mark.parametrize("env_name", ENV_NAMES)
 @pytest.mark.parametrize("num_envs", [1, 2, 16])
 def test_multi_speed(env_name, num_envs, benchmark):
@@ -0,0 +1,341 @@
+/*
+
+Env server that hosts VecGames for other processes, which attach through POSIX shared memory
+
+Each of the --slots slots is a VecGame of --num-envs envs with its own stepping threads, stepped by a thread of
+the server whenever the client driving the slot asks for a step. The observations are written straight into the
+shared memory, so a client reads them without any copy or serialization, see shm-protocol.h for the layout and the
+protocol and procgen/shm_env.py for the python client. The remaining arguments are env options, values that are
+numbers are ints, true and false are bools and anything else is a string.
+
+    procgen_server --name /procgen --slots 8 --num-envs 64 env_name=fruitbot num_threads=8 resource_root=procgen/data/assets/
+
+The server runs until it gets SIGINT or SIGTERM, and then removes the shared memory.
+
+*/
+
+#include "libenv.h"
+#include "shm-protocol.h"
+#include <cctype>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <thread>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+// spins before a futex wait, long enough to catch a client that asks for the next step right away
+const int SPIN_ITERATIONS = 4000;
+// how often a waiting slot thread checks for shutdown
+const long SHUTDOWN_POLL_NS = 100 * 1000 * 1000;
+
+static volatile sig_atomic_t stop_requested = 0;
+
+static void handle_stop_signal(int) {
+    stop_requested = 1;
+}
+
+// the region is shared between processes, so these are the non-private futex operations
+static void futex_wait(std::atomic<uint32_t> *addr, uint32_t value, long timeout_ns) {
+    struct timespec timeout;
+    timeout.tv_sec = timeout_ns / 1000000000;
+    timeout.tv_nsec = timeout_ns % 1000000000;
+    syscall(SYS_futex, (uint32_t *)(addr), FUTEX_WAIT, value, &timeout, nullptr, 0);
+}
+
+static void futex_wake(std::atomic<uint32_t> *addr) {
+    syscall(SYS_futex, (uint32_t *)(addr), FUTEX_WAKE, INT32_MAX, nullptr, nullptr, 0);
+}
+
+static size_t align_up(size_t n) {
+    return (n + SHM_ALIGNMENT - 1) / SHM_ALIGNMENT * SHM_ALIGNMENT;
+}
+
+static size_t tensortype_num_bytes(const libenv_tensortype &t) {
+    size_t n = t.dtype == LIBENV_DTYPE_UINT8 ? 1 : 4;
+    for (int d = 0; d < t.ndim; d++) {
+        n *= t.shape[d];
+    }
+    return n;
+}
+
+static std::vector<libenv_tensortype> get_tensortypes(libenv_env *env, libenv_space_name space) {
+    std::vector<libenv_tensortype> types(libenv_get_tensortypes(env, space, nullptr));
+    libenv_get_tensortypes(env, space, types.data());
+    return types;
+}
+
+// libenv options point at their values, so the values are kept alongside them
+class Options {
+  public:
+    // replaces an option that's already there, so the defaults can be overridden
+    void add(const std::string &name, const std::string &value) {
+        for (size_t k = 0; k < items.size(); k++) {
+            if (name == items[k].name) {
+                items.erase(items.begin() + k);
+                values.erase(values.begin() + k);
+                break;
+            }
+        }
+        libenv_option opt;
+        memset(&opt, 0, sizeof(opt));
+        strncpy(opt.name, name.c_str(), LIBENV_MAX_NAME_LEN - 1);
+        bool is_int = !value.empty() && (isdigit(value[0]) || (value[0] == '-' && value.size() > 1));
+        std::vector<uint8_t> data;
+        if (value == "true" || value == "false") {
+            opt.dtype = LIBENV_DTYPE_UINT8;
+            opt.count = 1;
+            data.push_back(value == "true");
+        } else if (is_int) {
+            opt.dtype = LIBENV_DTYPE_INT32;
+            opt.count = 1;
+            int32_t v = atoi(value.c_str());
+            data.resize(sizeof(v));
+            memcpy(data.data(), &v, sizeof(v));
+        } else {
+            opt.dtype = LIBENV_DTYPE_UINT8;
+            opt.count = (int)(value.size());
+            data.assign(value.begin(), value.end());
+        }
+        items.push_back(opt);
+        values.push_back(data);
+    }
+
+    void add_int(const std::string &name, int32_t value) {
+        add(name, std::to_string(value));
+    }
+
+    // the pointers are only filled in here, once the value vectors are done growing
+    libenv_options get() {
+        for (size_t k = 0; k < items.size(); k++) {
+            items[k].data = values[k].data();
+        }
+        libenv_options options;
+        options.items = items.data();
+        options.count = (int)(items.size());
+        return options;
+    }
+
+  private:
+    std::vector<libenv_option> items;
+    std::vector<std::vector<uint8_t>> values;
+};
+
+static void describe_tensors(const std::vector<libenv_tensortype> &types, ShmTensor *out, size_t &slot_size, int num_envs) {
+    if (types.size() > (size_t)(SHM_MAX_TENSORS)) {
+        fprintf(stderr, "too many tensors for the shared memory header\n");
+        exit(EXIT_FAILURE);
+    }
+    for (size_t t = 0; t < types.size(); t++) {
+        ShmTensor &tensor = out[t];
+        memcpy(tensor.name, types[t].name, LIBENV_MAX_NAME_LEN);
+        tensor.dtype = types[t].dtype;
+        tensor.ndim = types[t].ndim;
+        for (int d = 0; d < LIBENV_MAX_NDIM; d++) {
+            tensor.shape[d] = d < types[t].ndim ? types[t].shape[d] : 0;
+        }
+        tensor.env_size = tensortype_num_bytes(types[t]);
+        tensor.offset = slot_size;
+        slot_size = align_up(slot_size + tensor.env_size * num_envs);
+    }
+}
+
+// the buffer of env e for tensor t is at t * num_envs + e, see convert_bufs() in vecgame.cpp
+static void add_env_ptrs(const ShmTensor *tensors, int num_tensors, int num_envs, uint8_t *slot, std::vector<void *> &ptrs) {
+    for (int t = 0; t < num_tensors; t++) {
+        for (int e = 0; e < num_envs; e++) {
+            ptrs.push_back(slot + tensors[t].offset + e * tensors[t].env_size);
+        }
+    }
+}
+
+static void serve_slot(libenv_env *env, ShmHeader *header, ShmSlotControl *control) {
+    uint32_t done = control->done_seq.load(std::memory_order_relaxed);
+    while (!header->shutdown.load(std::memory_order_relaxed)) {
+        uint32_t request = done;
+        for (int i = 0; i < SPIN_ITERATIONS && request == done; i++) {
+            request = control->request_seq.load(std::memory_order_acquire);
+        }
+        if (request == done) {
+            futex_wait(&control->request_seq, done, SHUTDOWN_POLL_NS);
+            continue;
+        }
+
+        libenv_act(env);
+        libenv_observe(env);
+
+        done = request;
+        control->done_seq.store(done, std::memory_order_release);
+        futex_wake(&control->done_seq);
+    }
+}
+
+static void usage() {
+    fprintf(stderr, "usage: procgen_server [--name /procgen] [--slots N] [--num-envs N] env_name=NAME [option=value ...]\n");
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv) {
+    std::string name = "/procgen";
+    int num_slots = 1;
+    int num_envs = 64;
+    int rand_seed = 0;
+    Options opts;
+    // the defaults of env.py
+    opts.add_int("num_levels", 0);
+    opts.add_int("start_level", 0);
+    opts.add_int("num_actions", 15);
+    bool has_env_name = false;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg.rfind("--", 0) == 0) {
+            if (i + 1 >= argc) {
+                usage();
+            }
+            std::string value = argv[++i];
+            if (arg == "--name") {
+                name = value;
+            } else if (arg == "--slots") {
+                num_slots = atoi(value.c_str());
+            } else if (arg == "--num-envs") {
+                num_envs = atoi(value.c_str());
+            } else {
+                usage();
+            }
+            continue;
+        }
+        size_t eq = arg.find('=');
+        if (eq == std::string::npos || eq == 0) {
+            usage();
+        }
+        if (arg.substr(0, eq) == "rand_seed") {
+            rand_seed = atoi(arg.c_str() + eq + 1);
+        } else {
+            opts.add(arg.substr(0, eq), arg.substr(eq + 1));
+        }
+        has_env_name = has_env_name || arg.substr(0, eq) == "env_name";
+    }
+    if (!has_env_name || num_slots <= 0 || num_envs <= 0 || name.empty() || name[0] != '/') {
+        usage();
+    }
+
+    // every slot plays different levels, the rand_seed option is the seed of the first slot
+    std::vector<libenv_env *> envs(num_slots);
+    for (int s = 0; s < num_slots; s++) {
+        Options slot_opts = opts;
+        slot_opts.add_int("rand_seed", rand_seed + s);
+        envs[s] = libenv_make(num_envs, slot_opts.get());
+    }
+
+    auto ob_types = get_tensortypes(envs[0], LIBENV_SPACE_OBSERVATION);
+    auto info_types = get_tensortypes(envs[0], LIBENV_SPACE_INFO);
+    auto ac_types = get_tensortypes(envs[0], LIBENV_SPACE_ACTION);
+    if (ac_types.size() != 1 || ac_types[0].dtype != LIBENV_DTYPE_INT32 || ac_types[0].ndim != 0) {
+        fprintf(stderr, "the server only supports a single int32 action\n");
+        return EXIT_FAILURE;
+    }
+
+    ShmHeader layout;
+    memset((void *)(&layout), 0, sizeof(layout));
+    layout.version = SHM_VERSION;
+    layout.num_actions = ac_types[0].high.int32 + 1;
+    layout.num_slots = num_slots;
+    layout.num_envs = num_envs;
+    layout.num_obs = (int32_t)(ob_types.size());
+    layout.num_info = (int32_t)(info_types.size());
+
+    size_t slot_size = 0;
+    describe_tensors(ob_types, layout.obs, slot_size, num_envs);
+    describe_tensors(info_types, layout.info, slot_size, num_envs);
+    layout.action_offset = slot_size;
+    slot_size = align_up(slot_size + sizeof(int32_t) * num_envs);
+    layout.rew_offset = slot_size;
+    slot_size = align_up(slot_size + sizeof(float) * num_envs);
+    layout.first_offset = slot_size;
+    slot_size = align_up(slot_size + num_envs);
+    layout.slot_size = slot_size;
+    layout.controls_offset = align_up(sizeof(ShmHeader));
+    layout.slots_offset = align_up(layout.controls_offset + sizeof(ShmSlotControl) * num_slots);
+    size_t region_size = layout.slots_offset + slot_size * num_slots;
+
+    // a region left over from a server that didn't shut down cleanly is replaced
+    shm_unlink(name.c_str());
+    int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0 || ftruncate(fd, (off_t)(region_size)) != 0) {
+        fprintf(stderr, "failed to create shared memory %s: %s\n", name.c_str(), strerror(errno));
+        return EXIT_FAILURE;
+    }
+    auto region = (uint8_t *)(mmap(nullptr, region_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0));
+    close(fd);
+    if (region == MAP_FAILED) {
+        fprintf(stderr, "failed to map shared memory %s: %s\n", name.c_str(), strerror(errno));
+        shm_unlink(name.c_str());
+        return EXIT_FAILURE;
+    }
+
+    // ftruncate zero fills the region, so the counters and the magic start at 0
+    auto header = (ShmHeader *)(region);
+    memcpy((void *)(&header->num_slots), (const void *)(&layout.num_slots), sizeof(ShmHeader) - offsetof(ShmHeader, num_slots));
+    header->version = SHM_VERSION;
+    header->num_actions = layout.num_actions;
+    auto controls = (ShmSlotControl *)(region + layout.controls_offset);
+
+    for (int s = 0; s < num_slots; s++) {
+        uint8_t *slot = region + layout.slots_offset + s * slot_size;
+        std::vector<void *> ob_ptrs, info_ptrs, ac_ptrs;
+        add_env_ptrs(header->obs, header->num_obs, num_envs, slot, ob_ptrs);
+        add_env_ptrs(header->info, header->num_info, num_envs, slot, info_ptrs);
+        for (int e = 0; e < num_envs; e++) {
+            ac_ptrs.push_back(slot + layout.action_offset + e * sizeof(int32_t));
+        }
+        libenv_buffers bufs;
+        bufs.ob = ob_ptrs.data();
+        bufs.rew = (float *)(slot + layout.rew_offset);
+        bufs.first = slot + layout.first_offset;
+        bufs.info = info_ptrs.data();
+        bufs.ac = ac_ptrs.data();
+        libenv_set_buffers(envs[s], &bufs);
+        // the first observation is there before any client attaches
+        libenv_observe(envs[s]);
+    }
+
+    std::atomic_thread_fence(std::memory_order_release);
+    header->magic = SHM_MAGIC;
+
+    signal(SIGINT, handle_stop_signal);
+    signal(SIGTERM, handle_stop_signal);
+
+    std::vector<std::thread> threads;
+    for (int s = 0; s < num_slots; s++) {
+        threads.emplace_back(serve_slot, envs[s], header, &controls[s]);
+    }
+    fprintf(stderr, "serving %d slots of %d envs at %s\n", num_slots, num_envs, name.c_str());
+
+    while (!stop_requested) {
+        pause();
+    }
+
+    header->shutdown.store(1);
+    for (int s = 0; s < num_slots; s++) {
+        // a client waiting for a step sees it never finish, waking it lets it check shutdown
+        futex_wake(&controls[s].done_seq);
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    for (auto env : envs) {
+        libenv_close(env);
+    }
+    munmap(region, region_size);
+    shm_unlink(name.c_str());
+    return 0;
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+/*
+
+Layout of the shared memory region of procgen_server, see procgen-server.cpp, mirrored by procgen/shm_env.py
+
+The region starts with a ShmHeader, followed by one ShmSlotControl per slot and then the buffers of each slot. A
+slot is one VecGame of num_envs envs, driven by one client at a time. Each buffer holds a tensor for all the envs of
+the slot one after the other, so a client can view it as a (num_envs, *shape) array without copying.
+
+A step is a handshake on the two counters of the slot's ShmSlotControl. The client writes the actions and then
+increments request_seq, the server steps the VecGame, which writes its results straight into the slot's buffers, and
+then sets done_seq to request_seq. Each counter has a single writer, and each side waits for the other's counter with
+a short spin followed by a futex wait, so an idle slot costs nothing. There is only one step in flight per slot, so
+more clients on more cores means more slots.
+
+All integers are little endian, a client on another architecture isn't supported. The python client reads and
+writes the counters with plain loads and stores, which are only ordered enough on x86, so it refuses to run elsewhere.
+
+*/
+
+#include "libenv.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+const uint32_t SHM_MAGIC = 0x4e454750; // "PGEN"
+const uint32_t SHM_VERSION = 2;
+const int SHM_MAX_TENSORS = 16;
+// the offset of each buffer is a multiple of this
+const size_t SHM_ALIGNMENT = 64;
+
+struct ShmTensor {
+    char name[LIBENV_MAX_NAME_LEN];
+    int32_t dtype;
+    int32_t ndim;
+    int32_t shape[LIBENV_MAX_NDIM];
+    // from the start of the slot's buffers
+    uint64_t offset;
+    // the size of the tensor of one env, the buffer is num_envs times this
+    uint64_t env_size;
+};
+
+struct ShmHeader {
+    // written last, once everything else is in place
+    uint32_t magic;
+    uint32_t version;
+    // set by the server when it's stopping, a client waiting on a slot sees done_seq not move and should give up
+    std::atomic<uint32_t> shutdown;
+    // the actions are ints from 0 to num_actions - 1
+    int32_t num_actions;
+    int32_t num_slots;
+    int32_t num_envs;
+    int32_t num_obs;
+    int32_t num_info;
+    // from the start of the region
+    uint64_t controls_offset;
+    uint64_t slots_offset;
+    uint64_t slot_size;
+    // from the start of each slot's buffers, int32 actions, float32 rewards and uint8 first flags, num_envs of each
+    uint64_t action_offset;
+    uint64_t rew_offset;
+    uint64_t first_offset;
+    ShmTensor obs[SHM_MAX_TENSORS];
+    ShmTensor info[SHM_MAX_TENSORS];
+};
+
+// the counters are on their own cache lines, so the client and the server don't write to the same line
+struct ShmSlotControl {
+    alignas(64) std::atomic<uint32_t> request_seq;
+    alignas(64) std::atomic<uint32_t> done_seq;
+};
+
+static_assert(sizeof(std::atomic<uint32_t>) == 4 && std::atomic<uint32_t>::is_always_lock_free, "futexes need plain 32 bit counters");
+static_assert(sizeof(ShmTensor) == 216, "ShmTensor layout is shared with shm_env.py");
+static_assert(offsetof(ShmHeader, obs) == 80, "ShmHeader layout is shared with shm_env.py");
+static_assert(sizeof(ShmSlotControl) == 128, "ShmSlotControl layout is shared with shm_env.py");
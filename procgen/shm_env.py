@@ -0,0 +1,166 @@
+"""
+Client of procgen_server, which steps VecGames for other processes through shared memory, see
+server/shm-protocol.h for the layout and the protocol.
+
+Each ShmProcgenEnv drives one slot of the server, and there should be only one client per slot. The observations
+returned by observe() are views of the shared memory, which the next act() overwrites, so copy them to keep them.
+The counters are read and written with plain loads and stores, which is only enough ordering on x86, so the client
+refuses to run on other machines.
+"""
+
+import ctypes
+import mmap
+import os
+import platform
+import struct
+
+import gym3
+import numpy as np
+from gym3 import types
+
+SHM_MAGIC = 0x4E454750
+SHM_VERSION = 2
+SHM_MAX_TENSORS = 16
+
+# the fields of ShmHeader up to obs, then the ShmTensor array of obs and the one of info
+HEADER_FORMAT = "<IIIiiiiiQQQQQQ"
+TENSOR_FORMAT = "<128sii16iQQ"
+SLOT_CONTROL_SIZE = 128
+DONE_SEQ_OFFSET = 64
+
+# LIBENV_DTYPE_* in libenv.h
+DTYPES = {1: np.uint8, 2: np.int32, 3: np.float32}
+
+# x86_64 only, see the module docstring
+SYS_FUTEX = 202
+FUTEX_WAIT = 0
+FUTEX_WAKE = 1
+
+
+class _Timespec(ctypes.Structure):
+    _fields_ = [("tv_sec", ctypes.c_long), ("tv_nsec", ctypes.c_long)]
+
+
+def _read_tensors(buf, offset, count):
+    size = struct.calcsize(TENSOR_FORMAT)
+    tensors = []
+    for i in range(count):
+        fields = struct.unpack_from(TENSOR_FORMAT, buf, offset + i * size)
+        name = fields[0].split(b"\0", 1)[0].decode("utf8")
+        dtype, ndim = fields[1], fields[2]
+        shape = tuple(fields[3 : 3 + ndim])
+        tensors.append((name, DTYPES[dtype], shape, fields[19]))
+    return tensors
+
+
+# the space of a tensor the server publishes, like gym3 makes them for ProcgenGym3Env
+def _space(dtype, shape):
+    if dtype == np.float32:
+        eltype = types.Real()
+    else:
+        n = 256 if dtype == np.uint8 else 2 ** 31
+        eltype = types.Discrete(n, dtype_name=np.dtype(dtype).name)
+    return types.TensorType(eltype=eltype, shape=shape)
+
+
+class ShmProcgenEnv(gym3.Env):
+    """
+    Steps slot `slot` of the procgen_server serving at `name`, the --name given to the server.
+    """
+
+    def __init__(self, name="/procgen", slot=0, wait_timeout=10.0):
+        self._mm = None
+        if platform.machine() not in ("x86_64", "AMD64"):
+            raise RuntimeError(f"ShmProcgenEnv needs the memory ordering of x86, not {platform.machine()}")
+        fd = os.open("/dev/shm/" + name.lstrip("/"), os.O_RDWR)
+        try:
+            self._mm = mmap.mmap(fd, 0)
+        finally:
+            os.close(fd)
+
+        header = struct.unpack_from(HEADER_FORMAT, self._mm, 0)
+        (magic, version, _shutdown, num_actions, num_slots, num_envs, num_obs, num_info) = header[:8]
+        (controls_offset, slots_offset, slot_size, action_offset, rew_offset, first_offset) = header[8:]
+        if magic != SHM_MAGIC:
+            raise RuntimeError(f"{name} isn't ready or isn't a procgen_server")
+        if version != SHM_VERSION:
+            raise RuntimeError(f"{name} has version {version}, this client supports {SHM_VERSION}")
+        if not 0 <= slot < num_slots:
+            raise ValueError(f"slot {slot} is out of range, the server has {num_slots} slots")
+
+        tensors_offset = struct.calcsize(HEADER_FORMAT)
+        tensors_size = SHM_MAX_TENSORS * struct.calcsize(TENSOR_FORMAT)
+        slot_start = slots_offset + slot * slot_size
+
+        def view(dtype, offset, shape):
+            count = num_envs * int(np.prod(shape))
+            arr = np.frombuffer(self._mm, dtype=dtype, count=count, offset=slot_start + offset)
+            return arr.reshape((num_envs,) + shape)
+
+        self._obs = {}
+        ob_space = {}
+        for name_, dtype, shape, offset in _read_tensors(self._mm, tensors_offset, num_obs):
+            self._obs[name_] = view(dtype, offset, shape)
+            ob_space[name_] = _space(dtype, shape)
+        self._info = {}
+        for name_, dtype, shape, offset in _read_tensors(
+            self._mm, tensors_offset + tensors_size, num_info
+        ):
+            self._info[name_] = view(dtype, offset, shape)
+        self._ac = view(np.int32, action_offset, ())
+        self._rew = view(np.float32, rew_offset, ())
+        self._first = view(np.uint8, first_offset, ())
+
+        control = controls_offset + slot * SLOT_CONTROL_SIZE
+        self._request_seq = ctypes.c_uint32.from_buffer(self._mm, control)
+        self._done_seq = ctypes.c_uint32.from_buffer(self._mm, control + DONE_SEQ_OFFSET)
+        self._shutdown = ctypes.c_uint32.from_buffer(self._mm, 8)
+        self._libc = ctypes.CDLL(None, use_errno=True)
+        self._sys_futex = SYS_FUTEX
+        self._wait_timeout = wait_timeout
+
+        super().__init__(
+            ob_space=types.DictType(**ob_space),
+            ac_space=types.TensorType(eltype=types.Discrete(num_actions), shape=()),
+            num=num_envs,
+        )
+
+    def _futex(self, counter, op, value, timeout=None):
+        ts = None
+        if timeout is not None:
+            ts = ctypes.byref(_Timespec(int(timeout), int((timeout % 1) * 1e9)))
+        self._libc.syscall(
+            self._sys_futex, ctypes.byref(counter), op, ctypes.c_uint32(value), ts, None, 0
+        )
+
+    def act(self, ac):
+        self._ac[:] = ac
+        request = (self._request_seq.value + 1) & 0xFFFFFFFF
+        self._request_seq.value = request
+        self._futex(self._request_seq, FUTEX_WAKE, 1)
+        waited = 0.0
+        while True:
+            done = self._done_seq.value
+            if done == request:
+                return
+            if self._shutdown.value:
+                raise RuntimeError("procgen_server stopped")
+            if waited >= self._wait_timeout:
+                raise TimeoutError("procgen_server didn't finish the step")
+            # short waits, so a server that's stopping is noticed
+            self._futex(self._done_seq, FUTEX_WAIT, done, timeout=0.1)
+            waited += 0.1
+
+    def observe(self):
+        return self._rew, self._obs, self._first.astype(bool)
+
+    def get_info(self):
+        return [{k: v[i] for k, v in self._info.items()} for i in range(self.num)]
+
+    def close(self):
+        if self._mm is not None:
+            # the ctypes and numpy views have to go before the mapping can be closed
+            self._obs = self._info = self._ac = self._rew = self._first = None
+            self._request_seq = self._done_seq = self._shutdown = None
+            self._mm.close()
+            self._mm = None
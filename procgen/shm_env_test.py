@@ -0,0 +1,73 @@
+import os
+import platform
+import signal
+import struct
+import subprocess
+import time
+
+import numpy as np
+import pytest
+
+from procgen import ProcgenGym3Env
+
+SCRIPT_DIR = os.path.dirname(os.path.abspath(__file__))
+
+
+def _server_path():
+    for build_dir in ["relwithdebinfo", os.path.join("relwithdebinfo", "RelWithDebInfo")]:
+        path = os.path.join(SCRIPT_DIR, ".build", build_dir, "procgen_server")
+        if os.path.exists(path):
+            return path
+    pytest.skip("procgen_server isn't built")
+
+
+def _option_arg(name, value):
+    if isinstance(value, bool):
+        value = "true" if value else "false"
+    return f"{name}={value}"
+
+
+@pytest.mark.skipif(
+    platform.system() != "Linux" or platform.machine() != "x86_64", reason="procgen_server needs linux on x86"
+)
+def test_server_matches_in_process_env():
+    from .shm_env import ShmProcgenEnv
+
+    env = ProcgenGym3Env(num=3, env_name="fruitbot", rand_seed=11, symbolic_obs=True)
+    name = f"/procgen_test_{os.getpid()}"
+    # the server's first slot gets the options and the rand_seed of env, so it plays the same levels
+    args = [_server_path(), "--name", name, "--slots", "1", "--num-envs", str(env.num)]
+    args += [_option_arg(k, v) for k, v in env.options.items()]
+    server = subprocess.Popen(args)
+    client = None
+    try:
+        for _ in range(300):
+            try:
+                client = ShmProcgenEnv(name=name)
+                break
+            except (OSError, RuntimeError, ValueError, struct.error):
+                # the region isn't there or isn't filled in yet
+                assert server.poll() is None
+                time.sleep(0.1)
+        assert client is not None
+        assert client.num == env.num
+        assert client.ac_space.eltype.n == env.ac_space.eltype.n
+        assert set(client.ob_space.keys()) == set(env.ob_space.keys())
+        assert type(client.ob_space["entities"].eltype) == type(env.ob_space["entities"].eltype)
+
+        for _ in range(100):
+            rew, obs, first = env.observe()
+            client_rew, client_obs, client_first = client.observe()
+            assert np.array_equal(rew, client_rew)
+            assert np.array_equal(first, client_first)
+            for key in obs:
+                assert np.array_equal(obs[key], client_obs[key])
+            ac = np.random.randint(0, env.ac_space.eltype.n, size=(env.num,), dtype=np.int32)
+            env.act(ac)
+            client.act(ac)
+    finally:
+        if client is not None:
+            client.close()
+        server.send_signal(signal.SIGINT)
+        server.wait(timeout=30)
+    assert server.returncode == 0
@@ -2,13 +2,15 @@
 #include "resources.h"
 #include "assetgen.h"
 #include "qt-utils.h"
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <tuple>
+#include <cstring>
 
 const float MAXVTHETA = 15 * PI / 180;
 const float MIXRATEROT = 0.5f;
 
-// A small constant buffer for handling collision detction and object pushing
-const float POS_EPS = -0.001f;
-
 // When the grid isn't integer aligned, consecutive blocks render with small gaps between them
 // This hack closes the gaps
 const float RENDER_EPS = 0.02f;
@@ -19,9 +21,53 @@ const int USE_ASSET_THRESHOLD = 100;
 const int MAX_ASSETS = USE_ASSET_THRESHOLD;
 const int MAX_IMAGE_THEMES = 10;
 
+/*
+  The assets only depend on the game, the type and theme, and the asset seed for the generated ones, so they're
+  shared by every instance in the process rather than each env holding its own copies (and reflections).
+  asset_rand_gen is part of the serialized state, so its state after generating is kept as well, that way a game
+  ends up in the same state whether or not another instance generated the asset first.
+*/
+struct SharedAsset {
+    std::shared_ptr<QImage> asset;
+    std::shared_ptr<QImage> reflection;
+    float aspect_ratio;
+    int num_themes;
+    bool generated;
+    RandGen rand_gen_after;
+};
+
+// game name, type, theme, use_generated_assets, fixed_asset_seed, rand_gen_kind
+typedef std::tuple<std::string, int, int, bool, int, int> SharedAssetKey;
+
+static std::mutex shared_assets_mutex;
+static std::map<SharedAssetKey, SharedAsset> shared_assets;
+
+/*
+  Which shared asset each img_idx of a game is drawn with, one table per combination of the options that pick the
+  assets, restrict_themes included since it masks the themes. A game only keeps a pointer to its table and a bit per
+  img_idx that it initialized itself, which it must have done before reading the entry so that asset_rand_gen goes
+  through the same states as if it had the assets to itself. The entries are written under shared_assets_mutex and
+  read without it, one game can read an entry while another initializes it as well, so they're atomic, the release
+  of the write and the acquire of the read make the asset it points to visible to the reader.
+*/
+struct SharedAssetTable {
+    // USE_ASSET_THRESHOLD * MAX_IMAGE_THEMES entries, null until initialized
+    std::unique_ptr<std::atomic<const SharedAsset *>[]> assets;
+
+    const SharedAsset *get(int img_idx) const {
+        return assets[img_idx].load(std::memory_order_acquire);
+    }
+};
+
+// game name, use_generated_assets, fixed_asset_seed, rand_gen_kind, restrict_themes
+typedef std::tuple<std::string, bool, int, int, bool> SharedAssetTableKey;
+
+static std::map<SharedAssetTableKey, SharedAssetTable> shared_asset_tables;
+
 BasicAbstractGame::BasicAbstractGame(std::string name)
     : Game(name) {
     char_dim = 5;
+    basic_step_object_fn = &BasicAbstractGame::step_object_kernel<BasicAbstractGame>;
 
     main_width = 0;
     main_height = 0;
@@ -52,6 +98,14 @@ BasicAbstractGame::~BasicAbstractGame() {
 }
 
 void BasicAbstractGame::game_init() {
+    asset_rand_gen.kind = options.rand_gen_kind;
+    entities.reserve(ENTITY_CAPACITY);
+    entity_pool->reserve(ENTITY_CAPACITY);
+
+    if (!options.step_kernels) {
+        basic_step_object_fn = &BasicAbstractGame::step_object_kernel<BasicAbstractGame>;
+    }
+
     if (!options.use_generated_assets) {
         load_background_images();
     }
@@ -65,19 +119,27 @@ void BasicAbstractGame::game_init() {
         use_procgen_background = false;
     }
 
-    basic_assets.clear();
-    basic_reflections.clear();
-    asset_aspect_ratios.clear();
-    asset_num_themes.clear();
-
-    basic_assets.resize(USE_ASSET_THRESHOLD * MAX_IMAGE_THEMES, nullptr);
-    basic_reflections.resize(USE_ASSET_THRESHOLD * MAX_IMAGE_THEMES, nullptr);
-    asset_aspect_ratios.resize(USE_ASSET_THRESHOLD * MAX_IMAGE_THEMES, 0);
-    asset_num_themes.resize(USE_ASSET_THRESHOLD, 0);
+    sprite_cache.clear();
+
+    {
+        auto key = SharedAssetTableKey(game_name, options.use_generated_assets, fixed_asset_seed, options.rand_gen_kind, options.restrict_themes);
+        std::lock_guard<std::mutex> lock(shared_assets_mutex);
+        auto &table = shared_asset_tables[key];
+        // allocated once, the other games read it without the lock
+        if (table.assets == nullptr) {
+            int num_assets = USE_ASSET_THRESHOLD * MAX_IMAGE_THEMES;
+            table.assets.reset(new std::atomic<const SharedAsset *>[num_assets]);
+            for (int i = 0; i < num_assets; i++) {
+                table.assets[i].store(nullptr, std::memory_order_relaxed);
+            }
+        }
+        asset_table = &table;
+    }
+    asset_initialized.assign(USE_ASSET_THRESHOLD * MAX_IMAGE_THEMES, false);
 }
 
 void BasicAbstractGame::initialize_asset_if_necessary(int img_idx) {
-    if (basic_assets.at(img_idx) != nullptr)
+    if (asset_initialized.at(img_idx))
         return;
 
     int type = img_idx % MAX_ASSETS;
@@ -85,6 +147,23 @@ void BasicAbstractGame::initialize_asset_if_necessary(int img_idx) {
 
     theme = mask_theme_if_necessary(theme, type);
 
+    auto key = SharedAssetKey(game_name, type, theme, options.use_generated_assets, fixed_asset_seed, options.rand_gen_kind);
+    // held while loading so that each asset is only created once
+    std::lock_guard<std::mutex> lock(shared_assets_mutex);
+    auto it = shared_assets.find(key);
+    if (it == shared_assets.end()) {
+        it = shared_assets.emplace(key, create_asset(type, theme)).first;
+    }
+    const auto &shared = it->second;
+
+    asset_table->assets[img_idx].store(&shared, std::memory_order_release);
+    asset_initialized[img_idx] = true;
+    if (shared.generated) {
+        asset_rand_gen = shared.rand_gen_after;
+    }
+}
+
+SharedAsset BasicAbstractGame::create_asset(int type, int theme) {
     std::shared_ptr<QImage> asset_ptr = nullptr;
     float aspect_ratio;
     int num_themes;
@@ -98,7 +177,8 @@ void BasicAbstractGame::initialize_asset_if_necessary(int img_idx) {
         }
     }
 
-    if (names.size() == 0) {
+    bool generated = names.size() == 0;
+    if (generated) {
         AssetGen pgen(&asset_rand_gen);
         asset_rand_gen.seed(fixed_asset_seed + type);
 
@@ -114,18 +194,14 @@ void BasicAbstractGame::initialize_asset_if_necessary(int img_idx) {
         aspect_ratio = asset_ptr->width() * 1.0 / asset_ptr->height();
     }
 
-    basic_assets[img_idx] = asset_ptr;
-    asset_aspect_ratios[img_idx] = aspect_ratio;
-    asset_num_themes[type] = num_themes;
-
     std::shared_ptr<QImage> reflection_ptr(new QImage(asset_ptr->mirrored(true, false)));
-    basic_reflections[img_idx] = reflection_ptr;
+    return SharedAsset{asset_ptr, reflection_ptr, aspect_ratio, num_themes, generated, asset_rand_gen};
 }
 
 void BasicAbstractGame::fill_elem(int x, int y, int dx, int dy, char elem) {
     for (int j = 0; j < dx; j++) {
         for (int k = 0; k < dy; k++) {
-            grid.set(x + j, y + k, elem);
+            set_obj(x + j, y + k, elem);
         }
     }
 }
@@ -158,6 +234,7 @@ void BasicAbstractGame::check_grid_collisions(const std::shared_ptr<Entity> &ent
             int grid_type = get_obj_from_floats(x, y);
 
             if (grid_type != SPACE) {
+                entity_grid.invalidate();
                 handle_grid_collision(ent, grid_type, x, y);
             }
         }
@@ -181,7 +258,7 @@ int BasicAbstractGame::get_obj(int x, int y) {
     if (!grid.contains(x, y)) {
         return out_of_bounds_object;
     }
-    return grid.get(x, y);
+    return grid.get_unchecked(x, y);
 }
 
 int BasicAbstractGame::to_grid_idx(int x, int y) {
@@ -199,33 +276,41 @@ int BasicAbstractGame::get_obj(int idx) {
     if (!grid.contains_index(idx)) {
         return out_of_bounds_object;
     }
-    return grid.get_index(idx);
+    return grid.get_index_unchecked(idx);
 }
 
 std::vector<int> BasicAbstractGame::get_cells_with_type(int type) {
     std::vector<int> cells;
-
-    for (int i = 0; i < grid_size; i++) {
-        if (grid.get_index(i) == type) {
-            cells.push_back(i);
-        }
-    }
-
+    cell_index.get_cells(type, cells);
     return cells;
 }
 
 void BasicAbstractGame::set_obj(int idx, int elem) {
-    grid.set_index(idx, elem);
+    fassert(elem == GridCell(elem));
+    fassert(grid.contains_index(idx));
+    set_cell(idx, elem);
 }
 
 void BasicAbstractGame::set_obj(int x, int y, int elem) {
-    grid.set(x, y, elem);
+    fassert(elem == GridCell(elem));
+    fassert(grid.contains(x, y));
+    set_cell(grid.to_index(x, y), elem);
+}
+
+void BasicAbstractGame::set_cell(int idx, int elem) {
+    cell_index.update(idx, grid.get_index_unchecked(idx), elem);
+    grid.set_index_unchecked(idx, elem);
+}
+
+// after the whole grid was replaced
+void BasicAbstractGame::reindex_grid() {
+    cell_index.build(grid.data, grid.w, grid.h);
 }
 
 std::shared_ptr<Entity> BasicAbstractGame::spawn_child(const std::shared_ptr<Entity> &src, int type, float obj_r, bool match_vel) {
     float vx = match_vel ? src->vx : 0;
     float vy = match_vel ? src->vy : 0;
-    auto child = std::make_shared<Entity>(src->x, src->y, vx, vy, obj_r, type);
+    auto child = make_entity(src->x, src->y, vx, vy, obj_r, type);
     entities.push_back(child);
     return child;
 }
@@ -238,137 +323,7 @@ float BasicAbstractGame::get_theta(const std::shared_ptr<Entity> &src, const std
 }
 
 bool BasicAbstractGame::push_obj(const std::shared_ptr<Entity> &src, const std::shared_ptr<Entity> &target, bool is_horizontal, int depth) {
-    float rsum = is_horizontal ? (src->rx + target->rx) : (src->ry + target->ry);
-    float delx = target->x - src->x;
-    float dely = target->y - src->y;
-    float t_vx = 0;
-    float t_vy = 0;
-
-    if (is_horizontal) {
-        t_vx = src->x + sign(delx) * rsum - target->x;
-    } else {
-        t_vy = src->y + sign(dely) * rsum - target->y;
-    }
-
-    bool block = false;
-
-    // Rare numerical conditions (dependent on POS_EPS) could cause infinite loops.
-    // For now we break quit after a small depth.
-    if (depth < 5) {
-        block = sub_step(target, t_vx, t_vy, depth + 1);
-    }
-
-    if (is_horizontal) {
-        target->vx = 0;
-    } else {
-        target->vy = 0;
-    }
-
-    return block;
-}
-
-bool BasicAbstractGame::sub_step(const std::shared_ptr<Entity> &obj, float _vx, float _vy, int depth) {
-    if (obj->will_erase)
-        return false;
-
-    float ny = obj->y + _vy;
-    float nx = obj->x + _vx;
-
-    float margin = 0.98f;
-
-    bool is_horizontal = _vx != 0;
-
-    bool block = false;
-    bool reflect = false;
-
-    for (int i = 0; i < 2; i++) {
-        for (int j = 0; j < 2; j++) {
-            int type2 = get_obj_from_floats(nx + obj->rx * margin * (2 * i - 1), ny + obj->ry * margin * (2 * j - 1));
-            block = block || is_blocked(obj, type2, is_horizontal);
-            reflect = reflect || will_reflect(obj->type, type2);
-        }
-    }
-
-    if (reflect) {
-        if (is_horizontal) {
-            float delta;
-
-            if (_vx < 0) {
-                delta = ceil(nx - obj->rx) - (nx - obj->rx);
-            } else {
-                delta = floor(nx + obj->rx) - (nx + obj->rx);
-            }
-
-            obj->vx = -1 * obj->vx;
-            nx = nx + 2 * delta;
-        } else {
-            float delta;
-
-            if (_vy < 0) {
-                delta = ceil(ny - obj->ry) - (ny - obj->ry);
-            } else {
-                delta = floor(ny + obj->ry) - (ny + obj->ry);
-            }
-
-            obj->vy = -1 * obj->vy;
-            ny = ny + 2 * delta;
-        }
-    } else if (block) {
-        if (is_horizontal) {
-            if (grid_step) {
-                nx = obj->x;
-            } else {
-                nx = _vx > 0 ? (floor(nx + obj->rx) - obj->rx) : (ceil(nx - obj->rx) + obj->rx);
-            }
-        } else {
-            if (grid_step) {
-                ny = obj->y;
-            } else {
-                ny = _vy > 0 ? (floor(ny + obj->ry) - obj->ry) : (ceil(ny - obj->ry) + obj->ry);
-            }
-        }
-    }
-
-    obj->x = nx;
-    obj->y = ny;
-
-    bool block2 = false;
-
-    for (int i = (int)(entities.size()) - 1; i >= 0; i--) {
-        auto m = entities[i];
-
-        if (m == obj || m->will_erase) {
-            continue;
-        }
-
-        bool curr_block = false;
-
-        if (has_collision(obj, m, POS_EPS)) {
-            if (is_blocked_ents(obj, m, is_horizontal)) {
-                curr_block = true;
-            } else if (will_reflect(obj->type, m->type)) {
-                if (is_horizontal) {
-                    float delx = m->x - obj->x;
-                    float rsum = m->rx + obj->rx;
-                    obj->x += _vx > 0 ? -2 * (rsum - delx) : 2 * (rsum + delx);
-                    obj->vx = -1 * obj->vx;
-                } else {
-                    float dely = m->y - obj->y;
-                    float rsum = m->ry + obj->ry;
-                    obj->y += _vy > 0 ? -2 * (rsum - dely) : 2 * (rsum + dely);
-                    obj->vy = -1 * obj->vy;
-                }
-            }
-
-            if (curr_block) {
-                push_obj(m, obj, is_horizontal, depth);
-            }
-        }
-
-        block2 = block2 || curr_block;
-    }
-
-    return block || block2;
+    return push_obj_kernel<BasicAbstractGame>(src, target, is_horizontal, depth);
 }
 
 /*
@@ -509,7 +464,7 @@ float BasicAbstractGame::get_agent_acceleration_scale() {
 */
 
 std::shared_ptr<Entity> BasicAbstractGame::spawn_entity_rxy(float rx, float ry, int type, float x, float y, float w, float h, bool check_collisions) {
-    std::shared_ptr<Entity> ent(new Entity(0, 0, 0, 0, rx, ry, type));
+    std::shared_ptr<Entity> ent = make_entity(0, 0, 0, 0, rx, ry, type);
 
     reposition(ent, x, y, w, h, check_collisions);
 
@@ -519,7 +474,7 @@ std::shared_ptr<Entity> BasicAbstractGame::spawn_entity_rxy(float rx, float ry,
 }
 
 bool BasicAbstractGame::agent_has_collision() {
-    for (auto ent : entities) {
+    for (const auto &ent : entities) {
         if (has_agent_collision(ent)) {
             return true;
         }
@@ -542,6 +497,16 @@ void BasicAbstractGame::reposition(const std::shared_ptr<Entity> &ent, float x,
     float rx = ent->rx;
     float ry = ent->ry;
 
+    // only ent moves during the retries, so a broadphase over the other entities stays valid, unless ent is one of them
+    bool is_listed = std::find(entities.begin(), entities.end(), ent) != entities.end();
+    bool build_entity_grid = check_collisions && !is_listed && !entity_grid.is_valid();
+
+    if (is_listed) {
+        entity_grid.invalidate();
+    } else if (build_entity_grid) {
+        entity_grid.build(entities, main_width, main_height);
+    }
+
     ent->x = rand_pos(rx, x, x + w);
     ent->y = rand_pos(ry, y, y + h);
 
@@ -553,6 +518,10 @@ void BasicAbstractGame::reposition(const std::shared_ptr<Entity> &ent, float x,
         count++;
     }
 
+    if (build_entity_grid) {
+        entity_grid.invalidate();
+    }
+
     if (count == 100) {
         printf("WARNING: excessive randomization attempts. Game num, type, rx, ry, w, h: %d %d %f_%f %d %d \n", game_n, ent->type, rx, ry, main_width, main_height);
         printf("Agent: %f %f\n", agent->x, agent->y);
@@ -564,13 +533,13 @@ std::shared_ptr<Entity> BasicAbstractGame::spawn_entity(float r, int type, float
 }
 
 std::shared_ptr<Entity> BasicAbstractGame::add_entity(float x, float y, float vx, float vy, float r, int type) {
-    std::shared_ptr<Entity> ent(new Entity(x, y, vx, vy, r, r, type));
+    std::shared_ptr<Entity> ent = make_entity(x, y, vx, vy, r, r, type);
     entities.push_back(ent);
     return ent;
 }
 
 std::shared_ptr<Entity> BasicAbstractGame::add_entity_rxy(float x, float y, float vx, float vy, float rx, float ry, int type) {
-    std::shared_ptr<Entity> ent(new Entity(x, y, vx, vy, rx, ry, type));
+    std::shared_ptr<Entity> ent = make_entity(x, y, vx, vy, rx, ry, type);
     entities.push_back(ent);
     return ent;
 }
@@ -591,68 +560,7 @@ void BasicAbstractGame::spawn_entities(int num_entities, float r, int type, floa
 }
 
 void BasicAbstractGame::basic_step_object(const std::shared_ptr<Entity> &obj) {
-    if (obj->will_erase)
-        return;
-
-    int num_sub_steps;
-
-    if (grid_step) {
-        num_sub_steps = 1;
-    } else {
-        num_sub_steps = int(4 * sqrt(obj->vx * obj->vx + obj->vy * obj->vy));
-        if (num_sub_steps < 4)
-            num_sub_steps = 4;
-    }
-
-    float pct = 1.0 / num_sub_steps;
-
-    float cmp = fabs(obj->vx) - fabs(obj->vy);
-
-    /*
-     Resolve ties randomly -- important for randomized movement through tight corridors in orbeater.
-     In order to ensure that enemies choose randomly between horizontal/vertical forks in a path,
-     this collision detection shouldn't favor one direction over another.
-    */
-    bool step_x_first = cmp == 0 ? step_rand_int % 2 == 0 : (cmp > 0);
-
-    // edge case -- needed for player movement through tight corridors (e.g. Pacman)
-    if (obj->type == PLAYER) {
-        if (action_vx != 0)
-            step_x_first = true;
-        if (action_vy != 0)
-            step_x_first = false;
-    }
-
-    float vx_pct = 0;
-    float vy_pct = 0;
-
-    for (int s = 0; s < num_sub_steps; s++) {
-        bool block_x = false;
-        bool block_y = false;
-
-        if (step_x_first) {
-            block_x = sub_step(obj, obj->vx * pct, 0, 0);
-            block_y = sub_step(obj, 0, obj->vy * pct, 0);
-        } else {
-            block_y = sub_step(obj, 0, obj->vy * pct, 0);
-            block_x = sub_step(obj, obj->vx * pct, 0, 0);
-        }
-
-        if (!block_x)
-            vx_pct += 1;
-        if (!block_y)
-            vy_pct += 1;
-
-        if (block_x && block_y) {
-            break;
-        }
-    }
-
-    vx_pct = vx_pct / num_sub_steps;
-    vy_pct = vy_pct / num_sub_steps;
-
-    obj->vx *= vx_pct;
-    obj->vy *= vy_pct;
+    (this->*basic_step_object_fn)(obj);
 }
 
 void BasicAbstractGame::set_action_xy(int move_act) {
@@ -683,7 +591,60 @@ void BasicAbstractGame::decay_agent_velocity() {
     agent->vy = .9 * agent->vy;
 }
 
+/*
+  Run handle_collision() for every entity that entities[ent_idx] collides with, in the same order as
+  a scan from the back of the entity list. Candidates come from the broadphase until a handler runs,
+  since handlers may move or add entities the rest of the scan is done without it.
+*/
+void BasicAbstractGame::collide_with_entities(int ent_idx) {
+    auto ent = entities[ent_idx];
+
+    if (!entity_grid.is_valid()) {
+        entity_grid.build(entities, main_width, main_height);
+    }
+
+    entity_grid.query(ent->x, ent->y, ent->rx, ent->ry, ent->collision_margin, collision_candidates);
+
+    int scan_from = -1;
+
+    for (int j : collision_candidates) {
+        if (j == ent_idx)
+            continue;
+        const auto &ent2 = entities[j];
+
+        if (has_collision(ent, ent2, ent->collision_margin) && !ent->will_erase && !ent2->will_erase) {
+            // the handler may add entities, so it gets its own handle rather than a reference into the list
+            auto target = ent2;
+            entity_grid.invalidate();
+            handle_collision(ent, target);
+            scan_from = j - 1;
+            break;
+        }
+    }
+
+    for (int j = scan_from; j >= 0; j--) {
+        if (ent_idx == j)
+            continue;
+        const auto &ent2 = entities[j];
+
+        if (has_collision(ent, ent2, ent->collision_margin) && !ent->will_erase && !ent2->will_erase) {
+            auto target = ent2;
+            handle_collision(ent, target);
+        }
+    }
+}
+
 void BasicAbstractGame::game_step() {
+    apply_action();
+
+    step_entities(entities);
+
+    resolve_collisions();
+
+    finish_step();
+}
+
+void BasicAbstractGame::apply_action() {
     step_rand_int = rand_gen.randint(0, 1000000);
     move_action = action % 9;
     special_action = 0;
@@ -713,26 +674,21 @@ void BasicAbstractGame::game_step() {
         agent->vrot = MIXRATEROT * agent->vrot;
         agent->vrot += MIXRATEROT * MAXVTHETA * action_vrot;
     }
+}
 
-    step_entities(entities);
+void BasicAbstractGame::resolve_collisions() {
+    entity_grid.build(entities, main_width, main_height);
 
     for (int i = (int)(entities.size()) - 1; i >= 0; i--) {
         auto ent = entities[i];
 
         if (has_agent_collision(ent)) {
+            entity_grid.invalidate();
             handle_agent_collision(ent);
         }
 
         if (ent->collides_with_entities) {
-            for (int j = (int)(entities.size()) - 1; j >= 0; j--) {
-                if (i == j)
-                    continue;
-                auto ent2 = entities[j];
-
-                if (has_collision(ent, ent2, ent->collision_margin) && !ent->will_erase && !ent2->will_erase) {
-                    handle_collision(ent, ent2);
-                }
-            }
+            collide_with_entities(i);
         }
 
         if (ent->smart_step) {
@@ -740,6 +696,79 @@ void BasicAbstractGame::game_step() {
         }
     }
 
+    entity_grid.invalidate();
+}
+
+/*
+  Same as resolve_collisions() for games whose collision handlers never move or resize an entity.
+  All the agent collision tests can then be done up front, in a loop over flat arrays that the compiler vectorizes,
+  and the broadphase is only built if some entity collides with other entities.
+*/
+void BasicAbstractGame::resolve_collisions_static() {
+    int num_entities = (int)(entities.size());
+    box_x.resize(num_entities);
+    box_y.resize(num_entities);
+    box_rx.resize(num_entities);
+    box_ry.resize(num_entities);
+    box_margin.resize(num_entities);
+    agent_hits.resize(num_entities);
+
+    for (int i = 0; i < num_entities; i++) {
+        const auto &ent = entities[i];
+        box_x[i] = ent->x;
+        box_y[i] = ent->y;
+        box_rx[i] = ent->rx;
+        box_ry[i] = ent->ry;
+        box_margin[i] = ent->collision_margin;
+    }
+
+    // the same arithmetic as has_collision(ent, agent, ent->collision_margin)
+    float ax = agent->x;
+    float ay = agent->y;
+    float arx = agent->rx;
+    float ary = agent->ry;
+    const float *xs = box_x.data();
+    const float *ys = box_y.data();
+    const float *rxs = box_rx.data();
+    const float *rys = box_ry.data();
+    const float *margins = box_margin.data();
+    uint8_t *hits = agent_hits.data();
+
+    for (int i = 0; i < num_entities; i++) {
+        bool hit_x = fabsf(xs[i] - ax) < (rxs[i] + arx) + margins[i];
+        bool hit_y = fabsf(ys[i] - ay) < (rys[i] + ary) + margins[i];
+        hits[i] = hit_x & hit_y;
+    }
+
+    entity_grid.invalidate();
+
+    for (int i = num_entities - 1; i >= 0; i--) {
+        const auto &ent = entities[i];
+
+        if (!hits[i] && !ent->collides_with_entities && !ent->smart_step) {
+            continue;
+        }
+
+        auto handle = ent;
+
+        if (hits[i] && handle->type != PLAYER) {
+            entity_grid.invalidate();
+            handle_agent_collision(handle);
+        }
+
+        if (handle->collides_with_entities) {
+            collide_with_entities(i);
+        }
+
+        if (handle->smart_step) {
+            check_grid_collisions(handle);
+        }
+    }
+
+    entity_grid.invalidate();
+}
+
+void BasicAbstractGame::finish_step() {
     erase_if_needed();
 
     step_data.done = step_data.done || is_out_of_bounds(agent);
@@ -749,26 +778,36 @@ void BasicAbstractGame::game_step() {
     // step_data.agent_y = agent->y;
 }
 
+/*
+  Remove dead entities in a single pass, linear in the number of entities however many of them died in the step,
+  where erasing them one at a time shifted the rest of the list for each. The order of the entity list is the draw
+  order within a render_z layer and the order collisions are resolved in, so survivors must keep their relative
+  order, swapping the last entity into the freed slot would change both.
+*/
 void BasicAbstractGame::erase_if_needed() {
-    for (int i = (int)(entities.size()) - 1; i >= 0; i--) {
-        auto e = entities[i];
+    PhaseTimer timer(stats.get(), STATS_ERASE, tracer, game_n);
+    auto should_remove = [this](const std::shared_ptr<Entity> &e) {
+        return e->will_erase || (e->auto_erase && is_out_of_bounds(e));
+    };
 
-        if (e->will_erase || (e->auto_erase && is_out_of_bounds(e))) {
-            entities.erase(entities.begin() + i);
-        }
-    }
+    entities.erase(std::remove_if(entities.begin(), entities.end(), should_remove), entities.end());
 }
 
 void BasicAbstractGame::game_reset() {
     choose_world_dim();
     fassert(main_width > 0 && main_height > 0);
 
+    background_caches.clear();
+    retained_frame_valid = false;
+
     bg_pct_x = rand_gen.rand01();
 
     grid_size = main_width * main_height;
     grid.resize(main_width, main_height);
+    reindex_grid();
 
-    background_index = 1; //rand_gen.randn((int)(main_bg_images_ptr->size()));
+    // the second background where there is one, chaser and the generated assets only have a single background
+    background_index = std::min(1, (int)(main_bg_images_ptr->size()) - 1); //rand_gen.randn((int)(main_bg_images_ptr->size()));
 
     AssetGen bggen(&rand_gen);
 
@@ -789,7 +828,7 @@ void BasicAbstractGame::game_reset() {
         ay = a_r;
     }
 
-    auto _agent = std::make_shared<Entity>(ax, ay, 0, 0, a_r, PLAYER);
+    auto _agent = make_entity(ax, ay, 0, 0, a_r, PLAYER);
     agent = _agent;
     agent->smart_step = true;
     agent->render_z = 1;
@@ -800,6 +839,24 @@ void BasicAbstractGame::game_reset() {
     fill_elem(0, 0, main_width, main_height, SPACE);
 }
 
+/*
+  Give the containers that stepping fills room for what the level can need, so that only a reset allocates them. The
+  scratch space of the collision loops holds as many entities as the entity list, and a column of the grid has at
+  most a run per cell and the runs out of bounds below and above it.
+*/
+void BasicAbstractGame::game_after_reset() {
+    int entity_capacity = (int)(entities.capacity());
+    entity_grid.reserve(entity_capacity, grid_size);
+    collision_candidates.reserve(entity_capacity);
+    for (auto v : {&box_x, &box_y, &box_rx, &box_ry, &box_margin}) {
+        v->reserve(entity_capacity);
+    }
+    agent_hits.reserve(entity_capacity);
+
+    cell_index.reserve();
+    visible_runs.reserve(main_height + 2);
+}
+
 QRectF BasicAbstractGame::get_screen_rect(float x, float y, float dx, float dy, float render_eps) {
     return QRectF((x - render_eps) * unit - x_off, (view_dim - y - render_eps) * unit + y_off, (dx + 2 * render_eps) * unit, (dy + 2 * render_eps) * unit);
 }
@@ -839,33 +896,50 @@ void BasicAbstractGame::prepare_for_drawing(float rect_height) {
 
     x_off = unit * (center_x - view_dim / 2);
     y_off = unit * (center_y - view_dim / 2);
+
+    if (snap_camera || options.snap_camera) {
+        x_off = round(x_off);
+        y_off = round(y_off);
+    }
+}
+
+/*
+  Split rect into tiles for tile_ratio (see tile_image()), returns the number of tiles, tile i is at
+  (rect.x() + i * tile_dx, rect.y() + i * tile_dy)
+*/
+int BasicAbstractGame::get_tile_layout(const QRectF &rect, float tile_ratio, float &tile_dx, float &tile_dy, float &tile_width, float &tile_height) {
+    int num_tiles;
+
+    if (tile_ratio < 0) {
+        tile_ratio = -1 * tile_ratio;
+        num_tiles = int(rect.height() / (rect.width() * tile_ratio));
+        if (num_tiles < 1)
+            num_tiles = 1;
+        tile_height = rect.height() / num_tiles;
+        tile_width = rect.width();
+        tile_dx = 0;
+        tile_dy = tile_height;
+    } else {
+        num_tiles = int(rect.width() / (rect.height() * tile_ratio));
+        if (num_tiles < 1)
+            num_tiles = 1;
+        tile_width = rect.width() / num_tiles;
+        tile_height = rect.height();
+        tile_dx = tile_width;
+        tile_dy = 0;
+    }
+
+    return num_tiles;
 }
 
 void BasicAbstractGame::tile_image(QPainter &p, QImage *image, const QRectF &rect, float tile_ratio) {
     if (tile_ratio != 0) {
-        if (tile_ratio < 0) {
-            tile_ratio = -1 * tile_ratio;
-            int num_tiles = int(rect.height() / (rect.width() * tile_ratio));
-            if (num_tiles < 1)
-                num_tiles = 1;
-            float tile_height = rect.height() / num_tiles;
-            float tile_width = rect.width();
-
-            for (int i = 0; i < num_tiles; i++) {
-                QRectF tile_rect = QRectF(rect.x(), rect.y() + tile_height * i, tile_width, tile_height);
-                p.drawImage(tile_rect, *image);
-            }
-        } else {
-            int num_tiles = int(rect.width() / (rect.height() * tile_ratio));
-            if (num_tiles < 1)
-                num_tiles = 1;
-            float tile_width = rect.width() / num_tiles;
-            float tile_height = rect.height();
-
-            for (int i = 0; i < num_tiles; i++) {
-                QRectF tile_rect = QRectF(rect.x() + tile_width * i, rect.y(), tile_width, tile_height);
-                p.drawImage(tile_rect, *image);
-            }
+        float tile_dx, tile_dy, tile_width, tile_height;
+        int num_tiles = get_tile_layout(rect, tile_ratio, tile_dx, tile_dy, tile_width, tile_height);
+
+        for (int i = 0; i < num_tiles; i++) {
+            QRectF tile_rect = QRectF(rect.x() + tile_dx * i, rect.y() + tile_dy * i, tile_width, tile_height);
+            p.drawImage(tile_rect, *image);
         }
     } else {
         p.drawImage(rect, *image);
@@ -874,8 +948,101 @@ void BasicAbstractGame::tile_image(QPainter &p, QImage *image, const QRectF &rec
 
 QImage *BasicAbstractGame::lookup_asset(int img_idx, bool is_reflected) {
     initialize_asset_if_necessary(img_idx);
-    auto assets = is_reflected ? &basic_reflections : &basic_assets;
-    return assets->at(img_idx).get();
+    const SharedAsset *shared = asset_table->get(img_idx);
+    return (is_reflected ? shared->reflection : shared->asset).get();
+}
+
+QImage *BasicAbstractGame::lookup_scaled_image(uint64_t key, const QImage &src, QPainter::RenderHints hints, int quarter_turns, int width, int height) {
+    key = (key << 2) | quarter_turns;
+    key = (key << 16) | (width & 0xffff);
+    key = (key << 16) | (height & 0xffff);
+
+    auto it = sprite_cache.find(key);
+
+    if (it != sprite_cache.end()) {
+        return &it->second;
+    }
+
+    // sizes only change with the render resolution and visibility, so this is rarely hit,
+    // but don't let a game with a continuously changing zoom grow the cache forever
+    if (sprite_cache.size() >= (size_t)(options.sprite_cache_entries)) {
+        sprite_cache.clear();
+    }
+
+    QImage scaled(width, height, QImage::Format_ARGB32_Premultiplied);
+    scaled.fill(0);
+
+    QPainter sp(&scaled);
+    sp.setRenderHints(hints);
+
+    // for odd quarter turns the unrotated sprite has its width and height swapped
+    float sprite_w = (quarter_turns % 2 == 0) ? width : height;
+    float sprite_h = (quarter_turns % 2 == 0) ? height : width;
+
+    sp.translate(width / 2.0, height / 2.0);
+    sp.rotate(quarter_turns * 90);
+    sp.drawImage(QRectF(-sprite_w / 2, -sprite_h / 2, sprite_w, sprite_h), src);
+    sp.end();
+
+    return &sprite_cache.emplace(key, std::move(scaled)).first->second;
+}
+
+QImage *BasicAbstractGame::lookup_scaled_asset(QPainter::RenderHints hints, int img_idx, bool is_reflected, int quarter_turns, int width, int height) {
+    uint64_t key = ((uint64_t)img_idx << 1) | (is_reflected ? 1 : 0);
+    return lookup_scaled_image(key, *lookup_asset(img_idx, is_reflected), hints, quarter_turns, width, height);
+}
+
+QImage *BasicAbstractGame::lookup_scaled_background(QPainter::RenderHints hints, int width, int height) {
+    // backgrounds are keyed after all the asset indices
+    uint64_t key = (uint64_t)(USE_ASSET_THRESHOLD * MAX_IMAGE_THEMES + background_index) << 1;
+    return lookup_scaled_image(key, *main_bg_images_ptr->at(background_index), hints, 0, width, height);
+}
+
+/*
+  Find the pixel box a sprite covers once it's rotated, returns false if the rotation is not a
+  multiple of 90 degrees, quarter_turns is then the closest number of quarter turns.
+*/
+bool BasicAbstractGame::get_sprite_box(const QRectF &rect, float rotation, int &quarter_turns, QRect &box) {
+    float turns = rotation / (PI / 2);
+    quarter_turns = int(round(turns));
+    bool is_exact = fabs(turns - quarter_turns) <= 1e-4;
+
+    quarter_turns = ((quarter_turns % 4) + 4) % 4;
+
+    float cx = rect.x() + rect.width() / 2;
+    float cy = rect.y() + rect.height() / 2;
+
+    float bw = (quarter_turns % 2 == 0) ? rect.width() : rect.height();
+    float bh = (quarter_turns % 2 == 0) ? rect.height() : rect.width();
+
+    int x0 = int(round(cx - bw / 2));
+    int y0 = int(round(cy - bh / 2));
+    int x1 = int(round(cx + bw / 2));
+    int y1 = int(round(cy + bh / 2));
+
+    box = QRect(x0, y0, x1 - x0, y1 - y0);
+
+    return is_exact;
+}
+
+/*
+  Draw a sprite as a 1:1 blit from the sprite cache, returns false if the rotation is not a
+  multiple of 90 degrees, in which case the caller should draw it the regular way.
+*/
+bool BasicAbstractGame::draw_cached_sprite(QPainter &p, const QRectF &rect, float rotation, bool is_reflected, int img_idx) {
+    int quarter_turns;
+    QRect box;
+
+    if (!get_sprite_box(rect, rotation, quarter_turns, box)) {
+        return false;
+    }
+
+    if (box.width() > 0 && box.height() > 0) {
+        QImage *scaled_ptr = lookup_scaled_asset(p.renderHints(), img_idx, is_reflected, quarter_turns, box.width(), box.height());
+        p.drawImage(box.topLeft(), *scaled_ptr);
+    }
+
+    return true;
 }
 
 void BasicAbstractGame::draw_image(QPainter &p, QRectF &base_rect, float rotation, bool is_reflected, int base_type, int theme, float alpha, float tile_ratio) {
@@ -900,9 +1067,11 @@ void BasicAbstractGame::draw_image(QPainter &p, QRectF &base_rect, float rotatio
             p.setOpacity(alpha);
         }
 
-        if (rotation == 0) {
+        bool drawn = options.cache_sprites && tile_ratio == 0 && draw_cached_sprite(p, adjusted_rect, rotation, is_reflected, img_idx);
+
+        if (!drawn && rotation == 0) {
             tile_image(p, asset_ptr, adjusted_rect, tile_ratio);
-        } else {
+        } else if (!drawn) {
             p.save();
             p.translate(adjusted_rect.x() + adjusted_rect.width() / 2, adjusted_rect.y() + adjusted_rect.height() / 2);
             p.rotate(rotation * 180 / PI);
@@ -922,13 +1091,7 @@ void BasicAbstractGame::draw_grid_obj(QPainter &p, const QRectF &rect, int type,
     p.fillRect(rect, color_for_type(type, theme));
 }
 
-void BasicAbstractGame::draw_foreground(QPainter &p, const QRect &rect) {
-    prepare_for_drawing(rect.height());
-
-    draw_entities(p, entities, -1);
-
-    int low_x, high_x, low_y, high_y;
-
+void BasicAbstractGame::get_visible_grid_range(int &low_x, int &high_x, int &low_y, int &high_y) {
     if (options.center_agent) {
         float margin = (visibility / 2.0 + 1);
         low_x = center_x - margin;
@@ -941,23 +1104,84 @@ void BasicAbstractGame::draw_foreground(QPainter &p, const QRect &rect) {
         low_y = 0;
         high_y = main_height - 1;
     }
+}
+
+/*
+  The runs of equal cells of column x between low_y and high_y, the parts outside the world are runs of
+  out_of_bounds_object, like get_obj() returns for them.
+*/
+void BasicAbstractGame::get_visible_column_runs(int x, int low_y, int high_y, std::vector<CellRun> &runs) {
+    runs.clear();
+
+    auto add_run = [&runs](int y, int length, int type) {
+        if (length > 0) {
+            runs.push_back(CellRun{y, length, type});
+        }
+    };
+
+    if (x < 0 || x >= grid.w) {
+        add_run(low_y, high_y - low_y + 1, out_of_bounds_object);
+        return;
+    }
+
+    add_run(low_y, std::min(high_y + 1, 0) - low_y, out_of_bounds_object);
+
+    for (const auto &run : cell_index.get_column_runs(x, grid.data)) {
+        int y0 = std::max(run.y, low_y);
+        int y1 = std::min(run.y + run.length - 1, high_y);
+        add_run(y0, y1 - y0 + 1, run.type);
+    }
+
+    int top = std::max(low_y, grid.h);
+    add_run(top, high_y - top + 1, out_of_bounds_object);
+}
+
+// column by column from the bottom up, the same order as drawing each visible cell in turn
+void BasicAbstractGame::draw_grid(QPainter &p) {
+    int low_x, high_x, low_y, high_y;
+    get_visible_grid_range(low_x, high_x, low_y, high_y);
+
+    if (!options.draw_grid_runs) {
+        for (int x = low_x; x <= high_x; x++) {
+            for (int y = low_y; y <= high_y; y++) {
+                int type = get_obj(x, y);
+
+                if (type == INVALID_OBJ) {
+                    continue;
+                }
+
+                QRectF r2 = get_screen_rect(x, y + 1, 1, 1, RENDER_EPS);
+                draw_image(p, r2, 0, false, type, theme_for_grid_obj(type), 1.0, 0.0);
+            }
+        }
+        return;
+    }
 
     for (int x = low_x; x <= high_x; x++) {
-        for (int y = low_y; y <= high_y; y++) {
-            int type = get_obj(x, y);
+        get_visible_column_runs(x, low_y, high_y, visible_runs);
+
+        for (const auto &run : visible_runs) {
+            int img_type = image_for_type(run.type);
 
-            if (type == INVALID_OBJ) {
+            if (run.type == INVALID_OBJ || img_type < 0 || img_type == SPACE) {
                 continue;
             }
 
-            int theme = theme_for_grid_obj(type);
+            int theme = theme_for_grid_obj(run.type);
 
-            QRectF r2 = get_screen_rect(x, y + 1, 1, 1, RENDER_EPS);
-
-            draw_image(p, r2, 0, false, type, theme, 1.0, 0.0);
+            for (int y = run.y; y < run.y + run.length; y++) {
+                QRectF r2 = get_screen_rect(x, y + 1, 1, 1, RENDER_EPS);
+                draw_image(p, r2, 0, false, run.type, theme, 1.0, 0.0);
+            }
         }
     }
+}
+
+void BasicAbstractGame::draw_foreground(QPainter &p, const QRect &rect) {
+    prepare_for_drawing(rect.height());
 
+    draw_entities(p, entities, -1);
+    draw_grid(p);
     draw_entities(p, entities, 0);
     draw_entities(p, entities, 1);
 
@@ -991,38 +1215,523 @@ void BasicAbstractGame::draw_background(QPainter &p, const QRect &rect) {
 
     QRectF main_rect = get_screen_rect(0, main_height, main_width, main_height);
 
+    if (options.cache_background) {
+        draw_cached_background(p, main_rect);
+    } else {
+        paint_background(p, main_rect);
+    }
+}
+
+void BasicAbstractGame::paint_background(QPainter &p, const QRectF &main_rect) {
     std::shared_ptr<QImage> background_image = main_bg_images_ptr->at(background_index);
 
     if (bg_tile_ratio < 0) {
         tile_image(p, background_image.get(), main_rect, bg_tile_ratio);
     } else {
-        float bgw = background_image->width();
-        float bgh = background_image->height();
-        float bg_ar = bgw / bgh;
+        p.drawImage(get_background_bounds(main_rect), *background_image);
+    }
+}
+
+/*
+  The area covered by the background image, this extends past the world horizontally when the image
+  has a wider aspect ratio than the world and isn't tiled.
+*/
+QRectF BasicAbstractGame::get_background_bounds(const QRectF &main_rect) {
+    if (bg_tile_ratio < 0) {
+        return main_rect;
+    }
+
+    std::shared_ptr<QImage> background_image = main_bg_images_ptr->at(background_index);
 
-        float world_ar = main_width * 1.0 / main_height;
+    float bgw = background_image->width();
+    float bgh = background_image->height();
+    float bg_ar = bgw / bgh;
 
-        float extra_w = bg_ar - world_ar;
-        float offset_x = bg_pct_x * extra_w;
+    float world_ar = main_width * 1.0 / main_height;
 
-        QRectF bg_rect = adjust_rect(main_rect, QRectF(-offset_x, 0, bg_ar / world_ar, 1));
-        p.drawImage(bg_rect, *background_image);
+    float extra_w = bg_ar - world_ar;
+    float offset_x = bg_pct_x * extra_w;
+
+    return adjust_rect(main_rect, QRectF(-offset_x, 0, bg_ar / world_ar, 1));
+}
+
+BasicAbstractGame::BackgroundCache *BasicAbstractGame::lookup_background_cache(QPainter::RenderHints hints, const QRectF &main_rect) {
+    for (auto &c : background_caches) {
+        if (c.unit == unit) {
+            return &c;
+        }
     }
+
+    // normally there are at most two resolutions in use (observation and render_human),
+    // if the scale keeps changing, don't let the cache grow without bound
+    if (background_caches.size() >= 2) {
+        background_caches.clear();
+    }
+
+    // render the background relative to the top left corner of the world
+    QRectF local_rect = QRectF(0, 0, main_rect.width(), main_rect.height());
+    QRectF bounds = get_background_bounds(local_rect);
+
+    background_caches.emplace_back();
+    BackgroundCache *cache = &background_caches.back();
+    cache->unit = unit;
+    cache->offset_x = floor(bounds.x());
+    cache->offset_y = floor(bounds.y());
+    cache->image = QImage(int(ceil(bounds.x() + bounds.width()) - cache->offset_x), int(ceil(bounds.y() + bounds.height()) - cache->offset_y), QImage::Format_RGB32);
+    cache->image.fill(QColor(0, 0, 0));
+
+    QPainter cp(&cache->image);
+    cp.setRenderHints(hints);
+    cp.translate(-cache->offset_x, -cache->offset_y);
+    paint_background(cp, local_rect);
+
+    return cache;
+}
+
+void BasicAbstractGame::draw_cached_background(QPainter &p, const QRectF &main_rect) {
+    BackgroundCache *cache = lookup_background_cache(p.renderHints(), main_rect);
+    p.drawImage(QPoint(int(round(main_rect.x() + cache->offset_x)), int(round(main_rect.y() + cache->offset_y))), cache->image);
 }
 
 void BasicAbstractGame::game_draw(QPainter &p, const QRect &rect) {
+    // the observation is small enough that there would be little to save
+    if (options.incremental_render && supports_incremental_render && drawing_hires) {
+        draw_incremental(p, rect);
+        return;
+    }
+
     draw_background(p, rect);
     draw_foreground(p, rect);
 }
 
+// move the pixels of img by (dx, dy), the pixels that are uncovered keep their old values
+static void shift_image(QImage &img, int dx, int dy) {
+    int w = img.width();
+    int h = img.height();
+    size_t row_bytes = size_t(w - abs(dx)) * 4;
+    int dst_x = std::max(dx, 0) * 4;
+    int src_x = std::max(-dx, 0) * 4;
+    // go against the direction of the shift so that rows are read before they are overwritten
+    if (dy > 0) {
+        for (int y = h - 1; y >= dy; y--) {
+            memmove(img.scanLine(y) + dst_x, img.scanLine(y - dy) + src_x, row_bytes);
+        }
+    } else {
+        for (int y = 0; y < h + dy; y++) {
+            memmove(img.scanLine(y) + dst_x, img.scanLine(y - dy) + src_x, row_bytes);
+        }
+    }
+}
+
+/*
+  The pixels that drawing an image of type at rect can touch, including the edges that antialiasing and smooth
+  scaling spread past the rect.
+*/
+QRect BasicAbstractGame::get_draw_box(const QRectF &rect, int type, float rotation) {
+    QRectF box = rect;
+    int img_type = image_for_type(type);
+
+    if (img_type >= 0) {
+        box = box.united(get_adjusted_image_rect(img_type, rect));
+    }
+
+    if (rotation != 0) {
+        float half = sqrt(box.width() * box.width() + box.height() * box.height()) / 2;
+        box = QRectF(box.center().x() - half, box.center().y() - half, 2 * half, 2 * half);
+    }
+
+    return box.toAlignedRect().adjusted(-2, -2, 2, 2);
+}
+
+/*
+  With options.incremental_render the hi-res frame is kept from one render to the next. A scroll of the camera
+  moves the kept frame, and then only the parts of it that can have changed are repainted: the area the scroll
+  uncovered, where the entities were and are, the grid cells that changed, and the velocity info. The repaint
+  draws everything as usual but clipped to those parts, so the layering is the same as with a full repaint.
+
+  The camera offset is rounded to whole pixels for the scroll, so the frame can be up to half a pixel off from
+  the frame drawn without the option. Anything else that changes the picture, a new level or a different frame
+  size, repaints the whole frame.
+*/
+void BasicAbstractGame::draw_incremental(QPainter &p, const QRect &rect) {
+    snap_camera = true;
+    prepare_for_drawing(rect.height());
+
+    bool full_repaint = !retained_frame_valid || retained_frame.size() != rect.size() || retained_unit != unit || (int)(retained_grid.size()) != grid.w * grid.h;
+    int dx = int(round(retained_x_off - x_off));
+    int dy = int(round(y_off - retained_y_off));
+    if (abs(dx) >= rect.width() || abs(dy) >= rect.height()) {
+        full_repaint = true;
+    }
+
+    if (full_repaint) {
+        retained_frame = QImage(rect.width(), rect.height(), QImage::Format_RGB32);
+    }
+
+    QRegion dirty;
+
+    if (!full_repaint) {
+        shift_image(retained_frame, dx, dy);
+
+        if (dy > 0) {
+            dirty += QRect(0, 0, rect.width(), dy);
+        } else if (dy < 0) {
+            dirty += QRect(0, rect.height() + dy, rect.width(), -dy);
+        }
+        if (dx > 0) {
+            dirty += QRect(0, 0, dx, rect.height());
+        } else if (dx < 0) {
+            dirty += QRect(rect.width() + dx, 0, -dx, rect.height());
+        }
+
+        for (const auto &box : retained_entity_boxes) {
+            dirty += box.translated(dx, dy);
+        }
+
+        for (int idx = 0; idx < grid.w * grid.h; idx++) {
+            int type = grid.get_index_unchecked(idx);
+            if (type != retained_grid[idx]) {
+                int x, y;
+                grid.to_xy(idx, &x, &y);
+                QRectF cell = get_screen_rect(x, y + 1, 1, 1, RENDER_EPS);
+                dirty += get_draw_box(cell, type, 0);
+                dirty += get_draw_box(cell, retained_grid[idx], 0);
+            }
+        }
+
+        if (has_useful_vel_info && options.paint_vel_info) {
+            // drawn at a fixed place on the screen, so the scroll also moved the last one
+            float infodim = rect.height() * .2;
+            QRect info_box = QRectF(0, 0, 2 * infodim, infodim).toAlignedRect();
+            dirty += info_box;
+            dirty += info_box.translated(dx, dy);
+        }
+    }
+
+    retained_entity_boxes.clear();
+    for (const auto &ent : entities) {
+        if (should_draw_entity(ent)) {
+            QRect box = get_draw_box(get_object_rect(ent), ent->image_type, ent->rotation);
+            retained_entity_boxes.push_back(box);
+            dirty += box;
+        }
+    }
+
+    // once most of the frame is dirty, the clipping costs more than it saves
+    int64_t dirty_area = 0;
+    for (const QRect &r : dirty) {
+        dirty_area += int64_t(r.width()) * r.height();
+    }
+    if (dirty_area * 4 >= int64_t(rect.width()) * rect.height() * 3) {
+        full_repaint = true;
+    }
+
+    {
+        QPainter rp(&retained_frame);
+        rp.setRenderHints(p.renderHints());
+        if (!full_repaint) {
+            rp.setClipRegion(dirty);
+        }
+        draw_background(rp, rect);
+        draw_foreground(rp, rect);
+    }
+
+    p.drawImage(QPoint(0, 0), retained_frame);
+
+    retained_frame_valid = true;
+    retained_unit = unit;
+    retained_x_off = x_off;
+    retained_y_off = y_off;
+    retained_grid = grid.data;
+    snap_camera = false;
+}
+
+/*
+  The symbolic observation has num_entities rows of (type, x, y, rx, ry). The first row is the agent in world
+  coordinates, followed by the nearest other entities in order of distance, relative to the agent. Unused rows
+  have type INVALID_OBJ and zeros elsewhere.
+
+  grid_obs holds the types of the grid_dim x grid_dim cells centered on the agent, with the top row at the highest y
+  like the rgb observation. Cells outside the world are out_of_bounds_object.
+*/
+void BasicAbstractGame::game_observe_symbolic(float *obs, int num_entities, uint8_t *grid_obs, int grid_dim) {
+    // pairs of squared distance and entity index, the index breaks ties deterministically
+    static thread_local std::vector<std::pair<float, int>> nearest;
+    nearest.clear();
+    nearest.reserve(entities.capacity());
+
+    for (int i = 0; i < (int)(entities.size()); i++) {
+        const auto &ent = entities[i];
+        if (ent == agent || ent->will_erase) {
+            continue;
+        }
+        float dx = ent->x - agent->x;
+        float dy = ent->y - agent->y;
+        nearest.emplace_back(dx * dx + dy * dy, i);
+    }
+
+    int num_nearest = std::min((int)(nearest.size()), num_entities - 1);
+    std::partial_sort(nearest.begin(), nearest.begin() + num_nearest, nearest.end());
+
+    auto write_row = [](float *row, const Entity &ent, float x_origin, float y_origin) {
+        row[0] = float(ent.type);
+        row[1] = ent.x - x_origin;
+        row[2] = ent.y - y_origin;
+        row[3] = ent.rx;
+        row[4] = ent.ry;
+    };
+
+    write_row(obs, *agent, 0, 0);
+
+    for (int k = 1; k < num_entities; k++) {
+        float *row = obs + k * SYMBOLIC_ENTITY_FEATURES;
+        if (k <= num_nearest) {
+            write_row(row, *entities[nearest[k - 1].second], agent->x, agent->y);
+        } else {
+            row[0] = float(INVALID_OBJ);
+            std::fill(row + 1, row + SYMBOLIC_ENTITY_FEATURES, 0.0f);
+        }
+    }
+
+    if (grid_obs == nullptr) {
+        return;
+    }
+
+    int low_x = int(floor(agent->x)) - grid_dim / 2;
+    int low_y = int(floor(agent->y)) - grid_dim / 2;
+
+    for (int row = 0; row < grid_dim; row++) {
+        int y = low_y + grid_dim - 1 - row;
+        for (int col = 0; col < grid_dim; col++) {
+            grid_obs[row * grid_dim + col] = uint8_t(get_obj(low_x + col, y));
+        }
+    }
+}
+
+/*
+  The software renderer mirrors draw_background() and draw_foreground(), backgrounds and sprites
+  come from the same caches as options.cache_background and options.cache_sprites, so the frames
+  match those options rather than the default rendering.
+*/
+bool BasicAbstractGame::game_draw_raster(RasterTarget &dst) {
+    if (!supports_software_render) {
+        return false;
+    }
+
+    ::raster_fill_rect(dst, 0, 0, dst.w, dst.h, 0xff000000);
+
+    prepare_for_drawing(dst.h);
+
+    if (options.use_backgrounds && dst.commands != nullptr) {
+        QRectF main_rect = get_screen_rect(0, main_height, main_width, main_height);
+        if (bg_tile_ratio < 0) {
+            raster_record_background(dst, main_rect, bg_tile_ratio);
+        } else {
+            raster_record_background(dst, get_background_bounds(main_rect), 0);
+        }
+    } else if (options.use_backgrounds) {
+        QRectF main_rect = get_screen_rect(0, main_height, main_width, main_height);
+        BackgroundCache *cache = lookup_background_cache(QPainter::RenderHints(), main_rect);
+        const QImage &image = cache->image;
+        raster_copy(dst, int(round(main_rect.x() + cache->offset_x)), int(round(main_rect.y() + cache->offset_y)), (const uint32_t *)image.constBits(), image.width(), image.height(), image.bytesPerLine() / 4);
+    }
+
+    raster_draw_foreground(dst);
+
+    return true;
+}
+
+void BasicAbstractGame::raster_draw_foreground(RasterTarget &dst) {
+    prepare_for_drawing(dst.h);
+
+    for (int render_z = -1; render_z <= 1; render_z++) {
+        if (render_z == 0) {
+            // grid objects are drawn between the entities with render_z -1 and 0
+            raster_draw_grid(dst);
+        }
+
+        for (const auto &ent : entities) {
+            if (ent->render_z == render_z && should_draw_entity(ent)) {
+                raster_draw_image(dst, get_object_rect(ent), ent->rotation, ent->is_reflected, ent->image_type, ent->image_theme, ent->alpha, get_tile_aspect_ratio(ent));
+            }
+        }
+    }
+
+    if (has_useful_vel_info && (options.paint_vel_info)) {
+        float infodim = dst.h * .2;
+        int s1 = to_shade(.5 * agent->vx / maxspeed + .5);
+        int s2 = to_shade(.5 * agent->vy / max_jump + .5);
+        raster_fill_rect(dst, QRectF(0, 0, infodim, infodim), QColor(s1, s1, s1));
+        raster_fill_rect(dst, QRectF(infodim, 0, infodim, infodim), QColor(s2, s2, s2));
+    }
+}
+
+void BasicAbstractGame::raster_draw_grid(RasterTarget &dst) {
+    int low_x, high_x, low_y, high_y;
+    get_visible_grid_range(low_x, high_x, low_y, high_y);
+
+    if (!options.draw_grid_runs) {
+        for (int x = low_x; x <= high_x; x++) {
+            for (int y = low_y; y <= high_y; y++) {
+                int type = get_obj(x, y);
+
+                if (type == INVALID_OBJ) {
+                    continue;
+                }
+
+                QRectF r2 = get_screen_rect(x, y + 1, 1, 1, RENDER_EPS);
+                raster_draw_image(dst, r2, 0, false, type, theme_for_grid_obj(type), 1.0, 0.0);
+            }
+        }
+        return;
+    }
+
+    for (int x = low_x; x <= high_x; x++) {
+        get_visible_column_runs(x, low_y, high_y, visible_runs);
+
+        for (const auto &run : visible_runs) {
+            int img_type = image_for_type(run.type);
+
+            if (run.type == INVALID_OBJ || img_type < 0 || img_type == SPACE) {
+                continue;
+            }
+
+            int theme = theme_for_grid_obj(run.type);
+
+            if (options.use_monochrome_assets || img_type >= USE_ASSET_THRESHOLD) {
+                // neighboring cells overlap by RENDER_EPS, so one opaque fill from the top of the run to the
+                // bottom covers the same pixels as filling each cell
+                QColor color = color_for_type(img_type, theme);
+
+                if (color.alpha() == 255) {
+                    QRectF top = get_screen_rect(x, run.y + run.length, 1, 1, RENDER_EPS);
+                    QRectF bottom = get_screen_rect(x, run.y + 1, 1, 1, RENDER_EPS);
+                    ::raster_fill_rect(dst, int(round(top.x())), int(round(top.y())), int(round(top.x() + top.width())), int(round(bottom.y() + bottom.height())), color.rgba());
+                    continue;
+                }
+            }
+
+            for (int y = run.y; y < run.y + run.length; y++) {
+                QRectF r2 = get_screen_rect(x, y + 1, 1, 1, RENDER_EPS);
+                raster_draw_image(dst, r2, 0, false, run.type, theme, 1.0, 0.0);
+            }
+        }
+    }
+}
+
+void BasicAbstractGame::raster_draw_image(RasterTarget &dst, const QRectF &base_rect, float rotation, bool is_reflected, int base_type, int theme, float alpha, float tile_ratio) {
+    int img_type = image_for_type(base_type);
+
+    if (img_type < 0) {
+        return;
+    }
+
+    if (options.use_monochrome_assets || img_type >= USE_ASSET_THRESHOLD) {
+        if (img_type != SPACE) {
+            raster_fill_rect(dst, base_rect, color_for_type(img_type, theme));
+        }
+        return;
+    }
+
+    int img_idx = img_type + theme * MAX_ASSETS;
+    fassert(theme < MAX_IMAGE_THEMES);
+
+    QRectF adjusted_rect = get_adjusted_image_rect(img_type, base_rect);
+
+    if (tile_ratio == 0) {
+        raster_draw_sprite(dst, adjusted_rect, rotation, is_reflected, img_idx, alpha);
+        return;
+    }
+
+    float tile_dx, tile_dy, tile_width, tile_height;
+    int num_tiles = get_tile_layout(adjusted_rect, tile_ratio, tile_dx, tile_dy, tile_width, tile_height);
+
+    for (int i = 0; i < num_tiles; i++) {
+        QRectF tile_rect = QRectF(adjusted_rect.x() + tile_dx * i, adjusted_rect.y() + tile_dy * i, tile_width, tile_height);
+        raster_draw_sprite(dst, tile_rect, 0, is_reflected, img_idx, alpha);
+    }
+}
+
+// rotations that are not a multiple of 90 degrees are snapped to the closest one
+void BasicAbstractGame::raster_draw_sprite(RasterTarget &dst, const QRectF &rect, float rotation, bool is_reflected, int img_idx, float alpha) {
+    int quarter_turns;
+    QRect box;
+    get_sprite_box(rect, rotation, quarter_turns, box);
+
+    if (box.width() <= 0 || box.height() <= 0) {
+        return;
+    }
+
+    if (dst.commands != nullptr) {
+        DrawCommand cmd;
+        cmd.kind = DRAW_IMAGE;
+        cmd.asset = img_idx % MAX_ASSETS;
+        cmd.theme = img_idx / MAX_ASSETS;
+        cmd.is_reflected = is_reflected;
+        cmd.x = rect.x();
+        cmd.y = rect.y();
+        cmd.w = rect.width();
+        cmd.h = rect.height();
+        cmd.rotation = rotation;
+        cmd.alpha = alpha;
+        dst.commands->push_back(cmd);
+        return;
+    }
+
+    QImage *scaled_ptr = lookup_scaled_asset(QPainter::RenderHints(), img_idx, is_reflected, quarter_turns, box.width(), box.height());
+    raster_blend(dst, box.x(), box.y(), (const uint32_t *)scaled_ptr->constBits(), scaled_ptr->width(), scaled_ptr->height(), scaled_ptr->bytesPerLine() / 4, alpha);
+}
+
+void BasicAbstractGame::raster_fill_rect(RasterTarget &dst, const QRectF &rect, const QColor &color) {
+    ::raster_fill_rect(dst, int(round(rect.x())), int(round(rect.y())), int(round(rect.x() + rect.width())), int(round(rect.y() + rect.height())), color.rgba());
+}
+
+void BasicAbstractGame::raster_record_background(RasterTarget &dst, const QRectF &rect, float tile_ratio) {
+    float tile_dx = 0, tile_dy = 0, tile_width = rect.width(), tile_height = rect.height();
+    int num_tiles = 1;
+
+    if (tile_ratio != 0) {
+        num_tiles = get_tile_layout(rect, tile_ratio, tile_dx, tile_dy, tile_width, tile_height);
+    }
+
+    for (int i = 0; i < num_tiles; i++) {
+        DrawCommand cmd;
+        cmd.kind = DRAW_BACKGROUND;
+        cmd.asset = background_index;
+        cmd.x = rect.x() + tile_dx * i;
+        cmd.y = rect.y() + tile_dy * i;
+        cmd.w = tile_width;
+        cmd.h = tile_height;
+
+        if (cmd.x < dst.w && cmd.x + cmd.w > 0 && cmd.y < dst.h && cmd.y + cmd.h > 0) {
+            dst.commands->push_back(cmd);
+        }
+    }
+}
+
+const QImage *BasicAbstractGame::draw_list_image(DrawKind kind, int asset, int theme) {
+    if (kind == DRAW_BACKGROUND) {
+        if (asset < 0 || asset >= (int)(main_bg_images_ptr->size())) {
+            return nullptr;
+        }
+        return main_bg_images_ptr->at(asset).get();
+    }
+
+    if (kind != DRAW_IMAGE || asset < 0 || asset >= MAX_ASSETS || theme < 0 || theme >= MAX_IMAGE_THEMES) {
+        return nullptr;
+    }
+
+    return lookup_asset(asset + theme * MAX_ASSETS);
+}
+
 void BasicAbstractGame::match_aspect_ratio(const std::shared_ptr<Entity> &ent, bool match_width) {
     int img_idx = ent->image_type + ent->image_theme * MAX_ASSETS;
     initialize_asset_if_necessary(img_idx);
 
     if (match_width) {
-        ent->ry = ent->rx / asset_aspect_ratios[img_idx];
+        ent->ry = ent->rx / asset_table->get(img_idx)->aspect_ratio;
     } else {
-        ent->rx = ent->ry * asset_aspect_ratios[img_idx];
+        ent->rx = ent->ry * asset_table->get(img_idx)->aspect_ratio;
     }
 }
 
@@ -1030,7 +1739,7 @@ void BasicAbstractGame::fit_aspect_ratio(const std::shared_ptr<Entity> &ent) {
     int img_idx = ent->image_type + ent->image_theme * MAX_ASSETS;
     initialize_asset_if_necessary(img_idx);
 
-    float ar = asset_aspect_ratios[img_idx];
+    float ar = asset_table->get(img_idx)->aspect_ratio;
 
     if (ar > 1) {
         ent->ry = ent->rx / ar;
@@ -1041,12 +1750,12 @@ void BasicAbstractGame::fit_aspect_ratio(const std::shared_ptr<Entity> &ent) {
 
 void BasicAbstractGame::choose_random_theme(const std::shared_ptr<Entity> &ent) {
     initialize_asset_if_necessary(ent->image_type);
-    ent->image_theme = rand_gen.randn(asset_num_themes[ent->image_type]);
+    ent->image_theme = rand_gen.randn(asset_table->get(ent->image_type)->num_themes);
 }
 
 void BasicAbstractGame::choose_step_random_theme(const std::shared_ptr<Entity> &ent) {
     initialize_asset_if_necessary(ent->image_type);
-    ent->image_theme = step_rand_int % asset_num_themes[ent->image_type];
+    ent->image_theme = step_rand_int % asset_table->get(ent->image_type)->num_themes;
 }
 
 bool BasicAbstractGame::should_draw_entity(const std::shared_ptr<Entity> &entity) {
@@ -1091,7 +1800,7 @@ void BasicAbstractGame::step_entities(const std::vector<std::shared_ptr<Entity>>
     int entities_count = (int)(given.size());
 
     for (int i = entities_count - 1; i >= 0; i--) {
-        auto ent = given.at(i);
+        const auto &ent = given.at(i);
 
         if (ent->smart_step) {
             basic_step_object(ent);
@@ -1116,8 +1825,22 @@ float BasicAbstractGame::rand_pos(float r, float max) {
 }
 
 bool BasicAbstractGame::has_any_collision(const std::shared_ptr<Entity> &e1, float margin) {
+    if (entity_grid.is_valid()) {
+        entity_grid.query(e1->x, e1->y, e1->rx, e1->ry, margin, collision_candidates);
+
+        for (int i : collision_candidates) {
+            const auto &ent = entities[i];
+
+            if (!ent->avoids_collisions && has_collision(e1, ent, margin)) {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
     for (int i = (int)(entities.size()) - 1; i >= 0; i--) {
-        auto ent = entities.at(i);
+        const auto &ent = entities.at(i);
 
         if (!ent->avoids_collisions && has_collision(e1, ent, margin)) {
             return true;
@@ -1164,12 +1887,20 @@ void BasicAbstractGame::write_entities(WriteBuffer *b, std::vector<std::shared_p
 void BasicAbstractGame::read_entities(ReadBuffer *b, std::vector<std::shared_ptr<Entity>> &ents) {
     ents.resize(b->read_int());
     for (size_t i = 0; i < ents.size(); i++) {
-        auto e = std::make_shared<Entity>();
+        auto e = make_entity();
         e->deserialize(b);
         ents[i] = e;
     }
 }
 
+// the copies come from our own entity pool, the pool of src_ents may belong to a game on another thread
+void BasicAbstractGame::copy_entities(const std::vector<std::shared_ptr<Entity>> &src_ents, std::vector<std::shared_ptr<Entity>> &ents) {
+    ents.resize(src_ents.size());
+    for (size_t i = 0; i < src_ents.size(); i++) {
+        ents[i] = make_entity(*src_ents[i]);
+    }
+}
+
 void BasicAbstractGame::serialize(WriteBuffer *b) {
     Game::serialize(b);
 
@@ -1179,14 +1910,11 @@ void BasicAbstractGame::serialize(WriteBuffer *b) {
 
     fassert(!options.use_generated_assets);
     // these will be cleared and re-generated instead of being saved
-//     std::vector<std::shared_ptr<QImage>> basic_assets;
-//     std::vector<std::shared_ptr<QImage>> basic_reflections;
+    // SharedAssetTable *asset_table;
+    // std::vector<bool> asset_initialized;
 //     std::vector<std::shared_ptr<QImage>> *main_bg_images_ptr;
 
-    // std::vector<float> asset_aspect_ratios;
-    // std::vector<int> asset_num_themes;
-
-    b->write_int(use_procgen_background);
+    b->write_bool(use_procgen_background);
     b->write_int(background_index);
     b->write_float(bg_tile_ratio);
     b->write_float(bg_pct_x);
@@ -1206,8 +1934,8 @@ void BasicAbstractGame::serialize(WriteBuffer *b) {
     b->write_float(center_x);
     b->write_float(center_y);
 
-    b->write_int(random_agent_start);
-    b->write_int(has_useful_vel_info);
+    b->write_bool(random_agent_start);
+    b->write_bool(has_useful_vel_info);
     b->write_int(step_rand_int);
 
     asset_rand_gen.serialize(b);
@@ -1243,15 +1971,12 @@ void BasicAbstractGame::deserialize(ReadBuffer *b) {
 
     // when restoring state (to the same game type) with generated assets disabled, these data structures contain cached
     // asset data, and missing data will be filled in the same way in all environments
-//     std::vector<std::shared_ptr<QImage>> basic_assets;
-//     std::vector<std::shared_ptr<QImage>> basic_reflections;
+    // SharedAssetTable *asset_table;
+    // std::vector<bool> asset_initialized;
     // main_bg_images_ptr is set in game_init for all supported games, so it should always be the same
 //     std::vector<std::shared_ptr<QImage>> *main_bg_images_ptr;
 
-    // std::vector<float> asset_aspect_ratios;
-    // std::vector<int> asset_num_themes;
-
-    use_procgen_background = b->read_int();
+    use_procgen_background = b->read_bool();
     background_index = b->read_int();
     bg_tile_ratio = b->read_float();
     bg_pct_x = b->read_float();
@@ -1271,8 +1996,8 @@ void BasicAbstractGame::deserialize(ReadBuffer *b) {
     center_x = b->read_float();
     center_y = b->read_float();
 
-    random_agent_start = b->read_int();
-    has_useful_vel_info = b->read_int();
+    random_agent_start = b->read_bool();
+    has_useful_vel_info = b->read_bool();
     step_rand_int = b->read_int();
 
     asset_rand_gen.deserialize(b);
@@ -1289,4 +2014,73 @@ void BasicAbstractGame::deserialize(ReadBuffer *b) {
     min_visibility = b->read_float();
 
     grid.deserialize(b);
+    reindex_grid();
+
+    background_caches.clear();
+    retained_frame_valid = false;
+}
+
+void BasicAbstractGame::summarize_level(LevelSummary &summary) {
+    summary.width = main_width;
+    summary.height = main_height;
+    summary.num_entities = (int32_t)(entities.size());
+}
+
+void BasicAbstractGame::copy_state(const Game &src) {
+    Game::copy_state(src);
+    const auto &other = static_cast<const BasicAbstractGame &>(src);
+
+    grid_size = other.grid_size;
+
+    copy_entities(other.entities, entities);
+
+    int agent_idx = find_entity_index(PLAYER);
+    fassert(agent_idx >= 0);
+    agent = entities[agent_idx];
+
+    // the assets are shared in the same way as for deserialize(), which has the same restriction
+    fassert(!options.use_generated_assets);
+
+    use_procgen_background = other.use_procgen_background;
+    background_index = other.background_index;
+    bg_tile_ratio = other.bg_tile_ratio;
+    bg_pct_x = other.bg_pct_x;
+
+    char_dim = other.char_dim;
+    last_move_action = other.last_move_action;
+    move_action = other.move_action;
+    special_action = other.special_action;
+    mixrate = other.mixrate;
+    maxspeed = other.maxspeed;
+    max_jump = other.max_jump;
+
+    action_vx = other.action_vx;
+    action_vy = other.action_vy;
+    action_vrot = other.action_vrot;
+
+    center_x = other.center_x;
+    center_y = other.center_y;
+
+    random_agent_start = other.random_agent_start;
+    has_useful_vel_info = other.has_useful_vel_info;
+    step_rand_int = other.step_rand_int;
+
+    asset_rand_gen = other.asset_rand_gen;
+
+    main_width = other.main_width;
+    main_height = other.main_height;
+    out_of_bounds_object = other.out_of_bounds_object;
+
+    unit = other.unit;
+    view_dim = other.view_dim;
+    x_off = other.x_off;
+    y_off = other.y_off;
+    visibility = other.visibility;
+    min_visibility = other.min_visibility;
+
+    grid = other.grid;
+    reindex_grid();
+
+    background_caches.clear();
+    retained_frame_valid = false;
 }
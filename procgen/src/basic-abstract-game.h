@@ -7,12 +7,27 @@ Base game class used by all currently existing games
 */
 
 #include <string>
+#include <cstdint>
+#include <cmath>
+#include <type_traits>
 #include <set>
 #include <queue>
+#include <unordered_map>
 #include "game.h"
 #include "grid.h"
+#include "entity-grid.h"
+#include "cell-index.h"
+#include "entity-pool.h"
 #include "cpp-utils.h"
 
+struct SharedAsset;
+struct SharedAssetTable;
+
+// A small constant buffer for handling collision detction and object pushing
+const float POS_EPS = -0.001f;
+// the entity list starts with room for the entities of nearly any level, so that stepping doesn't grow it
+const int ENTITY_CAPACITY = 256;
+
 class BasicAbstractGame : public Game {
   public:
     int grid_size = 0;
@@ -23,13 +38,20 @@ class BasicAbstractGame : public Game {
     // Game methods
     void game_step() override;
     void game_reset() override;
+    void game_after_reset() override;
     void game_draw(QPainter &p, const QRect &rect) override;
+    bool game_draw_raster(RasterTarget &dst) override;
+    const QImage *draw_list_image(DrawKind kind, int asset, int theme) override;
+    void game_observe_symbolic(float *obs, int num_entities, uint8_t *grid_obs, int grid_dim) override;
     void game_init() override;
     void serialize(WriteBuffer *b) override;
     void deserialize(ReadBuffer *b) override;
+    void copy_state(const Game &src) override;
+    void summarize_level(LevelSummary &summary) override;
 
     void write_entities(WriteBuffer *b, std::vector<std::shared_ptr<Entity>> &ents);
     void read_entities(ReadBuffer *b, std::vector<std::shared_ptr<Entity>> &ents);
+    void copy_entities(const std::vector<std::shared_ptr<Entity>> &src_ents, std::vector<std::shared_ptr<Entity>> &ents);
 
     virtual bool is_blocked(const std::shared_ptr<Entity> &src, int target, bool is_horizontal);
     virtual bool is_blocked_ents(const std::shared_ptr<Entity> &src, const std::shared_ptr<Entity> &target, bool is_horizontal);
@@ -46,6 +68,7 @@ class BasicAbstractGame : public Game {
     virtual int theme_for_grid_obj(int type);
     virtual bool should_preserve_type_themes(int type);
     virtual QColor color_for_type(int type, int theme);
+    // the grid cells of SPACE are skipped without calling this
     virtual void draw_grid_obj(QPainter &p, const QRectF &rect, int type, int theme);
     virtual void choose_world_dim();
     virtual bool should_draw_entity(const std::shared_ptr<Entity> &entity);
@@ -61,6 +84,9 @@ class BasicAbstractGame : public Game {
     void tile_image(QPainter &p, std::shared_ptr<QImage> image, QRectF &rect, float tile_ratio);
     void set_pen_brush_color(QPainter &p, QColor color, int thickness = 1);
     void basic_step_object(const std::shared_ptr<Entity> &obj);
+    // called by REGISTER_GAME with the class of the game, see step_object_kernel()
+    template <typename G>
+    static void specialize(G &game);
     std::shared_ptr<Entity> spawn_entity_rxy(float rx, float ry, int type, float x, float y, float w, float h, bool check_collisions = true);
     std::shared_ptr<Entity> spawn_entity(float r, int type, float x, float y, float w, float h, bool check_collisions = true);
     std::shared_ptr<Entity> spawn_entity_at_idx(int idx, float r, int type);
@@ -87,6 +113,16 @@ class BasicAbstractGame : public Game {
     void choose_random_theme(const std::shared_ptr<Entity> &ent);
     int mask_theme_if_necessary(int theme, int type);
     void tile_image(QPainter &p, QImage *image, const QRectF &rect, float tile_ratio);
+    int get_tile_layout(const QRectF &rect, float tile_ratio, float &tile_dx, float &tile_dy, float &tile_width, float &tile_height);
+    void get_visible_grid_range(int &low_x, int &high_x, int &low_y, int &high_y);
+
+    // software renderer used for options.software_render, see game_draw_raster()
+    void raster_draw_foreground(RasterTarget &dst);
+    void raster_draw_image(RasterTarget &dst, const QRectF &rect, float rotation, bool is_reflected, int img_idx, int theme, float alpha, float tile_ratio);
+    void raster_fill_rect(RasterTarget &dst, const QRectF &rect, const QColor &color);
+    // add the DRAW_BACKGROUND commands of the background image tiled over rect like tile_image(), for dst.commands
+    void raster_record_background(RasterTarget &dst, const QRectF &rect, float tile_ratio);
+    QImage *lookup_scaled_background(QPainter::RenderHints hints, int width, int height);
 
     float rand_pos(float r, float max);
     float rand_pos(float r, float min, float max);
@@ -106,20 +142,32 @@ class BasicAbstractGame : public Game {
 
     void step_entities(const std::vector<std::shared_ptr<Entity>> &given);
 
+    // the parts of game_step(), in order, for games that replace one of them
+    void apply_action();
+    void resolve_collisions();
+    void resolve_collisions_static();
+    void finish_step();
+
     void erase_if_needed();
 
     bool agent_has_collision();
     void reposition_agent();
 
+    // allocate an entity from the entity pool, this should be used instead of new Entity or std::make_shared<Entity>
+    template <typename... Args>
+    std::shared_ptr<Entity> make_entity(Args &&... args) {
+        return std::allocate_shared<Entity>(PoolAllocator<Entity>(entity_pool), std::forward<Args>(args)...);
+    }
+
   protected:
+    // declared before any entity handles, allocations keep the pool alive anyway but this way it's freed last
+    std::shared_ptr<EntityPool> entity_pool = std::make_shared<EntityPool>();
     std::shared_ptr<Entity> agent;
     std::vector<std::shared_ptr<Entity>> entities;
-    std::vector<std::shared_ptr<QImage>> basic_assets;
-    std::vector<std::shared_ptr<QImage>> basic_reflections;
+    // the assets are shared by the games with the same asset options, see SharedAssetTable in basic-abstract-game.cpp
+    SharedAssetTable *asset_table = nullptr;
+    std::vector<bool> asset_initialized;
     std::vector<std::shared_ptr<QImage>> *main_bg_images_ptr;
-
-    std::vector<float> asset_aspect_ratios;
-    std::vector<int> asset_num_themes;
     
     bool use_procgen_background = false;
     int background_index = 0;
@@ -143,7 +191,13 @@ class BasicAbstractGame : public Game {
 
     bool random_agent_start = true;
     bool has_useful_vel_info = false;
+    // set by games that draw only with the default BasicAbstractGame methods, or that override game_draw_raster()
+    bool supports_software_render = false;
+    // set by games that draw only with the default BasicAbstractGame methods, see draw_incremental()
+    bool supports_incremental_render = false;
     int step_rand_int = 0;
+    // cleared while stepping an object that no entity can block or reflect, sub_step() then only checks the grid
+    bool sub_step_checks_entities = true;
 
     RandGen asset_rand_gen;
 
@@ -159,16 +213,337 @@ class BasicAbstractGame : public Game {
     float min_visibility = 0.0f;
 
   private:
-    Grid<int> grid;
+    // every write goes through set_cell() or is followed by reindex_grid(), so that cell_index stays up to date
+    Grid<GridCell> grid;
+    CellIndex cell_index;
+
+    // broadphase for the entity collision loops, only valid while no entity can have moved since it was built
+    EntityGrid entity_grid;
+    std::vector<int> collision_candidates;
+    // scratch space for drawing the grid
+    std::vector<CellRun> visible_runs;
+
+    // scratch space for resolve_collisions_static()
+    std::vector<float> box_x;
+    std::vector<float> box_y;
+    std::vector<float> box_rx;
+    std::vector<float> box_ry;
+    std::vector<float> box_margin;
+    std::vector<uint8_t> agent_hits;
+
+    // with options.cache_background, the background is rendered once per level for each
+    // render resolution in use and then blitted unscaled on every frame
+    struct BackgroundCache {
+        float unit = 0.0f;
+        float offset_x = 0.0f;
+        float offset_y = 0.0f;
+        QImage image;
+    };
+    std::vector<BackgroundCache> background_caches;
+
+    // with options.cache_sprites, assets are kept pre-scaled (and pre-reflected and pre-rotated)
+    // at each pixel size they are drawn at, keyed by asset, orientation and size
+    std::unordered_map<uint64_t, QImage> sprite_cache;
+
+    // with options.incremental_render, the last hi-res frame along with the camera it was drawn with and the
+    // pixels that its entities and grid cells cover, retained_frame_valid is cleared whenever the level changes
+    QImage retained_frame;
+    bool retained_frame_valid = false;
+    float retained_unit = 0.0f;
+    float retained_x_off = 0.0f;
+    float retained_y_off = 0.0f;
+    std::vector<QRect> retained_entity_boxes;
+    std::vector<GridCell> retained_grid;
+    // round the camera offset to whole pixels, so that a scroll moves the frame by whole pixels
+    bool snap_camera = false;
 
     QImage *lookup_asset(int img_idx, bool is_reflected = false);
+    QImage *lookup_scaled_image(uint64_t key, const QImage &src, QPainter::RenderHints hints, int quarter_turns, int width, int height);
+    QImage *lookup_scaled_asset(QPainter::RenderHints hints, int img_idx, bool is_reflected, int quarter_turns, int width, int height);
+    bool get_sprite_box(const QRectF &rect, float rotation, int &quarter_turns, QRect &box);
+    bool draw_cached_sprite(QPainter &p, const QRectF &rect, float rotation, bool is_reflected, int img_idx);
+    void raster_draw_sprite(RasterTarget &dst, const QRectF &rect, float rotation, bool is_reflected, int img_idx, float alpha);
     void initialize_asset_if_necessary(int img_idx);
+    SharedAsset create_asset(int type, int theme);
     void prepare_for_drawing(float rect_height);
     void draw_background(QPainter &p, const QRect &rect);
+    void paint_background(QPainter &p, const QRectF &main_rect);
+    QRectF get_background_bounds(const QRectF &main_rect);
+    BackgroundCache *lookup_background_cache(QPainter::RenderHints hints, const QRectF &main_rect);
+    void draw_cached_background(QPainter &p, const QRectF &main_rect);
+    void collide_with_entities(int ent_idx);
     void draw_entity(QPainter &p, const std::shared_ptr<Entity> &to_draw);
     void draw_entities(QPainter &p, const std::vector<std::shared_ptr<Entity>> &to_draw, int render_z = 0);
     void draw_image(QPainter &p, QRectF &rect, float rotation, bool is_reflected, int img_idx, int theme, float alpha, float tile_ratio);
+    void draw_incremental(QPainter &p, const QRect &rect);
+    QRect get_draw_box(const QRectF &rect, int type, float rotation);
+    void set_cell(int idx, int elem);
+    void reindex_grid();
+    void get_visible_column_runs(int x, int low_y, int high_y, std::vector<CellRun> &runs);
+    void draw_grid(QPainter &p);
+    void raster_draw_grid(RasterTarget &dst);
+
+    // basic_step_object() compiled for the class of the game, or for any game when it's BasicAbstractGame
+    void (BasicAbstractGame::*basic_step_object_fn)(const std::shared_ptr<Entity> &obj);
 
+    template <typename G>
+    void step_object_kernel(const std::shared_ptr<Entity> &obj);
+    template <typename G>
     bool sub_step(const std::shared_ptr<Entity> &obj, float _vx, float _vy, int depth);
+    template <typename G>
+    bool push_obj_kernel(const std::shared_ptr<Entity> &src, const std::shared_ptr<Entity> &target, bool is_horizontal, int depth);
+    template <typename G>
+    bool kernel_is_blocked(const std::shared_ptr<Entity> &src, int target, bool is_horizontal);
+    template <typename G>
+    bool kernel_is_blocked_ents(const std::shared_ptr<Entity> &src, const std::shared_ptr<Entity> &target, bool is_horizontal);
+    template <typename G>
+    bool kernel_will_reflect(int src, int target);
     bool should_erase(const std::shared_ptr<Entity> &e1);
 };
+
+/*
+  The physics of basic_step_object() probe is_blocked() and will_reflect() several times per sub step, which as
+  virtual calls can't be inlined. REGISTER_GAME calls specialize() with the class of each game, which compiles the
+  physics again with the predicates of that class called directly, so they are inlined into the loops. The game
+  created by REGISTER_GAME has exactly that class, so calling its overrides directly is the same as calling them
+  through the vtable. Any other game, or one with options.step_kernels cleared, keeps the virtual calls.
+*/
+template <typename G>
+void BasicAbstractGame::specialize(G &game) {
+    static_assert(std::is_base_of<BasicAbstractGame, G>::value, "specialize() is for subclasses of BasicAbstractGame");
+    game.basic_step_object_fn = &BasicAbstractGame::step_object_kernel<G>;
+}
+
+template <typename G>
+bool BasicAbstractGame::kernel_is_blocked(const std::shared_ptr<Entity> &src, int target, bool is_horizontal) {
+    if constexpr (std::is_same<G, BasicAbstractGame>::value) {
+        return is_blocked(src, target, is_horizontal);
+    } else {
+        return static_cast<G *>(this)->G::is_blocked(src, target, is_horizontal);
+    }
+}
+
+template <typename G>
+bool BasicAbstractGame::kernel_is_blocked_ents(const std::shared_ptr<Entity> &src, const std::shared_ptr<Entity> &target, bool is_horizontal) {
+    if constexpr (std::is_same<G, BasicAbstractGame>::value) {
+        return is_blocked_ents(src, target, is_horizontal);
+    } else {
+        return static_cast<G *>(this)->G::is_blocked_ents(src, target, is_horizontal);
+    }
+}
+
+template <typename G>
+bool BasicAbstractGame::kernel_will_reflect(int src, int target) {
+    if constexpr (std::is_same<G, BasicAbstractGame>::value) {
+        return will_reflect(src, target);
+    } else {
+        return static_cast<G *>(this)->G::will_reflect(src, target);
+    }
+}
+
+template <typename G>
+bool BasicAbstractGame::push_obj_kernel(const std::shared_ptr<Entity> &src, const std::shared_ptr<Entity> &target, bool is_horizontal, int depth) {
+    float rsum = is_horizontal ? (src->rx + target->rx) : (src->ry + target->ry);
+    float delx = target->x - src->x;
+    float dely = target->y - src->y;
+    float t_vx = 0;
+    float t_vy = 0;
+
+    if (is_horizontal) {
+        t_vx = src->x + sign(delx) * rsum - target->x;
+    } else {
+        t_vy = src->y + sign(dely) * rsum - target->y;
+    }
+
+    bool block = false;
+
+    // Rare numerical conditions (dependent on POS_EPS) could cause infinite loops.
+    // For now we break quit after a small depth.
+    if (depth < 5) {
+        block = sub_step<G>(target, t_vx, t_vy, depth + 1);
+    }
+
+    if (is_horizontal) {
+        target->vx = 0;
+    } else {
+        target->vy = 0;
+    }
+
+    return block;
+}
+
+template <typename G>
+bool BasicAbstractGame::sub_step(const std::shared_ptr<Entity> &obj, float _vx, float _vy, int depth) {
+    if (obj->will_erase)
+        return false;
+
+    float ny = obj->y + _vy;
+    float nx = obj->x + _vx;
+
+    float margin = 0.98f;
+
+    bool is_horizontal = _vx != 0;
+
+    bool block = false;
+    bool reflect = false;
+
+    for (int i = 0; i < 2; i++) {
+        for (int j = 0; j < 2; j++) {
+            int type2 = get_obj_from_floats(nx + obj->rx * margin * (2 * i - 1), ny + obj->ry * margin * (2 * j - 1));
+            block = block || kernel_is_blocked<G>(obj, type2, is_horizontal);
+            reflect = reflect || kernel_will_reflect<G>(obj->type, type2);
+        }
+    }
+
+    if (reflect) {
+        if (is_horizontal) {
+            float delta;
+
+            if (_vx < 0) {
+                delta = ceil(nx - obj->rx) - (nx - obj->rx);
+            } else {
+                delta = floor(nx + obj->rx) - (nx + obj->rx);
+            }
+
+            obj->vx = -1 * obj->vx;
+            nx = nx + 2 * delta;
+        } else {
+            float delta;
+
+            if (_vy < 0) {
+                delta = ceil(ny - obj->ry) - (ny - obj->ry);
+            } else {
+                delta = floor(ny + obj->ry) - (ny + obj->ry);
+            }
+
+            obj->vy = -1 * obj->vy;
+            ny = ny + 2 * delta;
+        }
+    } else if (block) {
+        if (is_horizontal) {
+            if (grid_step) {
+                nx = obj->x;
+            } else {
+                nx = _vx > 0 ? (floor(nx + obj->rx) - obj->rx) : (ceil(nx - obj->rx) + obj->rx);
+            }
+        } else {
+            if (grid_step) {
+                ny = obj->y;
+            } else {
+                ny = _vy > 0 ? (floor(ny + obj->ry) - obj->ry) : (ceil(ny - obj->ry) + obj->ry);
+            }
+        }
+    }
+
+    obj->x = nx;
+    obj->y = ny;
+
+    bool block2 = false;
+
+    if (!sub_step_checks_entities) {
+        return block;
+    }
+
+    for (int i = (int)(entities.size()) - 1; i >= 0; i--) {
+        // nothing in this loop adds or removes entities, so a reference avoids refcounting on this hot path
+        const auto &m = entities[i];
+
+        if (m == obj || m->will_erase) {
+            continue;
+        }
+
+        bool curr_block = false;
+
+        if (has_collision(obj, m, POS_EPS)) {
+            if (kernel_is_blocked_ents<G>(obj, m, is_horizontal)) {
+                curr_block = true;
+            } else if (kernel_will_reflect<G>(obj->type, m->type)) {
+                if (is_horizontal) {
+                    float delx = m->x - obj->x;
+                    float rsum = m->rx + obj->rx;
+                    obj->x += _vx > 0 ? -2 * (rsum - delx) : 2 * (rsum + delx);
+                    obj->vx = -1 * obj->vx;
+                } else {
+                    float dely = m->y - obj->y;
+                    float rsum = m->ry + obj->ry;
+                    obj->y += _vy > 0 ? -2 * (rsum - dely) : 2 * (rsum + dely);
+                    obj->vy = -1 * obj->vy;
+                }
+            }
+
+            if (curr_block) {
+                push_obj_kernel<G>(m, obj, is_horizontal, depth);
+            }
+        }
+
+        block2 = block2 || curr_block;
+    }
+
+    return block || block2;
+}
+
+template <typename G>
+void BasicAbstractGame::step_object_kernel(const std::shared_ptr<Entity> &obj) {
+    if (obj->will_erase)
+        return;
+
+    int num_sub_steps;
+
+    if (grid_step) {
+        num_sub_steps = 1;
+    } else {
+        num_sub_steps = int(4 * sqrt(obj->vx * obj->vx + obj->vy * obj->vy));
+        if (num_sub_steps < 4)
+            num_sub_steps = 4;
+    }
+
+    float pct = 1.0 / num_sub_steps;
+
+    float cmp = fabs(obj->vx) - fabs(obj->vy);
+
+    /*
+     Resolve ties randomly -- important for randomized movement through tight corridors in orbeater.
+     In order to ensure that enemies choose randomly between horizontal/vertical forks in a path,
+     this collision detection shouldn't favor one direction over another.
+    */
+    bool step_x_first = cmp == 0 ? step_rand_int % 2 == 0 : (cmp > 0);
+
+    // edge case -- needed for player movement through tight corridors (e.g. Pacman)
+    if (obj->type == PLAYER) {
+        if (action_vx != 0)
+            step_x_first = true;
+        if (action_vy != 0)
+            step_x_first = false;
+    }
+
+    float vx_pct = 0;
+    float vy_pct = 0;
+
+    for (int s = 0; s < num_sub_steps; s++) {
+        bool block_x = false;
+        bool block_y = false;
+
+        if (step_x_first) {
+            block_x = sub_step<G>(obj, obj->vx * pct, 0, 0);
+            block_y = sub_step<G>(obj, 0, obj->vy * pct, 0);
+        } else {
+            block_y = sub_step<G>(obj, 0, obj->vy * pct, 0);
+            block_x = sub_step<G>(obj, obj->vx * pct, 0, 0);
+        }
+
+        if (!block_x)
+            vx_pct += 1;
+        if (!block_y)
+            vy_pct += 1;
+
+        if (block_x && block_y) {
+            break;
+        }
+    }
+
+    vx_pct = vx_pct / num_sub_steps;
+    vy_pct = vy_pct / num_sub_steps;
+
+    obj->vx *= vx_pct;
+    obj->vy *= vy_pct;
+}
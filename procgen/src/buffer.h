@@ -3,17 +3,47 @@
 #include "cpp-utils.h"
 #include <vector>
 #include <string>
+#include <cstring>
+#include <cstdint>
+#include <type_traits>
+
+/*
+
+Bools are bit-packed: a bool is stored in the most recent byte reserved for bools until all 8 of its
+bits are used up, even if other values were written in the meantime. This only requires that the
+reads mirror the writes, which they already need to. Everything else is copied in bulk, without
+any alignment requirements on the buffer.
+
+*/
 
 struct ReadBuffer {
     char *data = nullptr;
     size_t offset = 0;
     size_t length = 0;
+    size_t bool_offset = 0;
+    int bool_bits = 8;
 
     ReadBuffer(char *data, size_t length) : data(data), length(length) {
     };
 
+    void read_bytes(void *dst, size_t size) {
+        fassert(offset + size <= length);
+        if (size > 0) {
+            memcpy(dst, &data[offset], size);
+        }
+        offset += size;
+    };
+
     bool read_bool() {
-        return read_int() > 0;
+        if (bool_bits == 8) {
+            fassert(offset + 1 <= length);
+            bool_offset = offset;
+            bool_bits = 0;
+            offset++;
+        }
+        bool b = (data[bool_offset] >> bool_bits) & 1;
+        bool_bits++;
+        return b;
     };
 
     std::vector<bool> read_vector_bool() {
@@ -26,47 +56,38 @@ struct ReadBuffer {
     };
 
     int read_int() {
-        fassert(offset + sizeof(int) <= length);
-        auto d = (int*)(&data[offset]);
-        offset += sizeof(int);
-        return *d;
+        int i;
+        read_bytes(&i, sizeof(int));
+        return i;
     };
 
-    std::vector<int> read_vector_int() {
-        std::vector<int> v;
+    // a vector of plain values in a single copy
+    template <typename T>
+    std::vector<T> read_vector() {
+        static_assert(std::is_trivially_copyable<T>::value && !std::is_same<T, bool>::value, "use read_vector_bool");
+        std::vector<T> v;
         v.resize(read_int());
-        for (size_t i = 0; i < v.size(); i++) {
-            v[i] = read_int();
-        }
+        read_bytes(v.data(), v.size() * sizeof(T));
         return v;
     };
 
+    std::vector<int> read_vector_int() {
+        return read_vector<int>();
+    };
+
     float read_float() {
-        fassert(offset + sizeof(float) <= length);
-        auto d = (float*)(&data[offset]);
-        offset += sizeof(float);
-        return *d;
+        float f;
+        read_bytes(&f, sizeof(float));
+        return f;
     };
 
     std::vector<float> read_vector_float() {
-        std::vector<float> v;
-        v.resize(read_int());
-        for (size_t i = 0; i < v.size(); i++) {
-            v[i] = read_float();
-        }
-        return v;
+        return read_vector<float>();
     };
 
     std::string read_string() {
-        int size = read_int();
-        std::string s(size, '\x00');
-        fassert(offset + size <= length);
-        auto c = data + offset;
-        for (size_t i = 0; i < s.size(); i++) {
-            s[i] = *c;
-            c++;
-        }
-        offset += s.size();
+        std::string s(read_int(), '\x00');
+        read_bytes(&s[0], s.size());
         return s;
     };
 };
@@ -75,12 +96,32 @@ struct WriteBuffer {
     char *data = nullptr;
     size_t offset = 0;
     size_t length = 0;
+    size_t bool_offset = 0;
+    int bool_bits = 8;
 
     WriteBuffer(char *data, size_t length) :  data(data), length(length) {
     };
 
+    void write_bytes(const void *src, size_t size) {
+        fassert(offset + size <= length);
+        if (size > 0) {
+            memcpy(&data[offset], src, size);
+        }
+        offset += size;
+    };
+
     void write_bool(bool b) {
-        write_int(b ? 1 : 0);
+        if (bool_bits == 8) {
+            fassert(offset + 1 <= length);
+            bool_offset = offset;
+            bool_bits = 0;
+            data[offset] = 0;
+            offset++;
+        }
+        if (b) {
+            data[bool_offset] |= 1 << bool_bits;
+        }
+        bool_bits++;
     };
 
     void write_vector_bool(const std::vector<bool>& v) {
@@ -91,42 +132,30 @@ struct WriteBuffer {
     };
 
     void write_int(int i) {
-        fassert(offset + sizeof(int) <= length);
-        auto d = (int*)(&data[offset]);
-        *d = i;
-        offset += sizeof(int);
+        write_bytes(&i, sizeof(int));
     };
 
+    template <typename T>
+    void write_vector(const std::vector<T>& v) {
+        static_assert(std::is_trivially_copyable<T>::value && !std::is_same<T, bool>::value, "use write_vector_bool");
+        write_int(v.size());
+        write_bytes(v.data(), v.size() * sizeof(T));
+    };
 
     void write_vector_int(const std::vector<int>& v) {
-        write_int(v.size());
-        for (auto i : v) {
-            write_int(i);
-        }
+        write_vector(v);
     };
 
     void write_float(float f) {
-        fassert(offset + sizeof(float) <= length);
-        auto d = (float*)(&data[offset]);
-        *d = f;
-        offset += sizeof(float);
+        write_bytes(&f, sizeof(float));
     };
 
     void write_vector_float(const std::vector<float>& v) {
-        write_int(v.size());
-        for (auto i : v) {
-            write_float(i);
-        }
+        write_vector(v);
     };
 
-    void write_string(std::string s) {
-        fassert(offset + s.size() <= length);
+    void write_string(const std::string &s) {
         write_int(s.size());
-        auto c = data + offset;
-        for (size_t i = 0; i < s.size(); i++) {
-            *c = s[i];
-            c++;
-        }
-        offset += s.size();
+        write_bytes(s.data(), s.size());
     };
-};
\ No newline at end of file
+};
@@ -0,0 +1,156 @@
+#pragma once
+
+/*
+
+Index of the cells of the grid by type, kept up to date by every write to the grid
+
+For each type it keeps the list of the cells that hold it, so finding the cells of a type costs
+the number of matches instead of a scan of the grid. For each column it keeps the runs of equal
+cells from the bottom up, which lets drawing skip over the empty parts of the grid and fill a run
+of a solid color at once. The runs of a column are rebuilt the next time they're asked for after
+a cell of the column changed.
+
+*/
+
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include "cpp-utils.h"
+
+// the object ids stored in the grid go up to 1003, too many for a byte
+typedef int16_t GridCell;
+
+struct CellRun {
+    int y;
+    int length;
+    int type;
+};
+
+class CellIndex {
+  public:
+    void build(const std::vector<GridCell> &cells, int width, int height) {
+        w = width;
+        h = height;
+        // the lists keep their types and their memory from one level to the next
+        for (auto &list : type_cells) {
+            list.clear();
+        }
+        cell_slot.resize(cells.size());
+
+        for (int idx = 0; idx < (int)(cells.size()); idx++) {
+            auto &list = cells_of(cells[idx]);
+            cell_slot[idx] = (int)(list.size());
+            list.push_back(idx);
+        }
+
+        column_runs.resize(w);
+        column_dirty.assign(w, 1);
+    }
+
+    // make room for any changes to the cells without allocating: every cell in the list of each type, a few spare
+    // lists for the types that only appear while stepping, like the moving boulders of miner, and the most runs a
+    // column can have
+    void reserve() {
+        if ((int)(type_cells.size()) < num_lists + SPARE_LISTS) {
+            type_cells.resize(num_lists + SPARE_LISTS);
+        }
+        for (auto &list : type_cells) {
+            list.reserve(cell_slot.size());
+        }
+        for (auto &runs : column_runs) {
+            runs.reserve(h);
+        }
+    }
+
+    void update(int idx, int old_type, int new_type) {
+        if (old_type == new_type) {
+            return;
+        }
+
+        auto &old_list = cells_of(old_type);
+        int slot = cell_slot[idx];
+        debug_fassert(old_list[slot] == idx);
+        int moved = old_list.back();
+        old_list[slot] = moved;
+        cell_slot[moved] = slot;
+        old_list.pop_back();
+
+        auto &new_list = cells_of(new_type);
+        cell_slot[idx] = (int)(new_list.size());
+        new_list.push_back(idx);
+
+        column_dirty[idx % w] = 1;
+    }
+
+    // in increasing order, like a scan of the grid
+    void get_cells(int type, std::vector<int> &out) {
+        out = cells_of(type);
+        std::sort(out.begin(), out.end());
+    }
+
+    const std::vector<CellRun> &get_column_runs(int x, const std::vector<GridCell> &cells) {
+        auto &runs = column_runs[x];
+
+        if (column_dirty[x]) {
+            runs.clear();
+            for (int y = 0; y < h; y++) {
+                int type = cells[y * w + x];
+                if (!runs.empty() && runs.back().type == type) {
+                    runs.back().length++;
+                } else {
+                    runs.push_back(CellRun{y, 1, type});
+                }
+            }
+            column_dirty[x] = 0;
+        }
+
+        return runs;
+    }
+
+  private:
+    int w = 0;
+    int h = 0;
+
+    // the list of each type is found through list_of_type, indexed by type, or for a negative type by a search of
+    // negative_types, there are only a handful of types in use in a level
+    std::vector<int> list_of_type;
+    std::vector<int> negative_types;
+    std::vector<int> negative_lists;
+    // the lists of the types seen so far come first, followed by the spare ones
+    std::vector<std::vector<int>> type_cells;
+    int num_lists = 0;
+    static const int SPARE_LISTS = 4;
+    // the position of each cell in the list of its type
+    std::vector<int> cell_slot;
+
+    std::vector<std::vector<CellRun>> column_runs;
+    std::vector<uint8_t> column_dirty;
+
+    std::vector<int> &cells_of(int type) {
+        if (type >= 0) {
+            if (type >= (int)(list_of_type.size())) {
+                list_of_type.resize(type + 1, -1);
+            }
+            if (list_of_type[type] < 0) {
+                list_of_type[type] = new_list();
+            }
+            return type_cells[list_of_type[type]];
+        }
+
+        for (size_t t = 0; t < negative_types.size(); t++) {
+            if (negative_types[t] == type) {
+                return type_cells[negative_lists[t]];
+            }
+        }
+        negative_types.push_back(type);
+        negative_lists.push_back(new_list());
+        return type_cells[negative_lists.back()];
+    }
+
+    int new_list() {
+        if (num_lists == (int)(type_cells.size())) {
+            type_cells.emplace_back();
+        }
+        return num_lists++;
+    }
+};
@@ -20,6 +20,15 @@ const float PI = 3.14159265358979323846264338327950288f;
         }                                                                        \
     } while (0)
 
+// checks that are too expensive for the inner loops they're in, only compiled in with PROCGEN_DEBUG_CHECKS
+#ifdef PROCGEN_DEBUG_CHECKS
+#define debug_fassert(cond) fassert(cond)
+#else
+#define debug_fassert(cond) \
+    do {                    \
+    } while (0)
+#endif
+
 // https://stackoverflow.com/a/12891181
 #ifdef __GNUC__
 #define UNUSED(x) UNUSED_##x __attribute__((__unused__))
@@ -0,0 +1,46 @@
+#pragma once
+
+/*
+
+Draw lists, the frames of the software renderer as a list of commands instead of pixels, made by
+VecGame::record_draw_lists() so that the observations of all the envs can be drawn in one pass by
+a renderer outside of the library, for example on a GPU
+
+A frame is drawn by going through its commands in order, each is alpha blended over the ones before
+it. The images are found with Game::draw_list_image(), they're the same for all the envs of a game
+with the same options, so they can be put in an atlas once.
+
+*/
+
+#include <cstdint>
+
+enum DrawKind {
+    // fill the rect with color
+    DRAW_FILL = 0,
+    // an asset of the game, the image type asset in theme theme
+    DRAW_IMAGE,
+    // the background image asset of the game
+    DRAW_BACKGROUND,
+};
+
+// only 4 byte fields, so the layout is the same as an array of int32_t, see record_draw_lists() in env.py
+struct DrawCommand {
+    int32_t kind = DRAW_FILL;
+    int32_t asset = 0;
+    int32_t theme = 0;
+    // the image is mirrored horizontally before it's rotated
+    int32_t is_reflected = 0;
+    // 0xAARRGGBB with straight alpha, only for DRAW_FILL
+    uint32_t color = 0;
+    // in pixels of the observation from its top left corner, the image is stretched to fill the rect
+    float x = 0;
+    float y = 0;
+    float w = 0;
+    float h = 0;
+    // in radians around the center of the rect, the software renderer snaps it to quarter turns
+    float rotation = 0;
+    // multiplies the alpha of the image
+    float alpha = 1;
+};
+
+static_assert(sizeof(DrawCommand) == 11 * 4, "DrawCommand must not have padding");
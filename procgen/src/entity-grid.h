@@ -0,0 +1,156 @@
+#pragma once
+
+/*
+
+Uniform grid broadphase for entity-vs-entity collision checks
+
+Entities are bucketed into the unit cells of the world their bounding box overlaps, entities
+outside the world are bucketed into the nearest border cells. A query returns every entity that
+could overlap the given box, the caller still runs the exact test.
+
+The grid is a snapshot, so its owner must invalidate it whenever entities may have moved or
+the entity list may have changed.
+
+*/
+
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <cmath>
+#include "entity.h"
+
+class EntityGrid {
+  public:
+    void build(const std::vector<std::shared_ptr<Entity>> &ents, int width, int height) {
+        w = std::max(width, 1);
+        h = std::max(height, 1);
+        num_entities = (int)(ents.size());
+
+        cell_start.assign(w * h + 1, 0);
+        boxes.resize(num_entities * 4);
+
+        for (int i = 0; i < num_entities; i++) {
+            const auto &e = ents[i];
+            int *box = &boxes[i * 4];
+            get_cell_range(e->x, e->y, e->rx, e->ry, box);
+
+            for (int y = box[1]; y <= box[3]; y++) {
+                for (int x = box[0]; x <= box[2]; x++) {
+                    cell_start[y * w + x + 1]++;
+                }
+            }
+        }
+
+        for (int c = 0; c < w * h; c++) {
+            cell_start[c + 1] += cell_start[c];
+        }
+
+        cell_items.resize(cell_start[w * h]);
+        fill.assign(cell_start.begin(), cell_start.end() - 1);
+
+        for (int i = 0; i < num_entities; i++) {
+            const int *box = &boxes[i * 4];
+
+            for (int y = box[1]; y <= box[3]; y++) {
+                for (int x = box[0]; x <= box[2]; x++) {
+                    cell_items[fill[y * w + x]++] = i;
+                }
+            }
+        }
+
+        seen.assign(num_entities, 0);
+        query_id = 0;
+        valid = true;
+    }
+
+    // make room for building over up to max_entities entities in a world of num_cells cells, past that build() grows
+    // the buffers itself
+    void reserve(int max_entities, int num_cells) {
+        cell_start.reserve(num_cells + 1);
+        fill.reserve(num_cells);
+        // an entity no larger than a cell overlaps at most 4 of them
+        cell_items.reserve(max_entities * 4);
+        boxes.reserve(max_entities * 4);
+        seen.reserve(max_entities);
+    }
+
+    void invalidate() {
+        valid = false;
+    }
+
+    bool is_valid() const {
+        return valid;
+    }
+
+    // indices of the entities whose bounding box may overlap the given one grown by margin, in descending order
+    void query(float x, float y, float rx, float ry, float margin, std::vector<int> &out) {
+        out.clear();
+
+        // grow the box a little so that rounding can't drop a pair that the exact test would accept
+        float grow = std::max(margin, 0.0f) + 1e-3f;
+        int box[4];
+        get_cell_range(x, y, rx + grow, ry + grow, box);
+
+        query_id++;
+
+        if (query_id == 0) {
+            std::fill(seen.begin(), seen.end(), 0);
+            query_id = 1;
+        }
+
+        for (int cy = box[1]; cy <= box[3]; cy++) {
+            for (int cx = box[0]; cx <= box[2]; cx++) {
+                int c = cy * w + cx;
+
+                for (int k = cell_start[c]; k < cell_start[c + 1]; k++) {
+                    int i = cell_items[k];
+
+                    if (seen[i] != query_id) {
+                        seen[i] = query_id;
+                        out.push_back(i);
+                    }
+                }
+            }
+        }
+
+        std::sort(out.begin(), out.end(), std::greater<int>());
+    }
+
+  private:
+    int w = 0;
+    int h = 0;
+    int num_entities = 0;
+    bool valid = false;
+    unsigned int query_id = 0;
+
+    // compressed cell lists, the entities in cell c are cell_items[cell_start[c]:cell_start[c + 1]]
+    std::vector<int> cell_start;
+    std::vector<int> cell_items;
+    // inclusive cell range (min_x, min_y, max_x, max_y) of each entity
+    std::vector<int> boxes;
+    std::vector<unsigned int> seen;
+    // the next free slot of each cell while building, kept so that rebuilding every step doesn't allocate
+    std::vector<int> fill;
+
+    static int clamp_cell(float v, int n) {
+        float f = floor(v);
+
+        // also catches NaN
+        if (!(f >= 0)) {
+            return 0;
+        }
+
+        if (f > n - 1) {
+            return n - 1;
+        }
+
+        return int(f);
+    }
+
+    void get_cell_range(float x, float y, float rx, float ry, int *box) const {
+        box[0] = clamp_cell(x - rx, w);
+        box[1] = clamp_cell(y - ry, h);
+        box[2] = clamp_cell(x + rx, w);
+        box[3] = clamp_cell(y + ry, h);
+    }
+};
@@ -0,0 +1,117 @@
+#pragma once
+
+/*
+
+Pooled storage for entities
+
+Entities are allocated with std::allocate_shared through a PoolAllocator, so the Entity and its
+shared_ptr control block share one fixed size block carved out of larger chunks. Freed blocks go on
+a free list and are reused by the next level instead of going back to malloc.
+
+Every allocator copy (including the ones stored in control blocks) keeps the pool alive, so an
+entity can safely outlive the game that created it. A pool must only be used by one thread at a time,
+the same as the game that owns it.
+
+*/
+
+#include <memory>
+#include <vector>
+#include <cstddef>
+#include <new>
+
+class EntityPool {
+  public:
+    static const int BLOCKS_PER_CHUNK = 64;
+
+    // carve out room for num_blocks entities with the first allocation, once the block size is known
+    void reserve(int num_blocks) {
+        reserved_blocks = num_blocks;
+    }
+
+    void *allocate(size_t size) {
+        if (block_size == 0) {
+            block_size = round_up(size);
+            while ((int)(free_blocks.size()) < reserved_blocks) {
+                add_chunk();
+            }
+        }
+
+        // the pool only serves a single size, which is the size of the control block allocate_shared uses
+        if (round_up(size) != block_size) {
+            return ::operator new(size);
+        }
+
+        if (free_blocks.empty()) {
+            add_chunk();
+        }
+
+        void *p = free_blocks.back();
+        free_blocks.pop_back();
+        return p;
+    }
+
+    void deallocate(void *p, size_t size) {
+        if (round_up(size) != block_size) {
+            ::operator delete(p);
+            return;
+        }
+
+        free_blocks.push_back(p);
+    }
+
+  private:
+    size_t block_size = 0;
+    int reserved_blocks = 0;
+    std::vector<void *> free_blocks;
+    std::vector<std::unique_ptr<max_align_t[]>> chunks;
+
+    static size_t round_up(size_t size) {
+        return (size + sizeof(max_align_t) - 1) / sizeof(max_align_t) * sizeof(max_align_t);
+    }
+
+    void add_chunk() {
+        size_t units = block_size / sizeof(max_align_t);
+        chunks.emplace_back(new max_align_t[units * BLOCKS_PER_CHUNK]);
+        max_align_t *chunk = chunks.back().get();
+
+        // hand out blocks in address order so entities spawned together end up next to each other
+        for (int i = BLOCKS_PER_CHUNK - 1; i >= 0; i--) {
+            free_blocks.push_back(chunk + i * units);
+        }
+    }
+};
+
+template <typename T>
+class PoolAllocator {
+  public:
+    typedef T value_type;
+
+    std::shared_ptr<EntityPool> pool;
+
+    explicit PoolAllocator(const std::shared_ptr<EntityPool> &_pool)
+        : pool(_pool) {
+    }
+
+    template <typename U>
+    PoolAllocator(const PoolAllocator<U> &other)
+        : pool(other.pool) {
+    }
+
+    T *allocate(size_t n) {
+        return static_cast<T *>(pool->allocate(n * sizeof(T)));
+    }
+
+    void deallocate(T *p, size_t n) {
+        pool->deallocate(p, n * sizeof(T));
+    }
+
+    template <typename U>
+    bool operator==(const PoolAllocator<U> &other) const {
+        return pool == other.pool;
+    }
+
+    template <typename U>
+    bool operator!=(const PoolAllocator<U> &other) const {
+        return pool != other.pool;
+    }
+};
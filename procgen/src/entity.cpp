@@ -103,24 +103,24 @@ void Entity::serialize(WriteBuffer *b) {
 
     b->write_int(render_z);
 
-    b->write_int(will_erase);
-    b->write_int(collides_with_entities);
+    b->write_bool(will_erase);
+    b->write_bool(collides_with_entities);
 
     b->write_float(collision_margin);
     b->write_float(rotation);
     b->write_float(vrot);
 
-    b->write_int(is_reflected);
+    b->write_bool(is_reflected);
     b->write_int(fire_time);
     b->write_int(spawn_time);
     b->write_int(life_time);
     b->write_int(expire_time);
-    b->write_int(use_abs_coords);
+    b->write_bool(use_abs_coords);
 
     b->write_float(friction);
-    b->write_int(smart_step);
-    b->write_int(avoids_collisions);
-    b->write_int(auto_erase);
+    b->write_bool(smart_step);
+    b->write_bool(avoids_collisions);
+    b->write_bool(auto_erase);
 
     b->write_float(alpha);
     b->write_float(health);
@@ -149,24 +149,24 @@ void Entity::deserialize(ReadBuffer *b) {
 
     render_z = b->read_int();
 
-    will_erase = b->read_int();
-    collides_with_entities = b->read_int();
+    will_erase = b->read_bool();
+    collides_with_entities = b->read_bool();
 
     collision_margin = b->read_float();
     rotation = b->read_float();
     vrot = b->read_float();
 
-    is_reflected = b->read_int();
+    is_reflected = b->read_bool();
     fire_time = b->read_int();
     spawn_time = b->read_int();
     life_time = b->read_int();
     expire_time = b->read_int();
-    use_abs_coords = b->read_int();
+    use_abs_coords = b->read_bool();
 
     friction = b->read_float();
-    smart_step = b->read_int();
-    avoids_collisions = b->read_int();
-    auto_erase = b->read_int();
+    smart_step = b->read_bool();
+    avoids_collisions = b->read_bool();
+    auto_erase = b->read_bool();
 
     alpha = b->read_float();
     health = b->read_float();
@@ -0,0 +1,38 @@
+#pragma once
+
+/*
+
+Summaries of completed episodes, enabled with the episode_stats option
+
+Each game appends the episodes it completes to its own list, which is only touched by the thread that currently
+owns the game, so no locking or atomics are needed. VecGame::drain_episode_stats() collects the lists of all the
+games while the stepping threads are idle.
+
+*/
+
+#include <cstdint>
+
+// game specific counts of what happened during an episode, the games that don't have an event leave it at 0
+enum EpisodeEvent {
+    // fruitbot: fruit eaten
+    EPISODE_GOOD_OBJECT = 0,
+    // fruitbot: non-fruit eaten
+    EPISODE_BAD_OBJECT,
+    // fruitbot: walls and locked doors hit
+    EPISODE_WALL_HIT,
+    EPISODE_NUM_EVENTS,
+};
+
+const char *const EPISODE_EVENT_NAMES[EPISODE_NUM_EVENTS] = {"good_objects", "bad_objects", "wall_hits"};
+
+// only 4 byte fields, so the layout is the same as an array of int32_t, see drain_episode_stats() in env.py
+struct EpisodeStats {
+    int32_t env = 0;
+    int32_t level_seed = 0;
+    float episode_return = 0.0f;
+    int32_t length = 0;
+    int32_t level_complete = 0;
+    int32_t events[EPISODE_NUM_EVENTS] = {};
+};
+
+static_assert(sizeof(EpisodeStats) == (5 + EPISODE_NUM_EVENTS) * 4, "EpisodeStats must not have padding");
@@ -6,6 +6,9 @@ This is a way to register game classes without having to update a central index
 
 Each game should include "game-registry.h" and call REGISTER_GAME("name", GameSubClass)
 
+The new game is passed to GameSubClass::specialize(), which gets to set up anything that depends on knowing the
+exact class of the game, see BasicAbstractGame::specialize()
+
 */
 
 #include <vector>
@@ -19,7 +22,9 @@ class Game;
 
 #define REGISTER_GAME(name, cls)                                         \
     static auto UNUSED_FUNCTION(_registration) = registerGame(name, [] { \
-        return std::make_shared<cls>();                                  \
+        auto game = std::make_shared<cls>();                             \
+        cls::specialize(*game);                                          \
+        return std::shared_ptr<Game>(game);                              \
     })
 
 extern std::map<std::string, std::function<std::shared_ptr<Game>()>> *globalGameRegistry;
@@ -1,23 +1,149 @@
 #include "game.h"
 #include "vecoptions.h"
+#include "jpeg-encode.h"
+#include <algorithm>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define PROCGEN_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#else
+#define PROCGEN_X86 0
+#endif
+
+#if defined(__ARM_NEON) || defined(__aarch64__)
+#define PROCGEN_NEON 1
+#include <arm_neon.h>
+#else
+#define PROCGEN_NEON 0
+#endif
 
 // this should be updated whenever the state format or environments may have changed
-const int SERIALIZE_VERSION = 0;
+const int SERIALIZE_VERSION = 3;
+
+// the conversion runs on every observation (and on every hi-res frame when render_human is set)
+// so there are SIMD versions of it, picked at runtime since the package is built for a minimum spec cpu
+static void bgr32_to_rgb888_row_scalar(uint8_t *d, const uint8_t *s, int w) {
+    for (int x = 0; x < w; x++) {
+        d[0] = s[2];
+        d[1] = s[1];
+        d[2] = s[0];
+        s += 4;
+        d += 3;
+    }
+}
 
-void bgr32_to_rgb888(void *dst_rgb888, void *src_bgr32, int w, int h) {
-    uint8_t *src = (uint8_t *)src_bgr32;
+#if PROCGEN_X86
+#if defined(_MSC_VER)
+#define PROCGEN_TARGET(isa)
+#else
+#define PROCGEN_TARGET(isa) __attribute__((target(isa)))
+#endif
+
+PROCGEN_TARGET("ssse3")
+static void bgr32_to_rgb888_row_ssse3(uint8_t *d, const uint8_t *s, int w) {
+    const __m128i mask = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+    int x = 0;
+    // 16 pixels in, 48 bytes out
+    for (; x + 16 <= w; x += 16) {
+        __m128i a = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(s + 0)), mask);
+        __m128i b = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(s + 16)), mask);
+        __m128i c = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(s + 32)), mask);
+        __m128i e = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(s + 48)), mask);
+        _mm_storeu_si128((__m128i *)(d + 0), _mm_or_si128(a, _mm_slli_si128(b, 12)));
+        _mm_storeu_si128((__m128i *)(d + 16), _mm_or_si128(_mm_srli_si128(b, 4), _mm_slli_si128(c, 8)));
+        _mm_storeu_si128((__m128i *)(d + 32), _mm_or_si128(_mm_srli_si128(c, 8), _mm_slli_si128(e, 4)));
+        s += 64;
+        d += 48;
+    }
+    bgr32_to_rgb888_row_scalar(d, s, w - x);
+}
+
+static bool cpu_supports_ssse3() {
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    return (info[2] & (1 << 9)) != 0;
+#else
+    return __builtin_cpu_supports("ssse3");
+#endif
+}
+#endif
+
+#if PROCGEN_NEON
+static void bgr32_to_rgb888_row_neon(uint8_t *d, const uint8_t *s, int w) {
+    int x = 0;
+    for (; x + 16 <= w; x += 16) {
+        uint8x16x4_t bgra = vld4q_u8(s);
+        uint8x16x3_t rgb;
+        rgb.val[0] = bgra.val[2];
+        rgb.val[1] = bgra.val[1];
+        rgb.val[2] = bgra.val[0];
+        vst3q_u8(d, rgb);
+        s += 64;
+        d += 48;
+    }
+    bgr32_to_rgb888_row_scalar(d, s, w - x);
+}
+#endif
+
+typedef void (*bgr32_to_rgb888_row_fn)(uint8_t *d, const uint8_t *s, int w);
+
+static bgr32_to_rgb888_row_fn choose_bgr32_to_rgb888_row() {
+#if PROCGEN_X86
+    if (cpu_supports_ssse3()) {
+        return bgr32_to_rgb888_row_ssse3;
+    }
+#elif PROCGEN_NEON
+    return bgr32_to_rgb888_row_neon;
+#endif
+    return bgr32_to_rgb888_row_scalar;
+}
+
+static bgr32_to_rgb888_row_fn get_bgr32_to_rgb888_row() {
+    static const bgr32_to_rgb888_row_fn row_fn = choose_bgr32_to_rgb888_row();
+    return row_fn;
+}
+
+void bgr32_to_rgb888_strided(void *dst_rgb888, int dst_stride, const void *src_bgr32, int src_stride, int w, int h) {
+    const uint8_t *src = (const uint8_t *)src_bgr32;
     uint8_t *dst = (uint8_t *)dst_rgb888;
+    auto row_fn = get_bgr32_to_rgb888_row();
 
     for (int y = 0; y < h; y++) {
-        uint8_t *s = src + y * w * 4;
-        uint8_t *d = dst + y * w * 3;
-        for (int x = 0; x < w; x++) {
-            d[0] = s[2];
-            d[1] = s[1];
-            d[2] = s[0];
+        row_fn(dst + y * dst_stride, src + y * src_stride, w);
+    }
+}
+
+void bgr32_to_rgb888(void *dst_rgb888, void *src_bgr32, int w, int h) {
+    bgr32_to_rgb888_strided(dst_rgb888, w * 3, src_bgr32, w * 4, w, h);
+}
+
+void bgr32_to_obs(uint8_t *dst, const void *src_bgr32, int w, int h, bool chw, int channels) {
+    const uint8_t *s = (const uint8_t *)src_bgr32;
+    int num_pixels = w * h;
+
+    if (channels == 1) {
+        // rec. 601 luma in 8 bit fixed point, the weights sum to 256
+        for (int i = 0; i < num_pixels; i++) {
+            dst[i] = uint8_t((29 * s[0] + 150 * s[1] + 77 * s[2] + 128) >> 8);
             s += 4;
-            d += 3;
         }
+    } else if (chw) {
+        uint8_t *r = dst;
+        uint8_t *g = dst + num_pixels;
+        uint8_t *b = dst + 2 * num_pixels;
+        for (int i = 0; i < num_pixels; i++) {
+            r[i] = s[2];
+            g[i] = s[1];
+            b[i] = s[0];
+            s += 4;
+        }
+    } else {
+        bgr32_to_rgb888_strided(dst, w * 3, src_bgr32, w * 4, w, h);
     }
 }
 
@@ -38,17 +164,15 @@ Game::Game(std::string name) : game_name(name) {
 Game::~Game() {
 }
 
-void Game::parse_options(std::string name, VecOptions opts) {
-    opts.consume_bool("use_easy_jump", &options.use_easy_jump);
-    opts.consume_bool("paint_vel_info", &options.paint_vel_info);
-    opts.consume_bool("use_generated_assets", &options.use_generated_assets);
-    opts.consume_bool("use_monochrome_assets", &options.use_monochrome_assets);
-    opts.consume_bool("restrict_themes", &options.restrict_themes);
-    opts.consume_bool("use_backgrounds", &options.use_backgrounds);
-    opts.consume_bool("center_agent", &options.center_agent);
+/*
+  The options that only change the levels a game makes, and the rewards it gives in them, which VecGame::reconfigure()
+  can change at any time since an option that isn't given keeps its current value. The others can only be given when
+  the game is made.
+*/
+void Game::parse_level_options(std::string name, VecOptions &opts) {
     opts.consume_bool("use_sequential_levels", &options.use_sequential_levels);
 
-    int dist_mode = EasyMode;
+    int dist_mode = options.distribution_mode;
     opts.consume_int("distribution_mode", &dist_mode);
     options.distribution_mode = static_cast<DistributionMode>(dist_mode);
 
@@ -64,12 +188,6 @@ void Game::parse_options(std::string name, VecOptions opts) {
         fatal("invalid distribution_mode %d\n", options.distribution_mode);
     }
 
-    // coinrun_old
-    opts.consume_int("plain_assets", &options.plain_assets);
-    opts.consume_int("physics_mode", &options.physics_mode);
-    opts.consume_int("debug_mode", &options.debug_mode);
-    opts.consume_int("game_type", &game_type);
-    
     // FruitBot custom rewards
     if (name == "fruitbot") {
         // Read as integers (multiplied by 100) to avoid float parsing issues
@@ -106,12 +224,65 @@ void Game::parse_options(std::string name, VecOptions opts) {
         opts.consume_int("fruitbot_bad_line_x_pct", &options.fruitbot_bad_line_x_pct);
         opts.consume_int("fruitbot_line_padding_pct", &options.fruitbot_line_padding_pct);
         opts.consume_bool("fruitbot_force_no_walls", &options.fruitbot_force_no_walls);
+        opts.consume_bool("fruitbot_fast_step", &options.fruitbot_fast_step);
     }
+}
 
+void Game::parse_options(std::string name, VecOptions opts) {
+    opts.consume_bool("use_easy_jump", &options.use_easy_jump);
+    opts.consume_bool("paint_vel_info", &options.paint_vel_info);
+    opts.consume_bool("use_generated_assets", &options.use_generated_assets);
+    opts.consume_bool("use_monochrome_assets", &options.use_monochrome_assets);
+    opts.consume_bool("restrict_themes", &options.restrict_themes);
+    opts.consume_bool("use_backgrounds", &options.use_backgrounds);
+    opts.consume_bool("center_agent", &options.center_agent);
+    opts.consume_bool("cache_background", &options.cache_background);
+    opts.consume_bool("cache_sprites", &options.cache_sprites);
+    opts.consume_int("sprite_cache_entries", &options.sprite_cache_entries);
+    fassert(options.sprite_cache_entries >= 1);
+    opts.consume_bool("software_render", &options.software_render);
+    opts.consume_bool("incremental_render", &options.incremental_render);
+    opts.consume_bool("snap_camera", &options.snap_camera);
+    opts.consume_bool("step_kernels", &options.step_kernels);
+    opts.consume_bool("draw_grid_runs", &options.draw_grid_runs);
+    opts.consume_int("frame_skip", &options.frame_skip);
+    opts.consume_bool("frame_skip_max_pool", &options.frame_skip_max_pool);
+    fassert(options.frame_skip >= 1);
+
+    std::string rand_gen_name = "mt19937";
+    opts.consume_string("rand_gen", &rand_gen_name);
+    options.rand_gen_kind = rand_gen_kind_from_name(rand_gen_name);
+    level_seed_rand_gen.kind = options.rand_gen_kind;
+    rand_gen.kind = options.rand_gen_kind;
+
+    // coinrun_old
+    opts.consume_int("plain_assets", &options.plain_assets);
+    opts.consume_int("physics_mode", &options.physics_mode);
+    opts.consume_int("debug_mode", &options.debug_mode);
+    opts.consume_int("game_type", &game_type);
+
+    // a game that isn't given a distribution_mode is in easy mode
+    options.distribution_mode = EasyMode;
+    parse_level_options(name, opts);
     opts.ensure_empty();
 }
 
 void Game::render_to_buf(void *dst, int w, int h, bool antialias) {
+    // only the hi-res frame is antialiased
+    PhaseTimer timer(stats.get(), antialias ? STATS_RENDER_HIRES : STATS_RENDER, tracer, game_n);
+    // the software renderer has no antialiasing, so it's only used for the agent observation
+    if (options.software_render && !antialias) {
+        RasterTarget target;
+        target.buf = (uint32_t *)dst;
+        target.w = w;
+        target.h = h;
+        target.stride = w;
+
+        if (game_draw_raster(target)) {
+            return;
+        }
+    }
+
     // Qt focuses on RGB32 performance:
     // https://doc.qt.io/qt-5/qpainter.html#performance
     // so render to an RGB32 buffer and then convert it rather than render to RGB888 directly
@@ -124,12 +295,100 @@ void Game::render_to_buf(void *dst, int w, int h, bool antialias) {
     }
 
     QRect rect = QRect(0, 0, w, h);
+    drawing_hires = antialias;
     game_draw(p, rect);
+    drawing_hires = false;
+}
+
+bool Game::record_draw_list(std::vector<DrawCommand> &out) {
+    out.clear();
+
+    RasterTarget target;
+    target.w = obs_res;
+    target.h = obs_res;
+    target.commands = &out;
+
+    if (!game_draw_raster(target)) {
+        out.clear();
+        return false;
+    }
+
+    return true;
+}
+
+/*
+  Load a level that was serialized right after game_reset(), by the level cache or the level pregenerator. The
+  level comes from the snapshot but the per-env state that Game tracks (episode bookkeeping, the level seed
+  generator, and so on) is kept, so this is equivalent to calling game_reset().
+*/
+void Game::restore_level(const std::vector<char> &level) {
+    RandGen saved_level_seed_rand_gen = level_seed_rand_gen;
+    StepData saved_step_data = step_data;
+    int saved_action = action;
+    int saved_prev_level_seed = prev_level_seed;
+    int saved_episodes_remaining = episodes_remaining;
+    bool saved_episode_done = episode_done;
+    int saved_last_reward_timer = last_reward_timer;
+    float saved_last_reward = last_reward;
+    int saved_cur_time = cur_time;
+
+    // ReadBuffer never writes to its data
+    auto b = ReadBuffer(const_cast<char *>(level.data()), level.size());
+    deserialize(&b);
+
+    level_seed_rand_gen = saved_level_seed_rand_gen;
+    step_data = saved_step_data;
+    action = saved_action;
+    prev_level_seed = saved_prev_level_seed;
+    episodes_remaining = saved_episodes_remaining;
+    episode_done = saved_episode_done;
+    last_reward_timer = saved_last_reward_timer;
+    last_reward = saved_last_reward;
+    cur_time = saved_cur_time;
+}
+
+void Game::store_cached_level() {
+    // reset() normally runs on a stepping thread, the scratch buffer is too large for its stack
+    static thread_local std::vector<char> state_buf;
+    state_buf.resize(MAX_LEVEL_STATE_SIZE);
+
+    auto b = WriteBuffer(state_buf.data(), state_buf.size());
+    serialize(&b);
+    level_cache->insert(game_name, current_level_seed, state_buf.data(), b.offset);
+}
+
+void Game::game_observe_symbolic(float *entities, int num_entities, uint8_t *grid, int grid_dim) {
+    fatal("symbolic observations are not supported by %s\n", game_name.c_str());
+}
+
+bool Game::game_draw_raster(RasterTarget &dst) {
+    return false;
+}
+
+const QImage *Game::draw_list_image(DrawKind kind, int asset, int theme) {
+    return nullptr;
+}
+
+void Game::summarize_level(LevelSummary &summary) {
+}
+
+void Game::game_after_reset() {
+}
+
+void Game::generate_level(int level_seed) {
+    current_level_seed = level_seed;
+    rand_gen.seed(level_seed);
+    game_reset();
 }
 
 void Game::reset() {
+    PhaseTimer timer(stats.get(), STATS_RESET, tracer, game_n);
     reset_count++;
 
+    if (record_actions) {
+        finish_level_log();
+    }
+
     if (episodes_remaining == 0) {
         if (options.use_sequential_levels && step_data.level_complete) {
             // Sequential: deterministic increment
@@ -143,18 +402,224 @@ void Game::reset() {
 
     // Seed the game RNG with the NEW current_level_seed
     rand_gen.seed(current_level_seed);
-    game_reset();  // Uses rand_gen for all randomness
-    
+
+    std::shared_ptr<const std::vector<char>> level;
+
+    if (level_pregen != nullptr) {
+        level = level_pregen->take(game_n, current_level_seed);
+    }
+
+    if (level == nullptr && level_cache != nullptr) {
+        level = level_cache->find(game_name, current_level_seed);
+    }
+
+    if (level != nullptr) {
+        restore_level(*level);
+    } else {
+        game_reset();  // Uses rand_gen for all randomness
+
+        if (level_cache != nullptr) {
+            store_cached_level();
+        }
+    }
+    game_after_reset();
+
     cur_time = 0;
     total_reward = 0;
+    std::fill(std::begin(episode_events), std::end(episode_events), 0);
     episodes_remaining -= 1;
     action = default_action;
+
+    if (record_actions) {
+        level_log.env = game_n;
+        level_log.level_seed = current_level_seed;
+        level_log.actions.clear();
+        level_log_valid = true;
+    }
+
+    if (level_pregen != nullptr && episodes_remaining == 0) {
+        // the next reset draws a new seed, unless use_sequential_levels picks the next one in sequence,
+        // in which case the pregenerated level won't match and the level is generated as usual
+        RandGen next_seed_gen = level_seed_rand_gen;
+        level_pregen->request(game_n, next_seed_gen.randint(level_seed_low, level_seed_high));
+    }
+}
+
+void Game::record_episode() {
+    EpisodeStats episode;
+    episode.env = game_n;
+    episode.level_seed = current_level_seed;
+    episode.episode_return = total_reward;
+    episode.length = cur_time;
+    episode.level_complete = step_data.level_complete;
+    std::copy(std::begin(episode_events), std::end(episode_events), episode.events);
+    completed_episodes.push_back(episode);
+}
+
+void Game::finish_level_log() {
+    if (level_log_valid) {
+        completed_level_logs.push_back(level_log);
+    }
+    level_log_valid = false;
 }
 
+/*
+  The level is fully determined by its seed and the frames by the actions, as long as the game has the same options
+  as the one that recorded the log. Replaying steps the frames without observing them, which is most of the cost of
+  a step, and keeps a checkpoint of the state every checkpoint_interval frames, so a seek only steps from the
+  checkpoint before it.
+*/
+void Game::start_replay(const LevelLog &log, int checkpoint_interval) {
+    fassert(!record_actions);
+    fassert(checkpoint_interval > 0);
+
+    replay = std::make_unique<ReplayState>();
+    replay->log = log;
+    replay->checkpoint_interval = checkpoint_interval;
+
+    // reset() keeps current_level_seed while the level has episodes remaining
+    current_level_seed = log.level_seed;
+    episodes_remaining = 1;
+    reset();
+    step_data = StepData();
+    step_data.done = true;
+    episode_done = true;
+}
+
+int Game::replay_seek(int frame) {
+    fassert(replay != nullptr);
+    frame = std::max(0, std::min(frame, (int)(replay->log.actions.size())));
+
+    int interval = replay->checkpoint_interval;
+    int checkpoint = std::min(frame / interval, (int)(replay->checkpoints.size()) - 1);
+    if (checkpoint >= 0 && (replay->frame > frame || replay->frame < checkpoint * interval)) {
+        const auto &state = replay->checkpoints[checkpoint];
+        // ReadBuffer never writes to its data
+        auto b = ReadBuffer(const_cast<char *>(state.data()), state.size());
+        deserialize(&b);
+        replay->frame = checkpoint * interval;
+    }
+    // the first checkpoint is the start of the level, which start_replay() already went to
+    fassert(replay->frame <= frame);
+
+    static thread_local std::vector<char> state_buf;
+    while (true) {
+        if (replay->frame % interval == 0 && replay->frame / interval == (int)(replay->checkpoints.size())) {
+            state_buf.resize(MAX_LEVEL_STATE_SIZE);
+            auto b = WriteBuffer(state_buf.data(), state_buf.size());
+            serialize(&b);
+            replay->checkpoints.emplace_back(state_buf.begin(), state_buf.begin() + b.offset);
+        }
+        if (replay->frame == frame) {
+            break;
+        }
+        uint8_t logged_action = replay->log.actions[replay->frame];
+        action = logged_action == LEVEL_LOG_FORCE_RESET ? -1 : logged_action;
+        step_frame();
+        replay->frame++;
+    }
+
+    return frame;
+}
+
+void Game::restart_episode(int level_seed_gen_seed) {
+    if (level_seed_gen_seed >= 0) {
+        level_seed_rand_gen.seed(level_seed_gen_seed);
+    }
+
+    step_data.reward = 0;
+    step_data.done = true;
+    step_data.level_complete = false;
+    step_data.agent_x = 0.0f;
+    step_data.agent_y = 0.0f;
+    step_data.collision_x = -1.0f;
+    step_data.collision_y = -1.0f;
+    step_data.collision_type = 0;
+    episode_done = true;
+    prev_level_seed = current_level_seed;
+    // draw a new level seed even if the current level had episodes remaining
+    episodes_remaining = 0;
+    reset();
+}
+
+// the frame observe() renders before converting it to the observation, it doesn't outlive the call so it's per thread
+// rather than per game
+static uint32_t *render_scratch() {
+    static thread_local std::vector<uint32_t> buf(RES_W * RES_H);
+    return buf.data();
+}
+
+/*
+  With options.frame_skip, the action is repeated for several frames. The reward is summed over the frames, the
+  repeat stops early once the episode is done, and only the final frame is observed. With frame_skip_max_pool the
+  rgb observation is the max of the last two frames, unless the episode ended, when only the first frame of the
+  next episode is observed.
+*/
 void Game::step() {
+    // a reset in the middle of the repeat (with use_sequential_levels) would otherwise replace it with the default action
+    int repeated_action = action;
+    float reward = 0.0f;
+    bool level_complete = false;
+    float collision_x = -1.0f;
+    float collision_y = -1.0f;
+    int collision_type = 0;
+    bool pool_frames = false;
+
+    // the second to last frame, step() normally runs on a stepping thread so this is per thread
+    static thread_local std::vector<uint8_t> pool_buf;
+
+    for (int frame = 0; frame < options.frame_skip; frame++) {
+        if (options.frame_skip_max_pool && obs_ptrs.rgb != nullptr && frame > 0 && frame == options.frame_skip - 1) {
+            pool_buf.resize(obs_res * obs_res * obs_channels);
+            uint32_t *render_buf = render_scratch();
+            render_to_buf(render_buf, obs_res, obs_res, false);
+            PhaseTimer timer(stats.get(), STATS_CONVERT, tracer, game_n);
+            bgr32_to_obs(pool_buf.data(), render_buf, obs_res, obs_res, obs_chw, obs_channels);
+            pool_frames = true;
+        }
+
+        action = repeated_action;
+        step_frame();
+
+        reward += step_data.reward;
+        level_complete = level_complete || step_data.level_complete;
+        // keep the last collision of the repeat, even if the last frame had none
+        if (step_data.collision_type != 0) {
+            collision_x = step_data.collision_x;
+            collision_y = step_data.collision_y;
+            collision_type = step_data.collision_type;
+        }
+
+        if (step_data.done) {
+            pool_frames = false;
+            break;
+        }
+    }
+
+    step_data.reward = reward;
+    step_data.level_complete = level_complete;
+    step_data.collision_x = collision_x;
+    step_data.collision_y = collision_y;
+    step_data.collision_type = collision_type;
+
+    observe_frame(!step_data.done);
+
+    if (pool_frames) {
+        uint8_t *frame = obs_ptrs.rgb + frame_stack_head * pool_buf.size();
+        for (size_t i = 0; i < pool_buf.size(); i++) {
+            frame[i] = std::max(frame[i], pool_buf[i]);
+        }
+    }
+}
+
+void Game::step_frame() {
     cur_time += 1;
     bool will_force_reset = false;
 
+    if (level_log_valid) {
+        level_log.actions.push_back(action == -1 ? LEVEL_LOG_FORCE_RESET : uint8_t(action));
+    }
+
     if (action == -1) {
         action = default_action;
         will_force_reset = true;
@@ -168,7 +633,10 @@ void Game::step() {
     step_data.collision_x = -1.0f;
     step_data.collision_y = -1.0f;
     step_data.collision_type = 0;
-    game_step();
+    {
+        PhaseTimer timer(stats.get(), STATS_GAME_STEP, tracer, game_n);
+        game_step();
+    }
 
     step_data.done = step_data.done || will_force_reset || (cur_time >= timeout);
     total_reward += step_data.reward;
@@ -181,6 +649,9 @@ void Game::step() {
     prev_level_seed = current_level_seed;
 
     if (step_data.done) {
+        if (track_episodes) {
+            record_episode();
+        }
         reset();
     }
 
@@ -189,23 +660,89 @@ void Game::step() {
     }
 
     episode_done = step_data.done;
+}
+
+/*
+  The stack is oldest frame first with the newest frame last, so adding a frame moves the others down by one.
+  With frame_stack_ring the frames stay where they are and the newest frame replaces the oldest, the order is then
+  frame_stack_head + 1, ..., frame_stack_head modulo frame_stack. A new stack has only the newest frame, the older
+  ones are zero.
+*/
+uint8_t *Game::next_obs_frame(bool continue_frame_stack) {
+    if (frame_stack == 1) {
+        return obs_ptrs.rgb;
+    }
 
-    observe();
+    size_t frame_size = size_t(obs_res) * obs_res * obs_channels;
+
+    if (!continue_frame_stack) {
+        memset(obs_ptrs.rgb, 0, frame_stack * frame_size);
+        frame_stack_head = frame_stack_ring ? 0 : frame_stack - 1;
+    } else if (frame_stack_ring) {
+        frame_stack_head = (frame_stack_head + 1) % frame_stack;
+    } else {
+        memmove(obs_ptrs.rgb, obs_ptrs.rgb + frame_size, (frame_stack - 1) * frame_size);
+    }
+
+    return obs_ptrs.rgb + frame_stack_head * frame_size;
 }
 
 void Game::observe() {
-    render_to_buf(render_buf, RES_W, RES_H, false);
-    bgr32_to_rgb888(obs_bufs[0], render_buf, RES_W, RES_H);
+    // the caller may never read the tiles of this frame, so neither it nor the next frame can be a delta
+    if (tile_stream) {
+        tile_stream->request_keyframe();
+    }
+    observe_frame(false);
+    if (tile_stream) {
+        tile_stream->request_keyframe();
+    }
+}
+
+void Game::observe_frame(bool continue_frame_stack) {
+    if (obs_ptrs.rgb != nullptr) {
+        uint8_t *frame = next_obs_frame(continue_frame_stack);
+        uint32_t *render_buf = render_scratch();
+        render_to_buf(render_buf, obs_res, obs_res, false);
+        PhaseTimer timer(stats.get(), STATS_CONVERT, tracer, game_n);
+        bgr32_to_obs(frame, render_buf, obs_res, obs_res, obs_chw, obs_channels);
+    }
+
+    if (obs_ptrs.entities != nullptr) {
+        game_observe_symbolic(obs_ptrs.entities, symbolic_obs_entities, obs_ptrs.grid, symbolic_obs_grid_dim);
+    }
+
+    if (info_ptrs.rgb != nullptr || info_ptrs.jpeg != nullptr || info_ptrs.tiles != nullptr) {
+        // observe() normally runs on a stepping thread, so the hi-res frame is rendered in parallel
+        // across envs, the scratch buffer is too large for the stack of a worker thread
+        static thread_local std::vector<uint32_t> render_hires_buf;
+        render_hires_buf.resize(render_res * render_res);
+        render_to_buf(render_hires_buf.data(), render_res, render_res, true);
+        if (info_ptrs.rgb != nullptr) {
+            PhaseTimer timer(stats.get(), STATS_CONVERT, tracer, game_n);
+            bgr32_to_rgb888(info_ptrs.rgb, render_hires_buf.data(), render_res, render_res);
+        }
+        if (info_ptrs.jpeg != nullptr) {
+            PhaseTimer timer(stats.get(), STATS_ENCODE, tracer, game_n);
+            *info_ptrs.jpeg_size = (int32_t)(encode_jpeg_bgr32(render_hires_buf.data(), render_res, render_res, jpeg_quality, info_ptrs.jpeg, info_ptrs.jpeg_capacity));
+        }
+        if (info_ptrs.tiles != nullptr) {
+            PhaseTimer timer(stats.get(), STATS_ENCODE, tracer, game_n);
+            *info_ptrs.tiles_size = (int32_t)(tile_stream->encode(render_hires_buf.data(), jpeg_quality, info_ptrs.tiles, info_ptrs.tiles_capacity));
+        }
+    }
+
     *reward_ptr = step_data.reward;
     *first_ptr = (uint8_t)step_data.done;
-    *(int32_t *)(info_bufs[info_name_to_offset.at("prev_level_seed")]) = (int32_t)(prev_level_seed);
-    *(uint8_t *)(info_bufs[info_name_to_offset.at("prev_level_complete")]) = (uint8_t)(step_data.level_complete);
-    *(int32_t *)(info_bufs[info_name_to_offset.at("level_seed")]) = (int32_t)(current_level_seed);
-    *(float *)(info_bufs[info_name_to_offset.at("agent_x")]) = step_data.agent_x;
-    // *(float *)(info_bufs[info_name_to_offset.at("agent_y")]) = step_data.agent_y;
-    *(float *)(info_bufs[info_name_to_offset.at("collision_x")]) = step_data.collision_x;
-    *(float *)(info_bufs[info_name_to_offset.at("collision_y")]) = step_data.collision_y;
-    *(int32_t *)(info_bufs[info_name_to_offset.at("collision_type")]) = step_data.collision_type;
+    *info_ptrs.prev_level_seed = (int32_t)(prev_level_seed);
+    *info_ptrs.prev_level_complete = (uint8_t)(step_data.level_complete);
+    *info_ptrs.level_seed = (int32_t)(current_level_seed);
+    *info_ptrs.agent_x = step_data.agent_x;
+    *info_ptrs.collision_x = step_data.collision_x;
+    *info_ptrs.collision_y = step_data.collision_y;
+    *info_ptrs.collision_type = step_data.collision_type;
+    if (info_ptrs.frame_stack_head != nullptr) {
+        *info_ptrs.frame_stack_head = frame_stack_head;
+    }
 }
 
 void Game::game_init() {
@@ -216,32 +753,32 @@ void Game::serialize(WriteBuffer *b) {
     
     b->write_string(game_name);
 
-    b->write_int(options.paint_vel_info);
-    b->write_int(options.use_generated_assets);
-    b->write_int(options.use_monochrome_assets);
-    b->write_int(options.restrict_themes);
-    b->write_int(options.use_backgrounds);
-    b->write_int(options.center_agent);
+    b->write_bool(options.paint_vel_info);
+    b->write_bool(options.use_generated_assets);
+    b->write_bool(options.use_monochrome_assets);
+    b->write_bool(options.restrict_themes);
+    b->write_bool(options.use_backgrounds);
+    b->write_bool(options.center_agent);
     b->write_int(options.debug_mode);
     b->write_int(options.distribution_mode);
-    b->write_int(options.use_sequential_levels);
+    b->write_bool(options.use_sequential_levels);
 
-    b->write_int(options.use_easy_jump);
+    b->write_bool(options.use_easy_jump);
     b->write_int(options.plain_assets);
     b->write_int(options.physics_mode);
 
-    b->write_int(grid_step);
+    b->write_bool(grid_step);
     b->write_int(level_seed_low);
     b->write_int(level_seed_high);
     b->write_int(game_type);
-    b->write_int(game_n);
+    // game_n identifies the env the game belongs to rather than its state, so it's not saved
 
     level_seed_rand_gen.serialize(b);
     rand_gen.serialize(b);
 
     b->write_float(step_data.reward);
-    b->write_int(step_data.done);
-    b->write_int(step_data.level_complete);
+    b->write_bool(step_data.done);
+    b->write_bool(step_data.level_complete);
     b->write_float(step_data.agent_x);
     b->write_float(step_data.collision_x);
     b->write_float(step_data.collision_y);
@@ -253,7 +790,7 @@ void Game::serialize(WriteBuffer *b) {
     b->write_int(current_level_seed);
     b->write_int(prev_level_seed);
     b->write_int(episodes_remaining);
-    b->write_int(episode_done);
+    b->write_bool(episode_done);
 
     b->write_int(last_reward_timer);
     b->write_float(last_reward);
@@ -261,17 +798,19 @@ void Game::serialize(WriteBuffer *b) {
 
     b->write_int(fixed_asset_seed);
 
-    // don't save render buf as we will just re-write it on next observation
-    // uint32_t render_buf[RES_W * RES_H];
-
     b->write_int(cur_time);
-    b->write_int(is_waiting_for_step);
+    b->write_float(total_reward);
+    for (auto count : episode_events) {
+        b->write_int(count);
+    }
+    // is_waiting_for_step is owned by VecGame and isn't part of the game state
 
     // don't serialize these, since they are pointers, and will likely have incorrect values
     // if deserialized into another game object
     // int32_t *action_ptr;
     // std::vector<void *> obs_bufs;
     // std::vector<void *> info_bufs;
+    // InfoPtrs info_ptrs;
     // float *reward_ptr = nullptr;
     // uint8_t *first_ptr = nullptr;
 }
@@ -280,32 +819,33 @@ void Game::deserialize(ReadBuffer *b) {
     fassert(SERIALIZE_VERSION == b->read_int());
     fassert(game_name == b->read_string());
 
-    options.paint_vel_info = b->read_int();
-    options.use_generated_assets = b->read_int();
-    options.use_monochrome_assets = b->read_int();
-    options.restrict_themes = b->read_int();
-    options.use_backgrounds = b->read_int();
-    options.center_agent = b->read_int();
+    options.paint_vel_info = b->read_bool();
+    options.use_generated_assets = b->read_bool();
+    options.use_monochrome_assets = b->read_bool();
+    options.restrict_themes = b->read_bool();
+    options.use_backgrounds = b->read_bool();
+    options.center_agent = b->read_bool();
     options.debug_mode = b->read_int();
     options.distribution_mode = DistributionMode(b->read_int());
-    options.use_sequential_levels = b->read_int();
+    options.use_sequential_levels = b->read_bool();
 
-    options.use_easy_jump = b->read_int();
+    options.use_easy_jump = b->read_bool();
     options.plain_assets = b->read_int();
     options.physics_mode = b->read_int();
 
-    grid_step = b->read_int();
+    grid_step = b->read_bool();
     level_seed_low = b->read_int();
     level_seed_high = b->read_int();
     game_type = b->read_int();
-    game_n = b->read_int();
 
     level_seed_rand_gen.deserialize(b);
     rand_gen.deserialize(b);
+    // the generators carry their kind with them
+    options.rand_gen_kind = rand_gen.kind;
 
     step_data.reward = b->read_float();
-    step_data.done = b->read_int();
-    step_data.level_complete = b->read_int();
+    step_data.done = b->read_bool();
+    step_data.level_complete = b->read_bool();
     step_data.agent_x = b->read_float();
     step_data.collision_x = b->read_float();
     step_data.collision_y = b->read_float();
@@ -317,7 +857,7 @@ void Game::deserialize(ReadBuffer *b) {
     current_level_seed = b->read_int();
     prev_level_seed = b->read_int();
     episodes_remaining = b->read_int();
-    episode_done = b->read_int();
+    episode_done = b->read_bool();
 
     last_reward_timer = b->read_int();
     last_reward = b->read_float();
@@ -326,5 +866,58 @@ void Game::deserialize(ReadBuffer *b) {
     fixed_asset_seed = b->read_int();
 
     cur_time = b->read_int();
-    is_waiting_for_step = b->read_int();
+    total_reward = b->read_float();
+    for (auto &count : episode_events) {
+        count = b->read_int();
+    }
+
+    level_log_valid = false;
+}
+
+void Game::copy_state(const Game &src) {
+    fassert(game_name == src.game_name);
+    level_log_valid = false;
+
+    options.paint_vel_info = src.options.paint_vel_info;
+    options.use_generated_assets = src.options.use_generated_assets;
+    options.use_monochrome_assets = src.options.use_monochrome_assets;
+    options.restrict_themes = src.options.restrict_themes;
+    options.use_backgrounds = src.options.use_backgrounds;
+    options.center_agent = src.options.center_agent;
+    options.debug_mode = src.options.debug_mode;
+    options.distribution_mode = src.options.distribution_mode;
+    options.use_sequential_levels = src.options.use_sequential_levels;
+    options.rand_gen_kind = src.options.rand_gen_kind;
+
+    options.use_easy_jump = src.options.use_easy_jump;
+    options.plain_assets = src.options.plain_assets;
+    options.physics_mode = src.options.physics_mode;
+
+    grid_step = src.grid_step;
+    level_seed_low = src.level_seed_low;
+    level_seed_high = src.level_seed_high;
+    game_type = src.game_type;
+
+    level_seed_rand_gen = src.level_seed_rand_gen;
+    rand_gen = src.rand_gen;
+
+    step_data = src.step_data;
+
+    action = src.action;
+    timeout = src.timeout;
+
+    current_level_seed = src.current_level_seed;
+    prev_level_seed = src.prev_level_seed;
+    episodes_remaining = src.episodes_remaining;
+    episode_done = src.episode_done;
+
+    last_reward_timer = src.last_reward_timer;
+    last_reward = src.last_reward;
+    default_action = src.default_action;
+
+    fixed_asset_seed = src.fixed_asset_seed;
+
+    cur_time = src.cur_time;
+    total_reward = src.total_reward;
+    std::copy(std::begin(src.episode_events), std::end(src.episode_events), episode_events);
 }
@@ -16,16 +16,31 @@ Base class used for all games, all games must inherit from this
 #include "resources.h"
 #include "object-ids.h"
 #include "game-registry.h"
+#include "phase-stats.h"
+#include "episode-stats.h"
+#include "level-log.h"
+#include "level-summary.h"
+#include "tile-stream.h"
 #include "buffer.h"
+#include "raster.h"
+#include "level-cache.h"
+#include "level-pregen.h"
 
 // We want all games to have same observation space. So all these
 // constants here related to observation space are constants forever.
+// The obs_res option renders the observation at a lower resolution instead.
 const int RES_W = 64;
 const int RES_H = 64;
 
+// default resolution of the render_human frame, can be changed with the render_res option
 const int RENDER_RES = 512;
 
 void bgr32_to_rgb888(void *dst_rgb888, void *src_bgr32, int w, int h);
+// same conversion, but rows of the source and destination may be padded, strides are in bytes
+void bgr32_to_rgb888_strided(void *dst_rgb888, int dst_stride, const void *src_bgr32, int src_stride, int w, int h);
+// the observation formats of the obs_layout and obs_channels options, channels is 3 for rgb or 1 for grayscale,
+// chw stores each channel as a separate plane
+void bgr32_to_obs(uint8_t *dst, const void *src_bgr32, int w, int h, bool chw, int channels);
 
 class VecOptions;
 
@@ -47,6 +62,50 @@ struct StepData {
     int collision_type = 0;  // Type of entity collided with (0 = no collision)
 };
 
+// typed pointers into Game::info_bufs, these are resolved once in VecGame::set_buffers
+// so that observe() doesn't have to look up info names on every step
+struct InfoPtrs {
+    int32_t *prev_level_seed = nullptr;
+    uint8_t *prev_level_complete = nullptr;
+    int32_t *level_seed = nullptr;
+    float *agent_x = nullptr;
+    float *collision_x = nullptr;
+    float *collision_y = nullptr;
+    int32_t *collision_type = nullptr;
+    // only present when render_human is set
+    uint8_t *rgb = nullptr;
+    // only present when encode_jpeg is set, jpeg_size is the number of bytes used in jpeg
+    uint8_t *jpeg = nullptr;
+    int32_t *jpeg_size = nullptr;
+    size_t jpeg_capacity = 0;
+    // only present when encode_tiles is set, see tile-stream.h for the format
+    uint8_t *tiles = nullptr;
+    int32_t *tiles_size = nullptr;
+    size_t tiles_capacity = 0;
+    // only present with frame_stack_ring, the slot of the newest frame
+    int32_t *frame_stack_head = nullptr;
+};
+
+// typed pointers into Game::obs_bufs, resolved in VecGame::set_buffers like InfoPtrs
+struct ObsPtrs {
+    // not present when rgb_obs is disabled, holds frame_stack frames, see Game::next_obs_frame()
+    uint8_t *rgb = nullptr;
+    // only present when symbolic_obs is set, grid also needs symbolic_obs_grid_dim > 0
+    float *entities = nullptr;
+    uint8_t *grid = nullptr;
+};
+
+// type, x, y, rx, ry, see BasicAbstractGame::game_observe_symbolic()
+const int SYMBOLIC_ENTITY_FEATURES = 5;
+
+// a LevelLog being replayed, checkpoints[i] is the state after i * checkpoint_interval frames
+struct ReplayState {
+    LevelLog log;
+    int checkpoint_interval = 0;
+    int frame = 0;
+    std::vector<std::vector<char>> checkpoints;
+};
+
 struct GameOptions {
     bool paint_vel_info = false;
     bool use_generated_assets = false;
@@ -54,9 +113,30 @@ struct GameOptions {
     bool restrict_themes = false;
     bool use_backgrounds = true;
     bool center_agent = false;
+    bool cache_background = false;
+    bool cache_sprites = false;
+    // the sprite cache is emptied when it gets this many images, see BasicAbstractGame::lookup_scaled_image()
+    int sprite_cache_entries = 4096;
+    bool software_render = false;
+    // repaint only what changed since the last hi-res frame, see BasicAbstractGame::draw_incremental()
+    bool incremental_render = false;
+    // move the camera by whole pixels the way incremental_render does, so that the frames drawn with and without it
+    // can be compared
+    bool snap_camera = false;
+    // step with the physics compiled for the class of the game, see BasicAbstractGame::specialize(), clearing it
+    // is only useful to measure what that gains
+    bool step_kernels = true;
+    // draw the grid by the runs of equal cells in each column, clearing it draws each visible cell in turn, with the
+    // same frames
+    bool draw_grid_runs = true;
+    // run game_step() this many times per step, rendering only the last frame
+    int frame_skip = 1;
+    bool frame_skip_max_pool = false;
     int debug_mode = 0;
     DistributionMode distribution_mode = HardMode;
     bool use_sequential_levels = false;
+    // the generator used for the level seeds, the levels and the generated assets, see randgen.h
+    RandGenKind rand_gen_kind = RANDGEN_MT19937;
 
     // coinrun_old
     bool use_easy_jump = false;
@@ -84,12 +164,12 @@ struct GameOptions {
     int fruitbot_bad_line_x_pct = 85;       // percentage from left
     int fruitbot_line_padding_pct = 10;     // vertical padding percent
     bool fruitbot_force_no_walls = false;   // skip wall generation entirely
+    bool fruitbot_fast_step = false;        // specialized game_step with the same results, see fruitbot.cpp
 };
 
 class Game {
   public:
     const std::string game_name;
-    std::map<std::string, int> info_name_to_offset;
 
     GameOptions options;
 
@@ -119,35 +199,119 @@ class Game {
 
     int fixed_asset_seed = 0;
 
-    uint32_t render_buf[RES_W * RES_H];
+    // format of the rgb observation, set by VecGame from the obs_res, obs_layout and obs_channels options
+    int obs_res = RES_W;
+    bool obs_chw = false;
+    int obs_channels = 3;
+    // the frame_stack and frame_stack_ring options, frame_stack_head is the slot of the newest frame
+    int frame_stack = 1;
+    bool frame_stack_ring = false;
+    int frame_stack_head = 0;
+    int render_res = RENDER_RES;
+    // set by render_to_buf() while game_draw() draws the hi-res frame of the info rgb rather than the observation
+    bool drawing_hires = false;
+    int jpeg_quality = 0;
+    // only allocated with the encode_tiles option
+    std::unique_ptr<TileStream> tile_stream;
+    int symbolic_obs_entities = 0;
+    int symbolic_obs_grid_dim = 0;
 
     int cur_time = 0;
 
     bool is_waiting_for_step = false;
 
+    // set by VecGame when levels are cached or pregenerated, shared with the other games in the VecGame
+    LevelCache *level_cache = nullptr;
+    LevelPregenerator *level_pregen = nullptr;
+    // only allocated with the collect_stats option
+    std::unique_ptr<GameStats> stats;
+    // set by VecGame with the trace_events option
+    Tracer *tracer = nullptr;
+    // with the episode_stats option, each level played to the end is added to completed_episodes, which VecGame
+    // empties, episode_events is counted by the games during the current episode
+    bool track_episodes = false;
+    std::vector<EpisodeStats> completed_episodes;
+    int32_t episode_events[EPISODE_NUM_EVENTS] = {};
+    // with the record_actions option, each level is logged from its start until the next reset and then added to
+    // completed_level_logs, which VecGame empties, a level that a state was loaded into isn't logged since its actions
+    // alone no longer replay it
+    bool record_actions = false;
+    std::vector<LevelLog> completed_level_logs;
+
     // pointers to buffers
     int32_t *action_ptr;
     std::vector<void *> obs_bufs;
     std::vector<void *> info_bufs;
+    ObsPtrs obs_ptrs;
+    InfoPtrs info_ptrs;
     float *reward_ptr = nullptr;
     uint8_t *first_ptr = nullptr;
 
     Game(std::string name);
     void step();
     void reset();
+    // end the current episode and start a new one right away, first is set on the next observation,
+    // level_seed_gen_seed >= 0 also reseeds the generator of level seeds for the following levels
+    void restart_episode(int level_seed_gen_seed);
+    // start the level of log over, replay_seek() then steps through the log without rendering
+    void start_replay(const LevelLog &log, int checkpoint_interval);
+    // go to the state after frame frames of the log, or to its end if frame is past it, and return the frame reached
+    int replay_seek(int frame);
+    // make the level of level_seed the way reset() does, but without anything else a reset does, for generating levels
+    // away from the envs
+    void generate_level(int level_seed);
     void render_to_buf(void *buf, int w, int h, bool antialias);
+    // record the rgb observation as commands in out instead of drawing it, see draw-list.h, returns false and leaves
+    // out empty if the game doesn't support options.software_render
+    bool record_draw_list(std::vector<DrawCommand> &out);
     void parse_options(std::string name, VecOptions opt_vec);
+    void parse_level_options(std::string name, VecOptions &opts);
+    // see REGISTER_GAME, games that need nothing from it get this one
+    template <typename G>
+    static void specialize(G &game) {
+    }
 
     virtual ~Game() = 0;
+    // write the observation and start a new frame stack, see observe_frame(), for observing the env out of band of
+    // step(), so with encode_tiles the frame and the next one are keyframes
     virtual void observe();
+    // continue_frame_stack adds the frame to the stack, step() uses it unless the episode ended
+    void observe_frame(bool continue_frame_stack);
+    // where the next frame of the rgb observation goes
+    uint8_t *next_obs_frame(bool continue_frame_stack);
     virtual void game_init() = 0;
     virtual void game_reset() = 0;
+    // called at the end of every reset once the level is in place, whether game_reset() made it or it was restored
+    // from a cached or pregenerated level
+    virtual void game_after_reset();
     virtual void game_step() = 0;
     virtual void game_draw(QPainter &p, const QRect &rect) = 0;
+    // draw without Qt for options.software_render, returns false if the game doesn't support it
+    virtual bool game_draw_raster(RasterTarget &dst);
+    // the image drawn by a DRAW_IMAGE or DRAW_BACKGROUND command of record_draw_list(), without the reflection, null
+    // if there's no such image
+    virtual const QImage *draw_list_image(DrawKind kind, int asset, int theme);
+    // write the symbolic observation, grid is null when it isn't observed
+    virtual void game_observe_symbolic(float *entities, int num_entities, uint8_t *grid, int grid_dim);
     virtual void serialize(WriteBuffer *b);
     virtual void deserialize(ReadBuffer *b);
+    // copy the state of src, a game of the same type, the same state serialize() would save but without the round trip
+    virtual void copy_state(const Game &src);
+    // fill in what the game can tell about the level it just generated, level_seed is already set
+    virtual void summarize_level(LevelSummary &summary);
 
   private:
     int reset_count = 0;
     float total_reward = 0.0f;
+
+    LevelLog level_log;
+    bool level_log_valid = false;
+    // only allocated by start_replay()
+    std::unique_ptr<ReplayState> replay;
+
+    void step_frame();
+    void record_episode();
+    void finish_level_log();
+    void restore_level(const std::vector<char> &level);
+    void store_cached_level();
 };
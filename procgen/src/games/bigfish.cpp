@@ -26,10 +26,13 @@ class BigFish : public BasicAbstractGame {
 
         main_width = 20;
         main_height = 20;
+
+        supports_software_render = true;
+        supports_incremental_render = true;
     }
 
     void load_background_images() override {
-        main_bg_images_ptr = &water_backgrounds;
+        main_bg_images_ptr = get_background_images("water_backgrounds");
     }
 
     void asset_for_type(int type, std::vector<std::string> &names) override {
@@ -116,6 +119,13 @@ class BigFish : public BasicAbstractGame {
         fish_eaten = b->read_int();
         r_inc = b->read_float();
     }
+
+    void copy_state(const Game &src) override {
+        BasicAbstractGame::copy_state(src);
+        const auto &other = static_cast<const BigFish &>(src);
+        fish_eaten = other.fish_eaten;
+        r_inc = other.r_inc;
+    }
 };
 
 REGISTER_GAME(NAME, BigFish);
@@ -70,7 +70,7 @@ class BossfightGame : public BasicAbstractGame {
     }
 
     void load_background_images() override {
-        main_bg_images_ptr = &space_backgrounds;
+        main_bg_images_ptr = get_background_images("space_backgrounds");
     }
 
     void asset_for_type(int type, std::vector<std::string> &names) override {
@@ -333,7 +333,7 @@ class BossfightGame : public BasicAbstractGame {
             float ent_y = rand_gen.rand01() * (BOTTOM_MARGIN - min_barrier_y - barrier_r) + min_barrier_y;
             float ent_x = rand_gen.rand01() * (main_width - 2 * barrier_r) + barrier_r;
 
-            auto ent = std::make_shared<Entity>(ent_x, ent_y, 0, 0, barrier_r, BARRIER);
+            auto ent = make_entity(ent_x, ent_y, 0, 0, barrier_r, BARRIER);
             choose_random_theme(ent);
             match_aspect_ratio(ent);
             ent->health = 3;
@@ -475,6 +475,43 @@ class BossfightGame : public BasicAbstractGame {
         fassert(shields_idx >= 0);
         shields = entities[shields_idx];
     }
+
+    void copy_state(const Game &src) override {
+        BasicAbstractGame::copy_state(src);
+        const auto &other = static_cast<const BossfightGame &>(src);
+        attack_modes = other.attack_modes;
+        last_fire_time = other.last_fire_time;
+        time_to_swap = other.time_to_swap;
+        invulnerable_duration = other.invulnerable_duration;
+        vulnerable_duration = other.vulnerable_duration;
+        num_rounds = other.num_rounds;
+        round_num = other.round_num;
+        round_health = other.round_health;
+        boss_vel_timeout = other.boss_vel_timeout;
+        curr_vel_timeout = other.curr_vel_timeout;
+        attack_mode = other.attack_mode;
+        player_laser_theme = other.player_laser_theme;
+        boss_laser_theme = other.boss_laser_theme;
+        damaged_until_time = other.damaged_until_time;
+        shields_are_up = other.shields_are_up;
+        barriers_moves_right = other.barriers_moves_right;
+        base_fire_prob = other.base_fire_prob;
+        boss_bullet_vel = other.boss_bullet_vel;
+        barrier_vel = other.barrier_vel;
+        barrier_spawn_prob = other.barrier_spawn_prob;
+        rand_pct = other.rand_pct;
+        rand_fire_pct = other.rand_fire_pct;
+        rand_pct_x = other.rand_pct_x;
+        rand_pct_y = other.rand_pct_y;
+
+        int boss_idx = find_entity_index(BOSS);
+        fassert(boss_idx >= 0);
+        boss = entities[boss_idx];
+
+        int shields_idx = find_entity_index(SHIELDS);
+        fassert(shields_idx >= 0);
+        shields = entities[shields_idx];
+    }
 };
 
 REGISTER_GAME(NAME, BossfightGame);
@@ -1,7 +1,6 @@
 #include "../basic-abstract-game.h"
 #include "../assetgen.h"
 #include "../roomgen.h"
-#include <set>
 #include <queue>
 
 const std::string NAME = "caveflyer";
@@ -30,7 +29,7 @@ class CaveFlyerGame : public BasicAbstractGame {
     }
 
     void load_background_images() override {
-        main_bg_images_ptr = &space_backgrounds;
+        main_bg_images_ptr = get_background_images("space_backgrounds");
     }
 
     void asset_for_type(int type, std::vector<std::string> &names) override {
@@ -159,7 +158,7 @@ class CaveFlyerGame : public BasicAbstractGame {
             room_manager->update();
         }
 
-        std::set<int> best_room;
+        std::vector<int> best_room;
         room_manager->find_best_room(best_room);
         fassert(best_room.size() > 0);
 
@@ -190,8 +189,7 @@ class CaveFlyerGame : public BasicAbstractGame {
         bool should_prune = options.distribution_mode != MemoryMode;
 
         if (should_prune) {
-            std::set<int> wide_path;
-            wide_path.insert(goal_path.begin(), goal_path.end());
+            std::vector<int> wide_path = goal_path;
             room_manager->expand_room(wide_path, 4);
 
             for (int i = 0; i < grid_size; i++) {
@@ -27,6 +27,9 @@ class ChaserGame : public BasicAbstractGame {
     std::shared_ptr<MazeGen> maze_gen;
     std::vector<int> free_cells;
     std::vector<bool> is_space_vec;
+    // scratch space of game_step(), kept so that stepping doesn't allocate
+    std::vector<int> adj_elems;
+    std::vector<int> space_neighbors;
     int eat_timeout = 0;
     int egg_timeout = 0;
     int eat_time = 0;
@@ -45,10 +48,14 @@ class ChaserGame : public BasicAbstractGame {
 
         maze_gen = nullptr;
         has_useful_vel_info = false;
+
+        // a cell has at most 4 neighbors
+        adj_elems.reserve(4);
+        space_neighbors.reserve(4);
     }
 
     void load_background_images() override {
-        main_bg_images_ptr = &topdown_simple_backgrounds;
+        main_bg_images_ptr = get_background_images("topdown_simple_backgrounds");
     }
 
     void asset_for_type(int type, std::vector<std::string> &names) override {
@@ -328,8 +335,8 @@ class ChaserGame : public BasicAbstractGame {
                 bool be_agressive = step_rand_int % 2 == 0;
 
                 if ((ent->vx == 0 && ent->vy == 0) || is_at_junction) {
-                    std::vector<int> adj_elems;
-                    std::vector<int> space_neighbors;
+                    adj_elems.clear();
+                    space_neighbors.clear();
                     int prev_idx = to_grid_idx(x - sign(ent->vx), y - sign(ent->vy));
                     get_adjacent(enemy_idx, adj_elems);
 
@@ -410,6 +417,20 @@ class ChaserGame : public BasicAbstractGame {
         orbs_collected = b->read_int();
         maze_dim = b->read_int();
     }
+
+    void copy_state(const Game &src) override {
+        BasicAbstractGame::copy_state(src);
+        const auto &other = static_cast<const ChaserGame &>(src);
+        free_cells = other.free_cells;
+        is_space_vec = other.is_space_vec;
+        eat_timeout = other.eat_timeout;
+        egg_timeout = other.egg_timeout;
+        eat_time = other.eat_time;
+        total_enemies = other.total_enemies;
+        total_orbs = other.total_orbs;
+        orbs_collected = other.orbs_collected;
+        maze_dim = other.maze_dim;
+    }
 };
 
 REGISTER_GAME(NAME, ChaserGame);
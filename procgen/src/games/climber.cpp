@@ -42,7 +42,7 @@ class Climber : public BasicAbstractGame {
     }
 
     void load_background_images() override {
-        main_bg_images_ptr = &platform_backgrounds;
+        main_bg_images_ptr = get_background_images("platform_backgrounds");
     }
 
     void asset_for_type(int type, std::vector<std::string> &names) override {
@@ -338,6 +338,18 @@ class Climber : public BasicAbstractGame {
         gravity = b->read_float();
         air_control = b->read_float();
     }
+
+    void copy_state(const Game &src) override {
+        BasicAbstractGame::copy_state(src);
+        const auto &other = static_cast<const Climber &>(src);
+        has_support = other.has_support;
+        facing_right = other.facing_right;
+        coin_quota = other.coin_quota;
+        coins_collected = other.coins_collected;
+        wall_theme = other.wall_theme;
+        gravity = other.gravity;
+        air_control = other.air_control;
+    }
 };
 
 REGISTER_GAME(NAME, Climber);
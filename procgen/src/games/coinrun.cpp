@@ -58,7 +58,7 @@ class CoinRun : public BasicAbstractGame {
     }
 
     void load_background_images() override {
-        main_bg_images_ptr = &platform_backgrounds;
+        main_bg_images_ptr = get_background_images("platform_backgrounds");
     }
 
     QRectF get_adjusted_image_rect(int type, const QRectF &rect) override {
@@ -518,6 +518,18 @@ class CoinRun : public BasicAbstractGame {
         gravity = b->read_float();
         air_control = b->read_float();
     }
+
+    void copy_state(const Game &src) override {
+        BasicAbstractGame::copy_state(src);
+        const auto &other = static_cast<const CoinRun &>(src);
+        last_agent_y = other.last_agent_y;
+        wall_theme = other.wall_theme;
+        has_support = other.has_support;
+        facing_right = other.facing_right;
+        is_on_crate = other.is_on_crate;
+        gravity = other.gravity;
+        air_control = other.air_control;
+    }
 };
 
 REGISTER_GAME(NAME, CoinRun);
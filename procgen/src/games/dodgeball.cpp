@@ -44,7 +44,7 @@ class DodgeballGame : public BasicAbstractGame {
     }
 
     void load_background_images() override {
-        main_bg_images_ptr = &topdown_backgrounds;
+        main_bg_images_ptr = get_background_images("topdown_backgrounds");
     }
 
     void asset_for_type(int type, std::vector<std::string> &names) override {
@@ -464,6 +464,18 @@ class DodgeballGame : public BasicAbstractGame {
         num_enemies = b->read_int();
         enemy_fire_delay = b->read_int();
     }
+
+    void copy_state(const Game &src) override {
+        BasicAbstractGame::copy_state(src);
+        const auto &other = static_cast<const DodgeballGame &>(src);
+        min_dim = other.min_dim;
+        hard_min_dim = other.hard_min_dim;
+        ball_vscale = other.ball_vscale;
+        ball_r = other.ball_r;
+        last_fire_time = other.last_fire_time;
+        num_enemies = other.num_enemies;
+        enemy_fire_delay = other.enemy_fire_delay;
+    }
 };
 
 REGISTER_GAME(NAME, DodgeballGame);
@@ -37,12 +37,14 @@ class FruitBotGame : public BasicAbstractGame {
         min_dim = 5.0f;
         bullet_vscale = 0.5f;
         bg_tile_ratio = -1;
+        supports_software_render = true;
+        supports_incremental_render = true;
 
         out_of_bounds_object = OUT_OF_BOUNDS_WALL;
     }
 
     void load_background_images() override {
-        main_bg_images_ptr = &topdown_backgrounds;
+        main_bg_images_ptr = get_background_images("topdown_backgrounds");
     }
 
     void asset_for_type(int type, std::vector<std::string> &names) override {
@@ -105,15 +107,19 @@ class FruitBotGame : public BasicAbstractGame {
         if (obj->type == BARRIER) {
             step_data.reward += options.fruitbot_reward_wall_hit;
             step_data.done = true;
+            episode_events[EPISODE_WALL_HIT]++;
         } else if (obj->type == BAD_OBJ) {
             step_data.reward += options.fruitbot_reward_negative;
             obj->will_erase = true;
+            episode_events[EPISODE_BAD_OBJECT]++;
         } else if (obj->type == LOCKED_DOOR) {
             step_data.reward += options.fruitbot_reward_wall_hit;
             step_data.done = true;
+            episode_events[EPISODE_WALL_HIT]++;
         } else if (obj->type == GOOD_OBJ) {
             step_data.reward += options.fruitbot_reward_positive;
             obj->will_erase = true;
+            episode_events[EPISODE_GOOD_OBJECT]++;
         } else if (obj->type == PRESENT) {
             if (!step_data.done) {
             }
@@ -315,8 +321,43 @@ class FruitBotGame : public BasicAbstractGame {
         agent->rotation = -1.0f * PI / 2.0f;
     }
 
+    /*
+      Steps the entities like step_entities(), but the agent's sub steps skip the scan of the entity list when no
+      entity can block or reflect the agent, which is always the case with the fruitbot entity types.
+    */
+    void fast_step_entities() {
+        bool agent_can_be_blocked = false;
+
+        for (const auto &ent : entities) {
+            if (ent != agent && (is_blocked_ents(agent, ent, true) || is_blocked_ents(agent, ent, false) || will_reflect(agent->type, ent->type))) {
+                agent_can_be_blocked = true;
+                break;
+            }
+        }
+
+        for (int i = (int)(entities.size()) - 1; i >= 0; i--) {
+            const auto &ent = entities[i];
+
+            if (ent->smart_step) {
+                sub_step_checks_entities = ent != agent || agent_can_be_blocked;
+                basic_step_object(ent);
+                sub_step_checks_entities = true;
+            }
+
+            ent->step();
+        }
+    }
+
     void game_step() override {
-        BasicAbstractGame::game_step();
+        if (options.fruitbot_fast_step) {
+            // the collision handlers above only erase entities, so the static collision pass applies
+            apply_action();
+            fast_step_entities();
+            resolve_collisions_static();
+            finish_step();
+        } else {
+            BasicAbstractGame::game_step();
+        }
         
         // Small reward for each step survived (encourages forward progress)
         if (options.fruitbot_reward_step != 0.0f) {
@@ -333,6 +374,23 @@ class FruitBotGame : public BasicAbstractGame {
         }
     }
 
+    void summarize_level(LevelSummary &summary) override {
+        BasicAbstractGame::summarize_level(summary);
+        for (const auto &ent : entities) {
+            if (ent->type == BARRIER) {
+                // each row of walls is a barrier on either side of its gap
+                summary.features[LEVEL_WALLS]++;
+            } else if (ent->type == LOCKED_DOOR) {
+                summary.features[LEVEL_DOORS]++;
+            } else if (ent->type == GOOD_OBJ) {
+                summary.features[LEVEL_GOOD_OBJECTS]++;
+            } else if (ent->type == BAD_OBJ) {
+                summary.features[LEVEL_BAD_OBJECTS]++;
+            }
+        }
+        summary.features[LEVEL_WALLS] /= 2;
+    }
+
     void serialize(WriteBuffer *b) override {
         BasicAbstractGame::serialize(b);
         b->write_float(min_dim);
@@ -346,6 +404,14 @@ class FruitBotGame : public BasicAbstractGame {
         bullet_vscale = b->read_float();
         last_fire_time = b->read_int();
     }
+
+    void copy_state(const Game &src) override {
+        BasicAbstractGame::copy_state(src);
+        const auto &other = static_cast<const FruitBotGame &>(src);
+        min_dim = other.min_dim;
+        bullet_vscale = other.bullet_vscale;
+        last_fire_time = other.last_fire_time;
+    }
 };
 
 REGISTER_GAME(NAME, FruitBotGame);
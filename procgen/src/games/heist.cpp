@@ -34,7 +34,7 @@ class HeistGame : public BasicAbstractGame {
     }
 
     void load_background_images() override {
-        main_bg_images_ptr = &topdown_backgrounds;
+        main_bg_images_ptr = get_background_images("topdown_backgrounds");
     }
 
     bool should_preserve_type_themes(int type) override {
@@ -221,6 +221,14 @@ class HeistGame : public BasicAbstractGame {
         world_dim = b->read_int();
         has_keys = b->read_vector_bool();
     }
+
+    void copy_state(const Game &src) override {
+        BasicAbstractGame::copy_state(src);
+        const auto &other = static_cast<const HeistGame &>(src);
+        num_keys = other.num_keys;
+        world_dim = other.world_dim;
+        has_keys = other.has_keys;
+    }
 };
 
 REGISTER_GAME(NAME, HeistGame);
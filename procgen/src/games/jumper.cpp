@@ -2,7 +2,6 @@
 #include "../assetgen.h"
 #include "../roomgen.h"
 #include "../mazegen.h"
-#include <set>
 #include <queue>
 #include <memory>
 
@@ -44,7 +43,7 @@ class Jumper : public BasicAbstractGame {
     }
 
     void load_background_images() override {
-        main_bg_images_ptr = &platform_backgrounds;
+        main_bg_images_ptr = get_background_images("platform_backgrounds");
     }
 
     void asset_for_type(int type, std::vector<std::string> &names) override {
@@ -273,7 +272,7 @@ class Jumper : public BasicAbstractGame {
             set_obj(main_width - 1, i, CAVEWALL);
         }
 
-        std::set<int> best_room;
+        std::vector<int> best_room;
         room_manager->find_best_room(best_room);
         fassert(best_room.size() > 0);
 
@@ -309,8 +308,7 @@ class Jumper : public BasicAbstractGame {
         bool should_prune = options.distribution_mode != MemoryMode;
 
         if (should_prune) {
-            std::set<int> wide_path;
-            wide_path.insert(goal_path.begin(), goal_path.end());
+            std::vector<int> wide_path = goal_path;
             room_manager->expand_room(wide_path, 4);
 
             for (int i = 0; i < grid_size; i++) {
@@ -466,6 +464,22 @@ class Jumper : public BasicAbstractGame {
         fassert(goal_idx >= 0);
         goal = entities[goal_idx];
     }
+
+    void copy_state(const Game &src) override {
+        BasicAbstractGame::copy_state(src);
+        const auto &other = static_cast<const Jumper &>(src);
+        jump_count = other.jump_count;
+        jump_delta = other.jump_delta;
+        jump_time = other.jump_time;
+        has_support = other.has_support;
+        facing_right = other.facing_right;
+        wall_theme = other.wall_theme;
+        compass_dim = other.compass_dim;
+
+        int goal_idx = find_entity_index(GOAL);
+        fassert(goal_idx >= 0);
+        goal = entities[goal_idx];
+    }
 };
 
 REGISTER_GAME(NAME, Jumper);
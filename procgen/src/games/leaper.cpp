@@ -39,7 +39,7 @@ class LeaperGame : public BasicAbstractGame {
     }
 
     void load_background_images() override {
-        main_bg_images_ptr = &topdown_backgrounds;
+        main_bg_images_ptr = get_background_images("topdown_backgrounds");
     }
 
     void asset_for_type(int type, std::vector<std::string> &names) override {
@@ -189,7 +189,7 @@ class LeaperGame : public BasicAbstractGame {
             float spawn_prob = fabs(speed) / 6.0;
             if (rand_gen.rand01() < spawn_prob) {
                 float x = speed > 0 ? (-1 * MONSTER_RADIUS) : (main_width + MONSTER_RADIUS);
-                auto m = std::make_shared<Entity>(x, bottom_road_y + lane + 0.5, speed, 0, 2 * MONSTER_RADIUS, MONSTER_RADIUS, CAR);
+                auto m = make_entity(x, bottom_road_y + lane + 0.5, speed, 0, 2 * MONSTER_RADIUS, MONSTER_RADIUS, CAR);
                 choose_random_theme(m);
                 if (speed < 0) {
                     m->rotation = PI;
@@ -206,7 +206,7 @@ class LeaperGame : public BasicAbstractGame {
             float spawn_prob = fabs(speed) / 2.0;
             if (rand_gen.rand01() < spawn_prob) {
                 float x = speed > 0 ? (-1 * LOG_RADIUS) : (main_width + LOG_RADIUS);
-                auto m = std::make_shared<Entity>(x, bottom_water_y + lane + 0.5, speed, 0, LOG_RADIUS, LOG);
+                auto m = make_entity(x, bottom_water_y + lane + 0.5, speed, 0, LOG_RADIUS, LOG);
                 if (!has_any_collision(m)) {
                     entities.push_back(m);
                 }
@@ -299,6 +299,16 @@ class LeaperGame : public BasicAbstractGame {
         water_lane_speeds = b->read_vector_float();
         goal_y = b->read_int();
     }
+
+    void copy_state(const Game &src) override {
+        BasicAbstractGame::copy_state(src);
+        const auto &other = static_cast<const LeaperGame &>(src);
+        bottom_road_y = other.bottom_road_y;
+        road_lane_speeds = other.road_lane_speeds;
+        bottom_water_y = other.bottom_water_y;
+        water_lane_speeds = other.water_lane_speeds;
+        goal_y = other.goal_y;
+    }
 };
 
 REGISTER_GAME(NAME, LeaperGame);
@@ -24,7 +24,7 @@ class MazeGame : public BasicAbstractGame {
     }
 
     void load_background_images() override {
-        main_bg_images_ptr = &topdown_backgrounds;
+        main_bg_images_ptr = get_background_images("topdown_backgrounds");
     }
 
     void asset_for_type(int type, std::vector<std::string> &names) override {
@@ -122,6 +122,51 @@ class MazeGame : public BasicAbstractGame {
         step_data.done = step_data.reward > 0;
     }
 
+    // the shortest path to the goal by a breadth first search over the open cells
+    int get_path_length() {
+        std::vector<int> goal_cells = get_cells_with_type(GOAL);
+        if (goal_cells.empty()) {
+            return -1;
+        }
+
+        std::vector<int> dist(grid_size, -1);
+        std::queue<int> frontier;
+        int start = to_grid_idx(int(agent->x), int(agent->y));
+        dist[start] = 0;
+        frontier.push(start);
+
+        const int dxs[4] = {1, -1, 0, 0};
+        const int dys[4] = {0, 0, 1, -1};
+
+        while (!frontier.empty()) {
+            int idx = frontier.front();
+            frontier.pop();
+
+            if (idx == goal_cells[0]) {
+                return dist[idx];
+            }
+
+            int x, y;
+            to_grid_xy(idx, &x, &y);
+
+            for (int k = 0; k < 4; k++) {
+                int next = to_grid_idx(x + dxs[k], y + dys[k]);
+                if (next != INVALID_IDX && dist[next] < 0 && get_obj(next) != WALL_OBJ) {
+                    dist[next] = dist[idx] + 1;
+                    frontier.push(next);
+                }
+            }
+        }
+
+        return -1;
+    }
+
+    void summarize_level(LevelSummary &summary) override {
+        BasicAbstractGame::summarize_level(summary);
+        summary.features[LEVEL_WALLS] = (int32_t)(get_cells_with_type(WALL_OBJ).size());
+        summary.features[LEVEL_PATH_LENGTH] = get_path_length();
+    }
+
     void serialize(WriteBuffer *b) override {
         BasicAbstractGame::serialize(b);
         b->write_int(maze_dim);
@@ -133,6 +178,13 @@ class MazeGame : public BasicAbstractGame {
         maze_dim = b->read_int();
         world_dim = b->read_int();
     }
+
+    void copy_state(const Game &src) override {
+        BasicAbstractGame::copy_state(src);
+        const auto &other = static_cast<const MazeGame &>(src);
+        maze_dim = other.maze_dim;
+        world_dim = other.world_dim;
+    }
 };
 
 REGISTER_GAME(NAME, MazeGame);
@@ -36,7 +36,7 @@ class MinerGame : public BasicAbstractGame {
     }
 
     void load_background_images() override {
-        main_bg_images_ptr = &platform_backgrounds;
+        main_bg_images_ptr = get_background_images("platform_backgrounds");
     }
 
     void asset_for_type(int type, std::vector<std::string> &names) override {
@@ -322,6 +322,12 @@ class MinerGame : public BasicAbstractGame {
         BasicAbstractGame::deserialize(b);
         diamonds_remaining = b->read_int();
     }
+
+    void copy_state(const Game &src) override {
+        BasicAbstractGame::copy_state(src);
+        const auto &other = static_cast<const MinerGame &>(src);
+        diamonds_remaining = other.diamonds_remaining;
+    }
 };
 
 REGISTER_GAME(NAME, MinerGame);
\ No newline at end of file
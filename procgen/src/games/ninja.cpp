@@ -40,7 +40,7 @@ class Ninja : public BasicAbstractGame {
     }
 
     void load_background_images() override {
-        main_bg_images_ptr = &platform_backgrounds;
+        main_bg_images_ptr = get_background_images("platform_backgrounds");
     }
 
     void asset_for_type(int type, std::vector<std::string> &names) override {
@@ -433,6 +433,19 @@ class Ninja : public BasicAbstractGame {
         jump_charge = b->read_float();
         jump_charge_inc = b->read_float();
     }
+
+    void copy_state(const Game &src) override {
+        BasicAbstractGame::copy_state(src);
+        const auto &other = static_cast<const Ninja &>(src);
+        has_support = other.has_support;
+        facing_right = other.facing_right;
+        last_fire_time = other.last_fire_time;
+        wall_theme = other.wall_theme;
+        gravity = other.gravity;
+        air_control = other.air_control;
+        jump_charge = other.jump_charge;
+        jump_charge_inc = other.jump_charge_inc;
+    }
 };
 
 REGISTER_GAME(NAME, Ninja);
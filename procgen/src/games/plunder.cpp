@@ -43,7 +43,7 @@ class PlunderGame : public BasicAbstractGame {
     }
 
     void load_background_images() override {
-        main_bg_images_ptr = &water_surface_backgrounds;
+        main_bg_images_ptr = get_background_images("water_surface_backgrounds");
     }
 
     void asset_for_type(int type, std::vector<std::string> &names) override {
@@ -202,7 +202,7 @@ class PlunderGame : public BasicAbstractGame {
             float ent_y = (lane * .11 + .4) * (main_height / 2 - ent_r) + main_height / 2;
             float moves_right = lane_directions[lane];
             float ent_vx = lane_vels[lane] * (moves_right ? 1 : -1);
-            auto ent = std::make_shared<Entity>(0, ent_y, ent_vx, 0, ent_r, SHIP);
+            auto ent = make_entity(0, ent_y, ent_vx, 0, ent_r, SHIP);
             ent->image_type = SHIP;
             ent->image_theme = image_permutation[rand_gen.randn(num_current_ship_types)];
             match_aspect_ratio(ent);
@@ -275,6 +275,25 @@ class PlunderGame : public BasicAbstractGame {
         legend_r = b->read_float();
         min_agent_x = b->read_float();
     }
+
+    void copy_state(const Game &src) override {
+        BasicAbstractGame::copy_state(src);
+        const auto &other = static_cast<const PlunderGame &>(src);
+        last_fire_time = other.last_fire_time;
+        lane_directions = other.lane_directions;
+        target_bools = other.target_bools;
+        image_permutation = other.image_permutation;
+        lane_vels = other.lane_vels;
+        num_lanes = other.num_lanes;
+        num_current_ship_types = other.num_current_ship_types;
+        targets_hit = other.targets_hit;
+        target_quota = other.target_quota;
+        juice_left = other.juice_left;
+        r_scale = other.r_scale;
+        spawn_prob = other.spawn_prob;
+        legend_r = other.legend_r;
+        min_agent_x = other.min_agent_x;
+    }
 };
 
 REGISTER_GAME(NAME, PlunderGame);
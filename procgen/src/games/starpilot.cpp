@@ -51,10 +51,12 @@ class StarPilotGame : public BasicAbstractGame {
         : BasicAbstractGame(NAME) {
         main_width = 16;
         main_height = 16;
+
+        supports_software_render = true;
     }
 
     void load_background_images() override {
-        main_bg_images_ptr = &space_backgrounds;
+        main_bg_images_ptr = get_background_images("space_backgrounds");
     }
 
     void asset_for_type(int type, std::vector<std::string> &names) override {
@@ -123,6 +125,46 @@ class StarPilotGame : public BasicAbstractGame {
         draw_foreground(p, rect);
     }
 
+    bool game_draw_raster(RasterTarget &dst) override {
+        float scale = dst.h / main_height;
+
+        ::raster_fill_rect(dst, 0, 0, dst.w, dst.h, 0xff000000);
+
+        if (options.use_backgrounds) {
+            float bg_k = 3;
+            float t = cur_time;
+            float x_off = -t * scale * hp_slow_v * 2 / char_dim;
+
+            QRectF r_bg = QRectF(x_off, -dst.h * (bg_k - 1) / 2, dst.h * bg_k * BG_RATIO, dst.h * bg_k);
+
+            if (dst.commands != nullptr) {
+                raster_record_background(dst, r_bg, 1);
+            } else {
+                float tile_dx, tile_dy, tile_width, tile_height;
+                int num_tiles = get_tile_layout(r_bg, 1, tile_dx, tile_dy, tile_width, tile_height);
+
+                for (int i = 0; i < num_tiles; i++) {
+                    int x0 = int(round(r_bg.x() + tile_dx * i));
+                    int x1 = int(round(r_bg.x() + tile_dx * (i + 1)));
+
+                    if (x1 <= 0 || x0 >= dst.w) {
+                        continue;
+                    }
+
+                    int y0 = int(round(r_bg.y()));
+                    int y1 = int(round(r_bg.y() + tile_height));
+
+                    QImage *tile = lookup_scaled_background(QPainter::RenderHints(), x1 - x0, y1 - y0);
+                    raster_blend(dst, x0, y0, (const uint32_t *)tile->constBits(), tile->width(), tile->height(), tile->bytesPerLine() / 4);
+                }
+            }
+        }
+
+        raster_draw_foreground(dst);
+
+        return true;
+    }
+
     void handle_agent_collision(const std::shared_ptr<Entity> &obj) override {
         BasicAbstractGame::handle_agent_collision(obj);
 
@@ -301,7 +343,7 @@ class StarPilotGame : public BasicAbstractGame {
                     vx *= -1;
                 }
 
-                auto spawner = std::make_shared<Entity>(x_pos, y_pos, vx, vy, r, type);
+                auto spawner = make_entity(x_pos, y_pos, vx, vy, r, type);
                 spawner->fire_time = fire_time;
                 spawner->spawn_time = spawn_time;
                 spawner->health = health;
@@ -385,7 +427,7 @@ class StarPilotGame : public BasicAbstractGame {
                 b_vx = b_vx * bv_scale;
                 b_vy = b_vy * bv_scale;
 
-                std::shared_ptr<Entity> new_bullet(new Entity(m->x, m->y, b_vx, b_vy, bullet_r, bullet_type));
+                std::shared_ptr<Entity> new_bullet = make_entity(m->x, m->y, b_vx, b_vy, bullet_r, bullet_type);
                 new_bullet->face_direction(b_vx, b_vy, -1 * PI / 2);
                 entities.push_back(new_bullet);
             }
@@ -413,7 +455,7 @@ class StarPilotGame : public BasicAbstractGame {
             float vy = sin(theta) * v_scale;
             float x_off = agent->rx * cos(theta);
 
-            auto bullet = std::make_shared<Entity>(agent->x + x_off, agent->y, vx, vy, bullet_r, BULLET_PLAYER);
+            auto bullet = make_entity(agent->x + x_off, agent->y, vx, vy, bullet_r, BULLET_PLAYER);
             bullet->collides_with_entities = true;
             bullet->face_direction(vx, vy);
             bullet->rotation -= PI / 2;
@@ -421,7 +463,7 @@ class StarPilotGame : public BasicAbstractGame {
         }
 
         if (cur_time == SHOOTER_WIN_TIME) {
-            auto finish = std::make_shared<Entity>(main_width, main_height / 2, -1 * hp_slow_v * V_SCALE, 0, 2, main_height / 2, FINISH_LINE);
+            auto finish = make_entity(main_width, main_height / 2, -1 * hp_slow_v * V_SCALE, 0, 2, main_height / 2, FINISH_LINE);
             choose_random_theme(finish);
             match_aspect_ratio(finish, false);
             finish->x = main_width + finish->rx;
@@ -440,6 +482,14 @@ class StarPilotGame : public BasicAbstractGame {
 
         init_hps();
     }
+
+    void copy_state(const Game &src) override {
+        BasicAbstractGame::copy_state(src);
+        const auto &other = static_cast<const StarPilotGame &>(src);
+        copy_entities(other.spawners, spawners);
+
+        init_hps();
+    }
 };
 
 REGISTER_GAME(NAME, StarPilotGame);
@@ -66,15 +66,34 @@ class Grid {
         data[index] = v;
     };
 
+    // for callers that have already checked contains() or are looping over the grid,
+    // only checked when built with PROCGEN_DEBUG_CHECKS
+
+    T get_unchecked(int x, int y) const {
+        debug_fassert(contains(x, y));
+        return data[y * w + x];
+    };
+
+    T get_index_unchecked(int index) const {
+        debug_fassert(contains_index(index));
+        return data[index];
+    };
+
+    void set_index_unchecked(int index, T v) {
+        debug_fassert(contains_index(index));
+        data[index] = v;
+    };
+
     void serialize(WriteBuffer *b) {
         b->write_int(w);
         b->write_int(h);
-        b->write_vector_int(data);
+        b->write_vector(data);
     };
 
     void deserialize(ReadBuffer *b) {
         w = b->read_int();
         h = b->read_int();
-        data = b->read_vector_int();
+        data = b->read_vector<T>();
+        fassert(int(data.size()) == w * h);
     };
 };
@@ -0,0 +1,117 @@
+#include "jpeg-encode.h"
+#include "cpp-utils.h"
+
+#ifdef PROCGEN_USE_JPEG
+
+#include <cstdio>
+#include <vector>
+#include <jpeglib.h>
+
+// writes into a fixed buffer; once it fills up, the rest of the frame is discarded into a scratch
+// buffer instead of stopping the compressor, which would need a longjmp out of libjpeg
+struct FixedDest {
+    struct jpeg_destination_mgr pub;
+    uint8_t *out;
+    size_t out_len;
+    bool overflow;
+    uint8_t scratch[4096];
+};
+
+static void init_destination(j_compress_ptr cinfo) {
+    auto dest = (FixedDest *)(cinfo->dest);
+    dest->pub.next_output_byte = dest->out;
+    dest->pub.free_in_buffer = dest->out_len;
+}
+
+static boolean empty_output_buffer(j_compress_ptr cinfo) {
+    auto dest = (FixedDest *)(cinfo->dest);
+    dest->overflow = true;
+    dest->pub.next_output_byte = dest->scratch;
+    dest->pub.free_in_buffer = sizeof(dest->scratch);
+    return TRUE;
+}
+
+static void term_destination(j_compress_ptr cinfo) {
+}
+
+static void error_exit(j_common_ptr cinfo) {
+    char msg[JMSG_LENGTH_MAX];
+    (*cinfo->err->format_message)(cinfo, msg);
+    fatal("libjpeg error: %s\n", msg);
+}
+
+bool jpeg_encoding_available() {
+    return true;
+}
+
+size_t encode_jpeg_bgr32(const uint32_t *src, int w, int h, int quality, uint8_t *out, size_t out_len) {
+    struct jpeg_compress_struct cinfo;
+    struct jpeg_error_mgr jerr;
+    cinfo.err = jpeg_std_error(&jerr);
+    jerr.error_exit = error_exit;
+    jpeg_create_compress(&cinfo);
+
+    FixedDest dest;
+    dest.pub.init_destination = init_destination;
+    dest.pub.empty_output_buffer = empty_output_buffer;
+    dest.pub.term_destination = term_destination;
+    dest.out = out;
+    dest.out_len = out_len;
+    dest.overflow = false;
+    cinfo.dest = &dest.pub;
+
+    cinfo.image_width = w;
+    cinfo.image_height = h;
+#ifdef JCS_EXTENSIONS
+    // libjpeg-turbo reads the render buffer directly, a uint32_t 0xAARRGGBB is B, G, R, A in memory
+    cinfo.input_components = 4;
+    cinfo.in_color_space = JCS_EXT_BGRX;
+#else
+    cinfo.input_components = 3;
+    cinfo.in_color_space = JCS_RGB;
+#endif
+    jpeg_set_defaults(&cinfo);
+    jpeg_set_quality(&cinfo, quality, TRUE);
+    jpeg_start_compress(&cinfo, TRUE);
+
+#ifndef JCS_EXTENSIONS
+    static thread_local std::vector<uint8_t> row_buf;
+    row_buf.resize(w * 3);
+#endif
+    while (cinfo.next_scanline < cinfo.image_height) {
+        const uint32_t *src_row = src + cinfo.next_scanline * w;
+#ifdef JCS_EXTENSIONS
+        JSAMPROW row = (JSAMPROW)(src_row);
+#else
+        for (int x = 0; x < w; x++) {
+            row_buf[3 * x + 0] = (src_row[x] >> 16) & 0xff;
+            row_buf[3 * x + 1] = (src_row[x] >> 8) & 0xff;
+            row_buf[3 * x + 2] = src_row[x] & 0xff;
+        }
+        JSAMPROW row = row_buf.data();
+#endif
+        jpeg_write_scanlines(&cinfo, &row, 1);
+    }
+
+    jpeg_finish_compress(&cinfo);
+    size_t written = out_len - dest.pub.free_in_buffer;
+    jpeg_destroy_compress(&cinfo);
+
+    if (dest.overflow) {
+        return 0;
+    }
+    return written;
+}
+
+#else
+
+bool jpeg_encoding_available() {
+    return false;
+}
+
+size_t encode_jpeg_bgr32(const uint32_t *src, int w, int h, int quality, uint8_t *out, size_t out_len) {
+    fatal("procgen was built without libjpeg, encode_jpeg is not available\n");
+    return 0;
+}
+
+#endif
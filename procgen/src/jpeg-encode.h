@@ -0,0 +1,19 @@
+#pragma once
+
+/*
+
+JPEG encoding of rendered frames, used for the encode_jpeg option
+
+The frame is encoded on the stepping thread straight from the BGR32 render buffer, so that a frontend
+streaming frames doesn't have to convert and compress them in python. This needs procgen to be built
+with libjpeg (preferably libjpeg-turbo), otherwise jpeg_encoding_available() is false.
+
+*/
+
+#include <cstddef>
+#include <cstdint>
+
+bool jpeg_encoding_available();
+
+// returns the number of bytes written to out, or 0 if the encoded frame didn't fit in out_len bytes
+size_t encode_jpeg_bgr32(const uint32_t *src, int w, int h, int quality, uint8_t *out, size_t out_len);
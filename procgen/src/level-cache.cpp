@@ -0,0 +1,30 @@
+#include "level-cache.h"
+
+LevelCache::LevelCache(int max_levels)
+    : max_levels(max_levels) {
+}
+
+std::shared_ptr<const std::vector<char>> LevelCache::find(const std::string &game_name, int level_seed) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto it = levels.find(std::make_pair(game_name, level_seed));
+
+    if (it == levels.end()) {
+        return nullptr;
+    }
+
+    return it->second;
+}
+
+void LevelCache::insert(const std::string &game_name, int level_seed, const char *data, size_t length) {
+    // copy outside of the lock, another env may be generating the same level and lose the race
+    auto level = std::make_shared<const std::vector<char>>(data, data + length);
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    if (levels.size() >= max_levels) {
+        return;
+    }
+
+    levels.emplace(std::make_pair(game_name, level_seed), level);
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+/*
+
+Cache of generated levels, shared by all the games in a VecGame
+
+Each entry is the serialized state of a game right after game_reset() for a given level seed,
+restoring it is equivalent to generating the level again. Lookups and inserts may happen from
+several stepping threads at once.
+
+*/
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+// same as MAX_STATE_SIZE in env.py
+const int MAX_LEVEL_STATE_SIZE = 1 << 20;
+
+class LevelCache {
+  public:
+    explicit LevelCache(int max_levels);
+
+    std::shared_ptr<const std::vector<char>> find(const std::string &game_name, int level_seed);
+    // does nothing once the cache holds max_levels entries
+    void insert(const std::string &game_name, int level_seed, const char *data, size_t length);
+
+  private:
+    size_t max_levels;
+    std::mutex mutex;
+    std::map<std::pair<std::string, int>, std::shared_ptr<const std::vector<char>>> levels;
+};
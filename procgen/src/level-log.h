@@ -0,0 +1,25 @@
+#pragma once
+
+/*
+
+Action logs for replaying levels, enabled with the record_actions option
+
+A level is fully determined by its seed and the options of the game, and everything after that by the actions, so
+a log of the actions is enough to replay a level exactly in a game with the same options. The log is per frame
+rather than per step so it doesn't depend on frame_skip, and per level rather than per episode so a level reached
+with use_sequential_levels is replayed from its own start.
+
+*/
+
+#include <cstdint>
+#include <vector>
+
+// logged for an action of -1, which ends the episode
+const uint8_t LEVEL_LOG_FORCE_RESET = 255;
+
+struct LevelLog {
+    int32_t env = 0;
+    int32_t level_seed = 0;
+    // the action of each frame of the level
+    std::vector<uint8_t> actions;
+};
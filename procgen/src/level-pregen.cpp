@@ -0,0 +1,94 @@
+#include "level-pregen.h"
+#include "game.h"
+#include "level-cache.h"
+
+LevelPregenerator::LevelPregenerator(const std::vector<std::shared_ptr<Game>> &_generator_games)
+    : generator_games(_generator_games) {
+    slots.resize(generator_games.size());
+    thread = std::thread(&LevelPregenerator::worker, this);
+}
+
+LevelPregenerator::~LevelPregenerator() {
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        time_to_die = true;
+    }
+    level_requested.notify_all();
+    thread.join();
+}
+
+void LevelPregenerator::request(int env_idx, int level_seed) {
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        Slot &slot = slots.at(env_idx);
+
+        if (slot.level_seed == level_seed && (slot.is_requested || slot.level != nullptr)) {
+            return;
+        }
+
+        slot.level_seed = level_seed;
+        slot.is_requested = true;
+        slot.level = nullptr;
+        pending_envs.push_back(env_idx);
+    }
+    level_requested.notify_one();
+}
+
+std::shared_ptr<const std::vector<char>> LevelPregenerator::take(int env_idx, int level_seed) {
+    std::unique_lock<std::mutex> lock(mutex);
+    Slot &slot = slots.at(env_idx);
+
+    if (slot.level_seed != level_seed || slot.level == nullptr) {
+        return nullptr;
+    }
+
+    auto level = slot.level;
+    slot.level = nullptr;
+    return level;
+}
+
+void LevelPregenerator::worker() {
+    std::vector<char> state_buf(MAX_LEVEL_STATE_SIZE);
+
+    while (true) {
+        int env_idx;
+        int level_seed;
+
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            level_requested.wait(lock, [&]() { return time_to_die || !pending_envs.empty(); });
+
+            if (time_to_die) {
+                break;
+            }
+
+            env_idx = pending_envs.front();
+            pending_envs.pop_front();
+
+            // a later request for this env may have replaced the one that was queued
+            if (!slots[env_idx].is_requested) {
+                continue;
+            }
+
+            level_seed = slots[env_idx].level_seed;
+        }
+
+        const auto &game = generator_games[env_idx];
+        game->generate_level(level_seed);
+
+        auto b = WriteBuffer(state_buf.data(), state_buf.size());
+        game->serialize(&b);
+        auto level = std::make_shared<const std::vector<char>>(state_buf.data(), state_buf.data() + b.offset);
+
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            Slot &slot = slots[env_idx];
+
+            // only keep it if the env hasn't asked for a different level in the meantime
+            if (slot.is_requested && slot.level_seed == level_seed) {
+                slot.is_requested = false;
+                slot.level = level;
+            }
+        }
+    }
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+/*
+
+Generates the next level of each env ahead of time on a background thread
+
+After every reset, an env asks for the level it will most likely play next (the next value of its
+level seed generator). A private copy of the game generates it and keeps the serialized state, so
+the next reset only has to deserialize it instead of stalling the stepping batch on level generation.
+
+*/
+
+#include <memory>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+class Game;
+
+class LevelPregenerator {
+  public:
+    // generator_games[n] is only used by the background thread to generate levels for env n, it may be shared between envs
+    explicit LevelPregenerator(const std::vector<std::shared_ptr<Game>> &generator_games);
+    ~LevelPregenerator();
+
+    void request(int env_idx, int level_seed);
+    // the level generated for level_seed, or nullptr if it isn't ready yet or a different level was requested
+    std::shared_ptr<const std::vector<char>> take(int env_idx, int level_seed);
+
+  private:
+    struct Slot {
+        int level_seed = 0;
+        bool is_requested = false;
+        std::shared_ptr<const std::vector<char>> level;
+    };
+
+    std::vector<std::shared_ptr<Game>> generator_games;
+    std::vector<Slot> slots;
+    std::deque<int> pending_envs;
+
+    std::mutex mutex;
+    std::condition_variable level_requested;
+    bool time_to_die = false;
+    std::thread thread;
+
+    void worker();
+};
@@ -0,0 +1,40 @@
+#pragma once
+
+/*
+
+Summaries of generated levels, made by VecGame::generate_levels() for sweeps over level seeds
+
+The levels are generated the same way as on a reset, without being stepped or drawn, so a sweep
+costs only the level generation.
+
+*/
+
+#include <cstdint>
+
+// game specific measures of a level, the games that don't have a measure leave it at 0
+enum LevelFeature {
+    // fruitbot: rows of walls, maze: wall cells
+    LEVEL_WALLS = 0,
+    // fruitbot: locked doors
+    LEVEL_DOORS,
+    // fruitbot: fruit
+    LEVEL_GOOD_OBJECTS,
+    // fruitbot: non-fruit
+    LEVEL_BAD_OBJECTS,
+    // maze: moves from the start to the goal
+    LEVEL_PATH_LENGTH,
+    LEVEL_NUM_FEATURES,
+};
+
+const char *const LEVEL_FEATURE_NAMES[LEVEL_NUM_FEATURES] = {"walls", "doors", "good_objects", "bad_objects", "path_length"};
+
+// only 4 byte fields, so the layout is the same as an array of int32_t, see generate_levels() in env.py
+struct LevelSummary {
+    int32_t level_seed = 0;
+    int32_t width = 0;
+    int32_t height = 0;
+    int32_t num_entities = 0;
+    int32_t features[LEVEL_NUM_FEATURES] = {};
+};
+
+static_assert(sizeof(LevelSummary) == (4 + LEVEL_NUM_FEATURES) * 4, "LevelSummary must not have padding");
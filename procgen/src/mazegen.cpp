@@ -1,6 +1,7 @@
 #include "mazegen.h"
 #include "object-ids.h"
 #include "cpp-utils.h"
+#include <algorithm>
 
 struct Wall {
     int x1;
@@ -13,22 +14,39 @@ MazeGen::MazeGen(RandGen *_rand_gen, int _maze_dim) {
     rand_gen = _rand_gen;
     maze_dim = _maze_dim;
     array_dim = maze_dim + 2;
-    cell_sets.resize(array_dim * array_dim);
-    cell_sets_idxs.resize(array_dim * array_dim);
+    cell_parents.resize(maze_dim * maze_dim);
+    cell_ranks.resize(maze_dim * maze_dim);
+    is_free_cell.resize(maze_dim * maze_dim);
     free_cells.resize(array_dim * array_dim);
     grid.resize(array_dim, array_dim);
 }
 
+// the root of the set the cell is in, halving the path to it on the way
 int MazeGen::lookup(int x, int y) {
-    return cell_sets_idxs[maze_dim * y + x];
+    int cell = maze_dim * y + x;
+    while (cell_parents[cell] != cell) {
+        cell_parents[cell] = cell_parents[cell_parents[cell]];
+        cell = cell_parents[cell];
+    }
+    return cell;
+}
+
+void MazeGen::join(int root0, int root1) {
+    if (cell_ranks[root0] < cell_ranks[root1]) {
+        std::swap(root0, root1);
+    }
+    cell_parents[root1] = root0;
+    if (cell_ranks[root0] == cell_ranks[root1]) {
+        cell_ranks[root0]++;
+    }
 }
 
 void MazeGen::set_free_cell(int x, int y) {
     grid.set(x + MAZE_OFFSET, y + MAZE_OFFSET, SPACE);
     int cell = maze_dim * y + x;
-    if (free_cell_set.find(cell) == free_cell_set.end()) {
+    if (!is_free_cell[cell]) {
         free_cells[num_free_cells] = cell;
-        free_cell_set.insert(cell);
+        is_free_cell[cell] = true;
         num_free_cells += 1;
     }
 }
@@ -66,23 +84,31 @@ void MazeGen::get_neighbors(int idx, int type, std::vector<int> &neighbors) {
     }
 }
 
-int MazeGen::expand_to_type(std::set<int> &s0, std::set<int> &s1, int type) {
-    std::set<int> curr = s0;
+// s0 and s1 are indexed by grid index, the cells at each distance are visited in increasing order so that the
+// same cells are found as when these were std::sets
+int MazeGen::expand_to_type(const std::vector<bool> &s0, std::vector<bool> &s1, int type) {
+    std::vector<int> curr;
+    for (int i = 0; i < (int)(s0.size()); i++) {
+        if (s0[i]) {
+            curr.push_back(i);
+        }
+    }
 
+    std::vector<int> next;
     std::vector<int> target_elems;
     std::vector<int> adj_space;
 
     while (curr.size() > 0) {
-        std::set<int> next;
+        next.clear();
 
         for (int elem : curr) {
             get_neighbors(elem, type, target_elems);
             get_neighbors(elem, SPACE, adj_space);
 
             for (int j : adj_space) {
-                if (!set_contains(s0, j) && !set_contains(s1, j)) {
-                    next.insert(j);
-                    s1.insert(j);
+                if (!s0[j] && !s1[j]) {
+                    next.push_back(j);
+                    s1[j] = true;
                 }
             }
 
@@ -91,7 +117,8 @@ int MazeGen::expand_to_type(std::set<int> &s0, std::set<int> &s1, int type) {
             }
         }
 
-        curr = next;
+        std::sort(next.begin(), next.end());
+        curr.swap(next);
     }
 
     return -1;
@@ -121,18 +148,11 @@ void MazeGen::generate_maze() {
     std::vector<Wall> walls;
 
     num_free_cells = 0;
-    free_cell_set.clear();
-
-    std::set<int> *s0 = &cell_sets[0];
-    s0->clear();
-    s0->insert(0);
-    cell_sets_idxs[0] = 0;
-
-    for (int i = 1; i < maze_dim * maze_dim; i++) {
-        std::set<int> *s1 = &cell_sets[i];
-        s1->clear();
-        s1->insert(i);
-        cell_sets_idxs[i] = i;
+
+    for (int i = 0; i < maze_dim * maze_dim; i++) {
+        cell_parents[i] = i;
+        cell_ranks[i] = 0;
+        is_free_cell[i] = false;
     }
 
     for (int i = 1; i < maze_dim; i += 2) {
@@ -151,38 +171,51 @@ void MazeGen::generate_maze() {
         }
     }
 
-    while (walls.size() > 0) {
-        int n = rand_gen->randn((int)(walls.size()));
-        Wall wall = walls[n];
+    // each step draws one of the walls left in their original order, which is found with a fenwick tree
+    // counting the walls left rather than by erasing the drawn wall from the vector
+    int num_walls = (int)(walls.size());
+    std::vector<int> walls_left(num_walls + 1);
+    for (int i = 1; i <= num_walls; i++) {
+        walls_left[i] = i & -i;
+    }
+    int top_step = 1;
+    while (top_step * 2 <= num_walls) {
+        top_step *= 2;
+    }
+
+    for (int num_left = num_walls; num_left > 0; num_left--) {
+        int n = rand_gen->randn(num_left);
+
+        int wall_idx = 0;
+        for (int step = top_step; step > 0; step /= 2) {
+            if (wall_idx + step <= num_walls && walls_left[wall_idx + step] <= n) {
+                wall_idx += step;
+                n -= walls_left[wall_idx];
+            }
+        }
+        for (int i = wall_idx + 1; i <= num_walls; i += i & -i) {
+            walls_left[i]--;
+        }
+        Wall wall = walls[wall_idx];
 
         int s0_idx = lookup(wall.x1, wall.y1);
-        s0 = &cell_sets[s0_idx];
         int s1_idx = lookup(wall.x2, wall.y2);
-        std::set<int> *s1 = &cell_sets[s1_idx];
 
         int x0 = (wall.x1 + wall.x2) / 2;
         int y0 = (wall.y1 + wall.y2) / 2;
-        int center = maze_dim * y0 + x0;
 
         bool can_remove =
             (grid.get(x0 + MAZE_OFFSET, y0 + MAZE_OFFSET) == WALL_OBJ) &&
             (s0_idx != s1_idx);
 
+        // the cell between the two is never looked up, so it doesn't need to join their set
         if (can_remove) {
             set_free_cell(wall.x1, wall.y1);
             set_free_cell(x0, y0);
             set_free_cell(wall.x2, wall.y2);
 
-            s1->insert(s0->begin(), s0->end());
-            s1->insert(center);
-
-            std::set<int>::iterator it;
-            for (it = s1->begin(); it != s1->end(); ++it) {
-                cell_sets_idxs[*it] = s1_idx;
-            }
+            join(s0_idx, s1_idx);
         }
-
-        walls.erase(walls.begin() + n);
     }
 }
 
@@ -253,25 +286,32 @@ void MazeGen::generate_maze_with_doors(int num_doors) {
         grid.set_index(agent_cell, AGENT_OBJ);
     }
 
-    std::set<int> s0;
-    s0.insert(agent_cell);
+    int num_cells = array_dim * array_dim;
+    std::vector<bool> s0(num_cells, false);
+    s0[agent_cell] = true;
 
     for (int door_num = 0; door_num < num_doors + 1; door_num++) {
-        std::set<int> s1;
+        std::vector<bool> s1(num_cells, false);
         int found_door = -1;
 
         if (door_num < num_doors) {
             found_door = expand_to_type(s0, s1, DOOR_OBJ);
             grid.set_index(found_door, DOOR_OBJ + door_num + 1);
-            s0.insert(s1.begin(), s1.end());
+            for (int x = 0; x < num_cells; x++) {
+                if (s1[x]) {
+                    s0[x] = true;
+                }
+            }
         }
 
         expand_to_type(s0, s1, -999);
 
         std::vector<int> space_cells;
 
-        for (int x : s1) {
-            space_cells.push_back(x);
+        for (int x = 0; x < num_cells; x++) {
+            if (s1[x]) {
+                space_cells.push_back(x);
+            }
         }
 
         fassert(space_cells.size() > 0);
@@ -281,10 +321,12 @@ void MazeGen::generate_maze_with_doors(int num_doors) {
                                      ? EXIT_OBJ
                                      : (KEY_OBJ + door_num + 1));
 
-        s0.insert(s1.begin(), s1.end());
+        for (int x : space_cells) {
+            s0[x] = true;
+        }
 
         if (found_door >= 0) {
-            s0.insert(found_door);
+            s0[found_door] = true;
         }
     }
 }
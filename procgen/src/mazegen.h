@@ -4,10 +4,14 @@
 
 Generate a maze using kruskal's algorithm
 
+The cells joined so far are tracked with a disjoint set forest and the walls are drawn with the same random
+numbers as when they were kept in a vector that each drawn wall was erased from, so the same seed still gives
+the same maze.
+
 */
 
 #include <memory>
-#include <set>
+#include <vector>
 #include "grid.h"
 #include "randgen.h"
 
@@ -29,17 +33,18 @@ class MazeGen {
     int array_dim;
 
     int num_free_cells;
-    std::vector<std::set<int>> cell_sets;
-    std::vector<int> cell_sets_idxs;
-    std::set<int> free_cell_set;
+    std::vector<int> cell_parents;
+    std::vector<int> cell_ranks;
+    std::vector<bool> is_free_cell;
     std::vector<int> free_cells;
 
     void get_neighbors(int idx, int type, std::vector<int> &neighbors);
     int lookup(int x, int y);
+    void join(int cell0, int cell1);
     void set_free_cell(int x, int y);
     void set_obj(int idx, int type);
     int to_index(int x, int y);
     int get_obj(int idx);
     std::vector<int> filter_cells(int type);
-    int expand_to_type(std::set<int> &s0, std::set<int> &s1, int type);
+    int expand_to_type(const std::vector<bool> &s0, std::vector<bool> &s1, int type);
 };
@@ -0,0 +1,98 @@
+#pragma once
+
+/*
+
+Timing of the phases of stepping a game, enabled with the collect_stats option
+
+Each game has its own counters, which are only updated by the thread that currently owns the game, so no
+locking or atomics are needed. The durations go into a log2 histogram, bucket b counts durations in
+[2^b, 2^(b+1)) nanoseconds, which is enough to get percentiles to within a factor of 2.
+
+*/
+
+#include <chrono>
+#include <cstdint>
+#include "trace.h"
+
+enum StatsPhase {
+    // Game::step_frame(), around game_step(), which includes erase
+    STATS_GAME_STEP = 0,
+    // BasicAbstractGame::erase_if_needed()
+    STATS_ERASE,
+    // Game::reset(), including generating or restoring the level
+    STATS_RESET,
+    // Game::render_to_buf() for the 64x64 observation
+    STATS_RENDER,
+    // Game::render_to_buf() for the render_res frame of render_human and encode_jpeg
+    STATS_RENDER_HIRES,
+    // bgr32_to_obs() in Game::observe()
+    STATS_CONVERT,
+    // encode_jpeg_bgr32() in Game::observe()
+    STATS_ENCODE,
+    // VecGame::wait_for_stepping_threads(), only tracked by the VecGame
+    STATS_WAIT,
+    STATS_NUM_PHASES,
+};
+
+// also used as the names of the trace events
+const char *const STATS_PHASE_NAMES[STATS_NUM_PHASES] = {"game_step", "erase", "reset", "render", "render_hires", "convert", "encode", "wait"};
+
+const int STATS_NUM_BUCKETS = 32;
+// count, total_ns, max_ns, then the buckets
+const int STATS_VALUES_PER_PHASE = 3 + STATS_NUM_BUCKETS;
+
+struct PhaseStats {
+    uint64_t count = 0;
+    uint64_t total_ns = 0;
+    uint64_t max_ns = 0;
+    uint64_t buckets[STATS_NUM_BUCKETS] = {};
+
+    void add(uint64_t ns) {
+        count++;
+        total_ns += ns;
+        if (ns > max_ns) {
+            max_ns = ns;
+        }
+        int b = 0;
+        while (b < STATS_NUM_BUCKETS - 1 && (ns >> (b + 1)) != 0) {
+            b++;
+        }
+        buckets[b]++;
+    }
+};
+
+struct GameStats {
+    PhaseStats phases[STATS_NUM_PHASES];
+};
+
+// adds the lifetime of the timer to a phase and records it as a trace event, either of stats and tracer may be null
+class PhaseTimer {
+  public:
+    PhaseTimer(GameStats *_stats, StatsPhase _phase, Tracer *_tracer = nullptr, int _env = -1)
+        : stats(_stats), phase(_phase), tracer(_tracer), env(_env) {
+        if (stats != nullptr || tracer != nullptr) {
+            start = std::chrono::steady_clock::now();
+        }
+    }
+
+    ~PhaseTimer() {
+        if (stats == nullptr && tracer == nullptr) {
+            return;
+        }
+        auto end = std::chrono::steady_clock::now();
+        if (stats != nullptr) {
+            auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+            stats->phases[phase].add(uint64_t(ns));
+        }
+        if (tracer != nullptr) {
+            tracer->record(STATS_PHASE_NAMES[phase], env, start, end);
+        }
+    }
+
+  private:
+    GameStats *stats;
+    StatsPhase phase;
+    Tracer *tracer;
+    int env;
+    std::chrono::steady_clock::time_point start;
+};
@@ -1,25 +1,73 @@
 #include "randgen.h"
 #include "cpp-utils.h"
+#include <algorithm>
+#include <numeric>
 #include <set>
 #include <sstream>
 
+// mt19937 states start with the number of words that follow, so the other generators are marked with a negative int
+const int RANDGEN_PCG32_TAG = -1;
+// the default stream from the pcg reference implementation
+const uint64_t PCG32_DEFAULT_STREAM = 0xda3e39cb94b95bdbULL;
+const uint64_t PCG32_MULTIPLIER = 6364136223846793005ULL;
+
+RandGenKind rand_gen_kind_from_name(const std::string &name) {
+    if (name == "mt19937") {
+        return RANDGEN_MT19937;
+    } else if (name == "pcg32") {
+        return RANDGEN_PCG32;
+    }
+    fatal("unknown rand_gen %s\n", name.c_str());
+    return RANDGEN_MT19937;
+}
+
+RandGen::RandGen(const RandGen &other) {
+    *this = other;
+}
+
+RandGen &RandGen::operator=(const RandGen &other) {
+    kind = other.kind;
+    is_seeded = other.is_seeded;
+    pcg_state = other.pcg_state;
+    pcg_inc = other.pcg_inc;
+    if (other.stdgen == nullptr) {
+        stdgen.reset();
+    } else if (stdgen == nullptr) {
+        stdgen = std::make_unique<std::mt19937>(*other.stdgen);
+    } else if (stdgen != other.stdgen) {
+        *stdgen = *other.stdgen;
+    }
+    return *this;
+}
+
+uint32_t RandGen::next() {
+    if (kind == RANDGEN_MT19937) {
+        return (*stdgen)();
+    }
+    uint64_t old_state = pcg_state;
+    pcg_state = old_state * PCG32_MULTIPLIER + pcg_inc;
+    uint32_t xorshifted = uint32_t(((old_state >> 18u) ^ old_state) >> 27u);
+    uint32_t rot = uint32_t(old_state >> 59u);
+    return (xorshifted >> rot) | (xorshifted << ((32 - rot) & 31));
+}
+
 int RandGen::randint(int low, int high) {
     fassert(is_seeded);
-    uint32_t x = stdgen();
+    uint32_t x = next();
     uint32_t range = high - low;
     return low + (x % range);
 }
 
 int RandGen::randn(int high) {
     fassert(is_seeded);
-    uint32_t x = stdgen();
+    uint32_t x = next();
     return (x % high);
 }
 
 float RandGen::rand01() {
     fassert(is_seeded);
-    uint32_t x = stdgen();
-    return (float)((double)(x) / ((double)(stdgen.max()) + 1));
+    uint32_t x = next();
+    return (float)((double)(x) / ((double)(UINT32_MAX) + 1));
 }
 
 bool RandGen::randbool() {
@@ -87,28 +135,112 @@ std::vector<int> RandGen::simple_choose(int n, int k) {
     return chosen;
 }
 
+void RandGen::partition_spacings(int x, int n, std::vector<int> &partition) {
+    fassert(n > 0 && x >= 0);
+    partition.resize(n);
+
+    // the cut points are stored in place and turned into the gaps between them
+    partition[n - 1] = x;
+    for (int i = 0; i < n - 1; i++) {
+        partition[i] = randn(x + 1);
+    }
+    std::sort(partition.begin(), partition.end() - 1);
+    for (int i = n - 1; i > 0; i--) {
+        partition[i] -= partition[i - 1];
+    }
+}
+
+void RandGen::choose_n_fast(std::vector<int> &elems, int n) {
+    int size = (int)(elems.size());
+    n = std::min(n, size);
+
+    // partial fisher-yates
+    for (int i = 0; i < n; i++) {
+        std::swap(elems[i], elems[i + randn(size - i)]);
+    }
+}
+
+void RandGen::simple_choose_fast(int n, int k, std::vector<int> &chosen) {
+    fassert(k <= n);
+
+    chosen.resize(n);
+    std::iota(chosen.begin(), chosen.end(), 0);
+    choose_n_fast(chosen, k);
+    chosen.resize(k);
+}
+
 int RandGen::randint() {
     fassert(is_seeded);
-    return stdgen();
+    return next();
 }
 
 void RandGen::seed(int seed) {
-    stdgen.seed(seed);
+    if (kind == RANDGEN_MT19937) {
+        if (stdgen == nullptr) {
+            stdgen = std::make_unique<std::mt19937>();
+        }
+        stdgen->seed(seed);
+    } else {
+        stdgen.reset();
+        pcg_state = 0;
+        pcg_inc = (PCG32_DEFAULT_STREAM << 1u) | 1u;
+        next();
+        pcg_state += uint32_t(seed);
+        next();
+    }
     is_seeded = true;
 }
 
+// the textual representation is the only portable way to get at the engine state, store the numbers
+// it's made of rather than the text, which is about 3 times as large
 void RandGen::serialize(WriteBuffer *b) {
-    b->write_int(is_seeded);
+    b->write_bool(is_seeded);
+    if (kind == RANDGEN_PCG32) {
+        b->write_int(RANDGEN_PCG32_TAG);
+        b->write_bytes(&pcg_state, sizeof(pcg_state));
+        b->write_bytes(&pcg_inc, sizeof(pcg_inc));
+        return;
+    }
     std::ostringstream ostream;
-    ostream << stdgen;
-    auto str = ostream.str();
-    b->write_string(str);
+    if (stdgen != nullptr) {
+        ostream << *stdgen;
+    } else {
+        ostream << std::mt19937();
+    }
+    std::istringstream istream(ostream.str());
+    std::vector<int> words;
+    uint32_t word;
+    while (istream >> word) {
+        words.push_back(int(word));
+    }
+    b->write_vector_int(words);
 }
 
 void RandGen::deserialize(ReadBuffer *b) {
-    is_seeded = b->read_int();
-    auto str = b->read_string();
-    std::istringstream istream;
-    istream.str(str);
-    istream >> stdgen;
+    is_seeded = b->read_bool();
+    int length = b->read_int();
+    if (length == RANDGEN_PCG32_TAG) {
+        kind = RANDGEN_PCG32;
+        stdgen.reset();
+        b->read_bytes(&pcg_state, sizeof(pcg_state));
+        b->read_bytes(&pcg_inc, sizeof(pcg_inc));
+        return;
+    }
+    fassert(length >= 0);
+    kind = RANDGEN_MT19937;
+    std::vector<int> words(length);
+    b->read_bytes(words.data(), words.size() * sizeof(int));
+    std::ostringstream ostream;
+    for (size_t i = 0; i < words.size(); i++) {
+        if (i > 0) {
+            ostream << ' ';
+        }
+        ostream << uint32_t(words[i]);
+    }
+    std::istringstream istream(ostream.str());
+    if (stdgen == nullptr) {
+        stdgen = std::make_unique<std::mt19937>();
+    }
+    istream >> *stdgen;
+    fassert(!istream.fail());
 }
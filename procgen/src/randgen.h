@@ -4,14 +4,37 @@
 
 Random number generator with consistent behavior across platforms
 
+mt19937 is the default and the one the levels were designed with, pcg32 draws different levels but has 16 bytes
+of state instead of 2.5KB, which makes seeding and serializing much cheaper. The mt19937 state is allocated by the
+first seed() or deserialize() that needs it, so the pcg32 generators of a game don't carry one around.
+
 */
 
 #include "buffer.h"
+#include <cstdint>
+#include <memory>
 #include <random>
+#include <string>
+
+enum RandGenKind {
+    RANDGEN_MT19937 = 0,
+    RANDGEN_PCG32 = 1,
+};
+
+// fatal for an unknown name
+RandGenKind rand_gen_kind_from_name(const std::string &name);
 
 class RandGen {
   public:
-    std::mt19937 stdgen;
+    // only used by the next seed(), deserialize() restores the kind that was serialized
+    RandGenKind kind = RANDGEN_MT19937;
+
+    RandGen() = default;
+    RandGen(const RandGen &other);
+    RandGen &operator=(const RandGen &other);
+    RandGen(RandGen &&other) = default;
+    RandGen &operator=(RandGen &&other) = default;
+
     int randint(int low, int high);
     int randn(int high);
     float rand01();
@@ -22,9 +45,26 @@ class RandGen {
     int choose_one(std::vector<int> &elems);
     std::vector<int> choose_n(const std::vector<int> &elems, int n);
     std::vector<int> simple_choose(int n, int k);
+
+    // faster versions of the above with different draws, existing distribution modes keep using the originals so
+    // that their levels don't change
+
+    // like partition() the n parts sum to x, but they're the gaps between n - 1 sorted cut points drawn uniformly in
+    // [0, x], which spreads them more than the multinomial of partition(), O(n log n) instead of O(x)
+    void partition_spacings(int x, int n, std::vector<int> &partition);
+    // reorders elems so the first n of them are a uniform random choice
+    void choose_n_fast(std::vector<int> &elems, int n);
+    // k distinct indices in [0, n), chosen is also used as scratch space so repeated calls don't allocate
+    void simple_choose_fast(int n, int k, std::vector<int> &chosen);
     void seed(int seed);
     void serialize(WriteBuffer *b);
     void deserialize(ReadBuffer *b);
   private:
     bool is_seeded = false;
+    uint64_t pcg_state = 0;
+    uint64_t pcg_inc = 0;
+    // only for RANDGEN_MT19937, null until seeded
+    std::unique_ptr<std::mt19937> stdgen;
+
+    uint32_t next();
 };
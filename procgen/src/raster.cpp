@@ -0,0 +1,134 @@
+#include "raster.h"
+#include <string.h>
+#include <algorithm>
+
+// clip the rect at (x, y) of size (w, h) against the target, returns false if nothing is left
+static bool clip_to_target(const RasterTarget &dst, int &x, int &y, int &w, int &h, int &src_x, int &src_y) {
+    src_x = 0;
+    src_y = 0;
+
+    if (x < 0) {
+        src_x = -x;
+        w += x;
+        x = 0;
+    }
+
+    if (y < 0) {
+        src_y = -y;
+        h += y;
+        y = 0;
+    }
+
+    w = std::min(w, dst.w - x);
+    h = std::min(h, dst.h - y);
+
+    return w > 0 && h > 0;
+}
+
+// mul two 8 bit values, dividing by 255 with correct rounding
+static inline uint32_t mul_255(uint32_t a, uint32_t b) {
+    uint32_t t = a * b + 128;
+    return (t + (t >> 8)) >> 8;
+}
+
+// premultiplied source over an opaque destination, with a 0-256 scale applied to the source
+static inline uint32_t blend_pixel(uint32_t d, uint32_t s, uint32_t scale) {
+    if (scale != 256) {
+        uint32_t rb = (((s & 0x00ff00ff) * scale) >> 8) & 0x00ff00ff;
+        uint32_t ag = (((s >> 8) & 0x00ff00ff) * scale) & 0xff00ff00;
+        s = rb | ag;
+    }
+
+    uint32_t sa = s >> 24;
+
+    if (sa == 255) {
+        return s;
+    } else if (sa == 0 && (s & 0x00ffffff) == 0) {
+        return d;
+    }
+
+    uint32_t ia = 255 - sa;
+    uint32_t r = ((s >> 16) & 0xff) + mul_255((d >> 16) & 0xff, ia);
+    uint32_t g = ((s >> 8) & 0xff) + mul_255((d >> 8) & 0xff, ia);
+    uint32_t b = (s & 0xff) + mul_255(d & 0xff, ia);
+
+    return 0xff000000 | (std::min(r, 255u) << 16) | (std::min(g, 255u) << 8) | std::min(b, 255u);
+}
+
+void raster_fill_rect(RasterTarget &dst, int x0, int y0, int x1, int y1, uint32_t color) {
+    int w = x1 - x0;
+    int h = y1 - y0;
+    int src_x, src_y;
+
+    if (!clip_to_target(dst, x0, y0, w, h, src_x, src_y)) {
+        return;
+    }
+
+    uint32_t a = color >> 24;
+
+    if (a == 0) {
+        return;
+    }
+
+    if (dst.commands != nullptr) {
+        DrawCommand cmd;
+        cmd.kind = DRAW_FILL;
+        cmd.color = color;
+        cmd.x = float(x0);
+        cmd.y = float(y0);
+        cmd.w = float(w);
+        cmd.h = float(h);
+        dst.commands->push_back(cmd);
+        return;
+    }
+
+    // fills take straight alpha colors, premultiply them for blending
+    uint32_t premul = (a << 24) | (mul_255((color >> 16) & 0xff, a) << 16) | (mul_255((color >> 8) & 0xff, a) << 8) | mul_255(color & 0xff, a);
+
+    for (int y = y0; y < y0 + h; y++) {
+        uint32_t *row = dst.buf + (size_t)y * dst.stride;
+
+        if (a == 255) {
+            std::fill(row + x0, row + x0 + w, color);
+        } else {
+            for (int x = x0; x < x0 + w; x++) {
+                row[x] = blend_pixel(row[x], premul, 256);
+            }
+        }
+    }
+}
+
+void raster_copy(RasterTarget &dst, int x, int y, const uint32_t *src, int src_w, int src_h, int src_stride) {
+    int src_x, src_y;
+
+    if (!clip_to_target(dst, x, y, src_w, src_h, src_x, src_y)) {
+        return;
+    }
+
+    for (int j = 0; j < src_h; j++) {
+        memcpy(dst.buf + (size_t)(y + j) * dst.stride + x, src + (size_t)(src_y + j) * src_stride + src_x, src_w * sizeof(uint32_t));
+    }
+}
+
+void raster_blend(RasterTarget &dst, int x, int y, const uint32_t *src, int src_w, int src_h, int src_stride, float alpha) {
+    int src_x, src_y;
+
+    if (!clip_to_target(dst, x, y, src_w, src_h, src_x, src_y)) {
+        return;
+    }
+
+    uint32_t scale = (uint32_t)(std::max(0.0f, std::min(alpha, 1.0f)) * 256 + 0.5f);
+
+    if (scale == 0) {
+        return;
+    }
+
+    for (int j = 0; j < src_h; j++) {
+        uint32_t *drow = dst.buf + (size_t)(y + j) * dst.stride + x;
+        const uint32_t *srow = src + (size_t)(src_y + j) * src_stride + src_x;
+
+        for (int i = 0; i < src_w; i++) {
+            drow[i] = blend_pixel(drow[i], srow[i], scale);
+        }
+    }
+}
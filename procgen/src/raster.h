@@ -0,0 +1,34 @@
+#pragma once
+
+/*
+
+A minimal software rasterizer for the observation path, it only does what BasicAbstractGame needs
+for the simpler games: rect fills and unscaled blits of premultiplied sprites into a RGB32 buffer.
+
+Scaling and rotation are done ahead of time (see the sprite cache in BasicAbstractGame), so
+drawing a frame doesn't need a QPainter.
+
+*/
+
+#include <stdint.h>
+#include <vector>
+#include "draw-list.h"
+
+struct RasterTarget {
+    uint32_t *buf = nullptr;
+    int w = 0;
+    int h = 0;
+    int stride = 0; // in pixels
+    // if set, raster_fill_rect() adds a command here instead of drawing to buf, and buf may be null, the images have
+    // to be recorded by the caller, raster_copy() and raster_blend() need buf
+    std::vector<DrawCommand> *commands = nullptr;
+};
+
+// fill the pixels in [x0, x1) x [y0, y1), color is 0xAARRGGBB and is blended if not opaque
+void raster_fill_rect(RasterTarget &dst, int x0, int y0, int x1, int y1, uint32_t color);
+
+// copy an opaque image to (x, y)
+void raster_copy(RasterTarget &dst, int x, int y, const uint32_t *src, int src_w, int src_h, int src_stride);
+
+// source-over blend a premultiplied ARGB image onto (x, y), with an additional constant opacity
+void raster_blend(RasterTarget &dst, int x, int y, const uint32_t *src, int src_w, int src_h, int src_stride, float alpha = 1.0f);
@@ -0,0 +1,154 @@
+#include "resource-bundle.h"
+#include "buffer.h"
+#include "cpp-utils.h"
+#include <cstdint>
+#include <cstdio>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+const int RESOURCE_BUNDLE_MAGIC = 0x42524750;
+const int RESOURCE_BUNDLE_VERSION = 1;
+// the pixel data of each image starts on a cache line
+const size_t RESOURCE_BUNDLE_ALIGNMENT = 64;
+
+static size_t align_offset(size_t offset) {
+    return (offset + RESOURCE_BUNDLE_ALIGNMENT - 1) / RESOURCE_BUNDLE_ALIGNMENT * RESOURCE_BUNDLE_ALIGNMENT;
+}
+
+ResourceBundle::ResourceBundle(const std::string &path) {
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        fatal("failed to open resource bundle %s\n", path.c_str());
+    }
+    LARGE_INTEGER size;
+    fassert(GetFileSizeEx(file, &size));
+    length = size_t(size.QuadPart);
+    HANDLE mapping = length > 0 ? CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr) : nullptr;
+    if (mapping != nullptr) {
+        data = (const char *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    }
+    file_handle = file;
+    mapping_handle = mapping;
+#else
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        fatal("failed to open resource bundle %s\n", path.c_str());
+    }
+    struct stat st;
+    fassert(fstat(fd, &st) == 0);
+    length = size_t(st.st_size);
+    if (length > 0) {
+        void *mapped = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapped != MAP_FAILED) {
+            data = (const char *)mapped;
+        }
+    }
+    // the mapping keeps the file open
+    close(fd);
+#endif
+    if (data == nullptr) {
+        fatal("failed to map resource bundle %s\n", path.c_str());
+    }
+
+    // ReadBuffer never writes to its data
+    auto b = ReadBuffer(const_cast<char *>(data), length);
+    if (length < 2 * sizeof(int) || b.read_int() != RESOURCE_BUNDLE_MAGIC) {
+        fatal("%s is not a resource bundle\n", path.c_str());
+    }
+    if (b.read_int() != RESOURCE_BUNDLE_VERSION) {
+        fatal("resource bundle %s was written by a different version of procgen, it needs to be rebuilt\n", path.c_str());
+    }
+
+    int num_images = b.read_int();
+    for (int i = 0; i < num_images; i++) {
+        auto relpath = b.read_string();
+        int format = b.read_int();
+        Entry entry;
+        entry.width = b.read_int();
+        entry.height = b.read_int();
+        entry.bytes_per_line = b.read_int();
+        entry.offset = size_t(b.read_int());
+        fassert(entry.offset % RESOURCE_BUNDLE_ALIGNMENT == 0);
+        fassert(entry.offset + size_t(entry.bytes_per_line) * entry.height <= length);
+        entries[{relpath, format}] = entry;
+    }
+}
+
+ResourceBundle::~ResourceBundle() {
+#ifdef _WIN32
+    UnmapViewOfFile(data);
+    CloseHandle((HANDLE)mapping_handle);
+    CloseHandle((HANDLE)file_handle);
+#else
+    munmap(const_cast<char *>(data), length);
+#endif
+}
+
+std::shared_ptr<QImage> ResourceBundle::find(const std::string &relpath, QImage::Format format) const {
+    auto it = entries.find({relpath, int(format)});
+    if (it == entries.end()) {
+        return nullptr;
+    }
+    const auto &entry = it->second;
+    // the const data constructor means that painting onto the image would detach it rather than write to the mapping
+    return std::make_shared<QImage>((const uchar *)(data + entry.offset), entry.width, entry.height, entry.bytes_per_line, format);
+}
+
+void ResourceBundle::write(const std::string &path, const std::vector<BundleImage> &images) {
+    size_t index_length = 3 * sizeof(int);
+    for (const auto &image : images) {
+        index_length += sizeof(int) + image.relpath.size() + 5 * sizeof(int);
+    }
+
+    std::vector<char> index(index_length);
+    auto b = WriteBuffer(index.data(), index.size());
+    b.write_int(RESOURCE_BUNDLE_MAGIC);
+    b.write_int(RESOURCE_BUNDLE_VERSION);
+    b.write_int(int(images.size()));
+
+    // rows are stored without padding
+    std::vector<size_t> offsets;
+    size_t offset = align_offset(index_length);
+    for (const auto &image : images) {
+        const auto &img = *image.image;
+        fassert(img.depth() == 32);
+        fassert(offset + size_t(img.width()) * 4 * img.height() <= size_t(INT32_MAX));
+        b.write_string(image.relpath);
+        b.write_int(int(img.format()));
+        b.write_int(img.width());
+        b.write_int(img.height());
+        b.write_int(img.width() * 4);
+        b.write_int(int(offset));
+        offsets.push_back(offset);
+        offset = align_offset(offset + size_t(img.width()) * 4 * img.height());
+    }
+    fassert(b.offset == index_length);
+
+    FILE *f = fopen(path.c_str(), "wb");
+    if (f == nullptr) {
+        fatal("failed to open %s for writing\n", path.c_str());
+    }
+    fwrite(index.data(), 1, index.size(), f);
+    const char padding[RESOURCE_BUNDLE_ALIGNMENT] = {};
+    size_t written = index.size();
+    for (size_t i = 0; i < images.size(); i++) {
+        const auto &img = *images[i].image;
+        fwrite(padding, 1, offsets[i] - written, f);
+        for (int y = 0; y < img.height(); y++) {
+            fwrite(img.constScanLine(y), 1, size_t(img.width()) * 4, f);
+        }
+        written = offsets[i] + size_t(img.width()) * 4 * img.height();
+    }
+    if (fclose(f) != 0) {
+        fatal("failed to write %s\n", path.c_str());
+    }
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+/*
+
+A single file holding the images from the resource root already decoded and converted to the format they're
+drawn in, so that starting up only has to map the file rather than decode hundreds of pngs
+
+The file is an index (the relative path, format, size and data offset of each image) followed by the pixel
+data of each image, aligned so that the images can be wrapped in place. Pages are only read from disk once
+an image is drawn, so a game only pays for the images it uses.
+
+*/
+
+#include <QtGui/QImage>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+struct BundleImage {
+    std::string relpath;
+    std::shared_ptr<QImage> image;
+};
+
+class ResourceBundle {
+  public:
+    // maps the file at path, fatal if it isn't a bundle
+    explicit ResourceBundle(const std::string &path);
+    ~ResourceBundle();
+    ResourceBundle(const ResourceBundle &) = delete;
+    ResourceBundle &operator=(const ResourceBundle &) = delete;
+
+    // the returned image uses the mapped memory without copying it, so it must not outlive the bundle,
+    // null if the bundle doesn't have the image in this format
+    std::shared_ptr<QImage> find(const std::string &relpath, QImage::Format format) const;
+
+    static void write(const std::string &path, const std::vector<BundleImage> &images);
+
+  private:
+    struct Entry {
+        int width;
+        int height;
+        int bytes_per_line;
+        size_t offset;
+    };
+
+    const char *data = nullptr;
+    size_t length = 0;
+    std::map<std::pair<std::string, int>, Entry> entries;
+#ifdef _WIN32
+    void *file_handle = nullptr;
+    void *mapping_handle = nullptr;
+#endif
+};
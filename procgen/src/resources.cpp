@@ -1,22 +1,23 @@
 #include "resources.h"
 #include "cpp-utils.h"
+#include "resource-bundle.h"
+#include <mutex>
+#include <set>
 
 std::string global_resource_root;
 
-std::vector<std::shared_ptr<QImage>> topdown_backgrounds;
-std::vector<std::shared_ptr<QImage>> topdown_simple_backgrounds;
-std::vector<std::shared_ptr<QImage>> platform_backgrounds;
-std::vector<std::shared_ptr<QImage>> space_backgrounds;
-std::vector<std::shared_ptr<QImage>> water_backgrounds;
-std::vector<std::shared_ptr<QImage>> water_surface_backgrounds;
-
-std::map<std::string, std::shared_ptr<QImage>> sprites;
-
-std::shared_ptr<QImage> get_asset_ptr(std::string relpath) {
-    return sprites.at(relpath);
-}
+// set by images_load() with the resource_bundle option, the images wrap its memory so it's never unmapped
+static std::unique_ptr<ResourceBundle> resource_bundle;
 
 std::shared_ptr<QImage> load_resource_ptr(std::string relpath, QImage::Format format) {
+    if (resource_bundle != nullptr) {
+        // an image added since the bundle was built is still decoded from its file
+        auto asset_ptr = resource_bundle->find(relpath, format);
+        if (asset_ptr != nullptr) {
+            return asset_ptr;
+        }
+    }
+
     auto path = global_resource_root + relpath;
     auto asset = QImage(QString(path.c_str())).convertToFormat(format);
     auto asset_ptr = std::make_shared<QImage>(asset);
@@ -27,8 +28,8 @@ std::shared_ptr<QImage> load_resource_ptr(std::string relpath, QImage::Format fo
     return asset_ptr;
 }
 
-void images_load() {
-    auto sprite_paths = std::vector<std::string>{
+static std::vector<std::string> sprite_paths() {
+    return std::vector<std::string>{
         "kenney/Ground/Planet/planetCorner_left.png",
         "kenney/Ground/Planet/planetHill_left.png",
         "kenney/Ground/Planet/planetHalf_right.png",
@@ -809,21 +810,10 @@ void images_load() {
         "platformer/playerRed_swim1.png",
         "platformer/playerGrey_duck.png",
     };
+}
 
-    for (const auto& sprite_path : sprite_paths) {
-        sprites[sprite_path] = load_resource_ptr(sprite_path, QImage::Format_ARGB32_Premultiplied);
-    }
-
-    auto group_to_vector = std::map<std::string, std::vector<std::shared_ptr<QImage>> *>{
-        {"space_backgrounds", &space_backgrounds},
-        {"platform_backgrounds", &platform_backgrounds},
-        {"topdown_backgrounds", &topdown_backgrounds},
-        {"topdown_simple_backgrounds", &topdown_simple_backgrounds},
-        {"water_backgrounds", &water_backgrounds},
-        {"water_surface_backgrounds", &water_surface_backgrounds},
-    };
-
-    auto group_to_paths = std::map<std::string, std::vector<std::string>>{
+static std::map<std::string, std::vector<std::string>> background_paths() {
+    return std::map<std::string, std::vector<std::string>>{
         {
             "space_backgrounds",
             {
@@ -939,16 +929,90 @@ void images_load() {
             },
         },
     };
+}
 
-    for (auto const &pair : group_to_paths) {
-        auto vec = group_to_vector.at(pair.first);
-        for (const auto &path : pair.second) {
-            vec->push_back(load_resource_ptr(path, QImage::Format_RGB32));
-        }
+void images_load(const std::string &bundle_path) {
+    if (bundle_path != "") {
+        resource_bundle = std::make_unique<ResourceBundle>(bundle_path);
+    }
+}
+
+// the images are only loaded the first time a game asks for them, so that a process running a single game
+// doesn't load the assets of all the others, the lock is held while loading to only load each image once
+static std::mutex resources_mutex;
+static std::map<std::string, std::shared_ptr<QImage>> sprites;
+// std::map never moves its values, so the games can keep pointers to the groups
+static std::map<std::string, std::vector<std::shared_ptr<QImage>>> background_groups;
+
+std::shared_ptr<QImage> get_asset_ptr(std::string relpath) {
+    std::lock_guard<std::mutex> lock(resources_mutex);
+    auto it = sprites.find(relpath);
+    if (it != sprites.end()) {
+        return it->second;
+    }
+
+    static const auto known_paths = [] {
+        auto paths = sprite_paths();
+        return std::set<std::string>(paths.begin(), paths.end());
+    }();
+    if (known_paths.count(relpath) == 0) {
+        fatal("unknown asset %s\n", relpath.c_str());
+    }
+
+    auto asset_ptr = load_resource_ptr(relpath, QImage::Format_ARGB32_Premultiplied);
+    sprites[relpath] = asset_ptr;
+    return asset_ptr;
+}
+
+static std::vector<std::shared_ptr<QImage>> *load_background_group(const std::string &name) {
+    auto it = background_groups.find(name);
+    if (it != background_groups.end()) {
+        return &it->second;
+    }
+
+    static const auto group_to_paths = background_paths();
+    auto paths = group_to_paths.find(name);
+    if (paths == group_to_paths.end()) {
+        fatal("unknown background group %s\n", name.c_str());
+    }
+
+    std::vector<std::shared_ptr<QImage>> group;
+    for (const auto &path : paths->second) {
+        group.push_back(load_resource_ptr(path, QImage::Format_RGB32));
     }
 
     // also add all space backgrounds as platform backgrounds
-    for (auto bg : space_backgrounds) {
-        platform_backgrounds.push_back(bg);
+    if (name == "platform_backgrounds") {
+        for (auto bg : *load_background_group("space_backgrounds")) {
+            group.push_back(bg);
+        }
     }
+
+    return &(background_groups[name] = std::move(group));
+}
+
+std::vector<std::shared_ptr<QImage>> *get_background_images(const std::string &name) {
+    std::lock_guard<std::mutex> lock(resources_mutex);
+    return load_background_group(name);
+}
+
+void write_resource_bundle(const std::string &path) {
+    std::vector<BundleImage> images;
+    std::set<std::pair<std::string, int>> added;
+    auto add = [&](const std::string &relpath, QImage::Format format) {
+        if (added.insert({relpath, int(format)}).second) {
+            images.push_back(BundleImage{relpath, load_resource_ptr(relpath, format)});
+        }
+    };
+
+    for (const auto &sprite_path : sprite_paths()) {
+        add(sprite_path, QImage::Format_ARGB32_Premultiplied);
+    }
+    for (auto const &pair : background_paths()) {
+        for (const auto &relpath : pair.second) {
+            add(relpath, QImage::Format_RGB32);
+        }
+    }
+
+    ResourceBundle::write(path, images);
 }
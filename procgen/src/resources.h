@@ -2,7 +2,7 @@
 
 /*
 
-Load assets stored as individual image files
+Load assets stored as individual image files, or mapped from a bundle of the already decoded images
 
 */
 
@@ -10,13 +10,13 @@ Load assets stored as individual image files
 #include <iostream>
 #include <memory>
 
+// both load the images the first time they are asked for and can be called from any thread
 std::shared_ptr<QImage> get_asset_ptr(std::string relpath);
+// name is a group of backgrounds such as "platform_backgrounds", the pointer stays valid for the lifetime of the process
+std::vector<std::shared_ptr<QImage>> *get_background_images(const std::string &name);
 
 extern std::string global_resource_root;
-extern void images_load();
-extern std::vector<std::shared_ptr<QImage>> topdown_backgrounds;
-extern std::vector<std::shared_ptr<QImage>> topdown_simple_backgrounds;
-extern std::vector<std::shared_ptr<QImage>> platform_backgrounds;
-extern std::vector<std::shared_ptr<QImage>> space_backgrounds;
-extern std::vector<std::shared_ptr<QImage>> water_backgrounds;
-extern std::vector<std::shared_ptr<QImage>> water_surface_backgrounds;
\ No newline at end of file
+// bundle_path is a file written by write_resource_bundle(), or empty to decode the images from their files
+extern void images_load(const std::string &bundle_path);
+// decode every image that can be loaded from global_resource_root and write them to path
+extern void write_resource_bundle(const std::string &path);
\ No newline at end of file
@@ -1,4 +1,5 @@
 #include "roomgen.h"
+#include <algorithm>
 
 int RoomGenerator::count_neighbors(int idx, int type) {
     int x, y;
@@ -20,7 +21,7 @@ int RoomGenerator::count_neighbors(int idx, int type) {
 
 void RoomGenerator::update() {
     // update cellular automata
-    std::vector<int> next_cells;
+    next_cells.clear();
 
     for (int i = 0; i < game->grid_size; i++) {
         if (count_neighbors(i, WALL_OBJ) >= 5) {
@@ -35,17 +36,27 @@ void RoomGenerator::update() {
     }
 }
 
-void RoomGenerator::build_room(int idx, std::set<int> &room) {
-    std::queue<int> curr;
+// the first of count marks no cell has yet, marks[i] == m then means cell i is in the set for mark m
+uint32_t RoomGenerator::new_marks(uint32_t count) {
+    if (int(marks.size()) != game->grid_size || mark > UINT32_MAX - count) {
+        marks.assign(game->grid_size, 0);
+        mark = 0;
+    }
+    uint32_t first = mark + 1;
+    mark += count;
+    return first;
+}
 
+// the cells are added to room in the order they're reached
+void RoomGenerator::build_room(int idx, uint32_t room_mark, std::vector<int> &room) {
     if (game->get_obj(idx) != SPACE)
         return;
 
-    curr.push(idx);
+    queue.clear();
+    queue.push_back(idx);
 
-    while (curr.size() > 0) {
-        int curr_idx = curr.front();
-        curr.pop();
+    for (size_t head = 0; head < queue.size(); head++) {
+        int curr_idx = queue[head];
 
         if (game->get_obj(curr_idx) != SPACE)
             continue;
@@ -58,9 +69,10 @@ void RoomGenerator::build_room(int idx, std::set<int> &room) {
                 if ((i == 0 || j == 0) && (i + j != 0)) {
                     int next_idx = game->to_grid_idx(x + i, y + j);
 
-                    if (!set_contains(room, next_idx) && game->get_obj(next_idx) == SPACE) {
-                        curr.push(next_idx);
-                        room.insert(next_idx);
+                    if (marks[next_idx] != room_mark && game->get_obj(next_idx) == SPACE) {
+                        queue.push_back(next_idx);
+                        marks[next_idx] = room_mark;
+                        room.push_back(next_idx);
                     }
                 }
             }
@@ -69,9 +81,12 @@ void RoomGenerator::build_room(int idx, std::set<int> &room) {
 }
 
 void RoomGenerator::find_path(int src, int dst, std::vector<int> &path) {
-    std::set<int> covered;
-    std::vector<int> expanded;
-    std::vector<int> parents;
+    uint32_t covered = new_marks(1);
+    // src isn't marked as covered, so it's expanded a second time from its first neighbor, which doesn't
+    // change the path but is kept so the search matches the original one exactly
+    auto &expanded = queue;
+    expanded.clear();
+    parents.clear();
 
     if (game->get_obj(src) != SPACE)
         return;
@@ -97,10 +112,10 @@ void RoomGenerator::find_path(int src, int dst, std::vector<int> &path) {
                 if ((i == 0 || j == 0) && (i + j != 0)) {
                     int next_idx = game->to_grid_idx(x + i, y + j);
 
-                    if (!set_contains(covered, next_idx) && game->get_obj(next_idx) == SPACE) {
+                    if (marks[next_idx] != covered && game->get_obj(next_idx) == SPACE) {
                         expanded.push_back(next_idx);
                         parents.push_back(search_idx);
-                        covered.insert(next_idx);
+                        marks[next_idx] = covered;
                     }
                 }
             }
@@ -109,7 +124,7 @@ void RoomGenerator::find_path(int src, int dst, std::vector<int> &path) {
         search_idx++;
     }
 
-    if (expanded[search_idx] == dst) {
+    if (search_idx < int(expanded.size()) && expanded[search_idx] == dst) {
         std::vector<int> tmp;
 
         while (search_idx >= 0) {
@@ -123,18 +138,21 @@ void RoomGenerator::find_path(int src, int dst, std::vector<int> &path) {
     }
 }
 
-void RoomGenerator::find_best_room(std::set<int> &best_room) {
-    std::set<int> all_rooms;
-    all_rooms.clear();
+void RoomGenerator::find_best_room(std::vector<int> &best_room) {
     best_room.clear();
 
+    // each room gets its own mark, they're connected components so a cell with any of these marks is already
+    // in a room
+    uint32_t first_mark = new_marks(game->grid_size);
+    uint32_t room_mark = first_mark;
+    std::vector<int> next_room;
+
     int best_room_size = -1;
 
     for (int i = 0; i < game->grid_size; i++) {
-        if (game->get_obj(i) == SPACE && !set_contains(all_rooms, i)) {
-            std::set<int> next_room;
-            build_room(i, next_room);
-            all_rooms.insert(next_room.begin(), next_room.end());
+        if (game->get_obj(i) == SPACE && marks[i] < first_mark) {
+            next_room.clear();
+            build_room(i, room_mark++, next_room);
 
             if (int(next_room.size()) > best_room_size) {
                 best_room_size = (int)(next_room.size());
@@ -142,16 +160,29 @@ void RoomGenerator::find_best_room(std::set<int> &best_room) {
             }
         }
     }
+
+    std::sort(best_room.begin(), best_room.end());
 }
 
-void RoomGenerator::expand_room(std::set<int> &set, int n) {
-    std::set<int> curr_set;
-    curr_set.insert(set.begin(), set.end());
+void RoomGenerator::expand_room(std::vector<int> &cells, int n) {
+    uint32_t in_set = new_marks(1);
+    std::vector<int> curr;
+
+    for (int idx : cells) {
+        if (marks[idx] != in_set) {
+            marks[idx] = in_set;
+            curr.push_back(idx);
+        }
+    }
+    cells = curr;
+
+    // the cells reached don't depend on the order they're visited in
+    std::vector<int> next;
 
     for (int loop = 0; loop < n; loop++) {
-        std::set<int> next;
+        next.clear();
 
-        for (int curr_idx : curr_set) {
+        for (int curr_idx : curr) {
             if (game->get_obj(curr_idx) != SPACE)
                 continue;
 
@@ -163,15 +194,18 @@ void RoomGenerator::expand_room(std::set<int> &set, int n) {
                     if (i != 0 || j != 0) {
                         int next_idx = game->to_grid_idx(x + i, y + j);
 
-                        if (!set_contains(set, next_idx) && game->get_obj(next_idx) == SPACE) {
-                            set.insert(next_idx);
-                            next.insert(next_idx);
+                        if (marks[next_idx] != in_set && game->get_obj(next_idx) == SPACE) {
+                            marks[next_idx] = in_set;
+                            cells.push_back(next_idx);
+                            next.push_back(next_idx);
                         }
                     }
                 }
             }
         }
 
-        curr_set = next;
+        curr.swap(next);
     }
+
+    std::sort(cells.begin(), cells.end());
 }
@@ -4,6 +4,9 @@
 
 Cellular-automata based room generation
 
+The sets of cells built while searching are marks in a single array owned by the generator, starting a new
+set just bumps the mark, so generating a level doesn't allocate anything per cell.
+
 */
 
 #include "basic-abstract-game.h"
@@ -15,12 +18,20 @@ class RoomGenerator {
 
     void update();
     void find_path(int src, int dst, std::vector<int> &path);
-    void find_best_room(std::set<int> &best_room);
-    void expand_room(std::set<int> &set, int n);
+    // both leave the cells sorted
+    void find_best_room(std::vector<int> &best_room);
+    void expand_room(std::vector<int> &cells, int n);
 
   private:
     BasicAbstractGame *game;
 
-    void build_room(int idx, std::set<int> &room);
+    std::vector<uint32_t> marks;
+    uint32_t mark = 0;
+    std::vector<int> queue;
+    std::vector<int> parents;
+    std::vector<int> next_cells;
+
+    uint32_t new_marks(uint32_t count);
+    void build_room(int idx, uint32_t room_mark, std::vector<int> &room);
     int count_neighbors(int idx, int type);
-};
\ No newline at end of file
+};
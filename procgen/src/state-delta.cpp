@@ -0,0 +1,133 @@
+#include "state-delta.h"
+#include "buffer.h"
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+const int32_t STATE_DELTA_MAGIC = 0x44454c54;
+// matches shorter than this are stored as literals
+const size_t DELTA_BLOCK_SIZE = 16;
+
+static uint32_t hash_block(const char *p) {
+    uint64_t a, b;
+    memcpy(&a, p, sizeof(a));
+    memcpy(&b, p + sizeof(a), sizeof(b));
+    uint64_t h = a * 0x9E3779B97F4A7C15ull ^ b * 0xC2B2AE3D27D4EB4Full;
+    return uint32_t(h >> 32) ^ uint32_t(h);
+}
+
+static uint32_t hash_bytes(const char *p, size_t len) {
+    uint32_t hash = 0x811c9dc5;
+    for (size_t i = 0; i < len; i++) {
+        hash = (hash ^ uint8_t(p[i])) * 0x1000193;
+    }
+    return hash;
+}
+
+/*
+  Each op is a run of literal bytes followed by a copy of copy_len bytes from copy_offset in the base.
+*/
+static void write_op(WriteBuffer *b, const char *literal, size_t literal_len, size_t copy_offset, size_t copy_len) {
+    b->write_int(int(literal_len));
+    b->write_bytes(literal, literal_len);
+    b->write_int(int(copy_offset));
+    b->write_int(int(copy_len));
+}
+
+size_t encode_state_delta(const char *base, size_t base_len, const char *state, size_t state_len, char *out, size_t out_len) {
+    auto b = WriteBuffer(out, out_len);
+    b.write_int(STATE_DELTA_MAGIC);
+    b.write_int(int(base_len));
+    b.write_int(int(hash_bytes(base, base_len)));
+    b.write_int(int(state_len));
+
+    // index the base blocks at multiples of the block size, a collision just keeps the first block
+    size_t num_blocks = base_len / DELTA_BLOCK_SIZE;
+    size_t table_size = 1;
+    while (table_size < 2 * num_blocks) {
+        table_size *= 2;
+    }
+    std::vector<int> table(table_size, -1);
+    for (size_t k = 0; k < num_blocks; k++) {
+        auto &entry = table[hash_block(base + k * DELTA_BLOCK_SIZE) & (table_size - 1)];
+        if (entry < 0) {
+            entry = int(k * DELTA_BLOCK_SIZE);
+        }
+    }
+
+    size_t pos = 0;
+    size_t literal_start = 0;
+    // where the next byte would be in the base if the last match just continued, fields that changed in place
+    // are then skipped over without having to find the next block in the table
+    int64_t expected = -1;
+
+    while (pos + DELTA_BLOCK_SIZE <= state_len) {
+        int64_t match = -1;
+
+        if (expected >= 0 && size_t(expected) + DELTA_BLOCK_SIZE <= base_len && memcmp(base + expected, state + pos, DELTA_BLOCK_SIZE) == 0) {
+            match = expected;
+        } else if (num_blocks > 0) {
+            int offset = table[hash_block(state + pos) & (table_size - 1)];
+            if (offset >= 0 && memcmp(base + offset, state + pos, DELTA_BLOCK_SIZE) == 0) {
+                match = offset;
+            }
+        }
+
+        if (match < 0) {
+            pos++;
+            if (expected >= 0) {
+                expected++;
+            }
+            continue;
+        }
+
+        size_t len = DELTA_BLOCK_SIZE;
+        while (pos + len < state_len && size_t(match) + len < base_len && state[pos + len] == base[match + len]) {
+            len++;
+        }
+        while (pos > literal_start && match > 0 && state[pos - 1] == base[match - 1]) {
+            pos--;
+            match--;
+            len++;
+        }
+
+        write_op(&b, state + literal_start, pos - literal_start, size_t(match), len);
+        pos += len;
+        literal_start = pos;
+        expected = match + len;
+    }
+
+    if (literal_start < state_len) {
+        write_op(&b, state + literal_start, state_len - literal_start, 0, 0);
+    }
+
+    return b.offset;
+}
+
+size_t apply_state_delta(const char *base, size_t base_len, const char *delta, size_t delta_len, char *out, size_t out_len) {
+    // ReadBuffer never writes to its data
+    auto b = ReadBuffer(const_cast<char *>(delta), delta_len);
+    fassert(b.read_int() == STATE_DELTA_MAGIC);
+    fassert(size_t(b.read_int()) == base_len);
+    fassert(uint32_t(b.read_int()) == hash_bytes(base, base_len));
+    size_t state_len = size_t(b.read_int());
+    fassert(state_len <= out_len);
+
+    size_t pos = 0;
+    while (b.offset < b.length) {
+        size_t literal_len = size_t(b.read_int());
+        fassert(pos + literal_len <= state_len);
+        b.read_bytes(out + pos, literal_len);
+        pos += literal_len;
+
+        size_t copy_offset = size_t(b.read_int());
+        size_t copy_len = size_t(b.read_int());
+        fassert(copy_offset + copy_len <= base_len);
+        fassert(pos + copy_len <= state_len);
+        memcpy(out + pos, base + copy_offset, copy_len);
+        pos += copy_len;
+    }
+    fassert(pos == state_len);
+
+    return state_len;
+}
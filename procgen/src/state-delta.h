@@ -0,0 +1,18 @@
+#pragma once
+
+/*
+
+Delta encoding of a serialized game state relative to a base state, usually the state of the same env a step earlier
+
+Most of the state doesn't change from one step to the next, but entities are erased and appended, which shifts
+everything serialized after them (the grid in particular). The delta is therefore a list of copies from anywhere
+in the base plus the literal bytes that couldn't be found there, rather than a diff of bytes at the same offsets.
+
+*/
+
+#include <cstddef>
+
+// both return the number of bytes written to out
+size_t encode_state_delta(const char *base, size_t base_len, const char *state, size_t state_len, char *out, size_t out_len);
+// base must be the same as the one used to encode the delta
+size_t apply_state_delta(const char *base, size_t base_len, const char *delta, size_t delta_len, char *out, size_t out_len);
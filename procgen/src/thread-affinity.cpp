@@ -0,0 +1,75 @@
+#include "thread-affinity.h"
+#include "cpp-utils.h"
+#include <cstdlib>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#elif defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#endif
+
+static int parse_cpu(const std::string &list, const std::string &s) {
+    if (s.empty() || s.find_first_not_of("0123456789") != std::string::npos) {
+        fatal("invalid cpu list %s\n", list.c_str());
+    }
+    return atoi(s.c_str());
+}
+
+std::vector<int> parse_cpu_list(const std::string &list) {
+    std::vector<int> cpus;
+
+    size_t start = 0;
+    while (start <= list.size()) {
+        size_t end = list.find(',', start);
+        if (end == std::string::npos) {
+            end = list.size();
+        }
+        auto part = list.substr(start, end - start);
+        start = end + 1;
+
+        auto dash = part.find('-');
+        if (dash == std::string::npos) {
+            cpus.push_back(parse_cpu(list, part));
+            continue;
+        }
+        int first = parse_cpu(list, part.substr(0, dash));
+        int last = parse_cpu(list, part.substr(dash + 1));
+        if (first > last) {
+            fatal("invalid cpu list %s\n", list.c_str());
+        }
+        for (int cpu = first; cpu <= last; cpu++) {
+            cpus.push_back(cpu);
+        }
+    }
+
+    return cpus;
+}
+
+bool thread_affinity_available() {
+#if defined(__linux__) || defined(_WIN32)
+    return true;
+#else
+    return false;
+#endif
+}
+
+void pin_current_thread(int cpu) {
+    bool pinned = false;
+#if defined(__linux__)
+    if (cpu < CPU_SETSIZE) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        pinned = pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+    }
+#elif defined(_WIN32)
+    if (cpu < 64) {
+        pinned = SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << cpu) != 0;
+    }
+#endif
+    if (!pinned) {
+        fatal("failed to pin thread to cpu %d\n", cpu);
+    }
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+/*
+
+Pinning threads to cpus, used for the cpu_affinity option
+
+Only supported on linux and windows, elsewhere thread_affinity_available() is false.
+
+*/
+
+#include <string>
+#include <vector>
+
+// parses a list like "0-3,8,10-11", fatal if it's malformed
+std::vector<int> parse_cpu_list(const std::string &list);
+
+bool thread_affinity_available();
+
+// fatal if the thread can't be pinned, e.g. because the cpu doesn't exist
+void pin_current_thread(int cpu);
@@ -0,0 +1,119 @@
+#include "tile-stream.h"
+#include "jpeg-encode.h"
+#include "cpp-utils.h"
+#include <cstring>
+
+const size_t TILE_STREAM_HEADER_BYTES = 3 * 4;
+
+static void write_le32(uint8_t *dst, uint32_t v) {
+    dst[0] = v & 0xff;
+    dst[1] = (v >> 8) & 0xff;
+    dst[2] = (v >> 16) & 0xff;
+    dst[3] = (v >> 24) & 0xff;
+}
+
+static void write_le16(uint8_t *dst, uint16_t v) {
+    dst[0] = v & 0xff;
+    dst[1] = (v >> 8) & 0xff;
+}
+
+// a word at a time, this runs over every pixel of every frame
+static uint64_t hash_tile(const uint32_t *frame, int stride, int x0, int y0, int tile_size) {
+    uint64_t h = 0x9e3779b97f4a7c15ull;
+    for (int y = y0; y < y0 + tile_size; y++) {
+        const uint32_t *row = frame + (size_t)y * stride + x0;
+        for (int x = 0; x < tile_size; x++) {
+            h = (h ^ row[x]) * 0xff51afd7ed558ccdull;
+            h ^= h >> 32;
+        }
+    }
+    return h;
+}
+
+TileStream::TileStream(int _w, int _h, int _tile_size, int _keyframe_interval)
+    : w(_w), h(_h), tile_size(_tile_size), keyframe_interval(_keyframe_interval) {
+    fassert(tile_size > 0 && tile_size % 16 == 0);
+    fassert(w % tile_size == 0 && h % tile_size == 0);
+    fassert(keyframe_interval >= 0);
+    tiles_x = w / tile_size;
+    tiles_y = h / tile_size;
+    // the tile coordinates are written as uint16
+    fassert(tiles_x <= 65536 && tiles_y <= 65536);
+    tile_hashes.resize(tiles_x * tiles_y);
+}
+
+void TileStream::request_keyframe() {
+    keyframe_pending = true;
+}
+
+size_t tile_stream_capacity(int w, int h, int tile_size) {
+    size_t num_tiles = size_t(w / tile_size) * (h / tile_size);
+    return TILE_STREAM_HEADER_BYTES + num_tiles * 4 + 4 + size_t(w) * h;
+}
+
+size_t TileStream::encode(const uint32_t *frame, int quality, uint8_t *out, size_t out_len) {
+    bool keyframe = keyframe_pending || (keyframe_interval > 0 && frames_since_keyframe + 1 >= keyframe_interval);
+
+    // encode() normally runs on a stepping thread, the scratch space is per thread
+    static thread_local std::vector<uint64_t> hashes;
+    static thread_local std::vector<int> changed;
+    static thread_local std::vector<uint32_t> strip;
+    hashes.resize(tile_hashes.size());
+    changed.clear();
+
+    for (int ty = 0; ty < tiles_y; ty++) {
+        for (int tx = 0; tx < tiles_x; tx++) {
+            int idx = ty * tiles_x + tx;
+            hashes[idx] = hash_tile(frame, w, tx * tile_size, ty * tile_size, tile_size);
+            if (keyframe || hashes[idx] != tile_hashes[idx]) {
+                changed.push_back(idx);
+            }
+        }
+    }
+
+    size_t index_bytes = TILE_STREAM_HEADER_BYTES + changed.size() * 4 + 4;
+    if (out_len < index_bytes) {
+        keyframe_pending = true;
+        return 0;
+    }
+
+    write_le32(out, keyframe ? TILE_STREAM_KEYFRAME : 0);
+    write_le32(out + 4, tile_size);
+    write_le32(out + 8, (uint32_t)changed.size());
+    uint8_t *dst = out + TILE_STREAM_HEADER_BYTES;
+    for (int idx : changed) {
+        write_le16(dst, idx % tiles_x);
+        write_le16(dst + 2, idx / tiles_x);
+        dst += 4;
+    }
+
+    size_t jpeg_size = 0;
+    if (!changed.empty()) {
+        strip.resize(changed.size() * tile_size * tile_size);
+        uint32_t *strip_row = strip.data();
+        for (int idx : changed) {
+            int x0 = (idx % tiles_x) * tile_size;
+            int y0 = (idx / tiles_x) * tile_size;
+            for (int y = y0; y < y0 + tile_size; y++) {
+                memcpy(strip_row, frame + (size_t)y * w + x0, tile_size * sizeof(uint32_t));
+                strip_row += tile_size;
+            }
+        }
+        jpeg_size = encode_jpeg_bgr32(strip.data(), tile_size, (int)(changed.size()) * tile_size, quality, dst + 4, out_len - index_bytes);
+        if (jpeg_size == 0) {
+            // the viewer never sees this frame, so the tiles it would have updated are still out of date
+            keyframe_pending = true;
+            return 0;
+        }
+    }
+    write_le32(dst, (uint32_t)jpeg_size);
+
+    tile_hashes.swap(hashes);
+    if (keyframe) {
+        keyframe_pending = false;
+        frames_since_keyframe = 0;
+    } else {
+        frames_since_keyframe++;
+    }
+    return index_bytes + jpeg_size;
+}
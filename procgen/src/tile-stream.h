@@ -0,0 +1,55 @@
+#pragma once
+
+/*
+
+Delta encoding of rendered frames for remote viewers, used for the encode_tiles option
+
+The frame is split into square tiles and only the tiles that changed since the last frame that was output are
+sent, with every tile sent again on a keyframe. The changed tiles are stacked on top of each other into a single
+image one tile wide, which is encoded as one JPEG, so the JPEG headers are paid once per frame rather than once per
+tile. With tiles a multiple of 16 pixels, the JPEG blocks never straddle two tiles.
+
+The output, all integers little endian:
+
+    int32 flags                 1 for a keyframe, which has every tile
+    int32 tile_size
+    int32 num_tiles
+    num_tiles x (uint16 tile_x, uint16 tile_y), in units of tiles
+    int32 jpeg_size             0 when there are no tiles
+    jpeg_size bytes             tile_size x (num_tiles * tile_size), tile i is at rows i * tile_size and on
+
+A viewer keeps the last frame and draws each tile over it, tiles that weren't sent stay as they were.
+
+*/
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+const int TILE_STREAM_KEYFRAME = 1;
+
+class TileStream {
+  public:
+    TileStream(int _w, int _h, int _tile_size, int _keyframe_interval);
+
+    // returns the number of bytes written to out, or 0 if they didn't fit in out_len, the next frame is then a keyframe
+    size_t encode(const uint32_t *frame, int quality, uint8_t *out, size_t out_len);
+    // make the next frame a keyframe, for a viewer that joins the stream
+    void request_keyframe();
+
+  private:
+    int w;
+    int h;
+    int tile_size;
+    int tiles_x;
+    int tiles_y;
+    // a keyframe at least every keyframe_interval frames, or only when requested if it's 0
+    int keyframe_interval;
+    int frames_since_keyframe = 0;
+    bool keyframe_pending = true;
+    // hashes of the tiles of the last frame that was output
+    std::vector<uint64_t> tile_hashes;
+};
+
+// room for a keyframe of a w x h frame with a jpeg of up to a byte per pixel, which a rendered frame stays well under
+size_t tile_stream_capacity(int w, int h, int tile_size);
@@ -0,0 +1,78 @@
+#include "trace.h"
+#include "cpp-utils.h"
+#include <cstdio>
+
+static std::atomic<uint64_t> next_tracer_id{1};
+
+Tracer::Tracer(size_t _events_per_thread) : events_per_thread(_events_per_thread) {
+    fassert(events_per_thread > 0);
+    id = next_tracer_id.fetch_add(1);
+    start = std::chrono::steady_clock::now();
+}
+
+Tracer::TraceRing *Tracer::ring_for_this_thread() {
+    // a thread may record into several tracers over its lifetime, tracers are told apart by id rather than by
+    // address in case a new tracer is allocated where an old one was
+    struct CachedRing {
+        uint64_t tracer_id;
+        TraceRing *ring;
+    };
+    static thread_local std::vector<CachedRing> cache;
+
+    for (const auto &entry : cache) {
+        if (entry.tracer_id == id) {
+            return entry.ring;
+        }
+    }
+
+    TraceRing *ring;
+    {
+        std::lock_guard<std::mutex> lock(rings_mutex);
+        rings.push_back(std::make_unique<TraceRing>());
+        ring = rings.back().get();
+        ring->tid = (int)(rings.size());
+        ring->events.resize(events_per_thread);
+    }
+    cache.push_back(CachedRing{id, ring});
+    return ring;
+}
+
+void Tracer::record(const char *name, int env, std::chrono::steady_clock::time_point begin, std::chrono::steady_clock::time_point end) {
+    auto ring = ring_for_this_thread();
+    uint64_t n = ring->count.load(std::memory_order_relaxed);
+    auto &event = ring->events[n % events_per_thread];
+    event.name = name;
+    event.env = env;
+    event.begin_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(begin - start).count();
+    event.end_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+    ring->count.store(n + 1, std::memory_order_release);
+}
+
+void Tracer::write_json(const std::string &path) {
+    FILE *f = fopen(path.c_str(), "w");
+    if (f == nullptr) {
+        fatal("failed to open trace file %s\n", path.c_str());
+    }
+
+    std::lock_guard<std::mutex> lock(rings_mutex);
+    fprintf(f, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+    bool first_event = true;
+    for (const auto &ring : rings) {
+        fprintf(f, "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 0, \"tid\": %d, \"args\": {\"name\": \"thread %d\"}}", first_event ? "" : ",\n", ring->tid, ring->tid);
+        first_event = false;
+
+        uint64_t count = ring->count.load(std::memory_order_acquire);
+        uint64_t begin = count > events_per_thread ? count - events_per_thread : 0;
+        for (uint64_t n = begin; n < count; n++) {
+            const auto &event = ring->events[n % events_per_thread];
+            fprintf(f, ",\n{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 0, \"tid\": %d, \"ts\": %.3f, \"dur\": %.3f", event.name, ring->tid,
+                    event.begin_ns / 1e3, (event.end_ns - event.begin_ns) / 1e3);
+            if (event.env >= 0) {
+                fprintf(f, ", \"args\": {\"env\": %d}", event.env);
+            }
+            fprintf(f, "}");
+        }
+    }
+    fprintf(f, "\n]}\n");
+    fclose(f);
+}
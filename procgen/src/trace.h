@@ -0,0 +1,75 @@
+#pragma once
+
+/*
+
+Timeline of what each thread of a VecGame is doing, enabled with the trace_events option
+
+Every thread that records an event gets its own ring buffer of the last trace_events events, so recording
+doesn't take any locks, the ring is only registered with the tracer the first time the thread records. The
+events can be written out as Chrome trace JSON, which chrome://tracing and Perfetto both load.
+
+*/
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class Tracer {
+  public:
+    explicit Tracer(size_t _events_per_thread);
+
+    // name must be a string literal (or otherwise outlive the tracer), env is -1 for events not tied to an env
+    void record(const char *name, int env, std::chrono::steady_clock::time_point begin, std::chrono::steady_clock::time_point end);
+    // the events should only be written while the threads that record them are idle, otherwise the oldest
+    // events of a ring can be overwritten while they are being written out
+    void write_json(const std::string &path);
+
+  private:
+    struct TraceEvent {
+        const char *name;
+        int env;
+        int64_t begin_ns;
+        int64_t end_ns;
+    };
+
+    struct TraceRing {
+        int tid;
+        std::vector<TraceEvent> events;
+        // total number of events recorded, only written by the thread that owns the ring
+        std::atomic<uint64_t> count{0};
+    };
+
+    size_t events_per_thread;
+    uint64_t id;
+    std::chrono::steady_clock::time_point start;
+    std::mutex rings_mutex;
+    std::vector<std::unique_ptr<TraceRing>> rings;
+
+    TraceRing *ring_for_this_thread();
+};
+
+// records an event for the lifetime of the scope, does nothing if tracer is null
+class TraceScope {
+  public:
+    TraceScope(Tracer *_tracer, const char *_name, int _env) : tracer(_tracer), name(_name), env(_env) {
+        if (tracer != nullptr) {
+            begin = std::chrono::steady_clock::now();
+        }
+    }
+
+    ~TraceScope() {
+        if (tracer != nullptr) {
+            tracer->record(name, env, begin, std::chrono::steady_clock::now());
+        }
+    }
+
+  private:
+    Tracer *tracer;
+    const char *name;
+    int env;
+    std::chrono::steady_clock::time_point begin;
+};
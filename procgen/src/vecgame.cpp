@@ -2,6 +2,13 @@
 #include "cpp-utils.h"
 #include "vecoptions.h"
 #include "game.h"
+#include "state-delta.h"
+#include "jpeg-encode.h"
+#include "trace.h"
+#include "thread-affinity.h"
+#include <algorithm>
+#include <chrono>
+#include <numeric>
 
 const int32_t END_OF_BUFFER = 0xCAFECAFE;
 
@@ -24,6 +31,15 @@ std::vector<std::string> split(std::string s, std::string delimiter) {
     return env_names;
 }
 
+size_t tensortype_num_bytes(const struct libenv_tensortype &type) {
+    size_t count = 1;
+    for (int d = 0; d < type.ndim; d++) {
+        count *= type.shape[d];
+    }
+    size_t elem_size = type.dtype == LIBENV_DTYPE_UINT8 ? sizeof(uint8_t) : sizeof(int32_t);
+    return count * elem_size;
+}
+
 // libenv api
 
 // convert_bufs reorganizes buffers so that they are indexed by the environment
@@ -92,6 +108,25 @@ void libenv_act(libenv_env *handle) {
     venv->act();
 }
 
+// like libenv_act, but only the envs with a nonzero entry in mask are stepped
+LIBENV_API void libenv_act_masked(libenv_env *handle, uint8_t *mask) {
+    auto venv = (VecGame *)(handle);
+    venv->act(mask);
+}
+
+LIBENV_API void libenv_act_async(libenv_env *handle) {
+    auto venv = (VecGame *)(handle);
+    fassert(venv->async_step);
+    venv->act();
+}
+
+// waits for the batch started by libenv_act_async and copies it into the caller's buffers
+LIBENV_API void libenv_wait(libenv_env *handle) {
+    auto venv = (VecGame *)(handle);
+    fassert(venv->async_step);
+    venv->observe();
+}
+
 void libenv_close(libenv_env *handle) {
     auto venv = (VecGame *)(handle);
     delete venv;
@@ -100,12 +135,40 @@ void libenv_close(libenv_env *handle) {
 
 // end libenv api
 
+// batches timed by tune_workers() for each number of active workers, after the ones skipped while it settles
+static const int TUNE_WARMUP_BATCHES = 2;
+static const int TUNE_BATCHES = 16;
+
+static int64_t steady_now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// the first time the threads are activated is before any step, just to initialize
+// the environment and produce the initial observation
+static void step_or_init_game(const std::shared_ptr<Game> &game) {
+    TraceScope scope(game->tracer, game->initial_reset_complete ? "step" : "init", game->game_n);
+    if (!game->initial_reset_complete) {
+        game->reset();
+        // not observe(), the first frame starts the encode_tiles stream as a keyframe and the next one follows it
+        game->observe_frame(false);
+        game->initial_reset_complete = true;
+    } else {
+        game->step();
+    }
+}
+
 static void stepping_worker(std::mutex &stepping_thread_mutex,
-                            std::list<std::shared_ptr<Game>> &pending_games,
+                            PendingGames &pending_games,
                             std::condition_variable &pending_games_added,
-                            std::condition_variable &pending_game_complete, bool &time_to_die) {
+                            std::condition_variable &pending_game_complete, bool &time_to_die,
+                            const std::function<void(Game &)> *&batch_task, int cpu) {
+    if (cpu >= 0) {
+        pin_current_thread(cpu);
+    }
+
     while (1) {
         std::shared_ptr<Game> game;
+        const std::function<void(Game &)> *task = nullptr;
 
         {
             std::unique_lock<std::mutex> lock(stepping_thread_mutex);
@@ -116,6 +179,7 @@ static void stepping_worker(std::mutex &stepping_thread_mutex,
                 if (!pending_games.empty()) {
                     game = pending_games.front();
                     pending_games.pop_front();
+                    task = batch_task;
                     break;
                 }
 
@@ -123,14 +187,11 @@ static void stepping_worker(std::mutex &stepping_thread_mutex,
             }
         }
 
-        // the first time the threads are activated is before any step, just to initialize
-        // the environment and produce the initial observation
-        if (!game->initial_reset_complete) {
-            game->reset();
-            game->observe();
-            game->initial_reset_complete = true;
-        } else{
-            game->step();
+        if (task != nullptr) {
+            TraceScope scope(game->tracer, "task", game->game_n);
+            (*task)(*game);
+        } else {
+            step_or_init_game(game);
         }
 
         {
@@ -141,11 +202,73 @@ static void stepping_worker(std::mutex &stepping_thread_mutex,
     }
 }
 
-void global_init(int rand_seed, std::string resource_root) {
+void VecGame::stealing_worker(int thread_idx) {
+    if (!worker_cpus.empty()) {
+        pin_current_thread(worker_cpu(thread_idx));
+    }
+
+    int seen_batch_id = 0;
+
+    while (1) {
+        {
+            std::unique_lock<std::mutex> lock(stepping_thread_mutex);
+            while (1) {
+                if (time_to_die) {
+                    return;
+                }
+                if (thread_idx >= active_workers) {
+                    parked_workers.wait(lock);
+                    continue;
+                }
+                if (batch_id != seen_batch_id) {
+                    seen_batch_id = batch_id;
+                    break;
+                }
+
+                pending_games_added.wait(lock);
+            }
+        }
+
+        // start with our own slice, then steal from the following ones
+        int num_slices = (int)(slices.size());
+        for (int k = 0; k < num_slices; k++) {
+            auto &slice = slices[(thread_idx + k) % num_slices];
+            while (1) {
+                int idx = slice.next.fetch_add(1, std::memory_order_acq_rel);
+                if (idx >= slice.end) {
+                    break;
+                }
+
+                // batch_task only changes between batches, and claiming a game synchronizes with the dispatch
+                if (batch_task != nullptr) {
+                    TraceScope scope(tracer.get(), "task", idx);
+                    (*batch_task)(*games[idx]);
+                } else if (step_envs[idx]) {
+                    step_or_init_game(games[idx]);
+                }
+
+                if (timing_batch && batch_task == nullptr) {
+                    // the batch ends with the last of its games, whichever worker finishes it
+                    int64_t end = steady_now_ns();
+                    int64_t prev = batch_end_ns.load(std::memory_order_relaxed);
+                    while (prev < end && !batch_end_ns.compare_exchange_weak(prev, end, std::memory_order_relaxed)) {
+                    }
+                }
+
+                if (games_remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                    std::unique_lock<std::mutex> lock(stepping_thread_mutex);
+                    pending_game_complete.notify_all();
+                }
+            }
+        }
+    }
+}
+
+void global_init(int rand_seed, std::string resource_root, std::string resource_bundle) {
     global_resource_root = resource_root;
 
     try {
-        images_load();
+        images_load(resource_bundle);
         coinrun_old_init(rand_seed);
     } catch (const std::exception &e) {
         fatal("failed to load images %s\n", e.what());
@@ -168,8 +291,28 @@ inline uint32_t hash_str_uint32(const std::string &str) {
 
 VecGame::VecGame(int _nenvs, VecOptions opts) {
     render_human = false;
+    work_stealing = false;
+    auto_threads = false;
+    async_step = false;
+    cache_levels = false;
+    pregenerate_levels = false;
+    level_generators = 0;
+    rgb_obs = true;
+    symbolic_obs = false;
+    symbolic_obs_entities = 32;
+    symbolic_obs_grid_dim = 16;
+    encode_jpeg = false;
+    jpeg_quality = 85;
+    encode_tiles = false;
+    frame_stack_ring = false;
+    tick_hz = 0;
+    collect_stats = false;
+    episode_stats = false;
+    record_actions = false;
+    obs_alignment = 1;
     num_envs = _nenvs;
     games.resize(num_envs);
+    step_envs.resize(num_envs, 1);
     std::string env_name;
 
     int num_levels = 0;
@@ -178,7 +321,13 @@ VecGame::VecGame(int _nenvs, VecOptions opts) {
 
     int rand_seed = 0;
     int num_threads = 4;
+    int render_res = RENDER_RES;
+    int obs_res = RES_W;
+    std::string obs_layout = "hwc";
+    int obs_channels = 3;
+    int frame_stack = 1;
     std::string resource_root;
+    std::string resource_bundle;
 
     opts.consume_string("env_name", &env_name);
     opts.consume_int("num_levels", &num_levels);
@@ -187,37 +336,172 @@ VecGame::VecGame(int _nenvs, VecOptions opts) {
     opts.consume_int("rand_seed", &rand_seed);
     opts.consume_int("num_threads", &num_threads);
     opts.consume_string("resource_root", &resource_root);
+    opts.consume_string("resource_bundle", &resource_bundle);
     opts.consume_bool("render_human", &render_human);
+    opts.consume_int("render_res", &render_res);
+    opts.consume_int("obs_res", &obs_res);
+    opts.consume_string("obs_layout", &obs_layout);
+    opts.consume_int("obs_channels", &obs_channels);
+    opts.consume_int("frame_stack", &frame_stack);
+    opts.consume_bool("frame_stack_ring", &frame_stack_ring);
+    opts.consume_bool("work_stealing", &work_stealing);
+    opts.consume_bool("async_step", &async_step);
+    opts.consume_bool("cache_levels", &cache_levels);
+    opts.consume_bool("pregenerate_levels", &pregenerate_levels);
+    opts.consume_int("level_generators", &level_generators);
+    opts.consume_bool("rgb_obs", &rgb_obs);
+    opts.consume_bool("symbolic_obs", &symbolic_obs);
+    opts.consume_int("symbolic_obs_entities", &symbolic_obs_entities);
+    opts.consume_int("symbolic_obs_grid_dim", &symbolic_obs_grid_dim);
+    opts.consume_bool("encode_jpeg", &encode_jpeg);
+    opts.consume_int("jpeg_quality", &jpeg_quality);
+    opts.consume_bool("encode_tiles", &encode_tiles);
+    int tile_size = 32;
+    opts.consume_int("tile_size", &tile_size);
+    int keyframe_interval = 60;
+    opts.consume_int("keyframe_interval", &keyframe_interval);
+    opts.consume_int("tick_hz", &tick_hz);
+    opts.consume_bool("collect_stats", &collect_stats);
+    opts.consume_bool("episode_stats", &episode_stats);
+    opts.consume_bool("record_actions", &record_actions);
+    opts.consume_int("obs_alignment", &obs_alignment);
+    int trace_events = 0;
+    opts.consume_int("trace_events", &trace_events);
+    opts.consume_string("trace_path", &trace_path);
+    std::string cpu_affinity;
+    opts.consume_string("cpu_affinity", &cpu_affinity);
+    bool numa_local_envs = false;
+    opts.consume_bool("numa_local_envs", &numa_local_envs);
 
     std::call_once(global_init_flag, global_init, rand_seed,
-                   resource_root);
+                   resource_root, resource_bundle);
+
+    fassert(cpu_affinity == "" || thread_affinity_available());
+    if (cpu_affinity != "") {
+        worker_cpus = parse_cpu_list(cpu_affinity);
+    }
+
+    // -1 makes a worker per cpu and lets tune_workers() pick how many of them step the games
+    auto_threads = num_threads == -1;
+    if (auto_threads) {
+        int num_cpus = !worker_cpus.empty() ? (int)(worker_cpus.size()) : (int)(std::thread::hardware_concurrency());
+        num_threads = std::max(1, std::min(num_cpus, num_envs));
+        // the parked workers' slices are stepped by stealing them
+        work_stealing = true;
+        fassert(!numa_local_envs);
+        for (int n = num_threads; n >= 1; n = n / 2) {
+            tune_candidates.push_back(n);
+        }
+    }
+    active_workers = num_threads;
 
     fassert(num_threads >= 0);
     threads.resize(num_threads);
+    // placement only means something with a static partition of the envs over pinned workers
+    fassert(!numa_local_envs || (work_stealing && num_threads > 0 && !worker_cpus.empty()));
+
+    if (work_stealing && num_threads > 0) {
+        slices = std::vector<GameSlice>(num_threads);
+        for (int t = 0; t < num_threads; t++) {
+            slices[t].begin = (int)((int64_t)num_envs * t / num_threads);
+            slices[t].end = (int)((int64_t)num_envs * (t + 1) / num_threads);
+            slices[t].next.store(slices[t].end);
+        }
+    }
+
     for (int t = 0; t < num_threads; t++) {
-        threads[t] = std::thread(
-            stepping_worker,
-            std::ref(stepping_thread_mutex),
-            std::ref(pending_games),
-            std::ref(pending_games_added),
-            std::ref(pending_game_complete),
-            std::ref(time_to_die));
+        if (work_stealing) {
+            threads[t] = std::thread(&VecGame::stealing_worker, this, t);
+        } else {
+            threads[t] = std::thread(
+                stepping_worker,
+                std::ref(stepping_thread_mutex),
+                std::ref(pending_games),
+                std::ref(pending_games_added),
+                std::ref(pending_game_complete),
+                std::ref(time_to_die),
+                std::ref(batch_task),
+                worker_cpus.empty() ? -1 : worker_cpu(t));
+        }
     }
 
     fassert(env_name != "");
     fassert(num_actions > 0);
     fassert(num_levels >= 0);
     fassert(start_level >= 0);
-
-    {
+    fassert(render_res > 0);
+    // observations are rendered to a RES_W x RES_H scratch frame, larger frames are what render_human is for
+    fassert(obs_res > 0 && obs_res <= RES_W);
+    fassert(obs_layout == "hwc" || obs_layout == "chw");
+    fassert(obs_channels == 1 || obs_channels == 3);
+    fassert(frame_stack >= 1);
+    fassert(!frame_stack_ring || (frame_stack > 1 && rgb_obs));
+    // with an unbounded level distribution the cache would almost never be hit
+    fassert(!cache_levels || num_levels > 0);
+    fassert(level_generators >= 0);
+    fassert(rgb_obs || symbolic_obs);
+    fassert(symbolic_obs_entities > 0);
+    fassert(symbolic_obs_grid_dim >= 0);
+    fassert(!encode_jpeg || jpeg_encoding_available());
+    fassert(jpeg_quality >= 1 && jpeg_quality <= 100);
+    fassert(!encode_tiles || jpeg_encoding_available());
+    // tiles are whole jpeg blocks and cover the frame exactly
+    fassert(!encode_tiles || (tile_size > 0 && tile_size % 16 == 0 && render_res % tile_size == 0));
+    fassert(keyframe_interval >= 0);
+    // the tick thread steps into the back buffers while the caller reads the ones it owns
+    fassert(tick_hz >= 0);
+    fassert(tick_hz == 0 || async_step);
+    // each frame of the tile stream is a delta on the one before it, a tick that isn't read would lose one
+    fassert(tick_hz == 0 || !encode_tiles);
+    fassert(obs_alignment > 0 && (obs_alignment & (obs_alignment - 1)) == 0);
+    fassert(trace_events >= 0);
+    fassert(trace_path == "" || trace_events > 0);
+
+    if (rgb_obs) {
         struct libenv_tensortype s;
         strcpy(s.name, "rgb");
         s.scalar_type = LIBENV_SCALAR_TYPE_DISCRETE;
         s.dtype = LIBENV_DTYPE_UINT8;
-        s.shape[0] = RES_W;
-        s.shape[1] = RES_H;
-        s.shape[2] = 3;
-        s.ndim = 3;
+        // with frame_stack the frames are stacked along a leading dimension, see Game::next_obs_frame()
+        int d = frame_stack > 1 ? 1 : 0;
+        s.shape[0] = frame_stack;
+        if (obs_layout == "chw") {
+            s.shape[d + 0] = obs_channels;
+            s.shape[d + 1] = obs_res;
+            s.shape[d + 2] = obs_res;
+        } else {
+            s.shape[d + 0] = obs_res;
+            s.shape[d + 1] = obs_res;
+            s.shape[d + 2] = obs_channels;
+        }
+        s.ndim = d + 3;
+        s.low.uint8 = 0;
+        s.high.uint8 = 255;
+        observation_types.push_back(s);
+    }
+
+    if (symbolic_obs) {
+        // see BasicAbstractGame::game_observe_symbolic() for the layout
+        struct libenv_tensortype s;
+        strcpy(s.name, "entities");
+        s.scalar_type = LIBENV_SCALAR_TYPE_REAL;
+        s.dtype = LIBENV_DTYPE_FLOAT32;
+        s.shape[0] = symbolic_obs_entities;
+        s.shape[1] = SYMBOLIC_ENTITY_FEATURES;
+        s.ndim = 2;
+        s.low.float32 = -1000.0f;
+        s.high.float32 = 1000.0f;
+        observation_types.push_back(s);
+    }
+
+    if (symbolic_obs && symbolic_obs_grid_dim > 0) {
+        struct libenv_tensortype s;
+        strcpy(s.name, "grid");
+        s.scalar_type = LIBENV_SCALAR_TYPE_DISCRETE;
+        s.dtype = LIBENV_DTYPE_UINT8;
+        s.shape[0] = symbolic_obs_grid_dim;
+        s.shape[1] = symbolic_obs_grid_dim;
+        s.ndim = 2;
         s.low.uint8 = 0;
         s.high.uint8 = 255;
         observation_types.push_back(s);
@@ -316,8 +600,8 @@ VecGame::VecGame(int _nenvs, VecOptions opts) {
         strcpy(s.name, "rgb");
         s.scalar_type = LIBENV_SCALAR_TYPE_DISCRETE;
         s.dtype = LIBENV_DTYPE_UINT8;
-        s.shape[0] = RENDER_RES;
-        s.shape[1] = RENDER_RES;
+        s.shape[0] = render_res;
+        s.shape[1] = render_res;
         s.shape[2] = 3;
         s.ndim = 3,
         s.low.uint8 = 0;
@@ -325,6 +609,66 @@ VecGame::VecGame(int _nenvs, VecOptions opts) {
         info_types.push_back(s);
     }
 
+    if (encode_jpeg) {
+        // libenv tensors have a fixed size, the encoded frame is at the start of jpeg and jpeg_size says how long it is,
+        // a jpeg of a rendered frame is far smaller than one byte per pixel, a frame that doesn't fit has jpeg_size 0
+        struct libenv_tensortype s;
+        strcpy(s.name, "jpeg");
+        s.scalar_type = LIBENV_SCALAR_TYPE_DISCRETE;
+        s.dtype = LIBENV_DTYPE_UINT8;
+        s.shape[0] = render_res * render_res;
+        s.ndim = 1;
+        s.low.uint8 = 0;
+        s.high.uint8 = 255;
+        info_types.push_back(s);
+    }
+
+    if (frame_stack_ring) {
+        struct libenv_tensortype s;
+        strcpy(s.name, "frame_stack_head");
+        s.scalar_type = LIBENV_SCALAR_TYPE_DISCRETE;
+        s.dtype = LIBENV_DTYPE_INT32;
+        s.ndim = 0;
+        s.low.int32 = 0;
+        s.high.int32 = frame_stack - 1;
+        info_types.push_back(s);
+    }
+
+    if (encode_jpeg) {
+        struct libenv_tensortype s;
+        strcpy(s.name, "jpeg_size");
+        s.scalar_type = LIBENV_SCALAR_TYPE_DISCRETE;
+        s.dtype = LIBENV_DTYPE_INT32;
+        s.ndim = 0;
+        s.low.int32 = 0;
+        s.high.int32 = render_res * render_res;
+        info_types.push_back(s);
+    }
+
+    if (encode_tiles) {
+        // like jpeg, the stream of the frame is at the start of tiles and tiles_size says how long it is
+        struct libenv_tensortype s;
+        strcpy(s.name, "tiles");
+        s.scalar_type = LIBENV_SCALAR_TYPE_DISCRETE;
+        s.dtype = LIBENV_DTYPE_UINT8;
+        s.shape[0] = (int)(tile_stream_capacity(render_res, render_res, tile_size));
+        s.ndim = 1;
+        s.low.uint8 = 0;
+        s.high.uint8 = 255;
+        info_types.push_back(s);
+    }
+
+    if (encode_tiles) {
+        struct libenv_tensortype s;
+        strcpy(s.name, "tiles_size");
+        s.scalar_type = LIBENV_SCALAR_TYPE_DISCRETE;
+        s.dtype = LIBENV_DTYPE_INT32;
+        s.ndim = 0;
+        s.low.int32 = 0;
+        s.high.int32 = (int)(tile_stream_capacity(render_res, render_res, tile_size));
+        info_types.push_back(s);
+    }
+
     int level_seed_low = 0;
     int level_seed_high = 0;
 
@@ -345,32 +689,106 @@ VecGame::VecGame(int _nenvs, VecOptions opts) {
     RandGen game_level_seed_gen;
     game_level_seed_gen.seed(rand_seed);
 
-    std::map<std::string, int> info_name_to_offset;
+    for (size_t i = 0; i < observation_types.size(); i++) {
+        observation_name_to_offset[observation_types[i].name] = i;
+    }
+
     for (size_t i = 0; i < info_types.size(); i++) {
         info_name_to_offset[info_types[i].name] = i;
     }
 
-    for (int n = 0; n < num_envs; n++) {
+    if (cache_levels) {
+        level_cache = std::make_shared<LevelCache>(num_levels * num_joint_games);
+    }
+
+    if (trace_events > 0) {
+        tracer = std::make_unique<Tracer>(trace_events);
+    }
+
+    auto make_game = [&](int n) {
         auto name = env_names[n % num_joint_games];
 
-        games[n] = globalGameRegistry->at(name)();
-        fassert(games[n]->game_name == name);
-        games[n]->level_seed_rand_gen.seed(game_level_seed_gen.randint());
-        games[n]->level_seed_high = level_seed_high;
-        games[n]->level_seed_low = level_seed_low;
-        games[n]->game_n = n;
-        games[n]->is_waiting_for_step = false;
-        games[n]->parse_options(name, opts);
-        games[n]->info_name_to_offset = info_name_to_offset;
+        auto game = globalGameRegistry->at(name)();
+        fassert(game->game_name == name);
+        game->level_seed_high = level_seed_high;
+        game->level_seed_low = level_seed_low;
+        game->game_n = n;
+        game->render_res = render_res;
+        game->obs_res = obs_res;
+        game->obs_chw = obs_layout == "chw";
+        game->obs_channels = obs_channels;
+        game->frame_stack = frame_stack;
+        game->frame_stack_ring = frame_stack_ring;
+        game->jpeg_quality = jpeg_quality;
+        if (encode_tiles) {
+            game->tile_stream = std::make_unique<TileStream>(render_res, render_res, tile_size, keyframe_interval);
+        }
+        if (collect_stats) {
+            game->stats = std::make_unique<GameStats>();
+        }
+        game->tracer = tracer.get();
+        game->track_episodes = episode_stats;
+        game->record_actions = record_actions;
+        game->symbolic_obs_entities = symbolic_obs_entities;
+        game->symbolic_obs_grid_dim = symbolic_obs_grid_dim;
+        game->is_waiting_for_step = false;
+        game->parse_options(name, opts);
+        // cached and pregenerated levels are restored with deserialize(), which doesn't support generated assets
+        fassert(!(cache_levels || pregenerate_levels) || !game->options.use_generated_assets);
 
         // Auto-selected a fixed_asset_seed if one wasn't specified on
         // construction
-        if (games[n]->fixed_asset_seed == 0) {
+        if (game->fixed_asset_seed == 0) {
             auto hashed = hash_str_uint32(name);
-            games[n]->fixed_asset_seed = int(hashed);
+            game->fixed_asset_seed = int(hashed);
+        }
+
+        game->game_init();
+        return game;
+    };
+
+    if (pregenerate_levels) {
+        // one private game per game type generates levels for all the envs of that type
+        std::vector<std::shared_ptr<Game>> generator_games(num_envs);
+
+        for (int n = 0; n < num_envs; n++) {
+            generator_games[n] = n < num_joint_games ? make_game(n) : generator_games[n % num_joint_games];
+        }
+
+        level_pregen = std::make_shared<LevelPregenerator>(generator_games);
+    }
+
+    for (int t = 0; t < level_generators; t++) {
+        for (int j = 0; j < num_joint_games; j++) {
+            level_generator_games.push_back(make_game(j));
+        }
+    }
+
+    if (numa_local_envs) {
+        // memory is placed on the node of the thread that first touches it, so each game is made on the cpu of the
+        // worker whose slice it's in, along with everything game_init() allocates
+        std::vector<std::thread> game_makers;
+        for (int t = 0; t < num_threads; t++) {
+            game_makers.emplace_back([&, t]() {
+                pin_current_thread(worker_cpu(t));
+                for (int n = slices[t].begin; n < slices[t].end; n++) {
+                    games[n] = make_game(n);
+                }
+            });
         }
+        for (auto &maker : game_makers) {
+            maker.join();
+        }
+    } else {
+        for (int n = 0; n < num_envs; n++) {
+            games[n] = make_game(n);
+        }
+    }
 
-        games[n]->game_init();
+    for (int n = 0; n < num_envs; n++) {
+        games[n]->level_seed_rand_gen.seed(game_level_seed_gen.randint());
+        games[n]->level_cache = level_cache.get();
+        games[n]->level_pregen = level_pregen.get();
     }
 }
 
@@ -378,6 +796,19 @@ void VecGame::set_buffers(const std::vector<std::vector<void *>> &ac, const std:
     {
         std::unique_lock<std::mutex> lock(stepping_thread_mutex);
 
+        if (async_step) {
+            front_obs_bufs = ob;
+            front_info_bufs = info;
+            front_rew = rew;
+            front_first = first;
+            back_rew.resize(num_envs);
+            back_first.resize(num_envs);
+            back_storage.clear();
+            back_storage.reserve(num_envs * (observation_types.size() + info_types.size()));
+        }
+
+        caller_obs_bufs = ob;
+
         for (int e = 0; e < num_envs; e++) {
             const auto &game = games[e];
             // we only ever have one action
@@ -386,6 +817,46 @@ void VecGame::set_buffers(const std::vector<std::vector<void *>> &ac, const std:
             game->info_bufs = info[e];
             game->reward_ptr = &rew[e];
             game->first_ptr = &first[e];
+
+            if (async_step) {
+                for (size_t i = 0; i < observation_types.size(); i++) {
+                    back_storage.emplace_back(tensortype_num_bytes(observation_types[i]));
+                    game->obs_bufs[i] = back_storage.back().data();
+                }
+                for (size_t i = 0; i < info_types.size(); i++) {
+                    back_storage.emplace_back(tensortype_num_bytes(info_types[i]));
+                    game->info_bufs[i] = back_storage.back().data();
+                }
+                game->reward_ptr = &back_rew[e];
+                game->first_ptr = &back_first[e];
+            }
+
+            update_obs_ptrs(*game);
+
+            auto &ptrs = game->info_ptrs;
+            ptrs.prev_level_seed = (int32_t *)(game->info_bufs[info_name_to_offset.at("prev_level_seed")]);
+            ptrs.prev_level_complete = (uint8_t *)(game->info_bufs[info_name_to_offset.at("prev_level_complete")]);
+            ptrs.level_seed = (int32_t *)(game->info_bufs[info_name_to_offset.at("level_seed")]);
+            ptrs.agent_x = (float *)(game->info_bufs[info_name_to_offset.at("agent_x")]);
+            ptrs.collision_x = (float *)(game->info_bufs[info_name_to_offset.at("collision_x")]);
+            ptrs.collision_y = (float *)(game->info_bufs[info_name_to_offset.at("collision_y")]);
+            ptrs.collision_type = (int32_t *)(game->info_bufs[info_name_to_offset.at("collision_type")]);
+            if (render_human) {
+                ptrs.rgb = (uint8_t *)(game->info_bufs[info_name_to_offset.at("rgb")]);
+            }
+            if (encode_jpeg) {
+                ptrs.jpeg = (uint8_t *)(game->info_bufs[info_name_to_offset.at("jpeg")]);
+                ptrs.jpeg_size = (int32_t *)(game->info_bufs[info_name_to_offset.at("jpeg_size")]);
+                ptrs.jpeg_capacity = tensortype_num_bytes(info_types[info_name_to_offset.at("jpeg")]);
+            }
+            if (encode_tiles) {
+                ptrs.tiles = (uint8_t *)(game->info_bufs[info_name_to_offset.at("tiles")]);
+                ptrs.tiles_size = (int32_t *)(game->info_bufs[info_name_to_offset.at("tiles_size")]);
+                ptrs.tiles_capacity = tensortype_num_bytes(info_types[info_name_to_offset.at("tiles")]);
+            }
+            if (frame_stack_ring) {
+                ptrs.frame_stack_head = (int32_t *)(game->info_bufs[info_name_to_offset.at("frame_stack_head")]);
+            }
             
             // render the initial state so we don't see a black screen on the first frame
             fassert(!game->is_waiting_for_step);
@@ -393,68 +864,523 @@ void VecGame::set_buffers(const std::vector<std::vector<void *>> &ac, const std:
             if (threads.size() == 0) {
                 // special case for no threads
                 game->reset();
-                game->observe();
+                game->observe_frame(false);
                 game->initial_reset_complete = true;
-            } else {
+            } else if (!work_stealing) {
                 game->is_waiting_for_step = true;
                 pending_games.push_back(game);
             }
         }
+
+        if (work_stealing && threads.size() > 0) {
+            dispatch_batch();
+        }
     }
     pending_games_added.notify_all();
+
+    if (tick_hz > 0) {
+        held_actions.resize(num_envs);
+        for (int e = 0; e < num_envs; e++) {
+            held_actions[e] = games[e]->default_action;
+        }
+        tick_rew.resize(num_envs, 0.0f);
+        tick_first.resize(num_envs, 0);
+        tick_thread = std::thread(&VecGame::tick_worker, this);
+    }
+}
+
+/*
+  Steps the games every 1 / tick_hz seconds, whether or not the previous tick was observed. The first tick only
+  waits for the initial reset started by set_buffers(). If a step takes longer than the period, the missed ticks
+  are dropped instead of being run back to back to catch up.
+*/
+void VecGame::tick_worker() {
+    auto period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(1.0 / tick_hz));
+    auto next_tick = std::chrono::steady_clock::now();
+    bool initial = true;
+
+    while (1) {
+        {
+            std::unique_lock<std::mutex> lock(tick_mutex);
+            if (!initial) {
+                if (tick_cv.wait_until(lock, next_tick, [&] { return tick_stop; })) {
+                    return;
+                }
+                start_step(step_mask.empty() ? nullptr : step_mask.data(), held_actions.data());
+            }
+            initial = false;
+
+            // tick_mutex is held for the whole step, so observe() only ever publishes completed ticks
+            wait_for_stepping_threads();
+            for (int e = 0; e < num_envs; e++) {
+                tick_rew[e] += back_rew[e];
+                tick_first[e] |= back_first[e];
+            }
+            tick_count++;
+        }
+        tick_cv.notify_all();
+
+        next_tick += period;
+        auto now = std::chrono::steady_clock::now();
+        if (next_tick < now) {
+            next_tick = now;
+        }
+    }
+}
+
+// must be called with stepping_thread_mutex held, after all per-game inputs
+// (such as game->action) have been written
+void VecGame::dispatch_batch() {
+    games_remaining.store(num_envs, std::memory_order_relaxed);
+    // the release stores on the cursors publish the game inputs to any worker
+    // that claims a game, including workers that are still leaving the previous batch
+    for (auto &slice : slices) {
+        slice.next.store(slice.begin, std::memory_order_release);
+    }
+    batch_id++;
+}
+
+/*
+  With num_threads -1, the batches after the initial reset try out a decreasing number of active workers, from one per
+  cpu halving down to 1, and the fastest is kept from then on. Each number of workers steps TUNE_WARMUP_BATCHES
+  batches and then TUNE_BATCHES timed ones, the median of which is compared so that the occasional slow batch (a level
+  generated on a reset) doesn't decide. Only batches that step every env are timed, a batch runs from its dispatch to
+  the end of its last game. Called with stepping_thread_mutex held, before the next batch is dispatched.
+*/
+void VecGame::tune_workers(bool full_batch) {
+    if (timing_batch) {
+        tune_samples.push_back(batch_end_ns.load(std::memory_order_relaxed) - batch_start_ns);
+        timing_batch = false;
+    }
+
+    if (tune_candidate >= tune_candidates.size()) {
+        return;
+    }
+
+    if ((int)(tune_samples.size()) == TUNE_WARMUP_BATCHES + TUNE_BATCHES) {
+        auto mid = tune_samples.begin() + TUNE_WARMUP_BATCHES + TUNE_BATCHES / 2;
+        std::nth_element(tune_samples.begin() + TUNE_WARMUP_BATCHES, mid, tune_samples.end());
+        tune_times.push_back(*mid);
+        tune_samples.clear();
+        tune_candidate++;
+
+        if (tune_candidate < tune_candidates.size()) {
+            active_workers = tune_candidates[tune_candidate];
+        } else {
+            // an earlier candidate wins a tie, it has more workers to absorb slow steps
+            size_t best = 0;
+            for (size_t c = 1; c < tune_times.size(); c++) {
+                if (tune_times[c] < tune_times[best]) {
+                    best = c;
+                }
+            }
+            active_workers = tune_candidates[best];
+        }
+        parked_workers.notify_all();
+    }
+
+    if (tune_candidate < tune_candidates.size() && full_batch) {
+        timing_batch = true;
+        batch_start_ns = steady_now_ns();
+        batch_end_ns.store(batch_start_ns, std::memory_order_relaxed);
+    }
+}
+
+int VecGame::num_active_threads() {
+    std::unique_lock<std::mutex> lock(stepping_thread_mutex);
+    return active_workers;
 }
 
 void VecGame::observe() {
+    if (tick_hz > 0) {
+        std::unique_lock<std::mutex> lock(tick_mutex);
+        while (tick_count == observed_tick_count) {
+            tick_cv.wait(lock);
+        }
+        observed_tick_count = tick_count;
+        publish_back_buffers();
+        return;
+    }
+
     wait_for_stepping_threads();
     // at this point all games belong to the python thread
 
-    if (render_human) {
-        uint8_t render_hires_buf[RENDER_RES * RENDER_RES * 4];
+    if (async_step) {
+        publish_back_buffers();
+    }
+}
 
-        for (int e = 0; e < num_envs; e++) {
-            const auto &game = games[e];
-            game->render_to_buf(render_hires_buf, RENDER_RES, RENDER_RES, true);
-            bgr32_to_rgb888(game->info_bufs[game->info_name_to_offset.at("rgb")], render_hires_buf, RENDER_RES, RENDER_RES);
+void VecGame::update_obs_ptrs(Game &game) {
+    auto &obs_ptrs = game.obs_ptrs;
+    if (rgb_obs) {
+        obs_ptrs.rgb = (uint8_t *)(game.obs_bufs[observation_name_to_offset.at("rgb")]);
+    }
+    if (symbolic_obs) {
+        obs_ptrs.entities = (float *)(game.obs_bufs[observation_name_to_offset.at("entities")]);
+    }
+    if (symbolic_obs && symbolic_obs_grid_dim > 0) {
+        obs_ptrs.grid = (uint8_t *)(game.obs_bufs[observation_name_to_offset.at("grid")]);
+    }
+}
+
+void VecGame::check_obs_alignment(const void *buf) {
+    if ((uintptr_t)buf % obs_alignment != 0) {
+        fatal("observation buffer %p is not aligned to %d bytes\n", buf, obs_alignment);
+    }
+}
+
+void VecGame::set_obs_buffer(const std::string &name, char *data) {
+    fassert(!caller_obs_bufs.empty());
+    auto it = observation_name_to_offset.find(name);
+    if (it == observation_name_to_offset.end()) {
+        fatal("unknown observation %s\n", name.c_str());
+    }
+    int i = it->second;
+    size_t num_bytes = tensortype_num_bytes(observation_types[i]);
+    check_obs_alignment(data);
+
+    for (int e = 0; e < num_envs; e++) {
+        auto &game = *games[e];
+        void *dst = data == nullptr ? caller_obs_bufs[e][i] : data + e * num_bytes;
+        // in async mode the stepping threads write to the back buffers, the destination is where observe() copies to
+        auto &cur = async_step ? front_obs_bufs[e][i] : game.obs_bufs[i];
+        // the envs that aren't stepped keep their observation
+        if (dst != cur) {
+            memcpy(dst, cur, num_bytes);
+        }
+        cur = dst;
+        if (!async_step) {
+            update_obs_ptrs(game);
         }
     }
 }
 
-void VecGame::act() {
+void VecGame::publish_back_buffers() {
+    for (int e = 0; e < num_envs; e++) {
+        const auto &game = games[e];
+        for (size_t i = 0; i < observation_types.size(); i++) {
+            memcpy(front_obs_bufs[e][i], game->obs_bufs[i], tensortype_num_bytes(observation_types[i]));
+        }
+        for (size_t i = 0; i < info_types.size(); i++) {
+            memcpy(front_info_bufs[e][i], game->info_bufs[i], tensortype_num_bytes(info_types[i]));
+        }
+    }
+    if (tick_hz > 0) {
+        memcpy(front_rew, tick_rew.data(), num_envs * sizeof(float));
+        memcpy(front_first, tick_first.data(), num_envs * sizeof(uint8_t));
+        std::fill(tick_rew.begin(), tick_rew.end(), 0.0f);
+        std::fill(tick_first.begin(), tick_first.end(), 0);
+        return;
+    }
+    memcpy(front_rew, back_rew.data(), num_envs * sizeof(float));
+    memcpy(front_first, back_first.data(), num_envs * sizeof(uint8_t));
+}
+
+void VecGame::act(const uint8_t *mask) {
+    if (tick_hz > 0) {
+        // the games are stepped by the tick thread, which uses the latest actions it was given
+        fassert(mask == nullptr);
+        std::unique_lock<std::mutex> lock(tick_mutex);
+        for (int e = 0; e < num_envs; e++) {
+            held_actions[e] = *games[e]->action_ptr;
+        }
+        return;
+    }
+
     wait_for_stepping_threads();
 
+    if (mask == nullptr && !step_mask.empty()) {
+        mask = step_mask.data();
+    }
+
+    start_step(mask, nullptr);
+}
+
+void VecGame::start_step(const uint8_t *mask, const int32_t *actions) {
     {
         std::unique_lock<std::mutex> lock(stepping_thread_mutex);
 
         for (int e = 0; e < num_envs; e++) {
             const auto &game = games[e];
             fassert(!game->is_waiting_for_step);
+            step_envs[e] = mask == nullptr || mask[e] != 0;
+            if (!step_envs[e]) {
+                // the observation buffers still hold the last observation of the env
+                *game->reward_ptr = 0.0f;
+                *game->first_ptr = 0;
+                continue;
+            }
             // save the action since it's only valid for the duration of this call
-            game->action = *game->action_ptr;
+            game->action = actions != nullptr ? actions[e] : *game->action_ptr;
             if (threads.size() == 0) {
                 // special case for no threads
                 game->step();
-            } else {
+            } else if (!work_stealing) {
                 game->is_waiting_for_step = true;
                 pending_games.push_back(game);
             }
         }
+
+        if (work_stealing && threads.size() > 0) {
+            if (auto_threads) {
+                tune_workers(mask == nullptr);
+            }
+            dispatch_batch();
+        }
     }
     // at this point all games belong to the stepping threads
 
     pending_games_added.notify_all();
 }
 
+void VecGame::for_each_game(const std::function<void(Game &)> &task) {
+    wait_for_stepping_threads();
+
+    if (threads.size() == 0) {
+        for (const auto &game : games) {
+            task(*game);
+        }
+        return;
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(stepping_thread_mutex);
+        batch_task = &task;
+
+        if (work_stealing) {
+            dispatch_batch();
+        } else {
+            for (const auto &game : games) {
+                fassert(!game->is_waiting_for_step);
+                game->is_waiting_for_step = true;
+                pending_games.push_back(game);
+            }
+        }
+    }
+    pending_games_added.notify_all();
+
+    wait_for_stepping_threads();
+
+    std::unique_lock<std::mutex> lock(stepping_thread_mutex);
+    batch_task = nullptr;
+}
+
 VecGame::~VecGame() {
+    if (tick_thread.joinable()) {
+        {
+            std::unique_lock<std::mutex> lock(tick_mutex);
+            tick_stop = true;
+        }
+        tick_cv.notify_all();
+        tick_thread.join();
+    }
+
     wait_for_stepping_threads();
     {
         std::unique_lock<std::mutex> lock(stepping_thread_mutex);
         time_to_die = true;
     }
     pending_games_added.notify_all();
+    parked_workers.notify_all();
 
     for (auto &t : threads) {
         t.join();
     }
+
+    if (trace_path != "") {
+        tracer->write_json(trace_path);
+    }
+}
+
+void VecGame::restart_episode(int env_idx, int level_seed_gen_seed) {
+    const auto &game = games.at(env_idx);
+    game->restart_episode(level_seed_gen_seed);
+    game->observe();
+    if (tick_hz > 0) {
+        // the next tick overwrites the observation before it's published, carry first over to it
+        tick_first[env_idx] = 1;
+    }
+}
+
+/*
+  Retargets an env that is already running, for handing it over to a user that wants different levels, without
+  making a new VecGame along with its threads and its games' assets. The levels of the new options are made from the
+  next reset on, so the cached and pregenerated levels, made with the old options, would be wrong.
+*/
+void VecGame::reconfigure(int env_idx, VecOptions opts) {
+    fassert(!cache_levels && !pregenerate_levels);
+    const auto &game = games.at(env_idx);
+
+    int num_levels = -1;
+    int start_level = -1;
+    int level_seed_gen_seed = -1;
+    opts.consume_int("num_levels", &num_levels);
+    opts.consume_int("start_level", &start_level);
+    opts.consume_int("level_seed_gen_seed", &level_seed_gen_seed);
+    if (start_level < 0) {
+        start_level = game->level_seed_low;
+    } else if (num_levels < 0) {
+        // a start_level on its own moves the levels and keeps how many there are, unlimited levels have no start
+        fassert(!(game->level_seed_low == 0 && game->level_seed_high == INT32_MAX));
+        num_levels = game->level_seed_high - game->level_seed_low;
+    }
+    if (num_levels == 0) {
+        game->level_seed_low = 0;
+        game->level_seed_high = INT32_MAX;
+    } else if (num_levels > 0) {
+        game->level_seed_low = start_level;
+        game->level_seed_high = start_level + num_levels;
+    }
+
+    game->parse_level_options(game->game_name, opts);
+    opts.ensure_empty();
+
+    restart_episode(env_idx, level_seed_gen_seed);
+}
+
+int VecGame::drain_episode_stats(EpisodeStats *out, int max_episodes) {
+    fassert(episode_stats);
+    int count = 0;
+    for (const auto &game : games) {
+        auto &completed = game->completed_episodes;
+        int n = std::min((int)(completed.size()), max_episodes - count);
+        std::copy(completed.begin(), completed.begin() + n, out + count);
+        completed.erase(completed.begin(), completed.begin() + n);
+        count += n;
+    }
+    return count;
+}
+
+static const int LEVEL_LOG_HEADER_SIZE = 3 * sizeof(int32_t);
+
+int VecGame::level_logs_size() {
+    fassert(record_actions);
+    size_t size = 0;
+    for (const auto &game : games) {
+        for (const auto &log : game->completed_level_logs) {
+            size += LEVEL_LOG_HEADER_SIZE + log.actions.size();
+        }
+    }
+    fassert(size <= INT32_MAX);
+    return (int)(size);
+}
+
+int VecGame::drain_level_logs(char *out, int length) {
+    fassert(record_actions);
+    int offset = 0;
+    for (const auto &game : games) {
+        auto &completed = game->completed_level_logs;
+        size_t n = 0;
+        for (; n < completed.size(); n++) {
+            const auto &log = completed[n];
+            int32_t num_frames = (int32_t)(log.actions.size());
+            if (LEVEL_LOG_HEADER_SIZE + num_frames > length - offset) {
+                break;
+            }
+            int32_t header[3] = {log.env, log.level_seed, num_frames};
+            memcpy(out + offset, header, LEVEL_LOG_HEADER_SIZE);
+            offset += LEVEL_LOG_HEADER_SIZE;
+            memcpy(out + offset, log.actions.data(), num_frames);
+            offset += num_frames;
+        }
+        completed.erase(completed.begin(), completed.begin() + n);
+        if (!completed.empty()) {
+            // a log didn't fit, the logs of the later envs wait for it so they stay in order
+            break;
+        }
+    }
+    return offset;
+}
+
+void VecGame::replay_level(int env_idx, const LevelLog &log, int checkpoint_interval) {
+    // the observation is written to the buffers directly, which async_step and tick mode don't expect
+    fassert(!async_step && tick_hz == 0);
+    const auto &game = games.at(env_idx);
+    game->start_replay(log, checkpoint_interval);
+    game->observe();
+}
+
+int VecGame::replay_seek(int env_idx, int frame) {
+    fassert(!async_step && tick_hz == 0);
+    const auto &game = games.at(env_idx);
+    frame = game->replay_seek(frame);
+    game->observe();
+    return frame;
+}
+
+// the generator threads take the seeds in chunks of this many, so they stay busy while their levels take different times
+static const int LEVEL_GENERATION_CHUNK = 64;
+
+void VecGame::generate_levels(int game_idx, int seed_start, int count, LevelSummary *out) {
+    fassert(level_generators > 0);
+    fassert(game_idx >= 0 && game_idx < num_joint_games);
+    fassert(count >= 0);
+
+    std::unique_lock<std::mutex> lock(level_generation_mutex);
+    std::atomic<int> next_level(0);
+
+    auto generate = [&](int t) {
+        const auto &game = level_generator_games[t * num_joint_games + game_idx];
+
+        while (true) {
+            int begin = next_level.fetch_add(LEVEL_GENERATION_CHUNK);
+            if (begin >= count) {
+                break;
+            }
+            int end = std::min(begin + LEVEL_GENERATION_CHUNK, count);
+
+            for (int i = begin; i < end; i++) {
+                // seeds past INT32_MAX wrap around like the seeds of use_sequential_levels
+                int level_seed = (int32_t)((uint32_t)(seed_start) + (uint32_t)(i));
+                game->generate_level(level_seed);
+                LevelSummary summary;
+                summary.level_seed = level_seed;
+                game->summarize_level(summary);
+                out[i] = summary;
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (int t = 1; t < level_generators; t++) {
+        threads.emplace_back(generate, t);
+    }
+    generate(0);
+    for (auto &thread : threads) {
+        thread.join();
+    }
+}
+
+int VecGame::record_draw_lists(int32_t *counts) {
+    draw_lists.resize(num_envs);
+
+    for_each_game([&](Game &game) {
+        bool supported = game.record_draw_list(draw_lists[game.game_n]);
+        counts[game.game_n] = supported ? (int32_t)(draw_lists[game.game_n].size()) : -1;
+    });
+
+    size_t total = 0;
+    for (const auto &commands : draw_lists) {
+        total += commands.size();
+    }
+    fassert(total <= INT32_MAX);
+    return (int)(total);
+}
+
+int VecGame::copy_draw_lists(DrawCommand *out, int max_commands) {
+    int n = 0;
+    for (const auto &commands : draw_lists) {
+        int count = std::min((int)(commands.size()), max_commands - n);
+        std::copy(commands.begin(), commands.begin() + count, out + n);
+        n += count;
+    }
+    return n;
+}
+
+std::unique_lock<std::mutex> VecGame::lock_games() {
+    std::unique_lock<std::mutex> lock(tick_mutex);
+    wait_for_stepping_threads();
+    return lock;
 }
 
 void VecGame::wait_for_stepping_threads() {
@@ -463,6 +1389,15 @@ void VecGame::wait_for_stepping_threads() {
     }
 
     std::unique_lock<std::mutex> lock(stepping_thread_mutex);
+    PhaseTimer timer(collect_stats ? &wait_stats : nullptr, STATS_WAIT, tracer.get());
+
+    if (work_stealing) {
+        while (games_remaining.load(std::memory_order_acquire) > 0) {
+            pending_game_complete.wait(lock);
+        }
+        return;
+    }
+
     while (1) {
         bool all_steps_completed = true;
 
@@ -481,7 +1416,7 @@ void VecGame::wait_for_stepping_threads() {
 extern "C" {
     LIBENV_API int get_state(libenv_env *handle, int env_idx, char *data, int length) {
         auto venv = (VecGame *)(handle);
-        venv->wait_for_stepping_threads();
+        auto lock = venv->lock_games();
         auto b = WriteBuffer(data, length);
         venv->games.at(env_idx)->serialize(&b);
         b.write_int(END_OF_BUFFER);
@@ -490,7 +1425,7 @@ extern "C" {
 
     LIBENV_API void set_state(libenv_env *handle, int env_idx, char *data, int length) {
         auto venv = (VecGame *)(handle);
-        venv->wait_for_stepping_threads();
+        auto lock = venv->lock_games();
         auto b = ReadBuffer(data, length);
         venv->games.at(env_idx)->deserialize(&b);
         fassert(b.read_int() == END_OF_BUFFER);
@@ -498,4 +1433,285 @@ extern "C" {
         // next time VecGame::observe() is called, the correct data will be in the buffers
         venv->games.at(env_idx)->observe();
     }
+
+    // get_state, encoded as a delta relative to base, usually an earlier state of the same env
+    LIBENV_API int get_state_delta(libenv_env *handle, int env_idx, char *base, int base_length, char *data, int length) {
+        static thread_local std::vector<char> state_buf;
+        state_buf.resize(MAX_LEVEL_STATE_SIZE);
+        int state_length = get_state(handle, env_idx, state_buf.data(), (int)(state_buf.size()));
+        return encode_state_delta(base, base_length, state_buf.data(), state_length, data, length);
+    }
+
+    // set_state from a delta returned by get_state_delta with the same base
+    LIBENV_API void set_state_delta(libenv_env *handle, int env_idx, char *base, int base_length, char *data, int length) {
+        static thread_local std::vector<char> state_buf;
+        state_buf.resize(MAX_LEVEL_STATE_SIZE);
+        int state_length = apply_state_delta(base, base_length, data, length, state_buf.data(), state_buf.size());
+        set_state(handle, env_idx, state_buf.data(), state_length);
+    }
+
+    // restrict the following libenv_act and libenv_act_async calls to the envs with a nonzero entry in mask,
+    // a null mask steps all envs again
+    LIBENV_API void set_step_mask(libenv_env *handle, uint8_t *mask) {
+        auto venv = (VecGame *)(handle);
+        std::unique_lock<std::mutex> lock(venv->tick_mutex);
+        if (mask == nullptr) {
+            venv->step_mask.clear();
+        } else {
+            venv->step_mask.assign(mask, mask + venv->num_envs);
+        }
+    }
+
+    // decode the images under resource_root and write them to path, for use with the resource_bundle option,
+    // this has to be called before any env is created in the process
+    LIBENV_API void make_resource_bundle(const char *resource_root, const char *path) {
+        global_resource_root = resource_root;
+        write_resource_bundle(path);
+    }
+
+    // the names of all the games that can be used for env_name, separated by commas, returns the length of the string
+    LIBENV_API int get_game_names(char *data, int length) {
+        std::string names;
+        for (const auto &entry : *globalGameRegistry) {
+            if (!names.empty()) {
+                names += ",";
+            }
+            names += entry.first;
+        }
+        fassert((int)(names.size()) <= length);
+        memcpy(data, names.data(), names.size());
+        return (int)(names.size());
+    }
+
+    // write the events recorded with the trace_events option to path as a Chrome trace, which Perfetto also opens
+    LIBENV_API void libenv_dump_trace(libenv_env *handle, const char *path) {
+        auto venv = (VecGame *)(handle);
+        fassert(venv->tracer != nullptr);
+        auto lock = venv->lock_games();
+        venv->tracer->write_json(path);
+    }
+
+    // the collect_stats counters, STATS_NUM_PHASES * STATS_VALUES_PER_PHASE values for each env followed by the same
+    // for the VecGame, see PhaseStats, returns the number of values written
+    LIBENV_API int libenv_get_stats(libenv_env *handle, uint64_t *data, int length) {
+        auto venv = (VecGame *)(handle);
+        fassert(venv->collect_stats);
+        auto lock = venv->lock_games();
+        int stats_len = STATS_NUM_PHASES * STATS_VALUES_PER_PHASE;
+        fassert(length >= (venv->num_envs + 1) * stats_len);
+
+        auto write_stats = [&](const GameStats &stats, uint64_t *dst) {
+            for (const auto &phase : stats.phases) {
+                *dst++ = phase.count;
+                *dst++ = phase.total_ns;
+                *dst++ = phase.max_ns;
+                for (int b = 0; b < STATS_NUM_BUCKETS; b++) {
+                    *dst++ = phase.buckets[b];
+                }
+            }
+        };
+
+        for (int e = 0; e < venv->num_envs; e++) {
+            write_stats(*venv->games[e]->stats, data + e * stats_len);
+        }
+        // wait_stats is only written while waiting for the stepping threads, which nothing else does while we hold the lock
+        write_stats(venv->wait_stats, data + venv->num_envs * stats_len);
+        return (venv->num_envs + 1) * stats_len;
+    }
+
+    // copy up to max_episodes completed episodes to data and forget them, see VecGame::drain_episode_stats(), returns
+    // the number copied
+    LIBENV_API int libenv_drain_episode_stats(libenv_env *handle, EpisodeStats *data, int max_episodes) {
+        auto venv = (VecGame *)(handle);
+        auto lock = venv->lock_games();
+        return venv->drain_episode_stats(data, max_episodes);
+    }
+
+    // write the summaries of the levels of count seeds from seed_start to data, see VecGame::generate_levels()
+    LIBENV_API void libenv_generate_levels(libenv_env *handle, int game_idx, int seed_start, int count, LevelSummary *data) {
+        auto venv = (VecGame *)(handle);
+        venv->generate_levels(game_idx, seed_start, count, data);
+    }
+
+    // the numbers drawn by one of the helpers of RandGen with a new generator of the kind the envs use, seeded with
+    // seed, for testing them, the choose methods pick from range(a), returns how many numbers were written to out
+    LIBENV_API int libenv_rand_gen_draws(libenv_env *handle, const char *method, int seed, int a, int b, int32_t *out, int length) {
+        auto venv = (VecGame *)(handle);
+        RandGen rand_gen;
+        rand_gen.kind = venv->games.at(0)->options.rand_gen_kind;
+        rand_gen.seed(seed);
+
+        std::string name = method;
+        std::vector<int> draws;
+        if (name == "partition") {
+            draws = rand_gen.partition(a, b);
+        } else if (name == "partition_spacings") {
+            rand_gen.partition_spacings(a, b, draws);
+        } else if (name == "choose_n" || name == "choose_n_fast") {
+            std::vector<int> elems(a);
+            std::iota(elems.begin(), elems.end(), 0);
+            if (name == "choose_n") {
+                draws = rand_gen.choose_n(elems, b);
+            } else {
+                rand_gen.choose_n_fast(elems, b);
+                draws.assign(elems.begin(), elems.begin() + std::min(a, b));
+            }
+        } else if (name == "simple_choose") {
+            draws = rand_gen.simple_choose(a, b);
+        } else if (name == "simple_choose_fast") {
+            rand_gen.simple_choose_fast(a, b, draws);
+        } else {
+            fatal("unknown RandGen method %s\n", method);
+        }
+
+        fassert((int)(draws.size()) <= length);
+        std::copy(draws.begin(), draws.end(), out);
+        return (int)(draws.size());
+    }
+
+    // record the draw list of each env, see VecGame::record_draw_lists(), returns the total number of commands
+    LIBENV_API int libenv_record_draw_lists(libenv_env *handle, int32_t *counts) {
+        auto venv = (VecGame *)(handle);
+        auto lock = venv->lock_games();
+        return venv->record_draw_lists(counts);
+    }
+
+    // see VecGame::copy_draw_lists()
+    LIBENV_API int libenv_copy_draw_lists(libenv_env *handle, DrawCommand *data, int max_commands) {
+        auto venv = (VecGame *)(handle);
+        auto lock = venv->lock_games();
+        return venv->copy_draw_lists(data, max_commands);
+    }
+
+    // the image of a command of the draw lists of env env_idx, see Game::draw_list_image(), size gets its width and
+    // height and the ARGB32 premultiplied pixels are written to data if it has room for them, returns 0 if there's
+    // no such image
+    LIBENV_API int libenv_draw_list_image(libenv_env *handle, int env_idx, int kind, int asset, int theme, int32_t *size, uint32_t *data, int max_pixels) {
+        auto venv = (VecGame *)(handle);
+        auto lock = venv->lock_games();
+        fassert(env_idx >= 0 && env_idx < venv->num_envs);
+        const QImage *image = venv->games[env_idx]->draw_list_image(DrawKind(kind), asset, theme);
+        if (image == nullptr) {
+            return 0;
+        }
+
+        QImage converted = image->convertToFormat(QImage::Format_ARGB32_Premultiplied);
+        size[0] = converted.width();
+        size[1] = converted.height();
+        if (data != nullptr && (int64_t)(converted.width()) * converted.height() <= max_pixels) {
+            for (int y = 0; y < converted.height(); y++) {
+                memcpy(data + (size_t)y * converted.width(), converted.constScanLine(y), (size_t)converted.width() * 4);
+            }
+        }
+        return 1;
+    }
+
+    // see VecGame::num_active_threads()
+    LIBENV_API int libenv_num_active_threads(libenv_env *handle) {
+        auto venv = (VecGame *)(handle);
+        return venv->num_active_threads();
+    }
+
+    // the number of bytes libenv_drain_level_logs() needs to drain all the completed level logs
+    LIBENV_API int libenv_level_logs_size(libenv_env *handle) {
+        auto venv = (VecGame *)(handle);
+        auto lock = venv->lock_games();
+        return venv->level_logs_size();
+    }
+
+    // move the completed level logs that fit in length bytes to data, see VecGame::drain_level_logs(), returns the
+    // number of bytes written
+    LIBENV_API int libenv_drain_level_logs(libenv_env *handle, char *data, int length) {
+        auto venv = (VecGame *)(handle);
+        auto lock = venv->lock_games();
+        return venv->drain_level_logs(data, length);
+    }
+
+    // start replaying num_frames actions from a level log in env env_idx, which needs the same options as the env
+    // that recorded them, a checkpoint of the state is kept every checkpoint_interval frames to make seeking fast
+    LIBENV_API void libenv_replay_level(libenv_env *handle, int env_idx, int level_seed, const uint8_t *actions, int num_frames, int checkpoint_interval) {
+        auto venv = (VecGame *)(handle);
+        auto lock = venv->lock_games();
+        LevelLog log;
+        log.env = env_idx;
+        log.level_seed = level_seed;
+        log.actions.assign(actions, actions + num_frames);
+        venv->replay_level(env_idx, log, checkpoint_interval);
+    }
+
+    // go to the state after frame frames of the level being replayed in env env_idx and observe it, returns the frame
+    // reached, which is the last one if frame is past it
+    LIBENV_API int libenv_replay_seek(libenv_env *handle, int env_idx, int frame) {
+        auto venv = (VecGame *)(handle);
+        auto lock = venv->lock_games();
+        return venv->replay_seek(env_idx, frame);
+    }
+
+    // end the episode of env env_idx and start a new one, for handing the env over to a new user, a level_seed_gen_seed
+    // >= 0 reseeds the sequence of levels the env plays, so the same seed always gives the same levels
+    LIBENV_API void libenv_reset_env(libenv_env *handle, int env_idx, int level_seed_gen_seed) {
+        auto venv = (VecGame *)(handle);
+        auto lock = venv->lock_games();
+        venv->restart_episode(env_idx, level_seed_gen_seed);
+    }
+
+    // change the levels env env_idx plays and start a new episode in it, see VecGame::reconfigure()
+    LIBENV_API void libenv_reconfigure(libenv_env *handle, int env_idx, struct libenv_options options) {
+        auto venv = (VecGame *)(handle);
+        auto lock = venv->lock_games();
+        venv->reconfigure(env_idx, VecOptions(options));
+    }
+
+    // make the next frame of the encode_tiles stream of env env_idx a keyframe, for a viewer that joins the stream
+    LIBENV_API void libenv_request_keyframe(libenv_env *handle, int env_idx) {
+        auto venv = (VecGame *)(handle);
+        fassert(venv->encode_tiles);
+        auto lock = venv->lock_games();
+        venv->games.at(env_idx)->tile_stream->request_keyframe();
+    }
+
+    // data holds the observation for all envs one after the other, null goes back to the buffers from
+    // libenv_set_buffers, see VecGame::set_obs_buffer()
+    LIBENV_API void set_obs_buffer(libenv_env *handle, const char *name, char *data) {
+        auto venv = (VecGame *)(handle);
+        auto lock = venv->lock_games();
+        venv->set_obs_buffer(name, data);
+    }
+
+    // make env dst_idx a copy of env src_idx, like set_state(dst_idx, get_state(src_idx)) but without serializing
+    LIBENV_API void libenv_clone_env(libenv_env *handle, int src_idx, int dst_idx) {
+        auto venv = (VecGame *)(handle);
+        auto lock = venv->lock_games();
+        if (src_idx == dst_idx) {
+            return;
+        }
+        const auto &dst = venv->games.at(dst_idx);
+        dst->copy_state(*venv->games.at(src_idx));
+        dst->observe();
+    }
+
+    // the batched versions of get_state and set_state, the state of env e is stored at data + e * stride
+    // and its length in lengths[e], the envs are serialized in parallel on the stepping threads
+    LIBENV_API void get_states(libenv_env *handle, char *data, int stride, int *lengths) {
+        auto venv = (VecGame *)(handle);
+        auto lock = venv->lock_games();
+        venv->for_each_game([&](Game &game) {
+            auto b = WriteBuffer(data + (size_t)game.game_n * stride, stride);
+            game.serialize(&b);
+            b.write_int(END_OF_BUFFER);
+            lengths[game.game_n] = b.offset;
+        });
+    }
+
+    LIBENV_API void set_states(libenv_env *handle, char *data, int stride, int *lengths) {
+        auto venv = (VecGame *)(handle);
+        auto lock = venv->lock_games();
+        venv->for_each_game([&](Game &game) {
+            fassert(lengths[game.game_n] <= stride);
+            auto b = ReadBuffer(data + (size_t)game.game_n * stride, lengths[game.game_n]);
+            game.deserialize(&b);
+            fassert(b.read_int() == END_OF_BUFFER);
+            game.observe();
+        });
+    }
 }
\ No newline at end of file
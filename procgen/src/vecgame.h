@@ -12,10 +12,48 @@ This implements the libenv interface and manages a vector of Game instances
 #include <string>
 #include <condition_variable>
 #include <thread>
-#include <list>
+#include <map>
+#include <atomic>
+#include <functional>
+#include "phase-stats.h"
+#include "episode-stats.h"
+#include "level-log.h"
+#include "level-summary.h"
+#include "draw-list.h"
 
 class VecOptions;
 class Game;
+class LevelCache;
+class LevelPregenerator;
+
+// the games waiting for a stepping thread in the order they were added, a vector that starts over once all of its
+// games have been taken, so that handing games to the threads at every step doesn't allocate
+class PendingGames {
+  public:
+    bool empty() const {
+        return head == games.size();
+    }
+
+    const std::shared_ptr<Game> &front() const {
+        return games[head];
+    }
+
+    void pop_front() {
+        games[head++].reset();
+        if (head == games.size()) {
+            games.clear();
+            head = 0;
+        }
+    }
+
+    void push_back(const std::shared_ptr<Game> &game) {
+        games.push_back(game);
+    }
+
+  private:
+    std::vector<std::shared_ptr<Game>> games;
+    size_t head = 0;
+};
 
 class VecGame {
   public:
@@ -27,26 +65,190 @@ class VecGame {
     int num_joint_games;
     int num_actions;
     bool render_human;
+    bool work_stealing;
+    // set by num_threads -1, see tune_workers()
+    bool auto_threads;
+    bool async_step;
+    bool cache_levels;
+    bool pregenerate_levels;
+    // the number of threads of generate_levels(), each with a private game of each type, 0 to not make them
+    int level_generators;
+    bool rgb_obs;
+    bool symbolic_obs;
+    int symbolic_obs_entities;
+    int symbolic_obs_grid_dim;
+    bool encode_jpeg;
+    int jpeg_quality;
+    bool encode_tiles;
+    bool frame_stack_ring;
+    // tick mode steps the games at a fixed rate on a background thread, see tick_worker()
+    int tick_hz;
+    bool collect_stats;
+    bool episode_stats;
+    bool record_actions;
+    // if set, the destructor writes the trace_events timeline here
+    std::string trace_path;
+    // only the STATS_WAIT phase is used, the other phases are tracked by each game
+    GameStats wait_stats;
 
+    // declared before games, which hold raw pointers to these
+    std::unique_ptr<Tracer> tracer;
+    std::shared_ptr<LevelCache> level_cache;
+    std::shared_ptr<LevelPregenerator> level_pregen;
     std::vector<std::shared_ptr<Game>> games;
+    // generate_levels() thread t uses level_generator_games[t * num_joint_games + j] for the game type j
+    std::vector<std::shared_ptr<Game>> level_generator_games;
+    // held by generate_levels(), the envs can go on stepping meanwhile
+    std::mutex level_generation_mutex;
+    std::map<std::string, int> observation_name_to_offset;
+    std::map<std::string, int> info_name_to_offset;
+    // the mask used by act() when it isn't given one, empty to step all envs, see set_step_mask()
+    std::vector<uint8_t> step_mask;
+    // in tick mode this is held by the tick thread while it steps the games, anything else that
+    // accesses the games (or step_mask) outside of act() and observe() must hold it as well
+    std::mutex tick_mutex;
 
     VecGame(int _nenvs, VecOptions opt_vec);
     ~VecGame();
 
     void set_buffers(const std::vector<std::vector<void *>> &ac, const std::vector<std::vector<void *>> &ob, const std::vector<std::vector<void *>> &info, float *rew, uint8_t *first);
     void observe();
-    void act();
+    // step only the envs with a nonzero entry in mask, or all of them if mask is null,
+    // the other envs keep their observation and report no reward
+    void act(const uint8_t *mask = nullptr);
     void wait_for_stepping_threads();
+    // lock tick_mutex and wait for the stepping threads, the games belong to the caller while the lock is held
+    std::unique_lock<std::mutex> lock_games();
+    // see Game::restart_episode(), must be called with the lock from lock_games()
+    void restart_episode(int env_idx, int level_seed_gen_seed);
+    // change the level options of env env_idx, see Game::parse_level_options(), along with num_levels and start_level,
+    // and then restart its episode like restart_episode() with the level_seed_gen_seed option, must be called with the
+    // lock from lock_games()
+    void reconfigure(int env_idx, VecOptions opts);
+    // run task on every game, in parallel on the stepping threads if there are any
+    void for_each_game(const std::function<void(Game &)> &task);
+    // write observation name of env e to data + e * its size from now on instead of the buffer from set_buffers(),
+    // null goes back to that buffer, must be called with the lock from lock_games()
+    void set_obs_buffer(const std::string &name, char *data);
+    // move up to max_episodes of the episodes completed by the games to out, in order of env and then of completion,
+    // returns the number moved, the rest are left for the next call, must be called with the lock from lock_games()
+    int drain_episode_stats(EpisodeStats *out, int max_episodes);
+    // the number of bytes drain_level_logs() needs for all the completed level logs
+    int level_logs_size();
+    // move the completed level logs that fit in length bytes to out, each as int32 env, int32 level_seed, int32
+    // num_frames and num_frames uint8 actions, returns the number of bytes written, must be called with the lock from
+    // lock_games()
+    int drain_level_logs(char *out, int length);
+    // see Game::start_replay() and Game::replay_seek(), the env then observes the frame it went to, must be called with
+    // the lock from lock_games()
+    void replay_level(int env_idx, const LevelLog &log, int checkpoint_interval);
+    int replay_seek(int env_idx, int frame);
+    // generate the levels of count consecutive seeds from seed_start for game type game_idx, in the order of env_name,
+    // with the options of the envs, on the level_generators threads and without touching the envs, out[i] is the
+    // summary of seed_start + i, doesn't need the lock from lock_games()
+    void generate_levels(int game_idx, int seed_start, int count, LevelSummary *out);
+    // the number of stepping threads that take part in the batches, the others stay parked, only fewer than the
+    // number of threads with auto_threads
+    int num_active_threads();
+    // record the draw list of each env for the state its game is in, see Game::record_draw_list(), counts[e] gets the
+    // number of commands of env e, or -1 if its game doesn't support them, returns the total number of commands, must
+    // be called with the lock from lock_games()
+    int record_draw_lists(int32_t *counts);
+    // copy up to max_commands of the commands of the last record_draw_lists() to out in order of env, returns the
+    // number copied, must be called with the lock from lock_games()
+    int copy_draw_lists(DrawCommand *out, int max_commands);
 
   private:
+    // async step mode: the stepping threads write into back buffers owned by VecGame
+    // while the caller is free to read the buffers it handed to set_buffers, observe()
+    // then copies the completed batch over to the caller's buffers
+    std::vector<std::vector<void *>> front_obs_bufs;
+    std::vector<std::vector<void *>> front_info_bufs;
+    float *front_rew = nullptr;
+    uint8_t *front_first = nullptr;
+    std::vector<std::vector<uint8_t>> back_storage;
+    std::vector<float> back_rew;
+    std::vector<uint8_t> back_first;
+
+    void publish_back_buffers();
+
+    // the observation buffers given to set_buffers(), set_obs_buffer() can replace them
+    std::vector<std::vector<void *>> caller_obs_bufs;
+    // the buffers given to set_obs_buffer() must be aligned to this many bytes, the ones of set_buffers() come from
+    // gym3 and aren't checked
+    int obs_alignment;
+    void check_obs_alignment(const void *buf);
+    void update_obs_ptrs(Game &game);
+
     // this mutex synchronizes access to pending_games and game->is_waiting_for_step
     // when game->is_waiting_for_step is set to true
     // ownership of game objects is transferred to the stepping thread until
     // game->is_waiting_for_step is set to false
     std::mutex stepping_thread_mutex;
-    std::list<std::shared_ptr<Game>> pending_games;
+    PendingGames pending_games;
     std::condition_variable pending_games_added;
     std::condition_variable pending_game_complete;
     std::vector<std::thread> threads;
     bool time_to_die = false;
+    // set by for_each_game(), the stepping threads run it on the games of the batch instead of stepping them
+    const std::function<void(Game &)> *batch_task = nullptr;
+
+    // work stealing mode: each worker owns a contiguous slice of games and claims
+    // games from it with an atomic cursor, moving on to its neighbors' slices once
+    // its own is exhausted. Completion is tracked with a single counter per batch,
+    // so stepping_thread_mutex is only taken once per batch instead of once per game.
+    struct alignas(64) GameSlice {
+        std::atomic<int> next{0};
+        int begin = 0;
+        int end = 0;
+    };
+    std::vector<GameSlice> slices;
+    std::atomic<int> games_remaining{0};
+    int batch_id = 0;
+
+    // kept between calls of record_draw_lists() for their memory
+    std::vector<std::vector<DrawCommand>> draw_lists;
+
+    // step_envs[e] is set if env e is stepped in the current batch, see act()
+    std::vector<uint8_t> step_envs;
+
+    void dispatch_batch();
+    void stealing_worker(int thread_idx);
+
+    // auto_threads: the workers from active_workers on wait on parked_workers instead of taking part in the batches,
+    // tune_workers() times tune_candidates[tune_candidate] active workers with tune_samples and moves on to the next
+    // candidate, tune_times has the median batch time of the candidates done so far
+    int active_workers = 0;
+    std::condition_variable parked_workers;
+    std::vector<int> tune_candidates;
+    size_t tune_candidate = 0;
+    std::vector<int64_t> tune_samples;
+    std::vector<int64_t> tune_times;
+    bool timing_batch = false;
+    int64_t batch_start_ns = 0;
+    std::atomic<int64_t> batch_end_ns{0};
+
+    void tune_workers(bool full_batch);
+
+    // cpu_affinity option: worker t is pinned to worker_cpus[t % worker_cpus.size()]
+    std::vector<int> worker_cpus;
+
+    int worker_cpu(int thread_idx) const {
+        return worker_cpus[thread_idx % worker_cpus.size()];
+    }
+
+    // tick mode: act() only updates held_actions and observe() waits for the next tick, rewards are summed
+    // and first is kept over the ticks between two observe() calls so that skipped ticks aren't lost
+    std::thread tick_thread;
+    std::condition_variable tick_cv;
+    bool tick_stop = false;
+    int64_t tick_count = 0;
+    int64_t observed_tick_count = 0;
+    std::vector<int32_t> held_actions;
+    std::vector<float> tick_rew;
+    std::vector<uint8_t> tick_first;
+
+    void tick_worker();
+    // start stepping the games, actions is null to use the caller's action buffers
+    void start_step(const uint8_t *mask, const int32_t *actions);
 };
@@ -0,0 +1,24 @@
+/*
+
+Writes the bundle of decoded images used by the resource_bundle option, a build with
+-DPROCGEN_RESOURCE_BUNDLE=ON runs this to put resources.bundle next to the library
+
+    procgen_bundle procgen/data/assets/ resources.bundle
+
+*/
+
+#include "libenv.h"
+#include <cstdio>
+
+extern "C" {
+LIBENV_API void make_resource_bundle(const char *resource_root, const char *path);
+}
+
+int main(int argc, char **argv) {
+    if (argc != 3) {
+        fprintf(stderr, "usage: procgen_bundle <resource root> <output path>\n");
+        return 1;
+    }
+    make_resource_bundle(argv[1], argv[2]);
+    return 0;
+}